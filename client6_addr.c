@@ -37,6 +37,8 @@
 #include <sys/ioctl.h>
 
 #include <linux/ipv6.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 
 #include <net/if.h>
 #include <time.h>
@@ -46,6 +48,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <signal.h>
 #include <net/if_arp.h>
 
 #include "queue.h"
@@ -56,37 +59,71 @@
 #include "lease.h"
 
 static int dhcp6_update_lease __P((struct dhcp6_addr *, struct dhcp6_lease *));
-static int dhcp6_add_lease __P((struct dhcp6_addr *));
+static int dhcp6_add_lease __P((struct dhcp6_iaidaddr *, struct dhcp6_addr *));
 struct dhcp6_lease *dhcp6_find_lease __P((struct dhcp6_iaidaddr *, 
 			struct dhcp6_addr *));
 int dhcp6_get_prefixlen __P((struct in6_addr *, struct dhcp6_if *));
-int client6_ifaddrconf __P((ifaddrconf_cmd_t, struct dhcp6_addr *));
+int client6_ifaddrconf __P((ifaddrconf_cmd_t, struct dhcp6_if *,
+			    struct dhcp6_addr *));
+int client6_prefixconf __P((ifaddrconf_cmd_t, struct dhcp6_if *,
+			    struct dhcp6_addr *));
+static int ifaddrconf __P((ifaddrconf_cmd_t, int, const char *,
+			   struct dhcp6_addr *));
+void radvd_reload __P((void));
+static void lease_batch_begin __P((struct dhcp6_if *));
+static int lease_batch_add __P((struct dhcp6_lease *, int));
+static void lease_batch_commit __P((void));
 u_int32_t get_min_preferlifetime __P((struct dhcp6_iaidaddr *));
 u_int32_t get_max_validlifetime __P((struct dhcp6_iaidaddr *));
 struct dhcp6_timer *dhcp6_iaidaddr_timo __P((void *));
 struct dhcp6_timer *dhcp6_lease_timo __P((void *));
 
-extern struct dhcp6_iaidaddr client6_iaidaddr;
 extern struct dhcp6_timer *client6_timo __P((void *));
 extern void client6_send __P((struct dhcp6_event *));
 extern void free_servers __P((struct dhcp6_if *));
 extern ssize_t gethwid __P((char *, int, const char *, u_int16_t *));
 
-extern int nlsock;
-extern FILE *client6_lease_file;
-extern struct dhcp6_iaidaddr client6_iaidaddr;
-extern struct dhcp6_list request_list;
+extern int rtnlsock;
 
-void
-dhcp6_init_iaidaddr(void)
+/*
+ * While an IA from a reply is processed the addresses to install or to
+ * refresh are queued here and handed to the kernel in one netlink batch.
+ */
+struct lease_batch_ent {
+	struct dhcp6_lease *lease;
+	int isnew;
+};
+static struct dhcp6_if *lease_batch_ifp;
+static struct lease_batch_ent *lease_batch = NULL;
+static int lease_batch_size = 0;
+static int lease_nbatch = -1;	/* -1: not batching */
+
+/*
+ * With the rtnetlink monitor running the kernel expires the addresses
+ * and dhcp6c learns about it from RTM_DELADDR; the per-lease timers are
+ * only needed for prefixes, or without the monitor.
+ */
+#define LEASE_NEEDS_TIMER(sp) \
+	((sp)->lease_addr.type == IAPD || rtnlsock < 0)
+
+int
+client6_init_iaidaddr(struct dhcp6_if *ifp)
 {
-	memset(&client6_iaidaddr, 0, sizeof(client6_iaidaddr));
-	TAILQ_INIT(&client6_iaidaddr.lease_list);
+	if (ifp->iaidaddr == NULL &&
+	    (ifp->iaidaddr = malloc(sizeof(*ifp->iaidaddr))) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return (-1);
+	}
+	memset(ifp->iaidaddr, 0, sizeof(*ifp->iaidaddr));
+	TAILQ_INIT(&ifp->iaidaddr->lease_list);
+	ifp->iaidaddr->ifp = ifp;
+	return (0);
 }
 
 int
-dhcp6_add_iaidaddr(struct dhcp6_optinfo *optinfo)
+client6_add_iaidaddr(struct dhcp6_if *ifp, struct dhcp6_optinfo *optinfo)
 {
+	struct dhcp6_iaidaddr *iaidaddr = ifp->iaidaddr;
 	struct dhcp6_listval *lv, *lv_next = NULL;
 	struct timeval timo;
 	struct dhcp6_lease *cl_lease;
@@ -96,21 +133,22 @@ dhcp6_add_iaidaddr(struct dhcp6_optinfo *optinfo)
 		dprintf(LOG_INFO, " T1 time is greater than T2 time");
 		return (0);
 	}
-	memcpy(&client6_iaidaddr.client6_info.iaidinfo, &optinfo->iaidinfo, 
-			sizeof(client6_iaidaddr.client6_info.iaidinfo));
-	client6_iaidaddr.client6_info.type = optinfo->type;
-	duidcpy(&client6_iaidaddr.client6_info.clientid, &optinfo->clientID);
-	if (duidcpy(&client6_iaidaddr.client6_info.serverid, &optinfo->serverID)) {
+	memcpy(&iaidaddr->client6_info.iaidinfo, &optinfo->iaidinfo, 
+			sizeof(iaidaddr->client6_info.iaidinfo));
+	iaidaddr->client6_info.type = optinfo->type;
+	duidcpy(&iaidaddr->client6_info.clientid, &optinfo->clientID);
+	if (duidcpy(&iaidaddr->client6_info.serverid, &optinfo->serverID)) {
 		dprintf(LOG_ERR, "%s" "failed to copy server ID %s", 
 			FNAME, duidstr(&optinfo->serverID));
 		return (-1);
 	}
 	/* add new address */
+	lease_batch_begin(ifp);
 	for (lv = TAILQ_FIRST(&optinfo->addr_list); lv; lv = lv_next) {
 		lv_next = TAILQ_NEXT(lv, link);
 		if (lv->val_dhcp6addr.type != IAPD) {	
 			lv->val_dhcp6addr.plen = 
-				dhcp6_get_prefixlen(&lv->val_dhcp6addr.addr, dhcp6_if);
+				dhcp6_get_prefixlen(&lv->val_dhcp6addr.addr, ifp);
 			if (lv->val_dhcp6addr.plen == PREFIX_LEN_NOTINRA) {
 				dprintf(LOG_WARNING, 
 					"assigned address %s prefix len is not in any RAs"
@@ -118,64 +156,66 @@ dhcp6_add_iaidaddr(struct dhcp6_optinfo *optinfo)
 					in6addr2str(&lv->val_dhcp6addr.addr, 0));
 			}
 		}
-		if ((cl_lease = dhcp6_find_lease(&client6_iaidaddr, 
+		if ((cl_lease = dhcp6_find_lease(iaidaddr, 
 						&lv->val_dhcp6addr)) != NULL) {
 			dhcp6_update_lease(&lv->val_dhcp6addr, cl_lease);
 			continue;
 		}
-		if (dhcp6_add_lease(&lv->val_dhcp6addr)) {
+		if (dhcp6_add_lease(iaidaddr, &lv->val_dhcp6addr)) {
 			dprintf(LOG_ERR, "%s" "failed to add a new addr lease %s", 
 				FNAME, in6addr2str(&lv->val_dhcp6addr.addr, 0));
 			continue;
 		}
 	}
-	if (TAILQ_EMPTY(&client6_iaidaddr.lease_list))
+	lease_batch_commit();
+	if (TAILQ_EMPTY(&iaidaddr->lease_list))
 		return 0;
 	/* set up renew T1, rebind T2 timer renew/rebind based on iaid */
 	/* Should we process IA_TA, IA_NA differently */
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == 0 ||
-	    client6_iaidaddr.client6_info.iaidinfo.renewtime >
-	    client6_iaidaddr.client6_info.iaidinfo.rebindtime) {
+	if (iaidaddr->client6_info.iaidinfo.renewtime == 0 ||
+	    iaidaddr->client6_info.iaidinfo.renewtime >
+	    iaidaddr->client6_info.iaidinfo.rebindtime) {
 		u_int32_t min_plifetime;
-		min_plifetime = get_min_preferlifetime(&client6_iaidaddr);
+		min_plifetime = get_min_preferlifetime(iaidaddr);
 		if (min_plifetime == DHCP6_DURATITION_INFINITE)
-			client6_iaidaddr.client6_info.iaidinfo.renewtime = min_plifetime;
+			iaidaddr->client6_info.iaidinfo.renewtime = min_plifetime;
 		else
-			client6_iaidaddr.client6_info.iaidinfo.renewtime = min_plifetime / 2;
+			iaidaddr->client6_info.iaidinfo.renewtime = min_plifetime / 2;
 	}
-	if (client6_iaidaddr.client6_info.iaidinfo.rebindtime == 0 ||
-		 client6_iaidaddr.client6_info.iaidinfo.renewtime >
-		 client6_iaidaddr.client6_info.iaidinfo.rebindtime) {
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime = 
-			get_min_preferlifetime(&client6_iaidaddr) * 4 / 5;
+	if (iaidaddr->client6_info.iaidinfo.rebindtime == 0 ||
+		 iaidaddr->client6_info.iaidinfo.renewtime >
+		 iaidaddr->client6_info.iaidinfo.rebindtime) {
+		iaidaddr->client6_info.iaidinfo.rebindtime = 
+			get_min_preferlifetime(iaidaddr) * 4 / 5;
 	}
 	dprintf(LOG_INFO, "renew time %d, rebind time %d", 
-		client6_iaidaddr.client6_info.iaidinfo.renewtime,
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime);
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == 0)
+		iaidaddr->client6_info.iaidinfo.renewtime,
+		iaidaddr->client6_info.iaidinfo.rebindtime);
+	if (iaidaddr->client6_info.iaidinfo.renewtime == 0)
 		return (0);
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == DHCP6_DURATITION_INFINITE) {
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime = DHCP6_DURATITION_INFINITE;
+	if (iaidaddr->client6_info.iaidinfo.renewtime == DHCP6_DURATITION_INFINITE) {
+		iaidaddr->client6_info.iaidinfo.rebindtime = DHCP6_DURATITION_INFINITE;
 		return (0);
 	}
 	/* set up start date, and renew timer */
-	if ((client6_iaidaddr.timer = 
-	    dhcp6_add_timer(dhcp6_iaidaddr_timo, &client6_iaidaddr)) == NULL) {
+	if ((iaidaddr->timer = 
+	    dhcp6_add_timer(dhcp6_iaidaddr_timo, iaidaddr)) == NULL) {
 		 dprintf(LOG_ERR, "%s" "failed to add a timer for iaid %u",
-			FNAME, client6_iaidaddr.client6_info.iaidinfo.iaid);
+			FNAME, iaidaddr->client6_info.iaidinfo.iaid);
 		 return (-1);
 	}
-	time(&client6_iaidaddr.start_date);
-	client6_iaidaddr.state = ACTIVE;
-	d = client6_iaidaddr.client6_info.iaidinfo.renewtime;
+	time(&iaidaddr->start_date);
+	iaidaddr->state = ACTIVE;
+	d = iaidaddr->client6_info.iaidinfo.renewtime;
 	timo.tv_sec = (long)d;
 	timo.tv_usec = 0;
-	dhcp6_set_timer(&timo, client6_iaidaddr.timer);
+	dhcp6_set_timer(&timo, iaidaddr->timer);
 	return (0);
 }
 
 int
-dhcp6_add_lease(addr)
+dhcp6_add_lease(iaidaddr, addr)
+	struct dhcp6_iaidaddr *iaidaddr;
 	struct dhcp6_addr *addr;
 {
 	struct dhcp6_lease *sp;
@@ -198,7 +238,7 @@ dhcp6_add_lease(addr)
 			FNAME, in6addr2str(&addr->addr, 0));
 		return (0);
 	}
-	if ((sp = dhcp6_find_lease(&client6_iaidaddr, addr)) != NULL) {
+	if ((sp = dhcp6_find_lease(iaidaddr, addr)) != NULL) {
 		dprintf(LOG_ERR, "%s" "duplicated address: %s",
 		    FNAME, in6addr2str(&addr->addr, 0));
 		return (-1);
@@ -210,10 +250,10 @@ dhcp6_add_lease(addr)
 	}
 	memset(sp, 0, sizeof(*sp));
 	memcpy(&sp->lease_addr, addr, sizeof(sp->lease_addr));
-	sp->iaidaddr = &client6_iaidaddr;
+	sp->iaidaddr = iaidaddr;
 	time(&sp->start_date);
 	sp->state = ACTIVE;
-	if (write_lease(sp, client6_lease_file) != 0) {
+	if (write_lease(sp, iaidaddr->ifp->lease_file) != 0) {
 		dprintf(LOG_ERR, "%s" "failed to write a new lease address %s to lease file", 
 			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 		if (sp->timer)
@@ -224,7 +264,11 @@ dhcp6_add_lease(addr)
 	if (sp->lease_addr.type == IAPD) {
 		dprintf(LOG_INFO, "request prefix is %s/%d", 
 			in6addr2str(&sp->lease_addr.addr, 0), sp->lease_addr.plen);
-	} else if (client6_ifaddrconf(IFADDRCONF_ADD, addr) != 0) {
+		if (client6_prefixconf(IFADDRCONF_ADD, iaidaddr->ifp, addr) == 0)
+			radvd_reload();
+	} else if (lease_batch_add(sp, 1) == 0) {
+		/* configured when the batch is committed */
+	} else if (client6_ifaddrconf(IFADDRCONF_ADD, iaidaddr->ifp, addr) != 0) {
 		dprintf(LOG_ERR, "%s" "adding address failed: %s",
 		    FNAME, in6addr2str(&addr->addr, 0));
 		if (sp->timer)
@@ -232,7 +276,7 @@ dhcp6_add_lease(addr)
 		free(sp);
 		return (-1);
 	}
-	TAILQ_INSERT_TAIL(&client6_iaidaddr.lease_list, sp, link);
+	TAILQ_INSERT_TAIL(&iaidaddr->lease_list, sp, link);
 	/* for infinite lifetime don't do any timer */
 	if (sp->lease_addr.validlifetime == DHCP6_DURATITION_INFINITE || 
 	    sp->lease_addr.preferlifetime == DHCP6_DURATITION_INFINITE) {
@@ -240,6 +284,8 @@ dhcp6_add_lease(addr)
 			FNAME, in6addr2str(&addr->addr, 0));
 		return (0);
 	}
+	if (!LEASE_NEEDS_TIMER(sp))
+		return (0);
 	/* set up expired timer for lease*/
 	if ((sp->timer = dhcp6_add_timer(dhcp6_lease_timo, sp)) == NULL) {
 		dprintf(LOG_ERR, "%s" "failed to add a timer for lease %s",
@@ -278,51 +324,54 @@ dhcp6_remove_lease(struct dhcp6_lease *sp)
 	dprintf(LOG_DEBUG, "%s" "removing address %s", FNAME,
 		in6addr2str(&sp->lease_addr.addr, 0));
 	sp->state = INVALID;
-	if (write_lease(sp, client6_lease_file) != 0) {
+	if (write_lease(sp, sp->iaidaddr->ifp->lease_file) != 0) {
 		dprintf(LOG_INFO, "%s" 
 			"failed to write removed lease address %s to lease file", 
 			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 		return (-1);
 	}
-	/* XXX: ToDo: prefix delegation for client */
 	if (sp->lease_addr.type == IAPD) {
 		dprintf(LOG_INFO, "request prefix is %s/%d", 
 			in6addr2str(&sp->lease_addr.addr, 0), sp->lease_addr.plen);
-		/* XXX: remove from the update prefix list */
-
-	} else if (client6_ifaddrconf(IFADDRCONF_REMOVE, &sp->lease_addr) != 0) {
+		if (client6_prefixconf(IFADDRCONF_REMOVE, sp->iaidaddr->ifp,
+		    &sp->lease_addr) == 0)
+			radvd_reload();
+	} else if (client6_ifaddrconf(IFADDRCONF_REMOVE, sp->iaidaddr->ifp,
+				      &sp->lease_addr) != 0) {
 			dprintf(LOG_INFO, "%s" "removing address %s failed",
 		    		FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 	}
 	/* remove expired timer for this lease. */
 	if (sp->timer)
 		dhcp6_remove_timer(sp->timer);
-	TAILQ_REMOVE(&client6_iaidaddr.lease_list, sp, link);
+	TAILQ_REMOVE(&sp->iaidaddr->lease_list, sp, link);
 	free(sp);
 	/* can't remove expired iaidaddr even there is no lease in this iaidaddr
 	 * since the rebind->solicit timer uses this iaidaddr
-	 * if(TAILQ_EMPTY(&client6_iaidaddr.lease_list))
+	 * if(TAILQ_EMPTY(&sp->iaidaddr->lease_list))
 	 *	dhcp6_remove_iaidaddr();
 	 */
 	return 0;
 }
 
 int
-dhcp6_update_iaidaddr(struct dhcp6_optinfo *optinfo, int flag)
+client6_update_iaidaddr(struct dhcp6_if *ifp, struct dhcp6_optinfo *optinfo,
+			int flag)
 {
+	struct dhcp6_iaidaddr *iaidaddr = ifp->iaidaddr;
 	struct dhcp6_listval *lv, *lv_next = NULL;
 	struct dhcp6_lease *cl, *cl_next;
 	struct timeval timo;
 	double d;
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime >
-	    client6_iaidaddr.client6_info.iaidinfo.rebindtime) {
+	if (iaidaddr->client6_info.iaidinfo.renewtime >
+	    iaidaddr->client6_info.iaidinfo.rebindtime) {
 		dprintf(LOG_INFO, " T1 time is greater than T2 time");
 		return (0);
 	}
 	if (flag == ADDR_REMOVE) {
 		for (lv = TAILQ_FIRST(&optinfo->addr_list); lv; lv = lv_next) {
 			lv_next = TAILQ_NEXT(lv, link);
-			cl = dhcp6_find_lease(&client6_iaidaddr, &lv->val_dhcp6addr);
+			cl = dhcp6_find_lease(iaidaddr, &lv->val_dhcp6addr);
 			if (cl) {
 				/* remove leases */
 				dhcp6_remove_lease(cl);
@@ -331,33 +380,35 @@ dhcp6_update_iaidaddr(struct dhcp6_optinfo *optinfo, int flag)
 		return 0;
 	}
 	/* flag == ADDR_UPDATE */
+	lease_batch_begin(ifp);
 	for (lv = TAILQ_FIRST(&optinfo->addr_list); lv; lv = lv_next) {
 		lv_next = TAILQ_NEXT(lv, link);
 		if (lv->val_dhcp6addr.type != IAPD) {	
 			lv->val_dhcp6addr.plen = 
-				dhcp6_get_prefixlen(&lv->val_dhcp6addr.addr, dhcp6_if);
+				dhcp6_get_prefixlen(&lv->val_dhcp6addr.addr, ifp);
 			if (lv->val_dhcp6addr.plen == PREFIX_LEN_NOTINRA) {
 				dprintf(LOG_WARNING, "assigned address %s is not in any RAs"
 					" prefix length using 64 bit instead",
 					in6addr2str(&lv->val_dhcp6addr.addr, 0)); 
 			}
 		}
-		if ((cl = dhcp6_find_lease(&client6_iaidaddr, &lv->val_dhcp6addr)) != NULL) {
+		if ((cl = dhcp6_find_lease(iaidaddr, &lv->val_dhcp6addr)) != NULL) {
 		/* update leases */
 			dhcp6_update_lease(&lv->val_dhcp6addr, cl);
 			continue;
 		}
 		/* need to add the new leases */	
-		if (dhcp6_add_lease(&lv->val_dhcp6addr)) {
+		if (dhcp6_add_lease(iaidaddr, &lv->val_dhcp6addr)) {
 			dprintf(LOG_INFO, "%s" "failed to add a new addr lease %s",
 				FNAME, in6addr2str(&lv->val_dhcp6addr.addr, 0));
 			continue;
 		}
 		continue;
 	}
+	lease_batch_commit();
 #if 0
 	/* remove leases that not on the updated list */
-	for (cl = TAILQ_FIRST(&client6_iaidaddr.lease_list); cl; cl = cl_next) { 
+	for (cl = TAILQ_FIRST(&iaidaddr->lease_list); cl; cl = cl_next) { 
 			cl_next = TAILQ_NEXT(cl, link);
 		lv = dhcp6_find_listval(&optinfo->addr_list, &cl->lease_addr, 
 			DHCP6_LISTVAL_DHCP6ADDR);
@@ -367,54 +418,54 @@ dhcp6_update_iaidaddr(struct dhcp6_optinfo *optinfo, int flag)
 	}	
 #endif
 	/* update server id */
-	if (client6_iaidaddr.state == REBIND) {
-		if (duidcpy(&client6_iaidaddr.client6_info.serverid, &optinfo->serverID)) {
+	if (iaidaddr->state == REBIND) {
+		if (duidcpy(&iaidaddr->client6_info.serverid, &optinfo->serverID)) {
 			dprintf(LOG_ERR, "%s" "failed to copy server ID", FNAME);
 			return (-1);
 		}
 	}
-	if (TAILQ_EMPTY(&client6_iaidaddr.lease_list))
+	if (TAILQ_EMPTY(&iaidaddr->lease_list))
 		return (0);
 	/* set up renew T1, rebind T2 timer renew/rebind based on iaid */
 	/* Should we process IA_TA, IA_NA differently */
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == 0) {
+	if (iaidaddr->client6_info.iaidinfo.renewtime == 0) {
 		u_int32_t min_plifetime;
-		min_plifetime = get_min_preferlifetime(&client6_iaidaddr);
+		min_plifetime = get_min_preferlifetime(iaidaddr);
 		if (min_plifetime == DHCP6_DURATITION_INFINITE)
-			client6_iaidaddr.client6_info.iaidinfo.renewtime = min_plifetime;
+			iaidaddr->client6_info.iaidinfo.renewtime = min_plifetime;
 		else
-			client6_iaidaddr.client6_info.iaidinfo.renewtime = min_plifetime / 2;
+			iaidaddr->client6_info.iaidinfo.renewtime = min_plifetime / 2;
 	}
-	if (client6_iaidaddr.client6_info.iaidinfo.rebindtime == 0) {
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime = 
-			get_min_preferlifetime(&client6_iaidaddr) * 4 / 5;
+	if (iaidaddr->client6_info.iaidinfo.rebindtime == 0) {
+		iaidaddr->client6_info.iaidinfo.rebindtime = 
+			get_min_preferlifetime(iaidaddr) * 4 / 5;
 	}
 	dprintf(LOG_INFO, "renew time %d, rebind time %d", 
-		client6_iaidaddr.client6_info.iaidinfo.renewtime,
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime);
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == 0)
+		iaidaddr->client6_info.iaidinfo.renewtime,
+		iaidaddr->client6_info.iaidinfo.rebindtime);
+	if (iaidaddr->client6_info.iaidinfo.renewtime == 0)
 		return (0);
-	if (client6_iaidaddr.client6_info.iaidinfo.renewtime == DHCP6_DURATITION_INFINITE) {
-		client6_iaidaddr.client6_info.iaidinfo.rebindtime = DHCP6_DURATITION_INFINITE;
-		if (client6_iaidaddr.timer)
-			dhcp6_remove_timer(client6_iaidaddr.timer);
+	if (iaidaddr->client6_info.iaidinfo.renewtime == DHCP6_DURATITION_INFINITE) {
+		iaidaddr->client6_info.iaidinfo.rebindtime = DHCP6_DURATITION_INFINITE;
+		if (iaidaddr->timer)
+			dhcp6_remove_timer(iaidaddr->timer);
 		return (0);
 	}
 	/* update the start date and timer */
-	if (client6_iaidaddr.timer == NULL) {
-		if ((client6_iaidaddr.timer = 
-		     dhcp6_add_timer(dhcp6_iaidaddr_timo, &client6_iaidaddr)) == NULL) {
+	if (iaidaddr->timer == NULL) {
+		if ((iaidaddr->timer = 
+		     dhcp6_add_timer(dhcp6_iaidaddr_timo, iaidaddr)) == NULL) {
 	 		dprintf(LOG_ERR, "%s" "failed to add a timer for iaid %u",
-				FNAME, client6_iaidaddr.client6_info.iaidinfo.iaid);
+				FNAME, iaidaddr->client6_info.iaidinfo.iaid);
 	 		return (-1);
 	    	}
 	}
-	time(&client6_iaidaddr.start_date);
-	client6_iaidaddr.state = ACTIVE;
-	d = client6_iaidaddr.client6_info.iaidinfo.renewtime;
+	time(&iaidaddr->start_date);
+	iaidaddr->state = ACTIVE;
+	d = iaidaddr->client6_info.iaidinfo.renewtime;
 	timo.tv_sec = (long)d;
 	timo.tv_usec = 0;
-	dhcp6_set_timer(&timo, client6_iaidaddr.timer);
+	dhcp6_set_timer(&timo, iaidaddr->timer);
 	return 0;
 }
 
@@ -442,18 +493,34 @@ dhcp6_update_lease(struct dhcp6_addr *addr, struct dhcp6_lease *sp)
 	memcpy(&sp->lease_addr, addr, sizeof(sp->lease_addr));
 	sp->state = ACTIVE;
 	time(&sp->start_date);
-	if (write_lease(sp, client6_lease_file) != 0) {
+	if (write_lease(sp, sp->iaidaddr->ifp->lease_file) != 0) {
 		dprintf(LOG_ERR, "%s" 
 			"failed to write an updated lease address %s to lease file", 
 			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 		return (-1);
 	}
+	/* hand the new lifetimes to the kernel */
+	if (sp->lease_addr.type == IAPD) {
+		if (client6_prefixconf(IFADDRCONF_ADD, sp->iaidaddr->ifp,
+		    &sp->lease_addr) != 0)
+			dprintf(LOG_INFO, "%s" "failed to refresh prefix %s/%d",
+				FNAME, in6addr2str(&sp->lease_addr.addr, 0),
+				sp->lease_addr.plen);
+	} else if (lease_batch_add(sp, 0) != 0 &&
+	    client6_ifaddrconf(IFADDRCONF_ADD, sp->iaidaddr->ifp,
+	    &sp->lease_addr) != 0)
+		dprintf(LOG_INFO, "%s" "failed to refresh address %s",
+			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 	if (sp->lease_addr.validlifetime == DHCP6_DURATITION_INFINITE || 
-	    sp->lease_addr.preferlifetime == DHCP6_DURATITION_INFINITE) {
-		dprintf(LOG_INFO, "%s" "infinity address life time for %s",
-			FNAME, in6addr2str(&addr->addr, 0));
+	    sp->lease_addr.preferlifetime == DHCP6_DURATITION_INFINITE ||
+	    !LEASE_NEEDS_TIMER(sp)) {
+		if (sp->lease_addr.validlifetime == DHCP6_DURATITION_INFINITE || 
+		    sp->lease_addr.preferlifetime == DHCP6_DURATITION_INFINITE)
+			dprintf(LOG_INFO, "%s" "infinity address life time for %s",
+				FNAME, in6addr2str(&addr->addr, 0));
 		if (sp->timer)
 			dhcp6_remove_timer(sp->timer);
+		sp->timer = NULL;
 		return (0);
 	}
 	if (sp->timer == NULL) {
@@ -503,11 +570,11 @@ dhcp6_iaidaddr_timo(void *arg)
 	int dhcpstate;
 	double d = 0;
 
-	dprintf(LOG_DEBUG, "client6_iaidaddr timeout for %d, state=%d", 
-		client6_iaidaddr.client6_info.iaidinfo.iaid, sp->state);
+	dprintf(LOG_DEBUG, "iaidaddr timeout for %d on %s, state=%d", 
+		sp->client6_info.iaidinfo.iaid, sp->ifp->ifname, sp->state);
 
-	dhcp6_clear_list(&request_list);
-	TAILQ_INIT(&request_list);
+	dhcp6_clear_list(&sp->ifp->request_list);
+	TAILQ_INIT(&sp->ifp->request_list);
 	/* ToDo: what kind of opiton Request value, client would like to pass? */
 	switch(sp->state) {
 	case ACTIVE:
@@ -520,7 +587,7 @@ dhcp6_iaidaddr_timo(void *arg)
 	case RENEW:
 		sp->state = REBIND;
 		dhcpstate = DHCP6S_REBIND;
-		d = get_max_validlifetime(&client6_iaidaddr) -
+		d = get_max_validlifetime(sp) -
 				sp->client6_info.iaidinfo.rebindtime; 
 		timeo.tv_sec = (long)d;
 		timeo.tv_usec = 0;
@@ -528,9 +595,9 @@ dhcp6_iaidaddr_timo(void *arg)
 			duidfree(&sp->client6_info.serverid);
 		break;
 	case REBIND:
-		dprintf(LOG_INFO, "%s" "failed to rebind a client6_iaidaddr %d"
+		dprintf(LOG_INFO, "%s" "failed to rebind iaidaddr %d"
 		    " go to solicit and request new ipv6 addresses",
-		    FNAME, client6_iaidaddr.client6_info.iaidinfo.iaid);
+		    FNAME, sp->client6_info.iaidinfo.iaid);
 		sp->state = INVALID;
 		dhcpstate = DHCP6S_SOLICIT;
 		free_servers(sp->ifp);
@@ -568,7 +635,7 @@ dhcp6_iaidaddr_timo(void *arg)
 	if (sp->state != INVALID) {
 		struct dhcp6_lease *cl;
 		/* create an address list for renew and rebind */
-		for (cl = TAILQ_FIRST(&client6_iaidaddr.lease_list); cl; 
+		for (cl = TAILQ_FIRST(&sp->lease_list); cl; 
 			cl = TAILQ_NEXT(cl, link)) {
 			struct dhcp6_listval *lv;
 			/* IA_NA address */
@@ -584,11 +651,11 @@ dhcp6_iaidaddr_timo(void *arg)
 			memcpy(&lv->val_dhcp6addr, &cl->lease_addr, 
 					sizeof(lv->val_dhcp6addr));
 			lv->val_dhcp6addr.status_code = DH6OPT_STCODE_UNDEFINE;
-			TAILQ_INSERT_TAIL(&request_list, lv, link);
+			TAILQ_INSERT_TAIL(&sp->ifp->request_list, lv, link);
 		}
 		dhcp6_set_timer(&timeo, sp->timer);
 	} else {
-		dhcp6_remove_iaidaddr(&client6_iaidaddr);
+		dhcp6_remove_iaidaddr(sp);
 		/* remove event data for that event */
 		sp->timer = NULL;
 	}
@@ -634,67 +701,202 @@ dhcp6_lease_timo(void *arg)
 }
 
 int
-client6_ifaddrconf(ifaddrconf_cmd_t cmd, struct dhcp6_addr *ifaddr)
+client6_ifaddrconf(ifaddrconf_cmd_t cmd, struct dhcp6_if *ifp,
+		   struct dhcp6_addr *ifaddr)
+{
+	return (ifaddrconf(cmd, ifp->ifid, ifp->ifname, ifaddr));
+}
+
+static int
+ifaddrconf(ifaddrconf_cmd_t cmd, int ifindex, const char *ifname,
+	   struct dhcp6_addr *ifaddr)
 {
-	struct in6_ifreq req;
-	struct dhcp6_if *ifp = client6_iaidaddr.ifp;
-	unsigned long ioctl_cmd;
+	int request, error;
 	char *cmdstr;
-	int s, errno;
 
 	switch(cmd) {
 	case IFADDRCONF_ADD:
 		cmdstr = "add";
-		ioctl_cmd = SIOCSIFADDR;
+		request = RTM_NEWADDR;
 		break;
 	case IFADDRCONF_REMOVE:
 		cmdstr = "remove";
-		ioctl_cmd = SIOCDIFADDR;
+		request = RTM_DELADDR;
 		break;
 	default:
 		return (-1);
 	}
 
-	if ((s = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
-		dprintf(LOG_ERR, "%s" "can't open a temporary socket: %s",
-			FNAME, strerror(errno));
+	if (netlink_ifaddr(request, ifindex, &ifaddr, 1,
+	    &error) < 0)
 		return (-1);
-	}
-	memset(&req, 0, sizeof(req));
-	req.ifr6_ifindex = if_nametoindex(ifp->ifname);
-	memcpy(&req.ifr6_addr, &ifaddr->addr, sizeof(req.ifr6_addr));
-	
-	req.ifr6_prefixlen = ifaddr->plen;
-
-	if (ioctl(s, ioctl_cmd, &req) && errno != EEXIST) {
+	/* the kernel may have expired the address already */
+	if (error != 0 && !(cmd == IFADDRCONF_REMOVE && 
+	    error == EADDRNOTAVAIL)) {
 		dprintf(LOG_NOTICE, "%s" "failed to %s an address on %s: %s",
-		    FNAME, cmdstr, ifp->ifname, strerror(errno));
-		close(s);
+		    FNAME, cmdstr, ifname, strerror(error));
 		return (-1);
 	}
 
 	dprintf(LOG_DEBUG, "%s" "%s an address %s on %s", FNAME, cmdstr,
-	    in6addr2str(&ifaddr->addr, 0), ifp->ifname);
-	close(s); 
+	    in6addr2str(&ifaddr->addr, 0), ifname);
 	return (0);
 }
 
+/*
+ * A delegated prefix is put to use on the downstream interface, the one
+ * named by prefix-delegation-interface or else the client interface:
+ * its first /64 gets the ::1 address with the lease lifetimes, so the
+ * kernel holds the on-link prefix radvd advertises and ages it out by
+ * itself.  The rest of a shorter prefix is routed unreachable so that
+ * unassigned subnets don't loop back upstream.  Adding an existing
+ * prefix only refreshes its lifetimes.
+ */
+int
+client6_prefixconf(ifaddrconf_cmd_t cmd, struct dhcp6_if *ifp,
+		   struct dhcp6_addr *prefix)
+{
+	struct dhcp6_addr ifaddr;
+	char *ifname;
+	int ifindex, i, error;
+
+	ifname = get_if_option(&ifp->option_list,
+			       DECL_PREFIX_DELEGATION_INTERFACE);
+	if (ifname == NULL || *ifname == '\0')
+		ifname = ifp->ifname;
+	if ((ifindex = if_nametoindex(ifname)) == 0) {
+		dprintf(LOG_ERR, "%s" "unknown downstream interface %s",
+			FNAME, ifname);
+		return (-1);
+	}
+
+	memcpy(&ifaddr, prefix, sizeof(ifaddr));
+	if (ifaddr.plen < 64)
+		ifaddr.plen = 64;
+	for (i = ifaddr.plen; i < 128; i++)
+		ifaddr.addr.s6_addr[i / 8] &= ~(0x80 >> (i % 8));
+	ifaddr.addr.s6_addr[15] |= 1;
+	if (ifaddrconf(cmd, ifindex, ifname, &ifaddr) != 0)
+		return (-1);
+
+	if (prefix->plen >= 64)
+		return (0);
+	error = netlink_route(cmd == IFADDRCONF_ADD ? RTM_NEWROUTE :
+			      RTM_DELROUTE, RTN_UNREACHABLE, 0,
+			      &prefix->addr, prefix->plen);
+	if (error != 0 && !(cmd == IFADDRCONF_REMOVE && error == ESRCH)) {
+		dprintf(LOG_NOTICE, "%s" "failed to %s the route for %s/%d",
+			FNAME, cmd == IFADDRCONF_ADD ? "add" : "remove",
+			in6addr2str(&prefix->addr, 0), prefix->plen);
+		return (-1);
+	}
+	return (0);
+}
+
+/* let radvd pick up a changed set of prefixes */
+void
+radvd_reload()
+{
+	FILE *fp;
+	long pid;
+
+	if ((fp = fopen(PATH_RADVD_PID, "r")) == NULL) {
+		dprintf(LOG_DEBUG, "%s" "no radvd running", FNAME);
+		return;
+	}
+	if (fscanf(fp, "%ld", &pid) != 1 || pid <= 0)
+		dprintf(LOG_INFO, "%s" "invalid radvd pid", FNAME);
+	else if (kill((pid_t)pid, SIGHUP) != 0)
+		dprintf(LOG_INFO, "%s" "failed to reload radvd: %s",
+			FNAME, strerror(errno));
+	fclose(fp);
+}
+
+static void
+lease_batch_begin(struct dhcp6_if *ifp)
+{
+	lease_batch_ifp = ifp;
+	lease_nbatch = 0;
+}
+
+/* returns -1 if no batch is open and the caller has to configure sp */
+static int
+lease_batch_add(struct dhcp6_lease *sp, int isnew)
+{
+	struct lease_batch_ent *nb;
+
+	if (lease_nbatch < 0)
+		return (-1);
+	if (lease_nbatch == lease_batch_size) {
+		nb = (struct lease_batch_ent *)realloc(lease_batch,
+		    (lease_batch_size + 8) * sizeof(*lease_batch));
+		if (nb == NULL)
+			return (-1);
+		lease_batch = nb;
+		lease_batch_size += 8;
+	}
+	lease_batch[lease_nbatch].lease = sp;
+	lease_batch[lease_nbatch].isnew = isnew;
+	lease_nbatch++;
+	return (0);
+}
+
+/* install the queued addresses, new leases the kernel refused are dropped */
+static void
+lease_batch_commit(void)
+{
+	struct dhcp6_if *ifp = lease_batch_ifp;
+	struct dhcp6_addr **addrs;
+	int *error;
+	int i, n = lease_nbatch, failed;
+
+	lease_nbatch = -1;
+	if (n <= 0)
+		return;
+	addrs = (struct dhcp6_addr **)malloc(n * sizeof(*addrs));
+	error = (int *)malloc(n * sizeof(*error));
+	if (addrs == NULL || error == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		exit(1);
+	}
+	for (i = 0; i < n; i++)
+		addrs[i] = &lease_batch[i].lease->lease_addr;
+
+	failed = netlink_ifaddr(RTM_NEWADDR, ifp->ifid, addrs, n, error);
+	for (i = 0; i < n; i++) {
+		if (failed < 0)
+			error[i] = EIO;
+		if (error[i] == 0) {
+			dprintf(LOG_DEBUG, "%s" "add an address %s on %s", FNAME,
+			    in6addr2str(&addrs[i]->addr, 0), ifp->ifname);
+			continue;
+		}
+		dprintf(LOG_NOTICE, "%s" "failed to add an address %s on %s: %s",
+		    FNAME, in6addr2str(&addrs[i]->addr, 0), ifp->ifname,
+		    strerror(error[i]));
+		if (lease_batch[i].isnew)
+			(void)dhcp6_remove_lease(lease_batch[i].lease);
+	}
+	free(addrs);
+	free(error);
+}
+
 
 int
 get_iaid(const char *ifname, const struct iaid_table *iaidtab, int num_device)
 {
-	struct hardware hdaddr;
 	struct iaid_table *temp = (struct iaid_table *)iaidtab;
+	unsigned int ifindex;
 	int i;
-	hdaddr.len = gethwid(hdaddr.data, 6, ifname, &hdaddr.type);
+
+	if ((ifindex = if_nametoindex(ifname)) == 0)
+		return 0;
 	for (i = 0; i < num_device; i++, temp++) {
-		if (!memcmp(temp->hwaddr.data, hdaddr.data, temp->hwaddr.len)
-		    && hdaddr.len == temp->hwaddr.len && hdaddr.type == temp->hwaddr.type) {
+		if (temp->ifindex == ifindex) {
 			dprintf(LOG_DEBUG, "%s"" found interface %s iaid %u", 
 				FNAME, ifname, temp->iaid);
 			return temp->iaid;
-		} else 
-			continue;
+		}
 	}
 	return 0;
 }
@@ -702,42 +904,54 @@ get_iaid(const char *ifname, const struct iaid_table *iaidtab, int num_device)
 int 
 create_iaid(struct iaid_table *iaidtab, int num_device)
 {
-	struct iaid_table *temp = iaidtab;
-	char buff[1024];
-	struct ifconf ifc;
-	struct ifreq *ifr;
-	int i;
+	struct iaid_table *temp = iaidtab, *t;
+	struct if_nameindex *ifnames, *ifn;
 	
-	ifc.ifc_len = sizeof(buff);
-	ifc.ifc_buf = buff;
-	if (ioctl(nlsock, SIOCGIFCONF, &ifc) < 0) {
-		dprintf(LOG_ERR, "%s" "ioctl SIOCGIFCONF", FNAME);
+	/* SIOCGIFCONF only lists interfaces with an IPv4 address */
+	if ((ifnames = if_nameindex()) == NULL) {
+		dprintf(LOG_ERR, "%s" "if_nameindex: %s", FNAME, strerror(errno));
 		return -1;
 	}
 
-	ifr = ifc.ifc_req;
-	for (i = ifc.ifc_len / sizeof(struct ifreq); --i >= 0 && num_device < MAX_DEVICE; 
-	     ifr++) {
-		if (!strcmp(ifr->ifr_name, "lo")) continue;
-		temp->hwaddr.len = gethwid(temp->hwaddr.data, sizeof(temp->hwaddr.data), ifr->ifr_name, &temp->hwaddr.type);
+	for (ifn = ifnames; ifn->if_index != 0 && num_device < MAX_DEVICE; 
+	     ifn++) {
+		if (!strcmp(ifn->if_name, "lo")) continue;
+		temp->hwaddr.len = gethwid(temp->hwaddr.data, sizeof(temp->hwaddr.data), ifn->if_name, &temp->hwaddr.type);
 		switch (temp->hwaddr.type) {
 		case ARPHRD_ETHER:
 		case ARPHRD_IEEE802:
 			memcpy(&temp->iaid, temp->hwaddr.data, sizeof(temp->iaid));
+			/*
+			 * a VLAN shares the hardware address of its parent,
+			 * which comes first in ifindex order: tell it apart by
+			 * its own name, whatever the command line order
+			 */
+			for (t = iaidtab; t < temp; t++) {
+				if (t->hwaddr.type == temp->hwaddr.type &&
+				    t->hwaddr.len == temp->hwaddr.len &&
+				    !memcmp(t->hwaddr.data, temp->hwaddr.data,
+				    temp->hwaddr.len)) {
+					temp->iaid ^= do_hash(ifn->if_name,
+					    strlen(ifn->if_name));
+					break;
+				}
+			}
 			break;
 		case ARPHRD_PPP:
-			temp->iaid = do_hash(ifr->ifr_name,sizeof(ifr->ifr_name))
-				+ if_nametoindex(ifr->ifr_name);
+			temp->iaid = do_hash(ifn->if_name, strlen(ifn->if_name))
+				+ ifn->if_index;
 			break;
 		default:
 			dprintf(LOG_INFO, "doesn't support %s address family %d", 
-				ifr->ifr_name, temp->hwaddr.type);
+				ifn->if_name, temp->hwaddr.type);
 			continue;
 		}
+		temp->ifindex = ifn->if_index;
 		dprintf(LOG_DEBUG, "%s"" create iaid %u for interface %s", 
-			FNAME, temp->iaid, ifr->ifr_name);
+			FNAME, temp->iaid, ifn->if_name);
 		num_device++;
 		temp++;
 	}
+	if_freenameindex(ifnames);
 	return num_device;
 }
@@ -78,6 +78,7 @@
 #include "common.h"
 #include "timer.h"
 #include "lease.h"
+#include "hash.h"
 
 int foreground;
 int debug_thresh;
@@ -86,32 +87,109 @@ struct dns_list dnslist;
 static struct host_conf *host_conflist;
 static int in6_matchflags __P((struct sockaddr *, char *, int));
 ssize_t gethwid __P((char *, int, const char *, u_int16_t *));
+static int dhcp6_get_ia __P((int, char *, int, struct dhcp6_optinfo *));
+static int dhcp6_set_ia __P((struct dhcp6opt *, struct dhcp6opt *,
+			     struct dhcp6_optinfo *));
 static int get_assigned_ipv6addrs __P((char *, char *,
 					struct dhcp6_optinfo *));
-struct dhcp6_if *
-find_ifconfbyname(const char *ifname)
+/*
+ * interfaces are looked up per packet, so keep them in an array indexed
+ * by ifindex and a hash by name; ifindex_refresh() rebuilds the array
+ * when the kernel reports link changes.
+ */
+static struct dhcp6_if **ifid_table = NULL;
+static unsigned int ifid_table_size = 0;
+static struct hash_table *ifname_hash_table = NULL;
+
+static unsigned int
+ifname_hash(const void *key)
 {
-	struct dhcp6_if *ifp;
+	const unsigned char *p = (const unsigned char *)key;
+	unsigned int index = 0;
 
-	for (ifp = dhcp6_if; ifp; ifp = ifp->next) {
-		if (strcmp(ifp->ifname, ifname) == 0)
-			return (ifp);
-	}
+	while (*p)
+		index = index * 31 + *p++;
+	return index;
+}
 
-	return (NULL);
+static void *
+ifname_findkey(const void *data)
+{
+	const struct dhcp6_if *ifp = (const struct dhcp6_if *)data;
+	return (void *)ifp->ifname;
 }
 
-struct dhcp6_if *
-find_ifconfbyid(unsigned int id)
+static int
+ifname_key_compare(const void *data, const void *key)
+{
+	const struct dhcp6_if *ifp = (const struct dhcp6_if *)data;
+
+	if (strcmp(ifp->ifname, (const char *)key) == 0)
+		return MATCH;
+	return MISCOMPARE;
+}
+
+static int
+ifid_table_add(struct dhcp6_if *ifp)
+{
+	struct dhcp6_if **table;
+	unsigned int size;
+
+	if (ifp->ifid >= ifid_table_size) {
+		for (size = ifid_table_size ? ifid_table_size : 16;
+		     size <= ifp->ifid; size *= 2)
+			;
+		table = realloc(ifid_table, size * sizeof(*table));
+		if (table == NULL) {
+			dprintf(LOG_ERR, "%s" "realloc failed", FNAME);
+			return (-1);
+		}
+		memset(table + ifid_table_size, 0,
+		       (size - ifid_table_size) * sizeof(*table));
+		ifid_table = table;
+		ifid_table_size = size;
+	}
+	ifid_table[ifp->ifid] = ifp;
+	return (0);
+}
+
+void
+ifindex_refresh()
 {
 	struct dhcp6_if *ifp;
+	unsigned int ifid;
 
+	if (ifid_table != NULL)
+		memset(ifid_table, 0, ifid_table_size * sizeof(*ifid_table));
 	for (ifp = dhcp6_if; ifp; ifp = ifp->next) {
-		if (ifp->ifid == id)
-			return (ifp);
+		if ((ifid = if_nametoindex(ifp->ifname)) == 0) {
+			dprintf(LOG_INFO, "%s" "interface %s disappeared",
+				FNAME, ifp->ifname);
+			continue;
+		}
+		if (ifid != ifp->ifid) {
+			dprintf(LOG_INFO, "%s" "interface %s index %u -> %u",
+				FNAME, ifp->ifname, ifp->ifid, ifid);
+			ifp->ifid = ifid;
+		}
+		(void)ifid_table_add(ifp);
 	}
+}
 
-	return (NULL);
+struct dhcp6_if *
+find_ifconfbyname(const char *ifname)
+{
+	if (ifname_hash_table == NULL)
+		return (NULL);
+	return ((struct dhcp6_if *)hash_search(ifname_hash_table, ifname));
+}
+
+struct dhcp6_if *
+find_ifconfbyid(unsigned int id)
+{
+	if (id >= ifid_table_size)
+		return (NULL);
+	return (ifid_table[id]);
 }
 
 struct host_conf *
@@ -169,6 +247,13 @@ ifinit(const char *ifname)
 #endif
 	if (get_linklocal(ifname, &ifp->linklocal) < 0)
 		goto die;
+	if (ifname_hash_table == NULL &&
+	    (ifname_hash_table = hash_table_create(DEFAULT_HASH_SIZE,
+			ifname_hash, ifname_findkey, ifname_key_compare)) == NULL)
+		goto die;
+	if (hash_add(ifname_hash_table, ifp->ifname, ifp) != 0 ||
+	    ifid_table_add(ifp) != 0)
+		goto die;
 	ifp->next = dhcp6_if;
 	dhcp6_if = ifp;
 	return;
@@ -215,6 +300,85 @@ dhcp6_clear_list(head)
 	return;
 }
 
+struct dhcp6_ia *
+dhcp6_add_ia(head, iaidinfo, type)
+	struct dhcp6_ia_list *head;
+	struct dhcp6_iaid_info *iaidinfo;
+	iatype_t type;
+{
+	struct dhcp6_ia *ia;
+
+	if ((ia = malloc(sizeof(*ia))) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return (NULL);
+	}
+	memset(ia, 0, sizeof(*ia));
+	ia->iaidinfo = *iaidinfo;
+	ia->type = type;
+	ia->ia_stcode = DH6OPT_STCODE_UNDEFINE;
+	TAILQ_INIT(&ia->addr_list);
+	TAILQ_INSERT_TAIL(head, ia, link);
+	return (ia);
+}
+
+void
+dhcp6_clear_ia_list(head)
+	struct dhcp6_ia_list *head;
+{
+	struct dhcp6_ia *ia;
+
+	while ((ia = TAILQ_FIRST(head)) != NULL) {
+		TAILQ_REMOVE(head, ia, link);
+		dhcp6_clear_list(&ia->addr_list);
+		free(ia);
+	}
+}
+
+/* exchange the entries of two lists */
+static void
+dhcp6_swap_list(l1, l2)
+	struct dhcp6_list *l1, *l2;
+{
+	struct dhcp6_list tmp;
+	struct dhcp6_listval *v;
+
+	TAILQ_INIT(&tmp);
+	while ((v = TAILQ_FIRST(l1)) != NULL) {
+		TAILQ_REMOVE(l1, v, link);
+		TAILQ_INSERT_TAIL(&tmp, v, link);
+	}
+	while ((v = TAILQ_FIRST(l2)) != NULL) {
+		TAILQ_REMOVE(l2, v, link);
+		TAILQ_INSERT_TAIL(l1, v, link);
+	}
+	while ((v = TAILQ_FIRST(&tmp)) != NULL) {
+		TAILQ_REMOVE(&tmp, v, link);
+		TAILQ_INSERT_TAIL(l2, v, link);
+	}
+}
+
+/* exchange the IA in optinfo's own fields with ia; again to undo */
+void
+dhcp6_swap_ia(optinfo, ia)
+	struct dhcp6_optinfo *optinfo;
+	struct dhcp6_ia *ia;
+{
+	struct dhcp6_iaid_info iaidinfo;
+	iatype_t type;
+	u_int16_t stcode;
+
+	iaidinfo = optinfo->iaidinfo;
+	optinfo->iaidinfo = ia->iaidinfo;
+	ia->iaidinfo = iaidinfo;
+	type = optinfo->type;
+	optinfo->type = ia->type;
+	ia->type = type;
+	stcode = optinfo->ia_stcode;
+	optinfo->ia_stcode = ia->ia_stcode;
+	ia->ia_stcode = stcode;
+	dhcp6_swap_list(&optinfo->addr_list, &ia->addr_list);
+}
+
 void
 relayfree(head)
 	struct relay_list *head;
@@ -853,6 +1017,7 @@ dhcp6_init_options(optinfo)
 	/* for safety */
 	optinfo->clientID.duid_id = NULL;
 	optinfo->serverID.duid_id = NULL;
+	optinfo->relayID.duid_id = NULL;
 	optinfo->ia_stcode = DH6OPT_STCODE_UNDEFINE;
 	optinfo->pref = DH6OPT_PREF_UNDEF;
 	TAILQ_INIT(&optinfo->addr_list);
@@ -860,6 +1025,7 @@ dhcp6_init_options(optinfo)
 	TAILQ_INIT(&optinfo->stcode_list);
 	TAILQ_INIT(&optinfo->dns_list.addrlist);
 	TAILQ_INIT(&optinfo->relay_list);
+	TAILQ_INIT(&optinfo->ia_list);
 	optinfo->dns_list.domainlist = NULL;
 }
 
@@ -870,12 +1036,17 @@ dhcp6_clear_options(optinfo)
 	struct domain_list *dlist, *dlist_next;
 	duidfree(&optinfo->clientID);
 	duidfree(&optinfo->serverID);
+	if (optinfo->relayID.duid_len != 0)
+		duidfree(&optinfo->relayID);
+	if (optinfo->reconfkey.duid_len != 0)
+		duidfree(&optinfo->reconfkey);
 
 	dhcp6_clear_list(&optinfo->addr_list);
 	dhcp6_clear_list(&optinfo->reqopt_list);
 	dhcp6_clear_list(&optinfo->stcode_list);
 	dhcp6_clear_list(&optinfo->dns_list.addrlist);
 	relayfree(&optinfo->relay_list);
+	dhcp6_clear_ia_list(&optinfo->ia_list);
 	if (dhcp6_mode == DHCP6_MODE_CLIENT) {
 		for (dlist = optinfo->dns_list.domainlist; dlist; dlist = dlist_next) {
 			dlist_next = dlist->next;
@@ -922,7 +1093,8 @@ dhcp6_get_options(p, ep, optinfo)
 	struct dhcp6_optinfo *optinfo;
 {
 	struct dhcp6opt *np, opth;
-	int i, opt, optlen, reqopts, num;
+	struct dhcp6_ia *ia;
+	int i, opt, optlen, reqopts, num, nia = 0;
 	char *cp, *val;
 	u_int16_t val16;
 
@@ -979,6 +1151,7 @@ dhcp6_get_options(p, ep, optinfo)
 			if (optlen != sizeof(u_int16_t))
 				goto malformed;
 			memcpy(&val16, cp, sizeof(val16));
+			optinfo->elapsed_time = val16;
 			num = ntohs(val16);
 			dprintf(LOG_DEBUG, " this message elapsed time is: %d",
 				num);
@@ -1046,6 +1219,11 @@ dhcp6_get_options(p, ep, optinfo)
 				goto malformed;
 			optinfo->flags |= DHCIFF_RAPID_COMMIT;
 			break;
+		case DH6OPT_RECONF_ACCEPT:
+			if (optlen != 0)
+				goto malformed;
+			optinfo->flags |= DHCIFF_RECONF_ACCEPT;
+			break;
 		case DH6OPT_UNICAST:
 			if (optlen != sizeof(struct in6_addr)
 			    && dhcp6_mode != DHCP6_MODE_CLIENT)
@@ -1054,39 +1232,6 @@ dhcp6_get_options(p, ep, optinfo)
 			memcpy(&optinfo->server_addr,
 			       (struct in6_addr *)cp, sizeof(struct in6_addr));
 			break;
-		case DH6OPT_IA_TA:
-			if (optlen < sizeof(u_int32_t))
-				goto malformed;
-			/* check iaid */
-			optinfo->flags |= DHCIFF_TEMP_ADDRS;
-			optinfo->type = IATA;
-			dprintf(LOG_DEBUG, "%s" "get option iaid is %u", 
-				FNAME, optinfo->iaidinfo.iaid);
-			optinfo->iaidinfo.iaid = ntohl(*(u_int32_t *)cp);
-			if (get_assigned_ipv6addrs(cp + 4, cp + optlen, optinfo))
-				goto fail;
-			break;
-		case DH6OPT_IA_NA:
-		case DH6OPT_IA_PD:
-			if (opt == DH6OPT_IA_NA)
-				optinfo->type = IANA;
-			else if (opt == DH6OPT_IA_PD)
-				optinfo->type = IAPD;
-			/* check iaid */
-			if (optlen < sizeof(struct dhcp6_iaid_info)) 
-				goto malformed;
-			optinfo->iaidinfo.iaid = ntohl(*(u_int32_t *)cp);
-			optinfo->iaidinfo.renewtime = 
-				ntohl(*(u_int32_t *)(cp + sizeof(u_int32_t)));
-			optinfo->iaidinfo.rebindtime = 
-				ntohl(*(u_int32_t *)(cp + 2 * sizeof(u_int32_t)));
-			dprintf(LOG_DEBUG, "get option iaid is %u, renewtime %u, "
-				"rebindtime %u", optinfo->iaidinfo.iaid,
-				optinfo->iaidinfo.renewtime, optinfo->iaidinfo.rebindtime);
-			if (get_assigned_ipv6addrs(cp + 3 * sizeof(u_int32_t), 
-						cp + optlen, optinfo))
-				goto fail;
-			break;
 		case DH6OPT_DNS_SERVERS:
 			if (optlen % sizeof(struct in6_addr) || optlen == 0)
 				goto malformed;
@@ -1145,6 +1290,28 @@ dhcp6_get_options(p, ep, optinfo)
 				}
 			}
 			break;
+		case DH6OPT_IA_TA:
+		case DH6OPT_IA_NA:
+		case DH6OPT_IA_PD:
+			/*
+			 * the server answers every IA of a request; parse
+			 * each one after the first into ia_list.
+			 */
+			ia = NULL;
+			if (nia++ > 0 && dhcp6_mode == DHCP6_MODE_SERVER) {
+				struct dhcp6_iaid_info iaid0;
+
+				memset(&iaid0, 0, sizeof(iaid0));
+				if ((ia = dhcp6_add_ia(&optinfo->ia_list,
+				    &iaid0, IANA)) == NULL)
+					goto fail;
+				dhcp6_swap_ia(optinfo, ia);
+			}
+			if (dhcp6_get_ia(opt, cp, optlen, optinfo) < 0)
+				goto fail;
+			if (ia != NULL)
+				dhcp6_swap_ia(optinfo, ia);
+			break;
 		default:
 			/* no option specific behavior */
 			dprintf(LOG_INFO, "%s"
@@ -1164,6 +1331,58 @@ dhcp6_get_options(p, ep, optinfo)
 	return (-1);
 }
 
+/* parse one IA_NA, IA_TA or IA_PD option into optinfo */
+static int
+dhcp6_get_ia(opt, cp, optlen, optinfo)
+	int opt, optlen;
+	char *cp;
+	struct dhcp6_optinfo *optinfo;
+{
+	switch (opt) {
+	case DH6OPT_IA_TA:
+		if (optlen < sizeof(u_int32_t))
+			goto malformed;
+		/* check iaid */
+		optinfo->flags |= DHCIFF_TEMP_ADDRS;
+		optinfo->type = IATA;
+		dprintf(LOG_DEBUG, "%s" "get option iaid is %u", 
+			FNAME, optinfo->iaidinfo.iaid);
+		optinfo->iaidinfo.iaid = ntohl(*(u_int32_t *)cp);
+		if (get_assigned_ipv6addrs(cp + 4, cp + optlen, optinfo))
+			goto fail;
+		break;
+	case DH6OPT_IA_NA:
+	case DH6OPT_IA_PD:
+		if (opt == DH6OPT_IA_NA)
+			optinfo->type = IANA;
+		else if (opt == DH6OPT_IA_PD)
+			optinfo->type = IAPD;
+		/* check iaid */
+		if (optlen < sizeof(struct dhcp6_iaid_info)) 
+			goto malformed;
+		optinfo->iaidinfo.iaid = ntohl(*(u_int32_t *)cp);
+		optinfo->iaidinfo.renewtime = 
+			ntohl(*(u_int32_t *)(cp + sizeof(u_int32_t)));
+		optinfo->iaidinfo.rebindtime = 
+			ntohl(*(u_int32_t *)(cp + 2 * sizeof(u_int32_t)));
+		dprintf(LOG_DEBUG, "get option iaid is %u, renewtime %u, "
+			"rebindtime %u", optinfo->iaidinfo.iaid,
+			optinfo->iaidinfo.renewtime, optinfo->iaidinfo.rebindtime);
+		if (get_assigned_ipv6addrs(cp + 3 * sizeof(u_int32_t), 
+					cp + optlen, optinfo))
+			goto fail;
+		break;
+	}
+
+	return (0);
+
+  malformed:
+	dprintf(LOG_INFO, "%s" "malformed IA option: type %d, len %d",
+	    FNAME, opt, optlen);
+  fail:
+	return (-1);
+}
+
 static int
 get_assigned_ipv6addrs(p, ep, optinfo)
 	char *p, *ep;
@@ -1355,37 +1574,16 @@ get_assigned_ipv6addrs(p, ep, optinfo)
 	dprintf(LOG_DEBUG, "%s" "set %s", FNAME, dhcp6optstr((t))); \
 } while (0)
 
-int
-dhcp6_set_options(bp, ep, optinfo)
-	struct dhcp6opt *bp, *ep;
+/* append the IA option held in optinfo's own fields */
+static int
+dhcp6_set_ia(p, ep, optinfo)
+	struct dhcp6opt *p, *ep;
 	struct dhcp6_optinfo *optinfo;
 {
-	struct dhcp6opt *p = bp, opth;
-	struct dhcp6_listval *stcode;
+	struct dhcp6opt opth;
 	int len = 0, optlen = 0;
 	char *tmpbuf = NULL;
 
-	if (optinfo->clientID.duid_len) {
-		COPY_OPTION(DH6OPT_CLIENTID, optinfo->clientID.duid_len,
-			    optinfo->clientID.duid_id, p);
-	}
-
-	if (optinfo->serverID.duid_len) {
-		COPY_OPTION(DH6OPT_SERVERID, optinfo->serverID.duid_len,
-			    optinfo->serverID.duid_id, p);
-	}
-	if (dhcp6_mode == DHCP6_MODE_CLIENT) 
-		COPY_OPTION(DH6OPT_ELAPSED_TIME, 2, &optinfo->elapsed_time, p);
-
-	if (optinfo->flags & DHCIFF_RAPID_COMMIT)
-		COPY_OPTION(DH6OPT_RAPID_COMMIT, 0, NULL, p);
-
-	if ((dhcp6_mode == DHCP6_MODE_SERVER) && (optinfo->flags & DHCIFF_UNICAST)) {
-		if (!IN6_IS_ADDR_UNSPECIFIED(&optinfo->server_addr)) {
-			COPY_OPTION(DH6OPT_UNICAST, sizeof(optinfo->server_addr),
-				    &optinfo->server_addr, p);
-		}
-	}
 	switch(optinfo->type) {
 	int buflen;
 	char *tp;
@@ -1598,6 +1796,61 @@ dhcp6_set_options(bp, ep, optinfo)
 	default:
 		break;
 	}
+
+	return (len);
+
+  fail:
+	if (tmpbuf)
+		free(tmpbuf);
+	return (-1);
+}
+
+int
+dhcp6_set_options(bp, ep, optinfo)
+	struct dhcp6opt *bp, *ep;
+	struct dhcp6_optinfo *optinfo;
+{
+	struct dhcp6opt *p = bp, opth;
+	struct dhcp6_listval *stcode;
+	struct dhcp6_ia *ia;
+	int len = 0, optlen = 0;
+	char *tmpbuf = NULL;
+
+	if (optinfo->clientID.duid_len) {
+		COPY_OPTION(DH6OPT_CLIENTID, optinfo->clientID.duid_len,
+			    optinfo->clientID.duid_id, p);
+	}
+
+	if (optinfo->serverID.duid_len) {
+		COPY_OPTION(DH6OPT_SERVERID, optinfo->serverID.duid_len,
+			    optinfo->serverID.duid_id, p);
+	}
+	if (dhcp6_mode == DHCP6_MODE_CLIENT) 
+		COPY_OPTION(DH6OPT_ELAPSED_TIME, 2, &optinfo->elapsed_time, p);
+
+	if (optinfo->flags & DHCIFF_RAPID_COMMIT)
+		COPY_OPTION(DH6OPT_RAPID_COMMIT, 0, NULL, p);
+
+	if ((dhcp6_mode == DHCP6_MODE_SERVER) && (optinfo->flags & DHCIFF_UNICAST)) {
+		if (!IN6_IS_ADDR_UNSPECIFIED(&optinfo->server_addr)) {
+			COPY_OPTION(DH6OPT_UNICAST, sizeof(optinfo->server_addr),
+				    &optinfo->server_addr, p);
+		}
+	}
+	if ((optlen = dhcp6_set_ia(p, ep, optinfo)) < 0)
+		goto fail;
+	p = (struct dhcp6opt *)((char *)p + optlen);
+	len += optlen;
+	for (ia = TAILQ_FIRST(&optinfo->ia_list); ia;
+	     ia = TAILQ_NEXT(ia, link)) {
+		dhcp6_swap_ia(optinfo, ia);
+		optlen = dhcp6_set_ia(p, ep, optinfo);
+		dhcp6_swap_ia(optinfo, ia);
+		if (optlen < 0)
+			goto fail;
+		p = (struct dhcp6opt *)((char *)p + optlen);
+		len += optlen;
+	}
 	if (dhcp6_mode == DHCP6_MODE_SERVER && optinfo->pref != DH6OPT_PREF_UNDEF) {
 		u_int8_t p8 = (u_int8_t)optinfo->pref;
 		dprintf(LOG_DEBUG, "server preference %2x", optinfo->pref);
@@ -1757,6 +2010,12 @@ dhcp6_reset_timer(ev)
 		 * MIN_SOL_DELAY and MAX_SOL_DELAY.
 		 * [dhcpv6-28 14.]
 		 */
+		if (ev->init_retrans > 0) {
+			/* a wider window set by the caller, e.g. for clients
+			 * restarting together after a power failure */
+			ev->retrans = random() % ev->init_retrans;
+			break;
+		}
 		ev->retrans = (random() % (MAX_SOL_DELAY - MIN_SOL_DELAY)) +
 			MIN_SOL_DELAY;
 		break;
@@ -1890,6 +2149,10 @@ dhcp6optstr(type)
 		return "status code";
 	case DH6OPT_RAPID_COMMIT:
 		return "rapid commit";
+	case DH6OPT_RECONF_ACCEPT:
+		return "reconfigure accept";
+	case DH6OPT_AUTH:
+		return "authentication";
 	case DH6OPT_DNS_SERVERS:
 		return "DNS_SERVERS";
 	default:
@@ -1934,6 +2197,14 @@ dhcp6msgstr(type)
 		return "relay forwarding";
 	case DH6_RELAY_REPL:
 		return "relay reply";
+	case DH6_LEASEQUERY:
+		return "leasequery";
+	case DH6_LQ_REPLY:
+		return "leasequery reply";
+	case DH6_LQ_DATA:
+		return "leasequery data";
+	case DH6_LQ_DONE:
+		return "leasequery done";
 	default:
 		sprintf(genstr, "msg%d", type);
 		return (genstr);
@@ -52,6 +52,10 @@ extern int debug_thresh;
 /* common.c */
 extern int dhcp6_copy_list __P((struct dhcp6_list *, const struct dhcp6_list *));
 extern void dhcp6_clear_list __P((struct dhcp6_list *));
+extern struct dhcp6_ia *dhcp6_add_ia __P((struct dhcp6_ia_list *,
+					  struct dhcp6_iaid_info *, iatype_t));
+extern void dhcp6_clear_ia_list __P((struct dhcp6_ia_list *));
+extern void dhcp6_swap_ia __P((struct dhcp6_optinfo *, struct dhcp6_ia *));
 extern int dhcp6_count_list __P((struct dhcp6_list *));
 extern struct dhcp6_listval *dhcp6_find_listval __P((struct dhcp6_list *,
 							void *,
@@ -103,5 +107,6 @@ extern void ifinit __P((const char *));
 extern int configure_duid __P((const char *, struct duid *));
 extern struct dhcp6_if *find_ifconfbyname __P((const char *));
 extern struct dhcp6_if *find_ifconfbyid __P((unsigned int));
+extern void ifindex_refresh __P((void));
 extern struct prefix_ifconf *find_prefixifconf __P((const char *));
 extern struct host_conf *find_hostconf __P((const struct duid *));
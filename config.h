@@ -30,7 +30,9 @@
  * SUCH DAMAGE.
  */
 
-#define MAX_DEVICE 100
+#include <stdio.h>
+
+#define MAX_DEVICE 1024
 
 struct hardware {
 	u_int16_t type;
@@ -42,6 +44,7 @@ struct iaid_table {
 	/* so far we support ethernet cards only */
 	struct hardware  hwaddr;
 	u_int32_t iaid;
+	unsigned int ifindex;
 };
 
 struct ra_info {
@@ -96,6 +99,8 @@ struct dhcp6_if {
 #define DHCIFF_TEMP_ADDRS 0x4
 #define DHCIFF_PREFIX_DELEGATION 0x8
 #define DHCIFF_UNICAST 0x10
+#define DHCIFF_LEASEQUERY 0x20
+#define DHCIFF_RECONF_ACCEPT 0x40
 
 
 	struct in6_addr linklocal;
@@ -108,6 +113,14 @@ struct dhcp6_if {
 	struct dhcp6_option_list option_list;
 	struct dhcp6_serverinfo *current_server;
 	struct dhcp6_serverinfo *servers;
+
+	/* client binding state, one per interface (client only) */
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_list request_list;
+	u_int8_t request_flag;
+	FILE *lease_file;
+	char *lease_name;
+	u_int64_t conf_start;	/* dhcp6_now() since it waits for addresses */
 };
 
 struct dhcp6_event {
@@ -119,7 +132,7 @@ struct dhcp6_event {
 	struct duid serverid;
 
 	/* internal timer parameters */
-	struct timeval start_time;
+	u_int64_t start_time;	/* dhcp6_now() at the first transmission */
 	long retrans;
 	long init_retrans;
 	long max_retrans_cnt;
@@ -303,7 +316,14 @@ extern int configure_global_option (void);
 extern void configure_cleanup (void);
 extern void configure_commit (void);
 extern int cfparse (const char *);
-extern int resolv_parse (struct dns_list *);
+extern int resolv_update __P((struct dhcp6_if *, const struct dns_list *));
+extern void resolv_clear __P((struct dhcp6_if *));
+extern void resolv_restore __P((void));
 extern int get_if_rainfo(struct dhcp6_if *ifp);
+struct nlmsghdr;
+extern int netlink_open_monitor(u_int32_t);
+extern int netlink_recv_monitor(int, int (*)(struct nlmsghdr *, void *), void *);
+extern int netlink_ifaddr(int, int, struct dhcp6_addr **, int, int *);
+extern int netlink_route(int, int, int, struct in6_addr *, int);
 
 extern void *get_if_option( struct dhcp6_option_list *, int);
@@ -57,6 +57,10 @@
 #define DH6_INFORM_REQ	11
 #define DH6_RELAY_FORW	12
 #define DH6_RELAY_REPL	13
+#define DH6_LEASEQUERY	14
+#define DH6_LQ_REPLY	15
+#define DH6_LQ_DATA	16
+#define DH6_LQ_DONE	17
 
 /* Predefined addresses */
 #define DH6ADDR_ALLAGENT	"ff02::1:2"
@@ -106,12 +110,10 @@
 #define RESOLV_CONF_FILE "/etc/resolv.conf"
 #define RESOLV_CONF_BAK_FILE "/etc/resolv.conf.dhcpv6.bak"
 #define RESOLV_CONF_DHCPV6_FILE "/etc/resolv.conf.dhcpv6"
-char resolv_dhcpv6_file[254];
 
-#define RADVD_CONF_FILE "/etc/radvd.conf"
-#define RADVD_CONF_BAK_FILE "/etc/radvd.conf.dhcpv6.bak"
-#define RADVD_CONF_DHCPV6_FILE "/etc/radvd.conf.dhcpv6"
-char radvd_dhcpv6_file[254];
+#ifndef PATH_RADVD_PID
+#define PATH_RADVD_PID "/var/run/radvd/radvd.pid"
+#endif
 
 
 typedef enum { IANA, IATA, IAPD} iatype_t;
@@ -160,6 +162,11 @@ struct dhcp6_lease {
 	time_t start_date;
 	/* address assigned on the interface */
 	struct dhcp6_timer *timer;
+	/* server: the range or prefix the lease is counted in */
+	TAILQ_ENTRY(dhcp6_lease) seglink;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix;
+	u_int32_t replgen;	/* standby: the last resync that sent it */
 };
 
 struct dhcp6_listval {
@@ -215,9 +222,24 @@ struct relay_listval {
 
 TAILQ_HEAD (relay_list, relay_listval);
 
+/* an IA_NA, IA_TA or IA_PD of a message beyond the first */
+struct dhcp6_ia {
+	TAILQ_ENTRY(dhcp6_ia) link;
+
+	struct dhcp6_iaid_info iaidinfo;
+	iatype_t type;
+	u_int16_t ia_stcode;
+	struct dhcp6_list addr_list;
+};
+
+TAILQ_HEAD(dhcp6_ia_list, dhcp6_ia);
+
 struct dhcp6_optinfo {
 	struct duid clientID;	/* DUID */
 	struct duid serverID;	/* DUID */
+	struct duid relayID;	/* DUID of the relay next to the client */
+	struct duid reconfkey;	/* server: the client's Reconfigure key, as
+				   the replication stream sends it */
 	u_int16_t elapsed_time;
 	struct dhcp6_iaid_info iaidinfo;
 	u_int16_t ia_stcode;	/* status code associated with iaidinfo */
@@ -231,6 +253,12 @@ struct dhcp6_optinfo {
 	struct dns_list dns_list; /* DNS server list */
 	struct relay_list relay_list; /* list of the relays the message 
 					 passed through on to the server */
+	/*
+	 * The first IA is in iaidinfo, type, ia_stcode and addr_list; any
+	 * others follow here.  dhcp6_swap_ia() brings one of them into
+	 * those fields, so that what handles one IA can handle each.
+	 */
+	struct dhcp6_ia_list ia_list;
 };
 
 /* DHCP6 base packet format */
@@ -259,6 +287,13 @@ struct dhcp6 {
 #define DH6OPT_RELAY_MSG 9
 
 #define DH6OPT_AUTH 11
+/* the reconfigure key authentication protocol, RFC 3315 21.5 */
+#  define DH6_AUTHPROTO_RECONFIG 3
+#  define DH6_AUTHALG_HMACMD5 1
+#  define DH6_AUTHRDM_MONOCOUNTER 0
+#  define DH6_AUTHINFO_RECONFKEY 1
+#  define DH6_AUTHINFO_HMACMD5 2
+#  define DH6_RECONFKEY_LEN 16
 #define DH6OPT_UNICAST 12
 #define DH6OPT_STATUS_CODE 13
 
@@ -276,6 +311,17 @@ struct dhcp6 {
 
 #  define DH6OPT_STCODE_NOPREFIXAVAIL 10
 
+/* leasequery status codes, RFC 5007; 7 and 8 clash with the ones above */
+#  define DH6OPT_STCODE_UNKNOWNQUERYTYPE 7
+#  define DH6OPT_STCODE_MALFORMEDQUERY 8
+#  define DH6OPT_STCODE_NOTCONFIGURED 9
+#  define DH6OPT_STCODE_NOTALLOWED 10
+/* bulk leasequery status codes, RFC 5460 */
+#  define DH6OPT_STCODE_QUERYTERMINATED 11
+#  define DH6OPT_STCODE_DATAMISSING 12
+#  define DH6OPT_STCODE_CATCHUPCOMPLETE 13
+#  define DH6OPT_STCODE_NOTSUPPORTED 14
+
 #  define DH6OPT_STCODE_UNDEFINE 0xffff
 
 #define DH6OPT_RAPID_COMMIT 14
@@ -284,6 +330,7 @@ struct dhcp6 {
 #define DH6OPT_VENDOR_OPTS 17
 #define DH6OPT_INTERFACE_ID 18
 #define DH6OPT_RECONF_MSG 19
+#define DH6OPT_RECONF_ACCEPT 20
 
 #define DEFAULT_VALID_LIFE_TIME 720000
 #define DEFAULT_PREFERRED_LIFE_TIME 360000
@@ -294,6 +341,21 @@ struct dhcp6 {
 #define DH6OPT_IA_PD 25
 #define DH6OPT_IAPREFIX 26
 
+/* leasequery, RFC 5007 */
+#define DH6OPT_LQ_QUERY 44
+#  define LQ_QUERY_BY_ADDRESS 1
+#  define LQ_QUERY_BY_CLIENTID 2
+#  define LQ_QUERY_BY_RELAYID 3		/* bulk leasequery only */
+#  define LQ_QUERY_BY_LINK_ADDRESS 4	/* bulk leasequery only */
+#  define LQ_QUERY_BY_REMOTEID 5		/* bulk leasequery only */
+#define DH6OPT_CLIENT_DATA 45
+#define DH6OPT_CLT_TIME 46
+#define DH6OPT_LQ_RELAY_DATA 47
+#define DH6OPT_LQ_CLIENT_LINK 48
+
+/* bulk leasequery, RFC 5460 */
+#define DH6OPT_RELAY_ID 53
+
 struct dhcp6opt {
 	u_int16_t dh6opt_type;
 	u_int16_t dh6opt_len;
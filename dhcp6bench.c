@@ -0,0 +1,927 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dhcp6bench: microbenchmarks for the primitives the server leans on
+ * under load -- the hash tables and do_hash(), the timer list, the option
+ * codec, address allocation and the lease file.  Every case is printed as
+ * one JSON object of the "results" array, with the number of operations
+ * timed and the nanoseconds they took, so runs can be diffed across
+ * commits.  A case that runs past the time budget stops early and says so
+ * with "truncated": true; its ops count is what completed.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "server6_conf.h"
+#include "lease.h"
+#include "hash.h"
+#include "timer.h"
+
+const dhcp6_mode_t dhcp6_mode = DHCP6_MODE_SERVER;
+
+static FILE *out;
+static int nresults;
+static int quick;
+static u_int64_t budget = 10ULL * 1000000000;
+static const char *tmpdir = "/tmp";
+static u_int32_t segsize = 65536;
+static char *corpus_files[16];
+static int ncorpus_files;
+
+static u_int64_t rnd_state = 0x9e3779b97f4a7c15ULL;
+
+static u_int64_t bench_now __P((void));
+static u_int64_t rnd __P((void));
+static void result __P((const char *, u_int64_t, u_int64_t, int,
+			const char *, ...));
+static void make_addr __P((int, u_int32_t, struct in6_addr *));
+static int make_duid __P((int, u_int32_t, char *));
+static void *addr_findkey __P((const void *));
+static int addr_compare __P((const void *, const void *));
+static void hash_free __P((struct hash_table *));
+static int bench_hash __P((int, u_int32_t));
+static void bench_do_hash __P((int, u_int32_t));
+static struct dhcp6_timer *bench_timo __P((void *));
+static void bench_timers __P((u_int32_t));
+static void bench_codec __P((u_int32_t));
+static void bench_newaddr __P((int));
+static struct dhcp6_lease *make_leases __P((u_int32_t));
+static void bench_leases __P((u_int32_t));
+static void usage __P((void));
+
+#define ADDR_POOL	0	/* consecutive addresses from one pool */
+#define ADDR_RANDOM	1	/* random interface IDs in one /64 */
+#define DUID_LLT	2
+#define DUID_LL		3
+#define DUID_EN		4
+
+static const char *keyname[] = { "pool", "random", "duid-llt", "duid-ll",
+				 "duid-en" };
+
+static u_int64_t
+bench_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift64*, so runs use the same keys */
+static u_int64_t
+rnd()
+{
+	rnd_state ^= rnd_state >> 12;
+	rnd_state ^= rnd_state << 25;
+	rnd_state ^= rnd_state >> 27;
+	return rnd_state * 2685821657736338717ULL;
+}
+
+/* the budget is checked every mask + 1 operations */
+#define OVER_BUDGET(start, i, mask) \
+	(((i) & (mask)) == 0 && bench_now() - (start) > budget)
+
+/*
+ * Print one result.  fmt gives the fields that identify the case, as
+ * "\"key\": value" pairs.
+ */
+static void
+#ifdef __GNUC__
+__attribute__ ((__format__(__printf__, 5, 6)))
+#endif
+result(const char *name, u_int64_t ops, u_int64_t ns, int truncated,
+       const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(out, "%s\n    {\"name\": \"%s\", ", nresults++ ? "," : "", name);
+	va_start(ap, fmt);
+	vfprintf(out, fmt, ap);
+	va_end(ap);
+	fprintf(out, ", \"ops\": %llu, \"ns\": %llu, \"ns_per_op\": %.1f%s}",
+		(unsigned long long)ops, (unsigned long long)ns,
+		ops ? (double)ns / ops : 0.0, truncated ? ", \"truncated\": true" : "");
+	fflush(out);
+}
+
+static void
+make_addr(kind, i, addr)
+	int kind;
+	u_int32_t i;
+	struct in6_addr *addr;
+{
+	u_int64_t iid;
+
+	memset(addr, 0, sizeof(*addr));
+	addr->s6_addr[0] = 0x20;
+	addr->s6_addr[1] = 0x01;
+	addr->s6_addr[2] = 0x0d;
+	addr->s6_addr[3] = 0xb8;
+	addr->s6_addr[7] = 0x01;
+	iid = (kind == ADDR_POOL) ? (u_int64_t)i + 1 : rnd();
+	addr->s6_addr32[2] = htonl(iid >> 32);
+	addr->s6_addr32[3] = htonl(iid & 0xffffffff);
+}
+
+/* DUIDs as CPEs send them: a fixed OUI or enterprise, a counting tail */
+static int
+make_duid(kind, i, buf)
+	int kind;
+	u_int32_t i;
+	char *buf;
+{
+	static const u_int8_t llt[] = { 0, 1, 0, 1, 0x2c, 0x1b, 0x4e, 0x10,
+					0x00, 0x16, 0x3e };
+	static const u_int8_t en[] = { 0, 2, 0, 0, 0x0d, 0xe9 };
+
+	switch (kind) {
+	case DUID_LLT:
+		memcpy(buf, llt, sizeof(llt));
+		buf[11] = (i >> 16) & 0xff;
+		buf[12] = (i >> 8) & 0xff;
+		buf[13] = i & 0xff;
+		return 14;
+	case DUID_LL:
+		memcpy(buf, llt, 4);
+		buf[1] = 3;
+		memcpy(buf + 4, llt + 8, 3);
+		buf[7] = (i >> 16) & 0xff;
+		buf[8] = (i >> 8) & 0xff;
+		buf[9] = i & 0xff;
+		return 10;
+	default:
+		memcpy(buf, en, sizeof(en));
+		memset(buf + 6, 0, 4);
+		buf[10] = (i >> 24) & 0xff;
+		buf[11] = (i >> 16) & 0xff;
+		buf[12] = (i >> 8) & 0xff;
+		buf[13] = i & 0xff;
+		return 14;
+	}
+}
+
+/*
+ * The lease table keys by struct dhcp6_addr through addr_hash(); this
+ * table does the same with bare dhcp6_addr entries, so ten million of
+ * them fit where as many struct dhcp6_lease would not.
+ */
+static void *
+addr_findkey(data)
+	const void *data;
+{
+	return (void *)data;
+}
+
+static int
+addr_compare(data, key)
+	const void *data, *key;
+{
+	if (IN6_ARE_ADDR_EQUAL(&((const struct dhcp6_addr *)data)->addr,
+			       &((const struct dhcp6_addr *)key)->addr))
+		return MATCH;
+	return MISCOMPARE;
+}
+
+static void
+hash_free(table)
+	struct hash_table *table;
+{
+	struct hashlist_element *element, *next;
+	int i;
+
+	for (i = 0; i < table->hash_size; i++) {
+		for (element = table->hash_list[i]; element; element = next) {
+			next = element->next;
+			free(element);
+		}
+	}
+	free(table->hash_list);
+	free(table);
+}
+
+/* returns 1 if a phase ran out of budget */
+static int
+bench_hash(kind, n)
+	int kind;
+	u_int32_t n;
+{
+	struct hash_table *table;
+	struct dhcp6_addr *keys, miss;
+	u_int64_t start, ns;
+	u_int32_t i, added, found = 0;
+	int truncated, slow;
+
+	if ((keys = calloc(n, sizeof(*keys))) == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory for %u keys\n", n);
+		return 1;
+	}
+	for (i = 0; i < n; i++) {
+		make_addr(kind, i, &keys[i].addr);
+		keys[i].type = IANA;
+	}
+	table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash, addr_findkey,
+				  addr_compare);
+
+	/* hash_add grows the table as it fills, so this includes grow_hash */
+	truncated = 0;
+	start = bench_now();
+	for (added = 0; added < n; added++) {
+		if (OVER_BUDGET(start, added, 1023)) {
+			truncated = 1;
+			break;
+		}
+		hash_add(table, &keys[added], &keys[added]);
+	}
+	ns = bench_now() - start;
+	slow = truncated;
+	result("hash_add", added, ns, truncated,
+	       "\"keys\": \"%s\", \"n\": %u, \"buckets\": %u", keyname[kind], n,
+	       table->hash_size);
+
+	truncated = 0;
+	start = bench_now();
+	for (i = 0; i < added; i++) {
+		if (OVER_BUDGET(start, i, 1023)) {
+			truncated = 1;
+			break;
+		}
+		if (hash_search(table, &keys[i]))
+			found++;
+	}
+	ns = bench_now() - start;
+	if (found != i)
+		fprintf(stderr, "dhcp6bench: hash_search found %u of %u\n", found, i);
+	result("hash_search_hit", i, ns, truncated,
+	       "\"keys\": \"%s\", \"n\": %u", keyname[kind], n);
+
+	truncated = 0;
+	memset(&miss, 0, sizeof(miss));
+	miss.type = IANA;
+	start = bench_now();
+	for (i = 0; i < added; i++) {
+		if (OVER_BUDGET(start, i, 1023)) {
+			truncated = 1;
+			break;
+		}
+		make_addr(kind, n + i, &miss.addr);
+		hash_search(table, &miss);
+	}
+	ns = bench_now() - start;
+	result("hash_search_miss", i, ns, truncated,
+	       "\"keys\": \"%s\", \"n\": %u", keyname[kind], n);
+
+	/* one more doubling of the table as it stands */
+	start = bench_now();
+	grow_hash(table);
+	ns = bench_now() - start;
+	result("grow_hash", added, ns, 0,
+	       "\"keys\": \"%s\", \"n\": %u, \"buckets\": %u", keyname[kind], n,
+	       table->hash_size);
+
+	truncated = 0;
+	start = bench_now();
+	for (i = 0; i < added; i++) {
+		if (OVER_BUDGET(start, i, 1023)) {
+			truncated = 1;
+			break;
+		}
+		hash_delete(table, &keys[i]);
+	}
+	ns = bench_now() - start;
+	result("hash_delete", i, ns, truncated,
+	       "\"keys\": \"%s\", \"n\": %u", keyname[kind], n);
+
+	hash_free(table);
+	free(keys);
+	return slow;
+}
+
+static int
+cmp_u32(a, b)
+	const void *a, *b;
+{
+	u_int32_t x = *(const u_int32_t *)a, y = *(const u_int32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * How well do_hash() spreads a key set: over the default table size and
+ * over the size the table has grown to by the time it holds n keys.  A
+ * uniform hash gives chi2_ratio near 1 and a max_chain near the mean.
+ */
+static void
+bench_do_hash(kind, n)
+	int kind;
+	u_int32_t n;
+{
+	u_int32_t *hashes, *counts, i, size, distinct, maxchain, used;
+	struct in6_addr addr;
+	char duid[16];
+	u_int64_t start, ns;
+	double expect, chi2;
+	int s;
+
+	if ((hashes = malloc(n * sizeof(*hashes))) == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory for %u hashes\n", n);
+		return;
+	}
+	start = bench_now();
+	for (i = 0; i < n; i++) {
+		if (kind == ADDR_POOL || kind == ADDR_RANDOM) {
+			make_addr(kind, i, &addr);
+			hashes[i] = do_hash(&addr, sizeof(addr));
+		} else
+			hashes[i] = do_hash(duid, make_duid(kind, i, duid));
+	}
+	ns = bench_now() - start;
+
+	for (s = 0; s < 2; s++) {
+		size = DEFAULT_HASH_SIZE;
+		while (s && n * 100 / size > 90)
+			size *= 2;
+		if ((counts = calloc(size, sizeof(*counts))) == NULL)
+			break;
+		for (i = 0; i < n; i++)
+			counts[hashes[i] % size]++;
+		expect = (double)n / size;
+		chi2 = 0;
+		maxchain = used = 0;
+		for (i = 0; i < size; i++) {
+			chi2 += (counts[i] - expect) * (counts[i] - expect) / expect;
+			if (counts[i] > maxchain)
+				maxchain = counts[i];
+			if (counts[i])
+				used++;
+		}
+		free(counts);
+		result("do_hash", n, ns, 0,
+		       "\"keys\": \"%s\", \"n\": %u, \"buckets\": %u, "
+		       "\"used_buckets\": %u, \"max_chain\": %u, "
+		       "\"mean_chain\": %.2f, \"chi2_ratio\": %.2f",
+		       keyname[kind], n, size, used, maxchain, expect,
+		       chi2 / (size - 1));
+	}
+
+	qsort(hashes, n, sizeof(*hashes), cmp_u32);
+	for (i = distinct = 0; i < n; i++) {
+		if (i == 0 || hashes[i] != hashes[i - 1])
+			distinct++;
+	}
+	result("do_hash_distinct", n, 0, 0,
+	       "\"keys\": \"%s\", \"n\": %u, \"distinct\": %u",
+	       keyname[kind], n, distinct);
+	free(hashes);
+}
+
+static struct dhcp6_timer *
+bench_timo(arg)
+	void *arg;
+{
+	dhcp6_remove_timer((struct dhcp6_timer *)arg);
+	return NULL;
+}
+
+static void
+bench_timers(n)
+	u_int32_t n;
+{
+	struct dhcp6_timer **timers, *tm;
+	struct timeval timo;
+	u_int64_t start, ns;
+	u_int32_t i;
+	int checks = 10, c;
+
+	if ((timers = malloc(n * sizeof(*timers))) == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory for %u timers\n", n);
+		return;
+	}
+	dhcp6_timer_init();
+
+	/* lease timers: one to two hours out, so none expire */
+	start = bench_now();
+	for (i = 0; i < n; i++) {
+		tm = timers[i] = dhcp6_add_timer(bench_timo, NULL);
+		tm->expire_data = tm;
+		timo.tv_sec = 3600 + rnd() % 3600;
+		timo.tv_usec = rnd() % 1000000;
+		dhcp6_set_timer(&timo, tm);
+	}
+	ns = bench_now() - start;
+	result("dhcp6_add_timer", n, ns, 0, "\"timers\": %u", n);
+
+	start = bench_now();
+	for (c = 0; c < checks; c++)
+		dhcp6_check_timer();
+	ns = bench_now() - start;
+	result("dhcp6_check_timer", checks, ns, 0,
+	       "\"timers\": %u, \"expiring\": 0", n);
+
+	/* a tenth of them rearmed, as renewals would */
+	start = bench_now();
+	for (i = 0; i < n / 10; i++) {
+		timo.tv_sec = 3600 + rnd() % 3600;
+		timo.tv_usec = 0;
+		dhcp6_set_timer(&timo, timers[rnd() % n]);
+	}
+	ns = bench_now() - start;
+	result("dhcp6_set_timer", n / 10, ns, 0, "\"timers\": %u", n);
+
+	/* everything due at once: the expiry pass, then the pass that frees */
+	timo.tv_sec = timo.tv_usec = 0;
+	for (i = 0; i < n; i++)
+		dhcp6_set_timer(&timo, timers[i]);
+	start = bench_now();
+	dhcp6_check_timer();
+	dhcp6_check_timer();
+	ns = bench_now() - start;
+	result("dhcp6_check_timer", n, ns, 0,
+	       "\"timers\": %u, \"expiring\": %u", n, n);
+
+	free(timers);
+}
+
+#define CORPUS_MAX	32
+
+struct corpus_msg {
+	const char *name;
+	char buf[1024];
+	int len;
+};
+
+static void
+bench_codec(iters)
+	u_int32_t iters;
+{
+	static struct corpus_msg corpus[CORPUS_MAX];
+	struct dhcp6_optinfo templates[5], optinfo;
+	static const char *tname[] = { "solicit", "advertise", "reply",
+				       "reply-pd", "reply-noaddr" };
+	struct dhcp6_addr addr6;
+	struct domain_list *dl;
+	struct in6_addr dns;
+	char cid[16], sid[16], *bp, *ep;
+	int ncorpus = 0, i, opt;
+	u_int32_t n;
+	u_int64_t start, ns, bytes = 0;
+
+	for (i = 0; i < 5; i++) {
+		struct dhcp6_optinfo *t = &templates[i];
+
+		dhcp6_init_options(t);
+		t->clientID.duid_len = make_duid(DUID_LLT, i, cid);
+		t->clientID.duid_id = cid;
+		t->type = IANA;
+		t->iaidinfo.iaid = 1;
+		t->iaidinfo.renewtime = 1800;
+		t->iaidinfo.rebindtime = 2880;
+		if (i == 0) {
+			/* what a client sends, as far as the server codec goes */
+			t->flags |= DHCIFF_RAPID_COMMIT;
+			t->ia_stcode = DH6OPT_STCODE_NOADDRAVAIL;
+			for (opt = DH6OPT_DNS_SERVERS; opt <= DH6OPT_DOMAIN_LIST;
+			     opt++)
+				dhcp6_add_listval(&t->reqopt_list, &opt,
+						  DHCP6_LISTVAL_NUM);
+			continue;
+		}
+		t->serverID.duid_len = make_duid(DUID_LL, 0, sid);
+		t->serverID.duid_id = sid;
+		if (i == 4) {
+			t->ia_stcode = DH6OPT_STCODE_NOADDRAVAIL;
+			continue;
+		}
+		memset(&addr6, 0, sizeof(addr6));
+		make_addr(ADDR_POOL, i, &addr6.addr);
+		addr6.preferlifetime = 3600;
+		addr6.validlifetime = 7200;
+		addr6.status_code = DH6OPT_STCODE_SUCCESS;
+		if (i == 3) {
+			t->type = IAPD;
+			addr6.plen = 56;
+		}
+		dhcp6_add_listval(&t->addr_list, &addr6, DHCP6_LISTVAL_DHCP6ADDR);
+		if (i == 1)
+			t->pref = 255;
+		if (i >= 2) {
+			make_addr(ADDR_POOL, 0xffff, &dns);
+			dhcp6_add_listval(&t->dns_list.addrlist, &dns,
+					  DHCP6_LISTVAL_ADDR6);
+			make_addr(ADDR_POOL, 0xfffe, &dns);
+			dhcp6_add_listval(&t->dns_list.addrlist, &dns,
+					  DHCP6_LISTVAL_ADDR6);
+			if ((dl = calloc(1, sizeof(*dl))) != NULL) {
+				strcpy(dl->name, "example.net");
+				t->dns_list.domainlist = dl;
+			}
+		}
+	}
+
+	/* encode */
+	for (i = 0; i < 5; i++) {
+		struct corpus_msg *m = &corpus[ncorpus++];
+
+		m->name = tname[i];
+		start = bench_now();
+		for (n = 0; n < iters; n++) {
+			m->len = dhcp6_set_options((struct dhcp6opt *)m->buf,
+						   (struct dhcp6opt *)(m->buf +
+						   sizeof(m->buf)), &templates[i]);
+		}
+		ns = bench_now() - start;
+		result("dhcp6_set_options", iters, ns, 0,
+		       "\"msg\": \"%s\", \"bytes\": %d", m->name, m->len);
+	}
+
+	/* raw option payloads, e.g. cut out of a capture */
+	for (i = 0; i < ncorpus_files && ncorpus < CORPUS_MAX; i++) {
+		struct corpus_msg *m = &corpus[ncorpus];
+		FILE *fp;
+
+		if ((fp = fopen(corpus_files[i], "r")) == NULL) {
+			fprintf(stderr, "dhcp6bench: cannot open %s\n",
+				corpus_files[i]);
+			continue;
+		}
+		/* skip the message type and transaction ID */
+		m->len = fread(m->buf, 1, sizeof(m->buf), fp);
+		fclose(fp);
+		if (m->len <= sizeof(struct dhcp6))
+			continue;
+		m->len -= sizeof(struct dhcp6);
+		memmove(m->buf, m->buf + sizeof(struct dhcp6), m->len);
+		m->name = corpus_files[i];
+		ncorpus++;
+	}
+
+	/* decode, with the allocations a received message costs */
+	for (i = 0; i < ncorpus; i++) {
+		struct corpus_msg *m = &corpus[i];
+		int error = 0;
+
+		bp = m->buf;
+		ep = m->buf + m->len;
+		start = bench_now();
+		for (n = 0; n < iters; n++) {
+			dhcp6_init_options(&optinfo);
+			if (dhcp6_get_options((struct dhcp6opt *)bp,
+					      (struct dhcp6opt *)ep, &optinfo) < 0)
+				error = 1;
+			dhcp6_clear_options(&optinfo);
+		}
+		ns = bench_now() - start;
+		bytes += m->len;
+		if (error)
+			fprintf(stderr, "dhcp6bench: %s does not parse\n", m->name);
+		result("dhcp6_get_options", iters, ns, 0,
+		       "\"msg\": \"%s\", \"bytes\": %d", m->name, m->len);
+	}
+}
+
+/*
+ * server6_get_newaddr() walks the segment from seg->free and probes the
+ * lease and host tables for each candidate, so its cost grows with how
+ * full the segment is.  The leases are spread at random over it.
+ */
+static void
+bench_newaddr(fill)
+	int fill;
+{
+	struct v6addrseg seg;
+	struct dhcp6_lease *leases;
+	struct dhcp6_addr v6addr;
+	u_int32_t i, j, nleases, ops;
+	u_int64_t start, ns;
+	int truncated = 0;
+
+	nleases = (u_int64_t)segsize * fill / 100;
+	if ((leases = calloc(nleases ? nleases : 1, sizeof(*leases))) == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory for %u leases\n", nleases);
+		return;
+	}
+	memset(&seg, 0, sizeof(seg));
+	make_addr(ADDR_POOL, 0, &seg.min);
+	make_addr(ADDR_POOL, segsize - 1, &seg.max);
+	seg.free = seg.min;
+	seg.prefix.addr = seg.min;
+	memset(&seg.prefix.addr.s6_addr[8], 0, 8);
+	seg.prefix.plen = 64;
+	seg.parainfo.prefer_life_time = 3600;
+	seg.parainfo.valid_life_time = 7200;
+
+	lease_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+					     lease_findkey, lease_key_compare);
+	host_addr_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+						 v6addr_findkey, v6addr_key_compare);
+
+	/* a partial Fisher-Yates shuffle picks which addresses are leased */
+	{
+		u_int32_t *perm;
+
+		if ((perm = malloc(segsize * sizeof(*perm))) == NULL) {
+			free(leases);
+			return;
+		}
+		for (i = 0; i < segsize; i++)
+			perm[i] = i;
+		for (i = 0; i < nleases; i++) {
+			u_int32_t t;
+
+			j = i + rnd() % (segsize - i);
+			t = perm[i];
+			perm[i] = perm[j];
+			perm[j] = t;
+			make_addr(ADDR_POOL, perm[i], &leases[i].lease_addr.addr);
+			leases[i].lease_addr.type = IANA;
+			hash_add(lease_hash_table, &leases[i].lease_addr,
+				 &leases[i]);
+		}
+		free(perm);
+	}
+
+	/* the segment is never exhausted, so every call finds an address */
+	ops = segsize - nleases;
+	if (ops > 10000)
+		ops = 10000;
+	start = bench_now();
+	for (i = 0; i < ops; i++) {
+		if (OVER_BUDGET(start, i, 0)) {
+			truncated = 1;
+			break;
+		}
+		memset(&v6addr, 0, sizeof(v6addr));
+		server6_get_newaddr(IANA, &v6addr, &seg);
+	}
+	ns = bench_now() - start;
+	result("server6_get_newaddr", i, ns, truncated,
+	       "\"segment\": %u, \"fill_pct\": %d", segsize, fill);
+
+	hash_free(lease_hash_table);
+	hash_free(host_addr_hash_table);
+	lease_hash_table = host_addr_hash_table = NULL;
+	free(leases);
+}
+
+/* n server leases, each with its own binding, in a fresh lease table */
+static struct dhcp6_lease *
+make_leases(n)
+	u_int32_t n;
+{
+	struct dhcp6_lease *leases;
+	struct dhcp6_iaidaddr *iaidaddrs;
+	char duid[16];
+	time_t now = time(NULL);
+	u_int32_t i;
+	int len;
+
+	leases = calloc(n, sizeof(*leases));
+	iaidaddrs = calloc(n, sizeof(*iaidaddrs));
+	if (leases == NULL || iaidaddrs == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory for %u leases\n", n);
+		free(leases);
+		free(iaidaddrs);
+		return NULL;
+	}
+	lease_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+					     lease_findkey, lease_key_compare);
+	for (i = 0; i < n; i++) {
+		struct dhcp6_iaidaddr *ia = &iaidaddrs[i];
+		struct dhcp6_lease *l = &leases[i];
+
+		len = make_duid(DUID_LLT, i, duid);
+		ia->client6_info.clientid.duid_len = len;
+		if ((ia->client6_info.clientid.duid_id = malloc(len)) == NULL)
+			exit(1);
+		memcpy(ia->client6_info.clientid.duid_id, duid, len);
+		ia->client6_info.type = IANA;
+		ia->client6_info.iaidinfo.iaid = i + 1;
+		ia->client6_info.iaidinfo.renewtime = 1800;
+		ia->client6_info.iaidinfo.rebindtime = 2880;
+		TAILQ_INIT(&ia->lease_list);
+
+		make_addr(ADDR_RANDOM, i, &l->lease_addr.addr);
+		l->lease_addr.plen = 64;
+		l->lease_addr.type = IANA;
+		l->lease_addr.preferlifetime = 3600;
+		l->lease_addr.validlifetime = 7200;
+		snprintf(l->hostname, sizeof(l->hostname), "cpe%u", i);
+		l->state = ACTIVE;
+		l->start_date = now;
+		l->iaidaddr = ia;
+		TAILQ_INSERT_TAIL(&ia->lease_list, l, link);
+		hash_add(lease_hash_table, &l->lease_addr, l);
+	}
+	return leases;
+}
+
+static void
+bench_leases(n)
+	u_int32_t n;
+{
+	struct dhcp6_lease *leases;
+	char path[MAXPATHLEN], template[MAXPATHLEN];
+	u_int64_t start, ns;
+	u_int32_t i;
+	FILE *file;
+	int truncated = 0;
+
+	if ((leases = make_leases(n)) == NULL)
+		return;
+	snprintf(path, sizeof(path), "%s/dhcp6bench.leases", tmpdir);
+
+	/* one lease per committed binding, as dhcp6s writes them */
+	if ((file = fopen(path, "w")) == NULL) {
+		fprintf(stderr, "dhcp6bench: cannot create %s: %s\n", path,
+			strerror(errno));
+		exit(1);
+	}
+	start = bench_now();
+	for (i = 0; i < n; i++) {
+		if (OVER_BUDGET(start, i, 0)) {
+			truncated = 1;
+			break;
+		}
+		write_lease(&leases[i], file);
+	}
+	ns = bench_now() - start;
+	result("write_lease", i, ns, truncated, "\"leases\": %u, \"dir\": \"%s\"",
+	       n, tmpdir);
+
+	/* compaction of the whole table */
+	snprintf(template, sizeof(template), "%s/dhcp6bench.leasesXXXXXX", tmpdir);
+	start = bench_now();
+	file = sync_leases(file, path, template, NULL);
+	ns = bench_now() - start;
+	result("sync_leases", n, ns, 0, "\"leases\": %u, \"dir\": \"%s\"",
+	       n, tmpdir);
+	if (file == NULL) {
+		fprintf(stderr, "dhcp6bench: sync_leases failed\n");
+		exit(1);
+	}
+	hash_free(lease_hash_table);
+
+	/* start-up: parsing the compacted file back into fresh tables */
+	lease_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+					     lease_findkey, lease_key_compare);
+	server6_hash_table = hash_table_create(DEFAULT_HASH_SIZE, iaid_hash,
+					       iaid_findkey, iaid_key_compare);
+	host_addr_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+						 v6addr_findkey, v6addr_key_compare);
+	dhcp6_timer_init();
+	start = bench_now();
+	lease_parse(file, NULL);
+	ns = bench_now() - start;
+	result("lease_parse", n, ns, 0, "\"leases\": %u, \"loaded\": %u",
+	       n, lease_hash_table->hash_count);
+
+	fclose(file);
+	unlink(path);
+	/* the parsed bindings and leases stay; this is the last user */
+	free(leases);
+}
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	static const u_int32_t hash_sizes[] = { 10000, 100000, 1000000, 10000000 };
+	static const int fills[] = { 0, 50, 99 };
+	char *outfile = NULL, *label = NULL;
+	int ch, i, kind, nhash;
+
+	while ((ch = getopt(argc, argv, "b:d:l:o:p:qs:")) != -1) {
+		switch (ch) {
+		case 'b':
+			budget = (u_int64_t)(atof(optarg) * 1e9);
+			break;
+		case 'd':
+			tmpdir = optarg;
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		case 'o':
+			outfile = optarg;
+			break;
+		case 'p':
+			if (ncorpus_files == sizeof(corpus_files) /
+			    sizeof(corpus_files[0]))
+				usage();
+			corpus_files[ncorpus_files++] = optarg;
+			break;
+		case 'q':
+			quick = 1;
+			break;
+		case 's':
+			segsize = strtoul(optarg, NULL, 10);
+			if (segsize < 2)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	foreground = 1;
+	setloglevel(0);
+	/* dprintf hands what is below the threshold to syslog */
+	setlogmask(LOG_UPTO(LOG_ERR));
+
+	hash_anchors = calloc(HASH_TABLE_COUNT, sizeof(*hash_anchors));
+	if (hash_anchors == NULL) {
+		fprintf(stderr, "dhcp6bench: no memory\n");
+		exit(1);
+	}
+
+	out = stdout;
+	if (outfile && (out = fopen(outfile, "w")) == NULL) {
+		fprintf(stderr, "dhcp6bench: cannot create %s: %s\n", outfile,
+			strerror(errno));
+		exit(1);
+	}
+	fprintf(out, "{\n  \"suite\": \"dhcp6bench\",\n");
+	if (label)
+		fprintf(out, "  \"label\": \"%s\",\n", label);
+	fprintf(out, "  \"time\": %ld,\n  \"quick\": %s,\n  \"results\": [",
+		(long)time(NULL), quick ? "true" : "false");
+
+	nhash = quick ? 2 : 4;
+	/* a key set that cannot fill a table in budget will not fill a bigger one */
+	for (kind = ADDR_POOL; kind <= ADDR_RANDOM; kind++) {
+		for (i = 0; i < nhash; i++) {
+			if (bench_hash(kind, hash_sizes[i]))
+				break;
+		}
+	}
+	for (kind = ADDR_POOL; kind <= DUID_EN; kind++)
+		bench_do_hash(kind, quick ? 100000 : 1000000);
+	bench_timers(quick ? 100000 : 1000000);
+	bench_codec(quick ? 10000 : 100000);
+	for (i = 0; i < sizeof(fills) / sizeof(fills[0]); i++)
+		bench_newaddr(fills[i]);
+	bench_leases(quick ? 10000 : 100000);
+
+	fprintf(out, "\n  ]\n}\n");
+	if (out != stdout)
+		fclose(out);
+	exit(0);
+}
+
+static void
+usage()
+{
+	fprintf(stderr,
+		"Usage: dhcp6bench [-q] [-b budget-seconds] [-d lease-dir] "
+		"[-l label]\n"
+		"                  [-o output.json] [-p packet-file]... "
+		"[-s segment-size]\n");
+	exit(1);
+}
@@ -35,6 +35,8 @@
 #include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #include <unistd.h>
 #include <errno.h>
 #if TIME_WITH_SYS_TIME
@@ -89,11 +91,14 @@ static u_long sig_flags = 0;
 
 const dhcp6_mode_t dhcp6_mode = DHCP6_MODE_CLIENT;
 
-static char *device = NULL;
+static char *device = NULL;	/* the DUID is derived from this one */
 static int num_device = 0;
-static struct iaid_table iaidtab[100];
-static u_int8_t client6_request_flag = 0;
-static	char leasename[100];
+static struct iaid_table iaidtab[MAX_DEVICE];
+/* requests from the command line, each interface starts with a copy */
+static u_int8_t cmd_request_flag = 0;
+static struct dhcp6_list cmd_request_list;
+/* -F: spread the first transmission over this many msec */
+static long fast_start_delay = 0;
 
 #define CLIENT6_RELEASE_ADDR	0x1
 #define CLIENT6_CONFIRM_ADDR	0x2
@@ -101,26 +106,27 @@ static	char leasename[100];
 #define CLIENT6_DECLINE_ADDR	0x8
 
 #define CLIENT6_INFO_REQ	0x10
+#define CLIENT6_FAST_START	0x20
 
-int insock;	/* inbound udp port */
-int outsock;	/* outbound udp port */
+int insock;	/* inbound udp port, shared by all interfaces */
 int nlsock;	
+int rtnlsock = -1;	/* rtnetlink link and address monitor */
 
 extern char *raproc_file;
 extern char *ifproc_file;
 extern struct ifproc_info *dadlist;
-extern FILE *client6_lease_file;
-extern struct dhcp6_iaidaddr client6_iaidaddr;
-FILE *dhcp6_resolv_file;
 static const struct sockaddr_in6 *sa6_allagent;
 static struct duid client_duid;
 
 static void usage __P((void));
-static void client6_init __P((char *));
-static void client6_ifinit __P((char *));
+static void client6_init __P((void));
+static void client6_outsock __P((struct dhcp6_if *));
+static void client6_ifinit __P((struct dhcp6_if *));
+static int client6_sync_leases __P((struct dhcp6_if *));
 void free_servers __P((struct dhcp6_if *));
 static void free_resources __P((struct dhcp6_if *));
-static int create_request_list __P((int));
+static int create_request_list __P((struct dhcp6_if *, int));
+static void client6_addr_ready __P((struct dhcp6_if *, const char *));
 static void client6_mainloop __P((void));
 static void process_signals __P((void));
 static struct dhcp6_serverinfo *find_server __P((struct dhcp6_if *,
@@ -140,30 +146,31 @@ static struct dhcp6_event *find_event_withid __P((struct dhcp6_if *,
 static struct dhcp6_timer *check_lease_file_timo __P((void *));
 static struct dhcp6_timer *check_link_timo __P((void *));
 static struct dhcp6_timer *check_dad_timo __P((void *));
+static void client6_link_change __P((struct dhcp6_if *, int));
+static int client6_dad_failed __P((struct dhcp6_if *, struct in6_addr *));
+static int client6_rtnl_event __P((struct nlmsghdr *, void *));
+static void client6_addr_deleted __P((struct dhcp6_if *, struct in6_addr *));
 static void setup_check_timer __P((struct dhcp6_if *));
 static void setup_interface __P((char *));
 struct dhcp6_timer *client6_timo __P((void *));
-extern int client6_ifaddrconf __P((ifaddrconf_cmd_t, struct dhcp6_addr *));
 extern struct dhcp6_timer *syncfile_timo __P((void *));
-extern int radvd_parse (struct dhcp6_iaidaddr *, int);
 
 #define DHCP6C_CONF "/etc/dhcp6c.conf"
 #define DHCP6C_PIDFILE "/var/run/dhcpv6/dhcp6c.pid"
 #define DUID_FILE "/var/lib/dhcpv6/dhcp6c_duid"
 
 static int pid;
-char client6_lease_temp[256];
-struct dhcp6_list request_list;
 
 int
 main(argc, argv)
 	int argc;
 	char **argv;
 {
-	int ch;
+	int ch, i;
 	char *progname, *conffile = DHCP6C_CONF;
 	FILE *pidfp;
 	char *addr;
+	struct dhcp6_if *ifp;
 
 	pid = getpid();
 	srandom(time(NULL) & pid);
@@ -173,14 +180,14 @@ main(argc, argv)
 	else
 		progname++;
 
-	TAILQ_INIT(&request_list);
-	while ((ch = getopt(argc, argv, "c:r:R:P:dDfI")) != -1) {
+	TAILQ_INIT(&cmd_request_list);
+	while ((ch = getopt(argc, argv, "c:r:R:P:dDfF:I")) != -1) {
 		switch (ch) {
 		case 'c':
 			conffile = optarg;
 			break;
 		case 'P':
-			client6_request_flag |= CLIENT6_REQUEST_ADDR;
+			cmd_request_flag |= CLIENT6_REQUEST_ADDR;
 			for (addr = strtok(optarg, " "); addr; addr = strtok(NULL, " ")) {
 				struct dhcp6_listval *lv;
 				if ((lv = (struct dhcp6_listval *)malloc(sizeof(*lv)))
@@ -199,12 +206,12 @@ main(argc, argv)
 				lv->val_dhcp6addr.type = IAPD;
 				lv->val_dhcp6addr.plen = atoi(strtok(NULL, "/"));
 				lv->val_dhcp6addr.status_code = DH6OPT_STCODE_UNDEFINE;
-				TAILQ_INSERT_TAIL(&request_list, lv, link);
+				TAILQ_INSERT_TAIL(&cmd_request_list, lv, link);
 			} 
 			break;
 
 		case 'R':
-			client6_request_flag |= CLIENT6_REQUEST_ADDR;
+			cmd_request_flag |= CLIENT6_REQUEST_ADDR;
 			for (addr = strtok(optarg, " "); addr; addr = strtok(NULL, " ")) {
 				struct dhcp6_listval *lv;
 				if ((lv = (struct dhcp6_listval *)malloc(sizeof(*lv)))
@@ -221,11 +228,11 @@ main(argc, argv)
 				}
 				lv->val_dhcp6addr.type = IANA;
 				lv->val_dhcp6addr.status_code = DH6OPT_STCODE_UNDEFINE;
-				TAILQ_INSERT_TAIL(&request_list, lv, link);
+				TAILQ_INSERT_TAIL(&cmd_request_list, lv, link);
 			} 
 			break;
 		case 'r':
-			client6_request_flag |= CLIENT6_RELEASE_ADDR;
+			cmd_request_flag |= CLIENT6_RELEASE_ADDR;
 			if (strcmp(optarg, "all")) {
 				for (addr = strtok(optarg, " "); addr; 
 				     addr = strtok(NULL, " ")) {
@@ -244,12 +251,12 @@ main(argc, argv)
 						exit(1);
 					}
 					lv->val_dhcp6addr.type = IANA;
-					TAILQ_INSERT_TAIL(&request_list, lv, link);
+					TAILQ_INSERT_TAIL(&cmd_request_list, lv, link);
 				}
 			} 
 			break;
 		case 'I':
-			client6_request_flag |= CLIENT6_INFO_REQ;
+			cmd_request_flag |= CLIENT6_INFO_REQ;
 			break;
 		case 'd':
 			debug = 1;
@@ -260,6 +267,14 @@ main(argc, argv)
 		case 'f':
 			foreground++;
 			break;
+		case 'F':
+			cmd_request_flag |= CLIENT6_FAST_START;
+			fast_start_delay = strtol(optarg, NULL, 10) * 1000;
+			if (fast_start_delay < 0) {
+				usage();
+				exit(0);
+			}
+			break;
 		default:
 			usage();
 			exit(0);
@@ -268,7 +283,13 @@ main(argc, argv)
 	argc -= optind;
 	argv += optind;
 
-	if (argc != 1) {
+	if (argc < 1) {
+		usage();
+		exit(0);
+	}
+	/* addresses given on the command line are of a single interface */
+	if (argc > 1 &&
+	    (cmd_request_flag & ~(CLIENT6_INFO_REQ | CLIENT6_FAST_START))) {
 		usage();
 		exit(0);
 	}
@@ -287,15 +308,17 @@ main(argc, argv)
 		fclose(pidfp);
 	}
 
-	ifinit(device);
+	for (i = 0; i < argc; i++)
+		ifinit(argv[i]);
 
 	if ((cfparse(conffile)) != 0) {
 		dprintf(LOG_ERR, "%s" "failed to parse configuration file",
 			FNAME);
 		exit(1);
 	}
-	client6_init(device);
-	client6_ifinit(device);
+	client6_init();
+	for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+		client6_ifinit(ifp);
 	client6_mainloop();
 	exit(0);
 }
@@ -306,51 +329,40 @@ usage()
 
 	fprintf(stderr, 
 	"usage: dhcpc [-c configfile] [-r all or (ipv6address ipv6address...)]\n"
-	"       [-R (ipv6 address ipv6address...) [-dDIf] interface\n");
+	"       [-R (ipv6 address ipv6address...) [-dDIf] interface\n"
+	"       dhcpc [-c configfile] [-F maxdelay] [-dDIf] interface "
+	"[interface ...]\n");
 }
 
 /*------------------------------------------------------------*/
 
 void
-client6_init(device)
-	char *device;
+client6_init()
 {
 	struct addrinfo hints, *res;
 	static struct sockaddr_in6 sa6_allagent_storage;
 	int error, on = 1;
 	struct dhcp6_if *ifp;
-	int ifidx;
-	char linklocal[64];
-	struct in6_addr lladdr;
-	
-	ifidx = if_nametoindex(device);
-	if (ifidx == 0) {
-		dprintf(LOG_ERR, "if_nametoindex(%s)", device);
-		exit(1);
-	}
 
 	/* get our DUID */
 	if (get_duid(DUID_FILE, device, &client_duid)) {
 		dprintf(LOG_ERR, "%s" "failed to get a DUID", FNAME);
 		exit(1);
 	}
-	if (get_linklocal(device, &lladdr) < 0) {
-		exit(1);
-	}
-	if (inet_ntop(AF_INET6, &lladdr, linklocal, sizeof(linklocal)) < 0) {
-		exit(1);
-	}
-	dprintf(LOG_DEBUG, "link local addr is %s", linklocal);
-	
+
+	/* 
+	 * one inbound socket serves all the interfaces, the receiving
+	 * interface is told by the packet info
+	 */
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = PF_INET6;
 	hints.ai_socktype = SOCK_DGRAM;
 	hints.ai_protocol = IPPROTO_UDP;
-	hints.ai_flags = 0;
-	error = getaddrinfo(linklocal, DH6PORT_DOWNSTREAM, &hints, &res);
+	hints.ai_flags = AI_PASSIVE;
+	error = getaddrinfo(NULL, DH6PORT_DOWNSTREAM, &hints, &res);
 	if (error) {
 		dprintf(LOG_ERR, "%s" "getaddrinfo: %s",
-			FNAME, strerror(error));
+			FNAME, gai_strerror(error));
 		exit(1);
 	}
 	insock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
@@ -375,8 +387,6 @@ client6_init(device)
 		exit(1);
 	}
 #endif
-	((struct sockaddr_in6 *)(res->ai_addr))->sin6_scope_id = ifidx;
-	dprintf(LOG_DEBUG, "res addr is %s/%d", addr2str(res->ai_addr), res->ai_addrlen);
 	if (bind(insock, res->ai_addr, res->ai_addrlen) < 0) {
 		dprintf(LOG_ERR, "%s" "bind(inbound): %s",
 			FNAME, strerror(errno));
@@ -384,33 +394,6 @@ client6_init(device)
 	}
 	freeaddrinfo(res);
 
-	hints.ai_flags = 0;
-	error = getaddrinfo(linklocal, DH6PORT_UPSTREAM, &hints, &res);
-	if (error) {
-		dprintf(LOG_ERR, "%s" "getaddrinfo: %s",
-			FNAME, gai_strerror(error));
-		exit(1);
-	}
-	outsock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
-	if (outsock < 0) {
-		dprintf(LOG_ERR, "%s" "socket(outbound): %s",
-			FNAME, strerror(errno));
-		exit(1);
-	}
-	if (setsockopt(outsock, IPPROTO_IPV6, IPV6_MULTICAST_IF,
-			&ifidx, sizeof(ifidx)) < 0) {
-		dprintf(LOG_ERR, "%s"
-			"setsockopt(outbound, IPV6_MULTICAST_IF): %s",
-			FNAME, strerror(errno));
-		exit(1);
-	}
-	((struct sockaddr_in6 *)(res->ai_addr))->sin6_scope_id = ifidx;
-	if (bind(outsock, res->ai_addr, res->ai_addrlen) < 0) {
-		dprintf(LOG_ERR, "%s" "bind(outbound): %s",
-			FNAME, strerror(errno));
-		exit(1);
-	}
-	freeaddrinfo(res);
 	/* open a socket to watch the off-on link for confirm messages */
 	if ((nlsock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) {
 		dprintf(LOG_ERR, "%s" "open a socket: %s",
@@ -430,14 +413,15 @@ client6_init(device)
 	memcpy(&sa6_allagent_storage, res->ai_addr, res->ai_addrlen);
 	sa6_allagent = (const struct sockaddr_in6 *)&sa6_allagent_storage;
 	freeaddrinfo(res);
+	/* link state and DAD results are reported by the kernel, the
+	 * link and DAD timers are only used when that is not available */
+	if ((rtnlsock = netlink_open_monitor(RTMGRP_LINK |
+	    RTMGRP_IPV6_IFADDR)) < 0)
+		dprintf(LOG_WARNING, "%s" "falling back to link polling", FNAME);
 
 	/* client interface configuration */
-	if ((ifp = find_ifconfbyname(device)) == NULL) {
-		dprintf(LOG_ERR, "%s" "interface %s not configured",
-			FNAME, device);
-		exit(1);
-	}
-	ifp->outsock = outsock;
+	for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+		client6_outsock(ifp);
 
 	if (signal(SIGHUP, client6_signal) == SIG_ERR) {
 		dprintf(LOG_WARNING, "%s" "failed to set signal: %s",
@@ -456,18 +440,64 @@ client6_init(device)
 	}
 }
 
+/* each interface sends from its own link-local address */
 static void
-client6_ifinit(char *device)
+client6_outsock(ifp)
+	struct dhcp6_if *ifp;
+{
+	struct addrinfo hints, *res;
+	int error;
+
+	dprintf(LOG_DEBUG, "link local addr of %s is %s", ifp->ifname,
+		in6addr2str(&ifp->linklocal, 0));
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_INET6;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	error = getaddrinfo(in6addr2str(&ifp->linklocal, 0), DH6PORT_UPSTREAM,
+			    &hints, &res);
+	if (error) {
+		dprintf(LOG_ERR, "%s" "getaddrinfo: %s",
+			FNAME, gai_strerror(error));
+		exit(1);
+	}
+	ifp->outsock = socket(res->ai_family, res->ai_socktype,
+			      res->ai_protocol);
+	if (ifp->outsock < 0) {
+		dprintf(LOG_ERR, "%s" "socket(outbound): %s",
+			FNAME, strerror(errno));
+		exit(1);
+	}
+	if (setsockopt(ifp->outsock, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+			&ifp->ifid, sizeof(ifp->ifid)) < 0) {
+		dprintf(LOG_ERR, "%s"
+			"setsockopt(outbound, IPV6_MULTICAST_IF): %s",
+			FNAME, strerror(errno));
+		exit(1);
+	}
+	((struct sockaddr_in6 *)(res->ai_addr))->sin6_scope_id = ifp->ifid;
+	if (bind(ifp->outsock, res->ai_addr, res->ai_addrlen) < 0) {
+		dprintf(LOG_ERR, "%s" "bind(outbound) on %s: %s",
+			FNAME, ifp->ifname, strerror(errno));
+		exit(1);
+	}
+	freeaddrinfo(res);
+}
+
+static void
+client6_ifinit(ifp)
+	struct dhcp6_if *ifp;
 {
-	struct dhcp6_if *ifp = dhcp6_if;
 	struct dhcp6_event *ev;
-	char iaidstr[20];
+	char leasename[256];
 
-	dhcp6_init_iaidaddr();
-	/* get iaid for each interface */
-	if (num_device == 0) {
-		if ((num_device = create_iaid(&iaidtab[0], num_device)) < 0)
-			exit(1);
+	if (client6_init_iaidaddr(ifp) < 0)
+		exit(1);
+	/* get iaid for each interface, unless it is configured */
+	if (num_device == 0 &&
+	    (num_device = create_iaid(&iaidtab[0], num_device)) < 0)
+		exit(1);
+	if (ifp->iaidinfo.iaid == 0) {
 		ifp->iaidinfo.iaid = get_iaid(ifp->ifname, &iaidtab[0], num_device);
 		if (ifp->iaidinfo.iaid == 0) {
 			dprintf(LOG_DEBUG, "%s" 
@@ -478,37 +508,48 @@ client6_ifinit(char *device)
 		dprintf(LOG_DEBUG, "%s" "interface %s iaid is %u", 
 			FNAME, ifp->ifname, ifp->iaidinfo.iaid);
 	}
-	client6_iaidaddr.ifp = ifp;
-	memcpy(&client6_iaidaddr.client6_info.iaidinfo, &ifp->iaidinfo, 
-			sizeof(client6_iaidaddr.client6_info.iaidinfo));
-	duidcpy(&client6_iaidaddr.client6_info.clientid, &client_duid);
-	/* parse the lease file */
-	strcpy(leasename, PATH_CLIENT6_LEASE);
-	sprintf(iaidstr, "%u", ifp->iaidinfo.iaid);
-	strcat(leasename, iaidstr);
-	if ((client6_lease_file = 
-		init_leases(leasename)) == NULL) {
+	memcpy(&ifp->iaidaddr->client6_info.iaidinfo, &ifp->iaidinfo, 
+			sizeof(ifp->iaidaddr->client6_info.iaidinfo));
+	duidcpy(&ifp->iaidaddr->client6_info.clientid, &client_duid);
+	ifp->request_flag = cmd_request_flag;
+	ifp->conf_start = dhcp6_now();
+	/* a fast start asks for the addresses in two messages */
+	if (ifp->request_flag & CLIENT6_FAST_START)
+		ifp->send_flags |= DHCIFF_RAPID_COMMIT;
+	TAILQ_INIT(&ifp->request_list);
+	if (dhcp6_copy_list(&ifp->request_list, &cmd_request_list)) {
+		dprintf(LOG_ERR, "%s" "failed to copy the request list", FNAME);
+		exit(1);
+	}
+	TAILQ_INIT(&ifp->dnslist.addrlist);
+	ifp->dnslist.domainlist = NULL;
+	/* parse the lease file of the interface */
+	snprintf(leasename, sizeof(leasename), "%s%u", PATH_CLIENT6_LEASE,
+		 ifp->iaidinfo.iaid);
+	if (ifp->lease_name == NULL &&
+	    (ifp->lease_name = strdup(leasename)) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		exit(1);
+	}
+	if ((ifp->lease_file = 
+		init_leases(ifp->lease_name, ifp->iaidaddr)) == NULL) {
 			dprintf(LOG_ERR, "%s" "failed to parse lease file", FNAME);
 		exit(1);
 	}
-	strcpy(client6_lease_temp, leasename);
-	strcat(client6_lease_temp, "XXXXXX");
-	client6_lease_file = 
-		sync_leases(client6_lease_file, leasename, client6_lease_temp);
-	if (client6_lease_file == NULL)
+	if (client6_sync_leases(ifp) < 0)
 		exit(1);
-	if (!TAILQ_EMPTY(&client6_iaidaddr.lease_list)) {
+	if (!TAILQ_EMPTY(&ifp->iaidaddr->lease_list)) {
 		struct dhcp6_listval *lv;
-		if (!(client6_request_flag & CLIENT6_REQUEST_ADDR) && 
-				!(client6_request_flag & CLIENT6_RELEASE_ADDR))
-			client6_request_flag |= CLIENT6_CONFIRM_ADDR;
-		if (TAILQ_EMPTY(&request_list)) {
-			if (create_request_list(1) < 0) 
+		if (!(ifp->request_flag & CLIENT6_REQUEST_ADDR) && 
+				!(ifp->request_flag & CLIENT6_RELEASE_ADDR))
+			ifp->request_flag |= CLIENT6_CONFIRM_ADDR;
+		if (TAILQ_EMPTY(&ifp->request_list)) {
+			if (create_request_list(ifp, 1) < 0) 
 				exit(1);
-		} else if (client6_request_flag & CLIENT6_RELEASE_ADDR) {
-			for (lv = TAILQ_FIRST(&request_list); lv; 
+		} else if (ifp->request_flag & CLIENT6_RELEASE_ADDR) {
+			for (lv = TAILQ_FIRST(&ifp->request_list); lv; 
 					lv = TAILQ_NEXT(lv, link)) {
-				if (dhcp6_find_lease(&client6_iaidaddr, 
+				if (dhcp6_find_lease(ifp->iaidaddr, 
 						&lv->val_dhcp6addr) == NULL) {
 					dprintf(LOG_INFO, "this address %s is not"
 						" leased by this client", 
@@ -517,7 +558,7 @@ client6_ifinit(char *device)
 				}
 			}
 		}	
-	} else if (client6_request_flag & CLIENT6_RELEASE_ADDR) {
+	} else if (ifp->request_flag & CLIENT6_RELEASE_ADDR) {
 		dprintf(LOG_INFO, "no ipv6 addresses are leased by client");
 		exit(0);
 	}
@@ -528,12 +569,13 @@ client6_ifinit(char *device)
 	(void)get_if_rainfo(ifp);
 
 	/* set up check link timer and sync file timer */	
-	if ((ifp->link_timer =
-	    dhcp6_add_timer(check_link_timo, ifp)) < 0) {
+	ifp->link_timer = NULL;
+	if (rtnlsock < 0 && (ifp->link_timer =
+	    dhcp6_add_timer(check_link_timo, ifp)) == NULL) {
 		dprintf(LOG_ERR, "%s" "failed to create a timer", FNAME);
 		exit(1);
 	}
-	if ((ifp->sync_timer = dhcp6_add_timer(check_lease_file_timo, ifp)) < 0) {
+	if ((ifp->sync_timer = dhcp6_add_timer(check_lease_file_timo, ifp)) == NULL) {
 		dprintf(LOG_ERR, "%s" "failed to create a timer", FNAME);
 		exit(1);
 	}
@@ -547,6 +589,9 @@ client6_ifinit(char *device)
 	}
 	ifp->servers = NULL;
 	ev->ifp->current_server = NULL;
+	/* the initial delay bounds the start jitter */
+	if (ifp->request_flag & CLIENT6_FAST_START)
+		ev->init_retrans = fast_start_delay;
 	TAILQ_INSERT_TAIL(&ifp->event_list, ev, link);
 	if ((ev->timer = dhcp6_add_timer(client6_timo, ev)) == NULL) {
 		dprintf(LOG_ERR, "%s" "failed to add a timer for %s",
@@ -556,59 +601,97 @@ client6_ifinit(char *device)
 	dhcp6_reset_timer(ev);
 }
 
+/* rewrite the lease file of the interface from its lease list */
+static int
+client6_sync_leases(ifp)
+	struct dhcp6_if *ifp;
+{
+	char template[256];
+	FILE *file;
+
+	snprintf(template, sizeof(template), "%sXXXXXX", ifp->lease_name);
+	file = sync_leases(ifp->lease_file, ifp->lease_name, template,
+			   ifp->iaidaddr);
+	if (file == NULL)
+		return (-1);
+	ifp->lease_file = file;
+	return (0);
+}
+
 static void
 free_resources(struct dhcp6_if *ifp)
 {
 	struct dhcp6_event *ev, *ev_next;
 	struct dhcp6_lease *sp, *sp_next;
-	struct stat buf;
-	if (client6_iaidaddr.client6_info.type == IAPD && 
-	    !TAILQ_EMPTY(&client6_iaidaddr.lease_list))
-		radvd_parse(&client6_iaidaddr, ADDR_REMOVE);
-	else {
-		for (sp = TAILQ_FIRST(&client6_iaidaddr.lease_list); sp; sp = sp_next) { 
-			sp_next = TAILQ_NEXT(sp, link);
-			if (client6_ifaddrconf(IFADDRCONF_REMOVE, &sp->lease_addr) != 0) 
-				dprintf(LOG_INFO, "%s" "deconfiging address %s failed",
-					FNAME, in6addr2str(&sp->lease_addr.addr, 0));
-		}
+	for (sp = TAILQ_FIRST(&ifp->iaidaddr->lease_list); sp; sp = sp_next) { 
+		sp_next = TAILQ_NEXT(sp, link);
+		if ((sp->lease_addr.type == IAPD ?
+		     client6_prefixconf(IFADDRCONF_REMOVE, ifp, &sp->lease_addr) :
+		     client6_ifaddrconf(IFADDRCONF_REMOVE, ifp,
+		     &sp->lease_addr)) != 0) 
+			dprintf(LOG_INFO, "%s" "deconfiging address %s failed",
+				FNAME, in6addr2str(&sp->lease_addr.addr, 0));
+	}
+	if (ifp->iaidaddr->client6_info.type == IAPD && 
+	    !TAILQ_EMPTY(&ifp->iaidaddr->lease_list))
+		radvd_reload();
+	/* the leases stay in the lease file for the next start */
+	for (sp = TAILQ_FIRST(&ifp->iaidaddr->lease_list); sp; sp = sp_next) { 
+		sp_next = TAILQ_NEXT(sp, link);
+		if (sp->timer)
+			dhcp6_remove_timer(sp->timer);
+		free(sp);
 	}
+	TAILQ_INIT(&ifp->iaidaddr->lease_list);
+	if (ifp->iaidaddr->timer)
+		dhcp6_remove_timer(ifp->iaidaddr->timer);
+	ifp->iaidaddr->timer = NULL;
+	dhcp6_clear_list(&ifp->request_list);
 	dprintf(LOG_DEBUG, "%s" " remove all events on interface", FNAME);
 	/* cancel all outstanding events for each interface */
 	for (ev = TAILQ_FIRST(&ifp->event_list); ev; ev = ev_next) {
 		ev_next = TAILQ_NEXT(ev, link);
 		dhcp6_remove_event(ev);
 	}
-	/* XXX: check the last dhcpv6 client daemon to restore the original file */
-	{
-		/* restore /etc/radv.conf.bak back to /etc/radvd.conf */
-		if (!lstat(RADVD_CONF_BAK_FILE, &buf))
-			rename(RADVD_CONF_BAK_FILE, RADVD_CONF_FILE);
-		/* restore /etc/resolv.conf.dhcpv6.bak back to /etc/resolv.conf */
-		if (!lstat(RESOLV_CONF_BAK_FILE, &buf)) {
-			if (rename(RESOLV_CONF_BAK_FILE, RESOLV_CONF_FILE)) 
-				dprintf(LOG_ERR, "%s" " failed to backup resolv.conf", FNAME);
-		}
-	}
+	if (ifp->link_timer)
+		dhcp6_remove_timer(ifp->link_timer);
+	if (ifp->dad_timer)
+		dhcp6_remove_timer(ifp->dad_timer);
+	if (ifp->sync_timer)
+		dhcp6_remove_timer(ifp->sync_timer);
+	ifp->link_timer = ifp->dad_timer = ifp->sync_timer = NULL;
+	if (ifp->lease_file != NULL)
+		fclose(ifp->lease_file);
+	ifp->lease_file = NULL;
+	resolv_clear(ifp);
 	free_servers(ifp);
 }
 
 static void
 process_signals()
 {
+	struct dhcp6_if *ifp;
+
 	if ((sig_flags & SIGF_TERM)) {
 		dprintf(LOG_INFO, FNAME "exiting");
-		free_resources(dhcp6_if);
+		for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+			free_resources(ifp);
+		resolv_restore();
 		unlink(DHCP6C_PIDFILE);
 		exit(0);
 	}
 	if ((sig_flags & SIGF_HUP)) {
 		dprintf(LOG_INFO, FNAME "restarting");
-		free_resources(dhcp6_if);
-		client6_ifinit(device);
+		for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+			free_resources(ifp);
+		resolv_restore();
+		for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+			client6_ifinit(ifp);
 	}
 	if ((sig_flags & SIGF_CLEAN)) {
-		free_resources(dhcp6_if);
+		for (ifp = dhcp6_if; ifp; ifp = ifp->next)
+			free_resources(ifp);
+		resolv_restore();
 		exit(0);
 	}
 	sig_flags = 0;
@@ -618,7 +701,7 @@ static void
 client6_mainloop()
 {
 	struct timeval *w;
-	int ret;
+	int ret, maxfd;
 	fd_set r;
 
 	while(1) {
@@ -628,8 +711,15 @@ client6_mainloop()
 
 		FD_ZERO(&r);
 		FD_SET(insock, &r);
+		maxfd = insock;
+		if (rtnlsock >= 0) {
+			FD_SET(rtnlsock, &r);
+			if (rtnlsock > maxfd)
+				maxfd = rtnlsock;
+		}
 
-		ret = select(insock + 1, &r, NULL, NULL, w);
+		ret = select(maxfd + 1, &r, NULL, NULL, w);
+		dhcp6_clock_update();
 		switch (ret) {
 		case -1:
 			if (errno != EINTR) {
@@ -640,25 +730,97 @@ client6_mainloop()
 			break;
 		case 0:	/* timeout */
 			break;	/* dhcp6_check_timer() will treat the case */
-		default: /* received a packet */
-			client6_recv();
+		default: /* received a packet or a netlink event */
+			if (rtnlsock >= 0 && FD_ISSET(rtnlsock, &r))
+				(void)netlink_recv_monitor(rtnlsock,
+				    client6_rtnl_event, NULL);
+			if (FD_ISSET(insock, &r))
+				client6_recv();
 		}
 	}
 }
 
+/*
+ * RTM_NEWLINK carries the link state, RTM_NEWADDR reports the end of DAD
+ * for each address and RTM_DELADDR the expiry of a leased one.  Events are
+ * handed to the interface of their index.  A NULL message means events were
+ * lost, the link state of every interface is then read again and
+ * /proc/net/if_inet6 scanned as the timers do.
+ */
+static int
+client6_rtnl_event(nlm, arg)
+	struct nlmsghdr *nlm;
+	void *arg;
+{
+	struct dhcp6_if *ifp;
+	struct ifinfomsg *ifi;
+	struct ifaddrmsg *ifa;
+	struct rtattr *rta;
+	struct in6_addr *addr = NULL;
+	u_int32_t flags;
+	int len;
+
+	if (nlm == NULL) {
+		for (ifp = dhcp6_if; ifp; ifp = ifp->next) {
+			(void)check_link_timo(ifp);
+			if (ifp->iaidaddr->client6_info.type != IAPD &&
+			    !TAILQ_EMPTY(&ifp->iaidaddr->lease_list))
+				(void)check_dad_timo(ifp);
+		}
+		return 0;
+	}
+
+	switch (nlm->nlmsg_type) {
+	case RTM_NEWLINK:
+		ifi = (struct ifinfomsg *)NLMSG_DATA(nlm);
+		if ((ifp = find_ifconfbyid(ifi->ifi_index)) != NULL)
+			client6_link_change(ifp, ifi->ifi_flags & IFF_RUNNING);
+		break;
+	case RTM_NEWADDR:
+	case RTM_DELADDR:
+		ifa = (struct ifaddrmsg *)NLMSG_DATA(nlm);
+		if (ifa->ifa_family != AF_INET6 ||
+		    (ifp = find_ifconfbyid(ifa->ifa_index)) == NULL)
+			break;
+		flags = ifa->ifa_flags;
+		len = IFA_PAYLOAD(nlm);
+		for (rta = IFA_RTA(ifa); RTA_OK(rta, len);
+		     rta = RTA_NEXT(rta, len)) {
+			if (rta->rta_type == IFA_ADDRESS)
+				addr = (struct in6_addr *)RTA_DATA(rta);
+#ifdef IFA_FLAGS
+			else if (rta->rta_type == IFA_FLAGS)
+				flags = *(u_int32_t *)RTA_DATA(rta);
+#endif
+		}
+		/* a failed address stays tentative */
+		if (addr == NULL)
+			break;
+		if (nlm->nlmsg_type == RTM_DELADDR)
+			client6_addr_deleted(ifp, addr);
+		else if (flags & IFA_F_DADFAILED)
+			(void)client6_dad_failed(ifp, addr);
+		else if (!(flags & IFA_F_TENTATIVE))
+			dprintf(LOG_DEBUG, "%s" "DAD completed for %s", FNAME,
+				in6addr2str(addr, 0));
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
 struct dhcp6_timer *
 client6_timo(arg)
 	void *arg;
 {
 	struct dhcp6_event *ev = (struct dhcp6_event *)arg;
 	struct dhcp6_if *ifp;
-	struct timeval now;
 	
 	ifp = ev->ifp;
 	ev->timeouts++;
-	gettimeofday(&now, NULL);
 	if ((ev->max_retrans_cnt && ev->timeouts >= ev->max_retrans_cnt) ||
-	    (ev->max_retrans_dur && (now.tv_sec - ev->start_time.tv_sec) 
+	    (ev->max_retrans_dur && (dhcp6_now() - ev->start_time) / DHCP6_NSEC
 	     >= ev->max_retrans_dur)) {
 		/* XXX: check up the duration time for renew & rebind */
 		dprintf(LOG_INFO, "%s" "no responses were received", FNAME);
@@ -684,21 +846,29 @@ client6_timo(arg)
 		 *    and information-only, conmand line -I are not set.
 		 */
 		if ((ifp->send_flags & DHCIFF_INFO_ONLY) || 
-		    (client6_request_flag & CLIENT6_INFO_REQ) ||
+		    (ifp->request_flag & CLIENT6_INFO_REQ) ||
 		    (!(ifp->ra_flag & IF_RA_MANAGED) && 
 		     (ifp->ra_flag & IF_RA_OTHERCONF)))
 			ev->state = DHCP6S_INFOREQ;
-		else if (client6_request_flag & CLIENT6_RELEASE_ADDR) 
+		else if (ifp->request_flag & CLIENT6_RELEASE_ADDR) 
 			/* do release */
 			ev->state = DHCP6S_RELEASE;
-		else if (client6_request_flag & CLIENT6_CONFIRM_ADDR) {
+		else if ((ifp->request_flag & CLIENT6_CONFIRM_ADDR) &&
+			 (ifp->request_flag & CLIENT6_FAST_START)) {
+			/*
+			 * rebind with what is left of the leases: the reply
+			 * confirms and extends them in one exchange.
+			 */
+			ev->state = DHCP6S_REBIND;
+			ifp->iaidaddr->state = REBIND;
+		} else if (ifp->request_flag & CLIENT6_CONFIRM_ADDR) {
 			struct dhcp6_listval *lv;
 			/* do confirm for reboot for IANA, IATA*/
-			if (client6_iaidaddr.client6_info.type == IAPD)
+			if (ifp->iaidaddr->client6_info.type == IAPD)
 				ev->state = DHCP6S_REBIND;
 			else
 				ev->state = DHCP6S_CONFIRM;
-			for (lv = TAILQ_FIRST(&request_list); lv; 
+			for (lv = TAILQ_FIRST(&ifp->request_list); lv; 
 					lv = TAILQ_NEXT(lv, link)) {
 				lv->val_dhcp6addr.preferlifetime = 0;
 				lv->val_dhcp6addr.validlifetime = 0;
@@ -716,7 +886,7 @@ client6_timo(arg)
 				exit(1); /* XXX */
 			}
 			/* if get the address assginment break */
-			if (!TAILQ_EMPTY(&client6_iaidaddr.lease_list)) {
+			if (!TAILQ_EMPTY(&ifp->iaidaddr->lease_list)) {
 				dhcp6_remove_event(ev);
 				return (NULL);
 			}
@@ -733,7 +903,7 @@ client6_timo(arg)
 	case DHCP6S_CONFIRM:
 	case DHCP6S_RENEW:
 	case DHCP6S_REBIND:
-		if (!TAILQ_EMPTY(&request_list))
+		if (!TAILQ_EMPTY(&ifp->request_list))
 			client6_send(ev);
 		else {
 			dprintf(LOG_INFO, "%s"
@@ -805,7 +975,6 @@ client6_send(ev)
 	struct dhcp6 *dh6;
 	struct dhcp6_optinfo optinfo;
 	ssize_t optlen, len;
-	struct timeval duration, now;
 
 	ifp = ev->ifp;
 
@@ -858,7 +1027,7 @@ client6_send(ev)
 	 */
 	dhcp6_init_options(&optinfo);
 	if (ev->timeouts == 0) {
-		gettimeofday(&ev->start_time, NULL);
+		ev->start_time = dhcp6_now();
 		optinfo.elapsed_time = 0;
 		/*
 		 * A client SHOULD generate a random number that cannot easily
@@ -873,9 +1042,8 @@ client6_send(ev)
 			FNAME, ifp, ev, ev->xid);
 	} else {
 		unsigned int etime;
-		gettimeofday(&now, NULL);
-		timeval_sub(&now, &(ev->start_time), &duration);
-		etime = (duration.tv_sec) * 100 + (duration.tv_usec) / 10000;
+		/* in hundredths of a second */
+		etime = (dhcp6_now() - ev->start_time) / (DHCP6_NSEC / 100);
 		if (etime > DHCP6_ELAPSEDTIME_MAX)
 			etime = DHCP6_ELAPSEDTIME_MAX;
 		optinfo.elapsed_time = htons((uint16_t)etime);
@@ -902,7 +1070,7 @@ client6_send(ev)
 		}
 		break;
 	case DHCP6S_RELEASE:
-		if (duidcpy(&optinfo.serverID, &client6_iaidaddr.client6_info.serverid)) {
+		if (duidcpy(&optinfo.serverID, &ifp->iaidaddr->client6_info.serverid)) {
 			dprintf(LOG_ERR, "%s" "failed to copy server ID", FNAME);
 			goto end;
 		}
@@ -927,8 +1095,8 @@ client6_send(ev)
 		if (ifp->send_flags & DHCIFF_RAPID_COMMIT) 
 			optinfo.flags |= DHCIFF_RAPID_COMMIT;
 		if (!(ifp->send_flags & DHCIFF_INFO_ONLY) ||
-		    (client6_request_flag & CLIENT6_REQUEST_ADDR)) {
-			memcpy(&optinfo.iaidinfo, &client6_iaidaddr.client6_info.iaidinfo,
+		    (ifp->request_flag & CLIENT6_REQUEST_ADDR)) {
+			memcpy(&optinfo.iaidinfo, &ifp->iaidaddr->client6_info.iaidinfo,
 					sizeof(optinfo.iaidinfo));
 			if (ifp->send_flags & DHCIFF_PREFIX_DELEGATION)
 				optinfo.type = IAPD;
@@ -938,14 +1106,14 @@ client6_send(ev)
 				optinfo.type = IANA;
 		}
 		/* support for client preferred ipv6 address */
-		if (client6_request_flag & CLIENT6_REQUEST_ADDR) {
-			if (dhcp6_copy_list(&optinfo.addr_list, &request_list))
+		if (ifp->request_flag & CLIENT6_REQUEST_ADDR) {
+			if (dhcp6_copy_list(&optinfo.addr_list, &ifp->request_list))
 				goto end;
 		}
 		break;
 	case DHCP6S_REQUEST:
 		if (!(ifp->send_flags & DHCIFF_INFO_ONLY)) {
-			memcpy(&optinfo.iaidinfo, &client6_iaidaddr.client6_info.iaidinfo,
+			memcpy(&optinfo.iaidinfo, &ifp->iaidaddr->client6_info.iaidinfo,
 					sizeof(optinfo.iaidinfo));
 			dprintf(LOG_DEBUG, "%s IAID is %u", FNAME, optinfo.iaidinfo.iaid);
 			if (ifp->send_flags & DHCIFF_TEMP_ADDRS) 
@@ -961,16 +1129,16 @@ client6_send(ev)
 	case DHCP6S_RELEASE:
 	case DHCP6S_CONFIRM:
 	case DHCP6S_DECLINE:
-		memcpy(&optinfo.iaidinfo, &client6_iaidaddr.client6_info.iaidinfo,
+		memcpy(&optinfo.iaidinfo, &ifp->iaidaddr->client6_info.iaidinfo,
 			sizeof(optinfo.iaidinfo));
-		optinfo.type = client6_iaidaddr.client6_info.type;
+		optinfo.type = ifp->iaidaddr->client6_info.type;
 		if (ev->state == DHCP6S_CONFIRM) {
 			optinfo.iaidinfo.renewtime = 0;
 			optinfo.iaidinfo.rebindtime = 0;
 		}
-		if (!TAILQ_EMPTY(&request_list)) {
+		if (!TAILQ_EMPTY(&ifp->request_list)) {
 			/* XXX: ToDo: seperate to prefix list and address list */
-			if (dhcp6_copy_list(&optinfo.addr_list, &request_list))
+			if (dhcp6_copy_list(&optinfo.addr_list, &ifp->request_list))
 				goto end;
 		} else {
 			if (ev->state == DHCP6S_RELEASE) {
@@ -979,13 +1147,11 @@ client6_send(ev)
 			}
 			/* XXX: allow the other emtpy list ?? */
 		}
-		if (client6_request_flag & CLIENT6_RELEASE_ADDR) {
-			if (dhcp6_update_iaidaddr(&optinfo, ADDR_REMOVE)) {
+		if (ifp->request_flag & CLIENT6_RELEASE_ADDR) {
+			if (client6_update_iaidaddr(ifp, &optinfo, ADDR_REMOVE)) {
 				dprintf(LOG_INFO, "client release failed");
 				exit(1);
 			}
-			if (client6_iaidaddr.client6_info.type == IAPD)
-				radvd_parse(&client6_iaidaddr, ADDR_REMOVE);
 		}
 		break;
 	default:
@@ -1217,7 +1383,8 @@ client6_recvadvert(ifp, dh6, len, optinfo0)
 		client6_send(ev);
 
 	} else if (ifp->servers->next == NULL) {
-		struct timeval *rest, elapsed, tv_rt, tv_irt, timo;
+		dhcp6_time_t rest, elapsed, rt, irt;
+		struct timeval timo;
 
 		/*
 		 * If this is the first advertise, adjust the timer so that
@@ -1226,13 +1393,11 @@ client6_recvadvert(ifp, dh6, len, optinfo0)
 		 *      calculation here.
 		 */
 		rest = dhcp6_timer_rest(ev->timer);
-		tv_rt.tv_sec = (ev->retrans * 1000) / 1000000;
-		tv_rt.tv_usec = (ev->retrans * 1000) % 1000000;
-		tv_irt.tv_sec = (ev->init_retrans * 1000) / 1000000;
-		tv_irt.tv_usec = (ev->init_retrans * 1000) % 1000000;
-		timeval_sub(&tv_rt, rest, &elapsed);
-		if (TIMEVAL_LEQ(elapsed, tv_irt))
-			timeval_sub(&tv_irt, &elapsed, &timo);
+		rt = (dhcp6_time_t)ev->retrans * (DHCP6_NSEC / 1000);
+		irt = (dhcp6_time_t)ev->init_retrans * (DHCP6_NSEC / 1000);
+		elapsed = rt > rest ? rt - rest : 0;
+		if (elapsed <= irt)
+			NS_TO_TIMEVAL(irt - elapsed, &timo);
 		else
 			timo.tv_sec = timo.tv_usec = 0;
 
@@ -1245,7 +1410,7 @@ client6_recvadvert(ifp, dh6, len, optinfo0)
 	/* if the client send preferred addresses reqeust in SOLICIT */
 	/* XXX: client might have some local policy to select the addresses */
 	if (!TAILQ_EMPTY(&optinfo0->addr_list))
-		dhcp6_copy_list(&request_list, &optinfo0->addr_list);
+		dhcp6_copy_list(&ifp->request_list, &optinfo0->addr_list);
 	return 0;
 }
 
@@ -1349,7 +1514,7 @@ client6_recvreply(ifp, dh6, len, optinfo)
 		return -1;
 	}
 
-	dhcp6_clear_list(&request_list);
+	dhcp6_clear_list(&ifp->request_list);
 
 	/* A Reply message must contain a Server ID option */
 	if (optinfo->serverID.duid_len == 0) {
@@ -1367,7 +1532,7 @@ client6_recvreply(ifp, dh6, len, optinfo)
 		if (newserver == NULL)
 			return (-1);
 		ifp->current_server = newserver;
-		duidcpy(&client6_iaidaddr.client6_info.serverid, 
+		duidcpy(&ifp->iaidaddr->client6_info.serverid, 
 			&ifp->current_server->optinfo.serverID);
 		break;
 	default:
@@ -1388,7 +1553,7 @@ client6_recvreply(ifp, dh6, len, optinfo)
 
 	if (!TAILQ_EMPTY(&optinfo->dns_list.addrlist) || 
 	    optinfo->dns_list.domainlist != NULL) {
-		resolv_parse(&optinfo->dns_list);
+		resolv_update(ifp, &optinfo->dns_list);
 	}
 	/*
 	 * The client MAY choose to report any status code or message from the
@@ -1433,7 +1598,7 @@ client6_recvreply(ifp, dh6, len, optinfo)
 	case DHCP6S_SOLICIT:
 		if (optinfo->iaidinfo.iaid == 0)
 			break;
-		else if (!optinfo->flags & DHCIFF_RAPID_COMMIT) {
+		else if (!(optinfo->flags & DHCIFF_RAPID_COMMIT)) {
 			newstate = DHCP6S_REQUEST;
 			break;
 		}
@@ -1460,30 +1625,35 @@ client6_recvreply(ifp, dh6, len, optinfo)
 		default:
 			if (!TAILQ_EMPTY(&optinfo->addr_list)) {
 				(void)get_if_rainfo(ifp);
-				dhcp6_add_iaidaddr(optinfo);
-				if (optinfo->type == IAPD)
-					radvd_parse(&client6_iaidaddr, ADDR_UPDATE);
-				else if (ifp->dad_timer == NULL && (ifp->dad_timer =
+				client6_add_iaidaddr(ifp, optinfo);
+				if (optinfo->type != IAPD && rtnlsock < 0 &&
+				    ifp->dad_timer == NULL && 
+					 (ifp->dad_timer =
 					  dhcp6_add_timer(check_dad_timo, ifp)) < 0) {
 					dprintf(LOG_INFO, "%s" "failed to create a timer for "
 						" DAD", FNAME); 
 				}
 				setup_check_timer(ifp);
+				if (!TAILQ_EMPTY(&ifp->iaidaddr->lease_list))
+					client6_addr_ready(ifp, ev->state ==
+					    DHCP6S_SOLICIT ? "rapid commit" : "request");
 			}
 			break;
 		}
 		break;
 	case DHCP6S_RENEW:
 	case DHCP6S_REBIND:
-		if (client6_request_flag & CLIENT6_CONFIRM_ADDR) 
+		if ((ifp->request_flag & CLIENT6_CONFIRM_ADDR) &&
+		    !(ifp->request_flag & CLIENT6_FAST_START)) 
 			goto rebind_confirm;
+		ifp->request_flag &= ~CLIENT6_CONFIRM_ADDR;
 		/* NoBinding for RENEW, REBIND, send REQUEST */
 		switch(addr_status_code) {
 		case DH6OPT_STCODE_NOBINDING:
 			newstate = DHCP6S_REQUEST;
 			dprintf(LOG_DEBUG, "%s" 
 			    	  "got a NoBinding reply, sending request.", FNAME);
-			dhcp6_remove_iaidaddr(&client6_iaidaddr);
+			dhcp6_remove_iaidaddr(ifp->iaidaddr);
 			break;
 		case DH6OPT_STCODE_NOADDRAVAIL:
 		case DH6OPT_STCODE_NOPREFIXAVAIL:
@@ -1492,15 +1662,15 @@ client6_recvreply(ifp, dh6, len, optinfo)
 		case DH6OPT_STCODE_SUCCESS:
 		case DH6OPT_STCODE_UNDEFINE:
 		default:
-			dhcp6_update_iaidaddr(optinfo, ADDR_UPDATE);
-			if (optinfo->type == IAPD)
-				radvd_parse(&client6_iaidaddr, ADDR_UPDATE);
+			client6_update_iaidaddr(ifp, optinfo, ADDR_UPDATE);
+			if (!TAILQ_EMPTY(&ifp->iaidaddr->lease_list))
+				client6_addr_ready(ifp, "rebind");
 			break;
 		}
 		break;
 	case DHCP6S_CONFIRM:
 		/* NOtOnLink for a Confirm, send SOLICIT message */
-rebind_confirm:	client6_request_flag &= ~CLIENT6_CONFIRM_ADDR;
+rebind_confirm:	ifp->request_flag &= ~CLIENT6_CONFIRM_ADDR;
 	switch(addr_status_code) {
 		struct timeb now;
 		struct timeval timo;
@@ -1519,35 +1689,37 @@ rebind_confirm:	client6_request_flag &= ~CLIENT6_CONFIRM_ADDR;
 			/* XXX: set up renew/rebind timer */
 			dprintf(LOG_DEBUG, "%s" "got an expected reply for confirm", FNAME);
 			ftime(&now);
-			client6_iaidaddr.state = ACTIVE;
-			if ((client6_iaidaddr.timer = dhcp6_add_timer(dhcp6_iaidaddr_timo, 
-						&client6_iaidaddr)) == NULL) {
+			ifp->iaidaddr->state = ACTIVE;
+			if ((ifp->iaidaddr->timer = dhcp6_add_timer(dhcp6_iaidaddr_timo, 
+						ifp->iaidaddr)) == NULL) {
 		 		dprintf(LOG_ERR, "%s" "failed to add a timer for iaid %u",
-					FNAME, client6_iaidaddr.client6_info.iaidinfo.iaid);
+					FNAME, ifp->iaidaddr->client6_info.iaidinfo.iaid);
 		 		return (-1);
 			}
-			if (client6_iaidaddr.client6_info.iaidinfo.renewtime == 0) {
-				client6_iaidaddr.client6_info.iaidinfo.renewtime 
-					= get_min_preferlifetime(&client6_iaidaddr)/2;
+			if (ifp->iaidaddr->client6_info.iaidinfo.renewtime == 0) {
+				ifp->iaidaddr->client6_info.iaidinfo.renewtime 
+					= get_min_preferlifetime(ifp->iaidaddr)/2;
 			}
-			if (client6_iaidaddr.client6_info.iaidinfo.rebindtime == 0) {
-				client6_iaidaddr.client6_info.iaidinfo.rebindtime 
-					= (get_min_preferlifetime(&client6_iaidaddr)*4)/5;
+			if (ifp->iaidaddr->client6_info.iaidinfo.rebindtime == 0) {
+				ifp->iaidaddr->client6_info.iaidinfo.rebindtime 
+					= (get_min_preferlifetime(ifp->iaidaddr)*4)/5;
 			}
-			offset = now.time - client6_iaidaddr.start_date;
-			if ( offset > client6_iaidaddr.client6_info.iaidinfo.renewtime) 
+			offset = now.time - ifp->iaidaddr->start_date;
+			if ( offset > ifp->iaidaddr->client6_info.iaidinfo.renewtime) 
 				timo.tv_sec = 0;
 			else
-				timo.tv_sec = client6_iaidaddr.client6_info.iaidinfo.renewtime 						- offset; 
+				timo.tv_sec = ifp->iaidaddr->client6_info.iaidinfo.renewtime 						- offset; 
 			timo.tv_usec = 0;
-			dhcp6_set_timer(&timo, client6_iaidaddr.timer);
+			dhcp6_set_timer(&timo, ifp->iaidaddr->timer);
 			/* check DAD */
-			if (optinfo->type != IAPD && ifp->dad_timer == NULL && 
+			if (optinfo->type != IAPD && rtnlsock < 0 && 
+			    ifp->dad_timer == NULL && 
 			    (ifp->dad_timer = dhcp6_add_timer(check_dad_timo, ifp)) < 0) {
 				dprintf(LOG_INFO, "%s" "failed to create a timer for "
 					" DAD", FNAME); 
 			}
 			setup_check_timer(ifp);
+			client6_addr_ready(ifp, "confirm");
 			break;
 		default:
 			break;
@@ -1557,7 +1729,7 @@ rebind_confirm:	client6_request_flag &= ~CLIENT6_CONFIRM_ADDR;
 		/* send REQUEST message to server with none decline address */
 		dprintf(LOG_DEBUG, "%s" 
 		    "got an expected reply for decline, sending request.", FNAME);
-		create_request_list(0);
+		create_request_list(ifp, 0);
 		/* remove event data list */
 		newstate = DHCP6S_REQUEST;
 		break;
@@ -1573,7 +1745,7 @@ rebind_confirm:	client6_request_flag &= ~CLIENT6_CONFIRM_ADDR;
 		client6_send_newstate(ifp, newstate);
 	} else 
 		dprintf(LOG_DEBUG, "%s" "got an expected reply, sleeping.", FNAME);
-	TAILQ_INIT(&request_list);
+	dhcp6_clear_list(&ifp->request_list);
 	return 0;
 }
 
@@ -1621,49 +1793,102 @@ find_event_withid(ifp, xid)
 }
 
 static int 
-create_request_list(int reboot)
+create_request_list(struct dhcp6_if *ifp, int reboot)
 {	
-	struct dhcp6_lease *cl;
+	struct dhcp6_lease *cl, *cl_next;
 	struct dhcp6_listval *lv;
+	struct dhcp6_addr addr;
+	time_t elapsed;
+	int expired;
 	/* create an address list for release all/confirm */
-	for (cl = TAILQ_FIRST(&client6_iaidaddr.lease_list); cl; 
-		cl = TAILQ_NEXT(cl, link)) {
+	for (cl = TAILQ_FIRST(&ifp->iaidaddr->lease_list); cl; cl = cl_next) {
+		cl_next = TAILQ_NEXT(cl, link);
+		/* what is left of the lifetimes since the lease was written */
+		addr = cl->lease_addr;
+		expired = 0;
+		if (reboot) {
+			elapsed = time(NULL) - cl->start_date;
+			if (elapsed < 0)
+				elapsed = 0;
+			if (addr.validlifetime != DHCP6_DURATITION_INFINITE &&
+			    addr.validlifetime <= elapsed) {
+				/* a fast start forgets it, otherwise it is
+				 * still confirmed but not configured */
+				if (ifp->request_flag & CLIENT6_FAST_START) {
+					dprintf(LOG_INFO, "%s" "lease %s expired",
+						FNAME, in6addr2str(&addr.addr, 0));
+					(void)dhcp6_remove_lease(cl);
+					continue;
+				}
+				expired = 1;
+			} else if (addr.validlifetime != DHCP6_DURATITION_INFINITE)
+				addr.validlifetime -= elapsed;
+			if (addr.preferlifetime != DHCP6_DURATITION_INFINITE)
+				addr.preferlifetime = (addr.preferlifetime > elapsed) ?
+				    addr.preferlifetime - elapsed : 0;
+		}
 		/* IANA, IAPD */
 		if ((lv = malloc(sizeof(*lv))) == NULL) {
 			dprintf(LOG_ERR, "%s" 
 				"failed to allocate memory for an ipv6 addr", FNAME);
 			 exit(1);
 		}
-		memcpy(&lv->val_dhcp6addr, &cl->lease_addr, 
-			sizeof(lv->val_dhcp6addr));
+		/* a fast start rebinds with the remaining lifetimes */
+		memcpy(&lv->val_dhcp6addr, (ifp->request_flag & CLIENT6_FAST_START) ?
+			&addr : &cl->lease_addr, sizeof(lv->val_dhcp6addr));
 		lv->val_dhcp6addr.status_code = DH6OPT_STCODE_UNDEFINE;
-		TAILQ_INSERT_TAIL(&request_list, lv, link);
-		/* config the interface for reboot */
-		if (reboot && client6_iaidaddr.client6_info.type != IAPD && 
-		    (client6_request_flag & CLIENT6_CONFIRM_ADDR)) {
-			if (client6_ifaddrconf(IFADDRCONF_ADD, &cl->lease_addr) != 0) {
+		TAILQ_INSERT_TAIL(&ifp->request_list, lv, link);
+		/* config the interface for reboot, the kernel expires
+		 * the address when the lease runs out */
+		if (reboot && !expired &&
+		    (ifp->request_flag & CLIENT6_CONFIRM_ADDR)) {
+			if ((ifp->iaidaddr->client6_info.type == IAPD ?
+			     client6_prefixconf(IFADDRCONF_ADD, ifp, &addr) :
+			     client6_ifaddrconf(IFADDRCONF_ADD, ifp, &addr)) != 0) {
 				dprintf(LOG_INFO, "config address failed: %s",
 					in6addr2str(&cl->lease_addr.addr, 0));
 				return (-1);
 			}
 		}
 	}
-	/* update radvd.conf for prefix delegation */
-	if (reboot && client6_iaidaddr.client6_info.type == IAPD &&
-	    (client6_request_flag & CLIENT6_CONFIRM_ADDR))
-		radvd_parse(&client6_iaidaddr, ADDR_UPDATE);
+	/* nothing left to confirm, start over */
+	if (reboot && TAILQ_EMPTY(&ifp->iaidaddr->lease_list)) {
+		ifp->request_flag &= ~CLIENT6_CONFIRM_ADDR;
+		return (0);
+	}
+	if (reboot && ifp->iaidaddr->client6_info.type == IAPD &&
+	    (ifp->request_flag & CLIENT6_CONFIRM_ADDR))
+		radvd_reload();
 	return (0);
 }
 
+/* log how long it took the interface to get its addresses */
+static void
+client6_addr_ready(ifp, how)
+	struct dhcp6_if *ifp;
+	const char *how;
+{
+	long msec;
+
+	if (ifp->conf_start == 0)
+		return;
+	msec = (dhcp6_now() - ifp->conf_start) / (DHCP6_NSEC / 1000);
+	dprintf(LOG_INFO, "%s" "%s configured by %s in %ld.%03ld seconds",
+		FNAME, ifp->ifname, how, msec / 1000, msec % 1000);
+	ifp->conf_start = 0;
+}
+
 static void setup_check_timer(struct dhcp6_if *ifp)
 {
 	double d;
 	struct timeval timo;
-	d = DHCP6_CHECKLINK_TIME;
-	timo.tv_sec = (long)d;
-	timo.tv_usec = 0;
-	dprintf(LOG_DEBUG, "set timer for checking link ...");
-	dhcp6_set_timer(&timo, ifp->link_timer);
+	if (ifp->link_timer != NULL) {
+		d = DHCP6_CHECKLINK_TIME;
+		timo.tv_sec = (long)d;
+		timo.tv_usec = 0;
+		dprintf(LOG_DEBUG, "set timer for checking link ...");
+		dhcp6_set_timer(&timo, ifp->link_timer);
+	}
 	if (ifp->dad_timer != NULL) {
 		d = DHCP6_CHECKDAD_TIME;
 		timo.tv_sec = (long)d;
@@ -1686,15 +1911,8 @@ static struct dhcp6_timer
 	double d;
 	struct timeval timo;
 	struct stat buf;
-	FILE *file;
-	stat(leasename, &buf);
-	strcpy(client6_lease_temp, leasename);
-	strcat(client6_lease_temp, "XXXXXX");
-	if (buf.st_size > MAX_FILE_SIZE) {
-		file = sync_leases(client6_lease_file, leasename, client6_lease_temp);
-		if ( file != NULL)
-			client6_lease_file = file;
-	}	
+	if (stat(ifp->lease_name, &buf) == 0 && buf.st_size > MAX_FILE_SIZE)
+		(void)client6_sync_leases(ifp);
 	d = DHCP6_SYNCFILE_TIME;
 	timo.tv_sec = (long)d;
 	timo.tv_usec = 0;
@@ -1707,56 +1925,130 @@ static struct dhcp6_timer
 {
 	struct dhcp6_if *ifp = (struct dhcp6_if *)arg;
 	int newstate;
-	if (client6_iaidaddr.client6_info.type == IAPD)
+	if (ifp->iaidaddr->client6_info.type == IAPD)
 		goto end;
 	dprintf(LOG_DEBUG, "enter checking dad ...");
-	if (dad_parse(ifproc_file) < 0) {
+	if (dad_parse(ifproc_file, ifp) < 0) {
 		dprintf(LOG_ERR, "parse /proc/net/if_inet6 failed");
 		goto end;
 	}
-	if (TAILQ_EMPTY(&request_list))
+	if (TAILQ_EMPTY(&ifp->request_list))
 		goto end;
-	/* remove RENEW timer for client6_iaidaddr */
-	if (client6_iaidaddr.timer != NULL)
-		dhcp6_remove_timer(client6_iaidaddr.timer);
+	/* remove RENEW timer for the interface's iaidaddr */
+	if (ifp->iaidaddr->timer != NULL)
+		dhcp6_remove_timer(ifp->iaidaddr->timer);
 	newstate = DHCP6S_DECLINE;
 	client6_send_newstate(ifp, newstate);
 end:
 	/* one time check for DAD */	
-	dhcp6_remove_timer(ifp->dad_timer);
+	if (ifp->dad_timer != NULL)
+		dhcp6_remove_timer(ifp->dad_timer);
 	ifp->dad_timer = NULL;
 	return NULL;
 }
+
+/* 
+ * The kernel removes an address when its valid lifetime runs out; the
+ * lease goes with it.  A removal before that time was not done by the
+ * kernel and is only logged.
+ */
+static void
+client6_addr_deleted(ifp, addr)
+	struct dhcp6_if *ifp;
+	struct in6_addr *addr;
+{
+	struct dhcp6_lease *cl;
+	time_t now;
+
+	for (cl = TAILQ_FIRST(&ifp->iaidaddr->lease_list); cl;
+	     cl = TAILQ_NEXT(cl, link)) {
+		if (cl->lease_addr.type != IAPD &&
+		    IN6_ARE_ADDR_EQUAL(&cl->lease_addr.addr, addr))
+			break;
+	}
+	if (cl == NULL || cl->lease_addr.validlifetime == DHCP6_DURATITION_INFINITE)
+		return;
+	time(&now);
+	if (now + 1 < cl->start_date + (time_t)cl->lease_addr.validlifetime) {
+		dprintf(LOG_INFO, "%s" "leased address %s was removed", FNAME,
+			in6addr2str(addr, 0));
+		return;
+	}
+	dprintf(LOG_DEBUG, "%s" "lease for %s expired", FNAME,
+		in6addr2str(addr, 0));
+	cl->state = INVALID;
+	(void)dhcp6_remove_lease(cl);
+}
+
+/* decline a leased address the kernel found to be a duplicate */
+static int
+client6_dad_failed(ifp, addr)
+	struct dhcp6_if *ifp;
+	struct in6_addr *addr;
+{
+	struct dhcp6_listval *lv;
+	struct dhcp6_lease *cl;
+
+	if (ifp->iaidaddr->client6_info.type == IAPD)
+		return 0;
+	for (cl = TAILQ_FIRST(&ifp->iaidaddr->lease_list); cl;
+	     cl = TAILQ_NEXT(cl, link)) {
+		if (cl->lease_addr.type != IAPD &&
+		    IN6_ARE_ADDR_EQUAL(&cl->lease_addr.addr, addr))
+			break;
+	}
+	if (cl == NULL)
+		return 0;
+	dprintf(LOG_INFO, "duplicated ipv6 address %s detected",
+		in6addr2str(addr, 0));
+
+	if ((lv = (struct dhcp6_listval *)malloc(sizeof(*lv))) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return (-1);
+	}
+	memset(lv, 0, sizeof(*lv));
+	memcpy(&lv->val_dhcp6addr.addr, addr, sizeof(lv->val_dhcp6addr.addr));
+	lv->val_dhcp6addr.type = IANA;
+	lv->val_dhcp6addr.plen = cl->lease_addr.plen;
+	lv->val_dhcp6addr.status_code = DH6OPT_STCODE_UNDEFINE;
+	/* deconfigure the interface's the address assgined by dhcpv6 */
+	if (dhcp6_remove_lease(cl) != 0) {
+		dprintf(LOG_INFO, "remove duplicated address failed: %s",
+			in6addr2str(addr, 0));
+		free(lv);
+		return (-1);
+	}
+	dhcp6_clear_list(&ifp->request_list);
+	TAILQ_INSERT_TAIL(&ifp->request_list, lv, link);
+	/* remove RENEW timer for the interface's iaidaddr */
+	if (ifp->iaidaddr->timer != NULL)
+		dhcp6_remove_timer(ifp->iaidaddr->timer);
+	ifp->iaidaddr->timer = NULL;
+	return client6_send_newstate(ifp, DHCP6S_DECLINE);
+}
 	
-static struct dhcp6_timer 
-*check_link_timo(void *arg)
+static void
+client6_link_change(ifp, running)
+	struct dhcp6_if *ifp;
+	int running;
 {
-	struct dhcp6_if *ifp = (struct dhcp6_if *)arg;
-	struct ifreq ifr;
-	struct timeval timo;
-	double d;
 	int newstate;
-	dprintf(LOG_DEBUG, "enter checking link ...");
-	strncpy(ifr.ifr_name, dhcp6_if->ifname, IFNAMSIZ);
-	if (ioctl(nlsock, SIOCGIFFLAGS, &ifr) < 0) {
-		dprintf(LOG_DEBUG, "ioctl SIOCGIFFLAGS failed");
-		goto settimer;
-	}
-	if (ifr.ifr_flags & IFF_RUNNING) {
+
+	if (running) {
 		/* check previous flag 
 		 * set current flag UP */
-		if (ifp->link_flag & IFF_RUNNING) {
-			goto settimer;
-		}
+		if (ifp->link_flag & IFF_RUNNING)
+			return;
 		/* check current state ACTIVE */
-		if (client6_iaidaddr.state == ACTIVE) {
+		if (ifp->iaidaddr->state == ACTIVE) {
 			/* remove timer for renew/rebind
 			 * send confirm for ipv6address or 
 			 * rebind for prefix delegation */
-			dhcp6_remove_timer(client6_iaidaddr.timer);
-			client6_request_flag |= CLIENT6_CONFIRM_ADDR;
-			create_request_list(1);
-			if (client6_iaidaddr.client6_info.type == IAPD)
+			dhcp6_remove_timer(ifp->iaidaddr->timer);
+			ifp->conf_start = dhcp6_now();
+			ifp->request_flag |= CLIENT6_CONFIRM_ADDR;
+			create_request_list(ifp, 1);
+			if (ifp->iaidaddr->client6_info.type == IAPD)
 				newstate = DHCP6S_REBIND;
 			else
 				newstate = DHCP6S_CONFIRM;
@@ -1764,12 +2056,30 @@ static struct dhcp6_timer
 		}
 		dprintf(LOG_INFO, "interface is from down to up");
 		ifp->link_flag |= IFF_RUNNING;
-	} else {
+	} else if (ifp->link_flag & IFF_RUNNING) {
 		dprintf(LOG_INFO, "interface is down");
 		/* set flag_prev flag DOWN */
 		ifp->link_flag &= ~IFF_RUNNING;
 	}
+}
+
+static struct dhcp6_timer 
+*check_link_timo(void *arg)
+{
+	struct dhcp6_if *ifp = (struct dhcp6_if *)arg;
+	struct ifreq ifr;
+	struct timeval timo;
+	double d;
+	dprintf(LOG_DEBUG, "enter checking link ...");
+	strncpy(ifr.ifr_name, ifp->ifname, IFNAMSIZ);
+	if (ioctl(nlsock, SIOCGIFFLAGS, &ifr) < 0) {
+		dprintf(LOG_DEBUG, "ioctl SIOCGIFFLAGS failed");
+		goto settimer;
+	}
+	client6_link_change(ifp, ifr.ifr_flags & IFF_RUNNING);
 settimer:
+	if (ifp->link_timer == NULL)
+		return NULL;
 	d = DHCP6_CHECKLINK_TIME;
 	timo.tv_sec = (long)d;
 	timo.tv_usec = 0;
@@ -0,0 +1,748 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dhcp6perf: load generator for dhcp6s.
+ *
+ * Every emulated client is an index into one flat array; its DUID-LL, IAID
+ * and transaction ID are all derived from that index, so a run over
+ * millions of clients costs a few dozen bytes of state per client and no
+ * allocation per message beyond what the option codec does itself.
+ * Clients go through SOLICIT/ADVERTISE and REQUEST/REPLY, optionally
+ * followed by RENEW/REPLY and RELEASE/REPLY, and the round trip of each
+ * exchange is recorded in a log-linear histogram.  Exchanges that are
+ * not answered within the timeout count as dropped and end the client's
+ * cycle.  With -l the messages are wrapped in RELAY-FORW as a relay agent
+ * on the given links would send them.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "server6_stats.h"
+
+const dhcp6_mode_t dhcp6_mode = DHCP6_MODE_CLIENT;
+
+/* exchanges, in the order a client goes through them */
+#define EX_SOLICIT	0
+#define EX_REQUEST	1
+#define EX_RENEW	2
+#define EX_RELEASE	3
+#define EX_MAX		4
+#define EX_IDLE		0xff
+
+static const char *exname[EX_MAX] = { "solicit", "request", "renew", "release" };
+static const u_int8_t exmsg[EX_MAX] = {
+	DH6_SOLICIT, DH6_REQUEST, DH6_RENEW, DH6_RELEASE
+};
+static const u_int8_t exreply[EX_MAX] = {
+	DH6_ADVERTISE, DH6_REPLY, DH6_REPLY, DH6_REPLY
+};
+
+struct exstats {
+	u_int64_t sent;
+	u_int64_t received;
+	u_int64_t dropped;	/* timed out or could not be sent */
+	u_int64_t refused;	/* answered with an error status */
+	struct stats_hist hist;	/* latency in microseconds */
+};
+
+#define NOCLIENT	0xffffffff
+#define PERF_DUID_LEN	10	/* DUID-LL with a 6 byte link-layer address */
+#define PERF_MAXSERVERS	8
+#define PERF_MAXLINKS	64
+
+struct perf_client {
+	u_int32_t prev, next;	/* pending list, in send order */
+	u_int32_t sent;		/* when the pending message left, usec */
+	struct in6_addr addr;	/* address the server offered or bound */
+	u_int8_t ex;		/* exchange in progress, EX_IDLE if none */
+	u_int8_t server;	/* index into servers[] */
+};
+
+static struct perf_client *clients;
+static u_int32_t nclients = 1000;
+static u_int32_t duid_base;
+static u_int32_t pending_head = NOCLIENT, pending_tail = NOCLIENT;
+static u_int32_t npending, cursor;
+static int last_ex = EX_REQUEST;
+static int rapid_commit;
+
+static struct duid servers[PERF_MAXSERVERS];
+static int nservers;
+
+static struct in6_addr links[PERF_MAXLINKS];
+static int nlinks;
+
+static struct exstats stats[EX_MAX];
+static u_int64_t cycles_started, cycles_done, unsolicited;
+
+static int sock;
+static struct sockaddr_in6 server_sa;
+static u_int64_t t0;
+
+static u_int64_t perf_now __P((void));
+static void perf_duid __P((u_int32_t, char *));
+static void pending_add __P((u_int32_t));
+static void pending_del __P((u_int32_t));
+static int perf_send __P((u_int32_t, int));
+static int perf_start __P((void));
+static void perf_expire __P((u_int64_t));
+static void perf_recv __P((void));
+static void perf_reply __P((u_int32_t, int, struct dhcp6_optinfo *));
+static int perf_server __P((struct duid *));
+static void perf_report __P((u_int64_t));
+static void usage __P((void));
+
+static u_int64_t
+perf_now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* DUID-LL of a client: hardware type 1, locally administered MAC */
+static void
+perf_duid(idx, buf)
+	u_int32_t idx;
+	char *buf;
+{
+	u_int32_t n = duid_base + idx;
+
+	buf[0] = 0;
+	buf[1] = 3;
+	buf[2] = 0;
+	buf[3] = 1;
+	buf[4] = 0x02;
+	buf[5] = 0;
+	buf[6] = (n >> 24) & 0xff;
+	buf[7] = (n >> 16) & 0xff;
+	buf[8] = (n >> 8) & 0xff;
+	buf[9] = n & 0xff;
+}
+
+static void
+pending_add(idx)
+	u_int32_t idx;
+{
+	struct perf_client *c = &clients[idx];
+
+	c->next = NOCLIENT;
+	c->prev = pending_tail;
+	if (pending_tail != NOCLIENT)
+		clients[pending_tail].next = idx;
+	else
+		pending_head = idx;
+	pending_tail = idx;
+	npending++;
+}
+
+static void
+pending_del(idx)
+	u_int32_t idx;
+{
+	struct perf_client *c = &clients[idx];
+
+	if (c->prev != NOCLIENT)
+		clients[c->prev].next = c->next;
+	else
+		pending_head = c->next;
+	if (c->next != NOCLIENT)
+		clients[c->next].prev = c->prev;
+	else
+		pending_tail = c->prev;
+	npending--;
+}
+
+/*
+ * Send the message of exchange ex for client idx and put the client on
+ * the pending list.  Returns -1 if the message could not be sent, in
+ * which case the exchange counts as dropped and the client goes idle.
+ */
+static int
+perf_send(idx, ex)
+	u_int32_t idx;
+	int ex;
+{
+	struct perf_client *c = &clients[idx];
+	char buf[BUFSIZ], duid[PERF_DUID_LEN];
+	struct dhcp6_optinfo optinfo;
+	struct dhcp6_addr addr6;
+	struct dhcp6_relay *rf = NULL;
+	struct dhcp6opt *ro = NULL;
+	struct dhcp6 *dh6;
+	int hdrlen = 0, optlen;
+	ssize_t len;
+
+	if (nlinks) {
+		rf = (struct dhcp6_relay *)buf;
+		ro = (struct dhcp6opt *)(rf + 1);
+		hdrlen = sizeof(*rf) + sizeof(*ro);
+	}
+	dh6 = (struct dhcp6 *)(buf + hdrlen);
+	dh6->dh6_xid = htonl(idx);
+	dh6->dh6_msgtype = exmsg[ex];
+
+	dhcp6_init_options(&optinfo);
+	perf_duid(idx, duid);
+	optinfo.clientID.duid_len = sizeof(duid);
+	optinfo.clientID.duid_id = duid;
+	optinfo.type = IANA;
+	optinfo.iaidinfo.iaid = idx + 1;
+	if (ex == EX_SOLICIT) {
+		if (rapid_commit)
+			optinfo.flags |= DHCIFF_RAPID_COMMIT;
+	} else {
+		optinfo.serverID = servers[c->server];
+		memset(&addr6, 0, sizeof(addr6));
+		addr6.addr = c->addr;
+		addr6.type = IANA;
+		addr6.status_code = DH6OPT_STCODE_UNDEFINE;
+		if (dhcp6_add_listval(&optinfo.addr_list, &addr6,
+		    DHCP6_LISTVAL_DHCP6ADDR) == NULL) {
+			dprintf(LOG_ERR, "%s" "failed to add address", FNAME);
+			exit(1);
+		}
+	}
+	optlen = dhcp6_set_options((struct dhcp6opt *)(dh6 + 1),
+				   (struct dhcp6opt *)(buf + sizeof(buf)), &optinfo);
+	/* the DUIDs are not ours to free */
+	dhcp6_clear_list(&optinfo.addr_list);
+	if (optlen < 0) {
+		dprintf(LOG_ERR, "%s" "failed to construct options", FNAME);
+		exit(1);
+	}
+	len = sizeof(*dh6) + optlen;
+
+	if (nlinks) {
+		memset(rf, 0, sizeof(*rf));
+		rf->dh6_msg_type = DH6_RELAY_FORW;
+		rf->link_addr = links[idx % nlinks];
+		/* a link-local peer address per client, fe80::<idx + 1> */
+		rf->peer_addr.s6_addr[0] = 0xfe;
+		rf->peer_addr.s6_addr[1] = 0x80;
+		rf->peer_addr.s6_addr32[3] = htonl(idx + 1);
+		ro->dh6opt_type = htons(DH6OPT_RELAY_MSG);
+		ro->dh6opt_len = htons(len);
+		len += hdrlen;
+	}
+
+	c->ex = ex;
+	c->sent = (u_int32_t)perf_now();
+	stats[ex].sent++;
+	if (sendto(sock, buf, len, 0, (struct sockaddr *)&server_sa,
+		   sizeof(server_sa)) != len) {
+		if (errno != EAGAIN && errno != ENOBUFS)
+			dprintf(LOG_ERR, "%s" "sendto: %s", FNAME, strerror(errno));
+		stats[ex].dropped++;
+		c->ex = EX_IDLE;
+		return -1;
+	}
+	pending_add(idx);
+	return 0;
+}
+
+/* start a cycle on the next idle client, -1 if it could not be started */
+static int
+perf_start()
+{
+	u_int32_t i;
+
+	for (i = 0; i < nclients; i++) {
+		u_int32_t idx = cursor;
+
+		if (++cursor == nclients)
+			cursor = 0;
+		if (clients[idx].ex != EX_IDLE)
+			continue;
+		cycles_started++;
+		return perf_send(idx, EX_SOLICIT);
+	}
+	return -1;
+}
+
+/* the pending list is in send order, so expired clients are at its head */
+static void
+perf_expire(timeout)
+	u_int64_t timeout;
+{
+	u_int32_t now = (u_int32_t)perf_now();
+
+	while (pending_head != NOCLIENT) {
+		u_int32_t idx = pending_head;
+		struct perf_client *c = &clients[idx];
+
+		if (now - c->sent < timeout)
+			break;
+		pending_del(idx);
+		stats[c->ex].dropped++;
+		c->ex = EX_IDLE;
+	}
+}
+
+static int
+perf_server(duid)
+	struct duid *duid;
+{
+	int i;
+
+	for (i = 0; i < nservers; i++) {
+		if (duidcmp(&servers[i], duid) == 0)
+			return i;
+	}
+	if (nservers == PERF_MAXSERVERS)
+		return -1;
+	if (duidcpy(&servers[nservers], duid))
+		exit(1);
+	dprintf(LOG_INFO, "%s" "server %s", FNAME, duidstr(duid));
+	return nservers++;
+}
+
+static void
+perf_recv()
+{
+	char buf[BUFSIZ], duid[PERF_DUID_LEN];
+	struct dhcp6_optinfo optinfo;
+	struct dhcp6 *dh6;
+	struct dhcp6opt *ep;
+	struct perf_client *c;
+	u_int32_t idx;
+	ssize_t len;
+	int type;
+
+	for (;;) {
+		if ((len = recv(sock, buf, sizeof(buf), 0)) < 0) {
+			if (errno != EAGAIN && errno != EINTR)
+				dprintf(LOG_ERR, "%s" "recv: %s", FNAME,
+					strerror(errno));
+			return;
+		}
+		dh6 = (struct dhcp6 *)buf;
+		ep = (struct dhcp6opt *)(buf + len);
+		if (nlinks) {
+			struct dhcp6opt *p, opth;
+			char *cp = buf + sizeof(struct dhcp6_relay);
+
+			if (len < sizeof(struct dhcp6_relay) ||
+			    buf[0] != DH6_RELAY_REPL) {
+				unsolicited++;
+				continue;
+			}
+			/* find the Relay Message option */
+			for (dh6 = NULL; cp + sizeof(opth) <= (char *)ep;
+			     cp += sizeof(opth) + ntohs(opth.dh6opt_len)) {
+				p = (struct dhcp6opt *)cp;
+				memcpy(&opth, p, sizeof(opth));
+				if (cp + sizeof(opth) + ntohs(opth.dh6opt_len) >
+				    (char *)ep)
+					break;
+				if (ntohs(opth.dh6opt_type) == DH6OPT_RELAY_MSG) {
+					dh6 = (struct dhcp6 *)(p + 1);
+					ep = (struct dhcp6opt *)(cp + sizeof(opth) +
+					    ntohs(opth.dh6opt_len));
+					break;
+				}
+			}
+			if (dh6 == NULL) {
+				unsolicited++;
+				continue;
+			}
+		}
+		if ((char *)ep - (char *)dh6 < sizeof(*dh6)) {
+			unsolicited++;
+			continue;
+		}
+
+		idx = ntohl(dh6->dh6_xid) & DH6_XIDMASK;
+		type = dh6->dh6_msgtype;
+		if (idx >= nclients || (c = &clients[idx])->ex == EX_IDLE ||
+		    (type != exreply[c->ex] && !(c->ex == EX_SOLICIT &&
+		     rapid_commit && type == DH6_REPLY))) {
+			/* late, after the exchange timed out, or not ours */
+			unsolicited++;
+			continue;
+		}
+
+		dhcp6_init_options(&optinfo);
+		perf_duid(idx, duid);
+		if (dhcp6_get_options((struct dhcp6opt *)(dh6 + 1), ep,
+				      &optinfo) < 0 ||
+		    optinfo.clientID.duid_len != sizeof(duid) ||
+		    memcmp(optinfo.clientID.duid_id, duid, sizeof(duid))) {
+			unsolicited++;
+			dhcp6_clear_options(&optinfo);
+			continue;
+		}
+		perf_reply(idx, type, &optinfo);
+		dhcp6_clear_options(&optinfo);
+	}
+}
+
+/* account for the answer to client idx and move on to its next exchange */
+static void
+perf_reply(idx, type, optinfo)
+	u_int32_t idx;
+	int type;
+	struct dhcp6_optinfo *optinfo;
+{
+	struct perf_client *c = &clients[idx];
+	struct dhcp6_listval *lv;
+	int ex = c->ex, server, next;
+
+	pending_del(idx);
+	stats[ex].received++;
+	stats_hist_add(&stats[ex].hist, (u_int32_t)perf_now() - c->sent);
+	c->ex = EX_IDLE;
+
+	if (ex == EX_RELEASE) {
+		cycles_done++;
+		return;
+	}
+	if (optinfo->ia_stcode != DH6OPT_STCODE_UNDEFINE &&
+	    optinfo->ia_stcode != DH6OPT_STCODE_SUCCESS) {
+		stats[ex].refused++;
+		return;
+	}
+	for (lv = TAILQ_FIRST(&optinfo->addr_list); lv;
+	     lv = TAILQ_NEXT(lv, link)) {
+		if (lv->val_dhcp6addr.status_code == DH6OPT_STCODE_UNDEFINE ||
+		    lv->val_dhcp6addr.status_code == DH6OPT_STCODE_SUCCESS)
+			break;
+	}
+	if (lv == NULL || (server = perf_server(&optinfo->serverID)) < 0) {
+		stats[ex].refused++;
+		return;
+	}
+	c->addr = lv->val_dhcp6addr.addr;
+	c->server = server;
+
+	/* a rapid commit REPLY to the SOLICIT stands for the REQUEST too */
+	if (ex == EX_SOLICIT && type == DH6_REPLY)
+		ex = EX_REQUEST;
+	if (ex >= last_ex) {
+		cycles_done++;
+		return;
+	}
+	next = ex + 1;
+	perf_send(idx, next);
+}
+
+static void
+perf_report(elapsed)
+	u_int64_t elapsed;
+{
+	double secs = elapsed / 1e6;
+	u_int64_t sent = 0, received = 0;
+	int ex;
+
+	printf("%u clients, %llu cycles started, %llu completed in %.3f s\n",
+	       nclients, (unsigned long long)cycles_started,
+	       (unsigned long long)cycles_done, secs);
+	printf("%-8s %10s %10s %10s %8s %8s %10s %10s %10s\n", "exchange",
+	       "sent", "received", "dropped", "drop%", "refused",
+	       "p50(ms)", "p99(ms)", "p999(ms)");
+	for (ex = 0; ex <= last_ex; ex++) {
+		struct exstats *st = &stats[ex];
+
+		sent += st->sent;
+		received += st->received;
+		printf("%-8s %10llu %10llu %10llu %8.3f %8llu %10.3f %10.3f %10.3f\n",
+		       exname[ex], (unsigned long long)st->sent,
+		       (unsigned long long)st->received,
+		       (unsigned long long)st->dropped,
+		       st->sent ? 100.0 * st->dropped / st->sent : 0.0,
+		       (unsigned long long)st->refused,
+		       stats_hist_percentile(&st->hist, 0.5) / 1e3,
+		       stats_hist_percentile(&st->hist, 0.99) / 1e3,
+		       stats_hist_percentile(&st->hist, 0.999) / 1e3);
+	}
+	if (secs > 0) {
+		printf("rate: %.1f cycles/s started, %.1f cycles/s completed, "
+		       "%.1f msgs/s sent, %.1f msgs/s received\n",
+		       cycles_started / secs, cycles_done / secs,
+		       sent / secs, received / secs);
+	}
+	if (unsolicited)
+		printf("%llu unexpected or late messages ignored\n",
+		       (unsigned long long)unsolicited);
+}
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	char *server = "::1", *local = NULL, *ifname = NULL;
+	struct addrinfo hints, *res;
+	struct sockaddr_in6 sa;
+	struct timeval tv;
+	double rate = 1000;
+	u_int64_t duration = 10000000, timeout = 1000000, maxpending = 10000;
+	u_int64_t now, end, next;
+	unsigned long n;
+	int ch, error, debug = 0, on = 1, bufsize = 4 * 1024 * 1024;
+	u_int32_t i;
+	fd_set r;
+
+	while ((ch = getopt(argc, argv, "b:c:Cdi:l:n:o:p:r:s:t:w:")) != -1) {
+		switch (ch) {
+		case 'b':
+			local = optarg;
+			break;
+		case 'c':
+			if (strcmp(optarg, "request") == 0)
+				last_ex = EX_REQUEST;
+			else if (strcmp(optarg, "renew") == 0)
+				last_ex = EX_RENEW;
+			else if (strcmp(optarg, "release") == 0)
+				last_ex = EX_RELEASE;
+			else
+				usage();
+			break;
+		case 'C':
+			rapid_commit = 1;
+			break;
+		case 'd':
+			debug++;
+			break;
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'l':
+			if (nlinks == PERF_MAXLINKS) {
+				fprintf(stderr, "dhcp6perf: at most %d links\n",
+					PERF_MAXLINKS);
+				exit(1);
+			}
+			if (inet_pton(AF_INET6, optarg, &links[nlinks]) != 1) {
+				fprintf(stderr, "dhcp6perf: bad link-address %s\n",
+					optarg);
+				exit(1);
+			}
+			nlinks++;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			if (n == 0 || n > DH6_XIDMASK) {
+				fprintf(stderr, "dhcp6perf: clients must be "
+					"between 1 and %u\n", DH6_XIDMASK);
+				exit(1);
+			}
+			nclients = n;
+			break;
+		case 'o':
+			duid_base = strtoul(optarg, NULL, 0);
+			break;
+		case 'p':
+			maxpending = strtoull(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = atof(optarg);
+			break;
+		case 's':
+			server = optarg;
+			break;
+		case 't':
+			duration = (u_int64_t)(atof(optarg) * 1e6);
+			break;
+		case 'w':
+			timeout = (u_int64_t)(atof(optarg) * 1e3);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc || timeout == 0 || timeout >= (1ULL << 31))
+		usage();
+
+	foreground = 1;
+	setloglevel(debug);
+	/* dprintf hands whatever is below the threshold to syslog */
+	setlogmask(LOG_UPTO(debug ? LOG_DEBUG : LOG_ERR));
+	srandom(time(NULL));
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = PF_INET6;
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	hints.ai_flags = AI_NUMERICHOST;
+	error = getaddrinfo(server, DH6PORT_UPSTREAM, &hints, &res);
+	if (error) {
+		fprintf(stderr, "dhcp6perf: %s: %s\n", server, gai_strerror(error));
+		exit(1);
+	}
+	memcpy(&server_sa, res->ai_addr, sizeof(server_sa));
+	freeaddrinfo(res);
+
+	/*
+	 * Replies come to port 546, or 547 for relayed ones, of the address
+	 * we send from.  dhcp6s -P binds both ports on the wildcard address
+	 * with SO_REUSEADDR, so binding a specific local address here steers
+	 * the replies to us.
+	 */
+	hints.ai_flags = AI_NUMERICHOST | AI_PASSIVE;
+	error = getaddrinfo(local, nlinks ? DH6PORT_UPSTREAM : DH6PORT_DOWNSTREAM,
+			    &hints, &res);
+	if (error) {
+		fprintf(stderr, "dhcp6perf: %s: %s\n", local ? local : "::",
+			gai_strerror(error));
+		exit(1);
+	}
+	memcpy(&sa, res->ai_addr, sizeof(sa));
+	freeaddrinfo(res);
+	if (ifname) {
+		if ((sa.sin6_scope_id = if_nametoindex(ifname)) == 0) {
+			fprintf(stderr, "dhcp6perf: unknown interface %s\n", ifname);
+			exit(1);
+		}
+		if (IN6_IS_ADDR_LINKLOCAL(&server_sa.sin6_addr) ||
+		    IN6_IS_ADDR_MULTICAST(&server_sa.sin6_addr))
+			server_sa.sin6_scope_id = sa.sin6_scope_id;
+		if (!IN6_IS_ADDR_LINKLOCAL(&sa.sin6_addr))
+			sa.sin6_scope_id = 0;
+	}
+
+	if ((sock = socket(PF_INET6, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		fprintf(stderr, "dhcp6perf: socket: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) < 0) {
+		fprintf(stderr, "dhcp6perf: setsockopt(SO_REUSEADDR): %s\n",
+			strerror(errno));
+		exit(1);
+	}
+	/* best effort, the kernel caps these at its rmem_max/wmem_max */
+	setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+	setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+	if (ifname && IN6_IS_ADDR_MULTICAST(&server_sa.sin6_addr) &&
+	    setsockopt(sock, IPPROTO_IPV6, IPV6_MULTICAST_IF,
+		       &server_sa.sin6_scope_id,
+		       sizeof(server_sa.sin6_scope_id)) < 0) {
+		fprintf(stderr, "dhcp6perf: setsockopt(IPV6_MULTICAST_IF): %s\n",
+			strerror(errno));
+		exit(1);
+	}
+	if (bind(sock, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+		fprintf(stderr, "dhcp6perf: bind: %s\n", strerror(errno));
+		exit(1);
+	}
+	if (fcntl(sock, F_SETFL, O_NONBLOCK) < 0) {
+		fprintf(stderr, "dhcp6perf: fcntl: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	if ((clients = malloc(nclients * sizeof(*clients))) == NULL) {
+		fprintf(stderr, "dhcp6perf: no memory for %u clients\n", nclients);
+		exit(1);
+	}
+	for (i = 0; i < nclients; i++)
+		clients[i].ex = EX_IDLE;
+
+	t0 = perf_now();
+	end = t0 + duration;
+	for (;;) {
+		now = perf_now();
+		if (now < end) {
+			/* start the cycles that are due, -r 0 keeps -p busy */
+			while (npending < maxpending && npending < nclients &&
+			       (rate <= 0 ||
+				cycles_started < (now - t0) * rate / 1e6)) {
+				if (perf_start() < 0)
+					break;
+			}
+		} else if (npending == 0)
+			break;
+		perf_expire(timeout);
+
+		/* sleep until the next start, timeout or end of the run */
+		next = now + 100000;
+		if (now < end && rate > 0 && npending < maxpending) {
+			u_int64_t due = t0 + (cycles_started + 1) * 1e6 / rate;
+
+			if (due < next)
+				next = due;
+		}
+		if (pending_head != NOCLIENT) {
+			u_int64_t expire = now - ((u_int32_t)now -
+			    clients[pending_head].sent) + timeout;
+
+			if (expire < next)
+				next = expire;
+		}
+		if (now < end && end < next)
+			next = end;
+		tv.tv_sec = next > now ? (next - now) / 1000000 : 0;
+		tv.tv_usec = next > now ? (next - now) % 1000000 : 0;
+
+		FD_ZERO(&r);
+		FD_SET(sock, &r);
+		if (select(sock + 1, &r, NULL, NULL, &tv) < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "dhcp6perf: select: %s\n", strerror(errno));
+			exit(1);
+		}
+		if (FD_ISSET(sock, &r))
+			perf_recv();
+	}
+
+	perf_report(perf_now() - t0);
+	exit(0);
+}
+
+static void
+usage()
+{
+	fprintf(stderr,
+		"Usage: dhcp6perf [-Cd] [-b local-address] [-c request|renew|release]\n"
+		"                 [-i interface] [-l link-address]... [-n clients]\n"
+		"                 [-o duid-offset] [-p max-pending] [-r rate]\n"
+		"                 [-s server] [-t seconds] [-w timeout-ms]\n");
+	exit(1);
+}
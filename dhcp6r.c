@@ -49,6 +49,8 @@
 #include "relay6_parser.h"
 #include "relay6_socket.h"
 #include "relay6_database.h"
+#include "relay6_thread.h"
+#include "relay6_trace.h"
 
 int 
 main(argc, argv)
@@ -77,6 +79,8 @@ main(argc, argv)
 	fclose(fp);
 
 	signal(SIGINT, handler);
+	signal(SIGUSR1, trace_level_up);
+	signal(SIGUSR2, trace_level_down);
 	init_relay();
 
 	if (argc > 1) {
@@ -124,6 +128,20 @@ main(argc, argv)
 			else if (strcmp(argv[i], "-cu") == 0) {
 				multicast_off = 1;          		         		
 			}
+			else if (strcmp(argv[i], "-v") == 0) {
+				i++;
+				if ((argv[i] == NULL) || (*argv[i] < '0') || 
+				    (*argv[i] > '0' + TRACE_DETAIL)) {
+					err = 6;
+					goto ERROR;
+				}
+				trace_level = atoi(argv[i]);
+				continue;
+			}
+			else if (strcmp(argv[i], "-t") == 0) {
+				relay_threads = 1;
+				continue;
+			}
 			else if (strcmp(argv[i], "-sm") == 0) {
           		i++;
           		if (get_interface_s(argv[i]) == NULL) {
@@ -250,15 +268,27 @@ main(argc, argv)
 
 	if (sw == 1)
 		multicast_off = 0;   
+
+	/* pick up the -cm interfaces */
+	index_interfaces(NULL);
+
+	if ((relay_threads == 1) && (sw == 0)) {
+		printf("dhcp6r: option '-t' requires at least one '-cm' interface\n");
+		exit(1);
+	}
      
 	init_socket();
   
 	if (set_sock_opt() == 0)
 		goto ERROR;
 
-	if (fill_addr_struct() == 0)
+	if (fill_addr_struct(recvsock) == 0)
 		goto ERROR;
 
+	if (init_netlink_socket() == 0)
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "INTERFACE CHANGES WILL NOT BE NOTICED\n");
+
 	if (du == 0) {
 		switch(fork()) {
 			case 0:
@@ -271,19 +301,32 @@ main(argc, argv)
 		} 
 	}
 
+	if (start_trace_thread(TRACEFILE) == 0)
+		goto ERROR;
+
+	if (relay_threads == 1) {
+		if (start_relay_workers() == 0)
+			goto ERROR;
+	}
+
 	while (1) {
-		if (check_select() == 1) {
-			if (recv_data() == 1) {
-				if (get_recv_data() == 1) {
-					mesg = create_parser_obj();                  
+		if (check_netlink() == 1) {
+			if (update_interface_info() == 0)
+				goto ERROR;
+		}
+
+		if (check_select(recvsock) == 1) {
+			if (recv_data(recvsock) == 1) {
+				if (get_recv_data(recvsock) == 1) {
+					mesg = create_parser_obj(recvsock, &msg_parser_list);
 					if (put_msg_in_store (mesg) == 0)
 						mesg->sent = 1; /* mark it for deletion */
 				}
 			}
 		}
 	
-		send_message();
-		delete_messages();
+		send_message(sendsock, &msg_parser_list);
+		delete_messages(&msg_parser_list);
 	}
 
 ERROR:
@@ -298,6 +341,11 @@ ERROR:
 		exit(1);
 	} 	
  
+	if (err == 6) {
+		printf("dhcp6r: trace level must be 0 to %d\n", TRACE_DETAIL);
+		exit(1);
+	}
+
 	if (err == 5) {
 		printf("dhcp6r: interface '%s' does not exist \n", argv[i]);
 		exit(1);
@@ -311,7 +359,8 @@ void
 command_text() 
 {
 	printf("Usage:\n");
-	printf("       dhcp6r [-d] [-cu] [-cm <interface>] [-sm <interface>] "
+	printf("       dhcp6r [-d] [-t] [-v <level>] [-cu] [-cm <interface>] "
+	       "[-sm <interface>] "
 	       "[-su <address>] [-sf <interface>+<address>] \n");
 	exit(1);
 }
@@ -319,11 +368,12 @@ command_text()
 char*  
 dhcp6r_clock() 
 {
+	static __thread char buf[32];	/* the workers trace concurrently */
 	time_t tim;
 	char *s, *p;
 
 	time(&tim);
-	s = ctime(&tim);
+	s = ctime_r(&tim, buf);
   
 	p = s;
 	do {
@@ -348,6 +398,7 @@ void  handler(int signo) {
 	close(sendsock->send_sock_desc);
 	TRACE(dump, "%s - %s", dhcp6r_clock(), 
 	      "RELAY AGENT IS STOPPING............\n");  
+	print_msg_counters(dump);
 	fflush(dump);
 
 	exit(0);
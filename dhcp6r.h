@@ -35,6 +35,7 @@
 
 #define MAX_DHCP_MSG_LENGTH     1400
 #define MESSAGE_HEADER_LENGTH   4
+#define RELAY_HEADER_LENGTH     34     /* msg-type, hop-count, link and peer */
 #define ALL_DHCP_SERVERS           "FF05::1:3"
 #define ALL_DHCP_RELAY_AND_SERVERS "FF02::1:2"
 #define INET6_LEN               16
@@ -42,6 +43,7 @@
 #define HEAD_SIZE               400
 #define HOP_COUNT_LIMIT         30
 #define DUMPFILE                "/var/log/dhcp6r.log"
+#define TRACEFILE               "/var/log/dhcp6r.trace"
 #define INTERFACEINFO           "/proc/net/if_inet6"
 #define PIDFILE                 "/var/run/dhcp6r.pid"
 #define MAXHOPCOUNT             32
@@ -62,6 +64,7 @@
 #define INFORMATION_REQUEST	11
 #define RELAY_FORW			12
 #define RELAY_REPL			13
+#define MSG_TYPE_MAX		RELAY_REPL
 
 #define OPTION_RELAY_MSG	9
 #define OPTION_INTERFACE_ID	18
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) NEC Europe Ltd., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/* dhcp6rdump: print the binary trace written by dhcp6r */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "relay6_trace.h"
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	FILE *fp;
+	struct trace_file_hdr hdr;
+	struct trace_rec rec;
+	const char *path = TRACEFILE;
+
+	if (argc > 2) {
+		fprintf(stderr, "Usage:\n       dhcp6rdump [tracefile]\n");
+		exit(1);
+	}
+	if (argc == 2)
+		path = argv[1];
+
+	if ((fp = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "dhcp6rdump: cannot open %s\n", path);
+		exit(1);
+	}
+
+	if ((fread(&hdr, sizeof(hdr), 1, fp) != 1) || 
+	    (hdr.magic != TRACE_MAGIC)) {
+		fprintf(stderr, "dhcp6rdump: %s is not a dhcp6r trace\n", path);
+		exit(1);
+	}
+	if ((hdr.version != TRACE_VERSION) || 
+	    (hdr.rec_size != sizeof(struct trace_rec))) {
+		fprintf(stderr, "dhcp6rdump: %s has trace version %u, expected %u\n",
+		        path, hdr.version, TRACE_VERSION);
+		exit(1);
+	}
+
+	while (fread(&rec, sizeof(rec), 1, fp) == 1)
+		format_trace_rec(stdout, &rec);
+
+	fclose(fp);
+	exit(0);
+}
@@ -0,0 +1,1071 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * dhcp6replay: run the dhcp6s message path in-process against a capture
+ * or a synthetic client population, on a virtual clock.
+ *
+ * dhcp6s.c is built with DHCP6S_REPLAY, which leaves out main() and the
+ * sockets; messages are handed to server6_replay_input() and replies come
+ * back through server6_transmit() below.  The timers read a virtual clock
+ * that jumps from one message to the next, firing whatever falls due in
+ * between, so a day of traffic and the lease expiry it causes replay as
+ * fast as the server can process it.  Every message is timed with the
+ * thread CPU clock and, when linked with the --wrap flags in Makefile.in,
+ * the allocations it makes are counted.
+ *
+ * With -p the client-to-server messages of a pcap file are replayed at
+ * their capture times.  Otherwise -n clients go through SOLICIT, REQUEST
+ * and RENEW at T1, and at each renewal some of them leave, by RELEASE or
+ * by letting the lease expire, and come back later as new devices.
+ */
+
+#include <sys/types.h>
+#include <sys/param.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "timer.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "hash.h"
+#include "lease.h"
+#include "server6_stats.h"
+
+extern void server6_replay_init __P((char *, char *, char *));
+extern int server6_replay_input __P((char *, ssize_t, struct in6_pktinfo *,
+				     struct sockaddr *, int));
+int server6_transmit __P((struct sockaddr_in6 *, char *, size_t));
+
+#define MSG_TYPES	16	/* message types 0..15, anything else is 0 */
+
+struct msgstats {
+	u_int64_t count;
+	u_int64_t replied;
+	u_int64_t cpu;		/* nanoseconds */
+	u_int64_t allocs;
+	u_int64_t frees;
+	struct stats_hist hist;	/* CPU time in nanoseconds */
+};
+
+static struct msgstats stats[MSG_TYPES];
+static struct msgstats timerstats;
+static u_int64_t replies[MSG_TYPES];
+
+/* allocation counters, bumped by the __wrap_ functions */
+static u_int64_t nallocs, nfrees;
+
+/* the virtual clock, in microseconds */
+static u_int64_t vnow, vstart;
+static u_int64_t timer_next;
+#define NEVER	(~(u_int64_t)0)
+
+/* the reply to the message being processed */
+static char txbuf[BUFSIZ];
+static ssize_t txlen;
+
+static struct sockaddr_in6 replay_from;
+static struct in6_pktinfo replay_pi;
+
+static u_int32_t leases_peak;
+static u_int64_t leases_expired;
+
+/* synthetic clients */
+#define ST_SOLICIT	0
+#define ST_REQUEST	1
+#define ST_RENEW	2
+
+#define RETRY_USEC	(60 * 1000000ULL)
+
+struct replay_client {
+	u_int64_t due;		/* virtual time of its next message */
+	struct in6_addr addr;
+	u_int32_t duid;		/* changes each time the client comes back */
+	u_int8_t state;
+};
+
+static struct replay_client *clients;
+static u_int32_t *heap;
+static u_int32_t nclients = 1000;
+static u_int32_t next_duid;
+static u_int64_t arrival = 3600 * 1000000ULL;
+static int churn = 10;
+static char srvid[128];
+static int srvidlen;
+static u_int64_t bound, renewed, released, abandoned, failed;
+
+/* a pcap file */
+#define PCAP_MAGIC	0xa1b2c3d4
+#define PCAP_MAGIC_NSEC	0xa1b23c4d
+#define PCAP_SWAP(p, x)	((p)->swap ? __builtin_bswap32(x) : (x))
+
+struct pcap {
+	FILE *fp;
+	int swap;
+	int nsec;
+	u_int32_t linktype;
+};
+
+static u_int64_t cputime __P((void));
+static u_int64_t walltime __P((void));
+static dhcp6_time_t replay_clock __P((void));
+static void replay_timers __P((void));
+static void replay_advance __P((u_int64_t));
+static int replay_type __P((char *, ssize_t));
+static int replay_input __P((char *, ssize_t));
+static char *replay_option __P((char *, ssize_t, int, int *));
+static int replay_serverid __P((char *, ssize_t));
+static u_int64_t synth_random __P((u_int64_t));
+static void heap_down __P((u_int32_t));
+static void heap_up __P((u_int32_t));
+static ssize_t synth_message __P((u_int32_t, int, char *));
+static void synth_step __P((u_int32_t));
+static void synth_run __P((u_int64_t));
+static int pcap_open __P((struct pcap *, char *));
+static int pcap_next __P((struct pcap *, u_int64_t *, char *, size_t));
+static char *pcap_udp __P((struct pcap *, char *, ssize_t, ssize_t *));
+static void pcap_run __P((char *));
+static void pcap_scan __P((char *, int));
+static void write_duid __P((char *));
+static void replay_report __P((u_int64_t));
+static void usage __P((void));
+
+/*
+ * Allocation counting.  Only calls the program makes itself are seen;
+ * libc's internal ones (strdup, fopen) go straight to the real malloc.
+ */
+void *__real_malloc __P((size_t));
+void *__real_calloc __P((size_t, size_t));
+void *__real_realloc __P((void *, size_t));
+void __real_free __P((void *));
+
+void *
+__wrap_malloc(size)
+	size_t size;
+{
+	nallocs++;
+	return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(n, size)
+	size_t n, size;
+{
+	nallocs++;
+	return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc(p, size)
+	void *p;
+	size_t size;
+{
+	nallocs++;
+	return __real_realloc(p, size);
+}
+
+void
+__wrap_free(p)
+	void *p;
+{
+	if (p != NULL)
+		nfrees++;
+	__real_free(p);
+}
+
+static u_int64_t
+cputime()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static u_int64_t
+walltime()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static dhcp6_time_t
+replay_clock()
+{
+	return vnow * 1000;
+}
+
+/*
+ * One pass over the timers, as the dhcp6s main loop makes before every
+ * select(); timer_next is when it would have woken up.
+ */
+static void
+replay_timers()
+{
+	struct timeval *w;
+	u_int64_t t, a = nallocs, f = nfrees;
+	u_int32_t before = lease_hash_table->hash_count;
+
+	t = cputime();
+	w = dhcp6_check_timer();
+	t = cputime() - t;
+
+	timerstats.count++;
+	timerstats.cpu += t;
+	timerstats.allocs += nallocs - a;
+	timerstats.frees += nfrees - f;
+	stats_hist_add(&timerstats.hist, t);
+	if (lease_hash_table->hash_count < before)
+		leases_expired += before - lease_hash_table->hash_count;
+
+	if (w == NULL)
+		timer_next = NEVER;
+	else
+		timer_next = vnow + (u_int64_t)w->tv_sec * 1000000 + w->tv_usec;
+}
+
+/* move the clock to "to", firing the timers that fall due on the way */
+static void
+replay_advance(to)
+	u_int64_t to;
+{
+	while (timer_next <= to) {
+		if (timer_next > vnow)
+			vnow = timer_next;
+		else if (timer_next < vnow)
+			break;	/* overdue and not rearmed, as select(0) would spin */
+		replay_timers();
+		if (timer_next <= vnow)
+			break;
+	}
+	if (to > vnow)
+		vnow = to;
+	dhcp6_clock_update();
+}
+
+/* message type of a client message, the innermost one if relayed */
+static int
+replay_type(buf, len)
+	char *buf;
+	ssize_t len;
+{
+	char *msg;
+	int depth, optlen;
+
+	for (depth = 0; depth < 32 && len > 0; depth++) {
+		if ((u_int8_t)buf[0] != DH6_RELAY_FORW &&
+		    (u_int8_t)buf[0] != DH6_RELAY_REPL)
+			return (u_int8_t)buf[0];
+		if (len < sizeof(struct dhcp6_relay))
+			break;
+		msg = replay_option(buf + sizeof(struct dhcp6_relay),
+				    len - sizeof(struct dhcp6_relay),
+				    DH6OPT_RELAY_MSG, &optlen);
+		if (msg == NULL)
+			break;
+		buf = msg;
+		len = optlen;
+	}
+	return (u_int8_t)buf[0];
+}
+
+/* value of the first option "code" in an option area, NULL if none */
+static char *
+replay_option(p, len, code, optlen)
+	char *p;
+	ssize_t len;
+	int code, *optlen;
+{
+	u_int16_t t, l;
+
+	while (len >= 4) {
+		memcpy(&t, p, 2);
+		memcpy(&l, p + 2, 2);
+		t = ntohs(t);
+		l = ntohs(l);
+		if (l > len - 4)
+			return NULL;
+		if (t == code) {
+			*optlen = l;
+			return p + 4;
+		}
+		p += 4 + l;
+		len -= 4 + l;
+	}
+	return NULL;
+}
+
+/* remember the server identifier of a message, 0 if it had one */
+static int
+replay_serverid(buf, len)
+	char *buf;
+	ssize_t len;
+{
+	char *id;
+	int l;
+
+	if (len < sizeof(struct dhcp6) ||
+	    (id = replay_option(buf + sizeof(struct dhcp6),
+				len - sizeof(struct dhcp6),
+				DH6OPT_SERVERID, &l)) == NULL ||
+	    l == 0 || l > sizeof(srvid))
+		return -1;
+	memcpy(srvid, id, l);
+	srvidlen = l;
+	return 0;
+}
+
+/* the in-memory transport: keep the reply for the caller to look at */
+int
+server6_transmit(dst, buf, len)
+	struct sockaddr_in6 *dst;
+	char *buf;
+	size_t len;
+{
+	if (len > sizeof(txbuf))
+		return -1;
+	memcpy(txbuf, buf, len);
+	txlen = len;
+	return 0;
+}
+
+/*
+ * Hand one message to the server the way server6_recv() would, then run
+ * the timer pass the main loop makes before waiting again.  Returns the
+ * type of the reply, -1 if there was none.
+ */
+static int
+replay_input(buf, len)
+	char *buf;
+	ssize_t len;
+{
+	struct msgstats *st;
+	u_int64_t t, a, f;
+	int type;
+
+	type = replay_type(buf, len);
+	st = &stats[type < MSG_TYPES ? type : 0];
+
+	txlen = -1;
+	a = nallocs;
+	f = nfrees;
+	t = cputime();
+	server6_replay_input(buf, len, &replay_pi,
+			     (struct sockaddr *)&replay_from,
+			     sizeof(replay_from));
+	t = cputime() - t;
+
+	st->count++;
+	st->cpu += t;
+	st->allocs += nallocs - a;
+	st->frees += nfrees - f;
+	stats_hist_add(&st->hist, t);
+	if (lease_hash_table->hash_count > leases_peak)
+		leases_peak = lease_hash_table->hash_count;
+
+	replay_timers();
+
+	if (txlen < 0)
+		return -1;
+	st->replied++;
+	type = replay_type(txbuf, txlen);
+	replies[type < MSG_TYPES ? type : 0]++;
+	return type;
+}
+
+/* uniform in [0, max), max may be above random()'s 31 bits */
+static u_int64_t
+synth_random(max)
+	u_int64_t max;
+{
+	if (max == 0)
+		return 0;
+	return (((u_int64_t)random() << 31) | random()) % max;
+}
+
+static void
+heap_down(i)
+	u_int32_t i;
+{
+	u_int32_t c, idx = heap[i];
+
+	while ((c = 2 * i + 1) < nclients) {
+		if (c + 1 < nclients &&
+		    clients[heap[c + 1]].due < clients[heap[c]].due)
+			c++;
+		if (clients[idx].due <= clients[heap[c]].due)
+			break;
+		heap[i] = heap[c];
+		i = c;
+	}
+	heap[i] = idx;
+}
+
+static void
+heap_up(i)
+	u_int32_t i;
+{
+	u_int32_t p, idx = heap[i];
+
+	while (i > 0) {
+		p = (i - 1) / 2;
+		if (clients[heap[p]].due <= clients[idx].due)
+			break;
+		heap[i] = heap[p];
+		i = p;
+	}
+	heap[i] = idx;
+}
+
+/* build a client message, without the option codec so it is not measured */
+static ssize_t
+synth_message(idx, type, buf)
+	u_int32_t idx;
+	int type;
+	char *buf;
+{
+	struct replay_client *c = &clients[idx];
+	struct dhcp6 *dh6 = (struct dhcp6 *)buf;
+	char *p = (char *)(dh6 + 1);
+	u_int16_t v16;
+	u_int32_t v32;
+
+	dh6->dh6_xid = htonl(idx);
+	dh6->dh6_msgtype = type;
+
+#define PUT16(v)	do { v16 = htons(v); memcpy(p, &v16, 2); p += 2; } while (0)
+#define PUT32(v)	do { v32 = htonl(v); memcpy(p, &v32, 4); p += 4; } while (0)
+	/* DUID-LL, hardware type 1, locally administered MAC */
+	PUT16(DH6OPT_CLIENTID);
+	PUT16(10);
+	PUT16(3);
+	PUT16(1);
+	PUT16(0x0200);
+	PUT32(c->duid);
+	if (type != DH6_SOLICIT) {
+		PUT16(DH6OPT_SERVERID);
+		PUT16(srvidlen);
+		memcpy(p, srvid, srvidlen);
+		p += srvidlen;
+	}
+	PUT16(DH6OPT_ELAPSED_TIME);
+	PUT16(2);
+	PUT16(0);
+	PUT16(DH6OPT_IA_NA);
+	PUT16(type == DH6_SOLICIT ? 12 : 12 + 4 + 24);
+	PUT32(1);
+	PUT32(0);
+	PUT32(0);
+	if (type != DH6_SOLICIT) {
+		PUT16(DH6OPT_IADDR);
+		PUT16(24);
+		memcpy(p, &c->addr, sizeof(c->addr));
+		p += sizeof(c->addr);
+		PUT32(0);
+		PUT32(0);
+	}
+#undef PUT16
+#undef PUT32
+	return p - buf;
+}
+
+/* send a client's next message and schedule the one after */
+static void
+synth_step(idx)
+	u_int32_t idx;
+{
+	struct replay_client *c = &clients[idx];
+	char buf[512], *ia, *ad, *st;
+	int type, reply, ialen, adlen, stlen;
+	u_int16_t code = DH6OPT_STCODE_SUCCESS;
+	u_int32_t t1 = 0, pref = 0, valid = 0;
+	ssize_t len;
+
+	if (c->state == ST_RENEW && random() % 100 < churn) {
+		/* the device goes away and a new one turns up later */
+		if (random() % 2) {
+			len = synth_message(idx, DH6_RELEASE, buf);
+			replay_input(buf, len);
+			released++;
+		} else
+			abandoned++;
+		c->duid = next_duid++;
+		c->state = ST_SOLICIT;
+		c->due = vnow + synth_random(arrival);
+		return;
+	}
+
+	type = c->state == ST_SOLICIT ? DH6_SOLICIT :
+	       c->state == ST_REQUEST ? DH6_REQUEST : DH6_RENEW;
+	len = synth_message(idx, type, buf);
+	reply = replay_input(buf, len);
+
+	if (reply >= 0 && txlen > sizeof(struct dhcp6)) {
+		char *opts = txbuf + sizeof(struct dhcp6);
+		ssize_t optslen = txlen - sizeof(struct dhcp6);
+
+		if (srvidlen == 0)
+			replay_serverid(txbuf, txlen);
+		if ((st = replay_option(opts, optslen, DH6OPT_STATUS_CODE,
+					&stlen)) != NULL && stlen >= 2)
+			code = ntohs(*(u_int16_t *)st);
+		if ((ia = replay_option(opts, optslen, DH6OPT_IA_NA,
+					&ialen)) != NULL && ialen >= 12) {
+			t1 = ntohl(*(u_int32_t *)(ia + 4));
+			if ((st = replay_option(ia + 12, ialen - 12,
+						DH6OPT_STATUS_CODE,
+						&stlen)) != NULL && stlen >= 2)
+				code = ntohs(*(u_int16_t *)st);
+			if ((ad = replay_option(ia + 12, ialen - 12,
+						DH6OPT_IADDR, &adlen)) != NULL &&
+			    adlen >= 24) {
+				memcpy(&c->addr, ad, sizeof(c->addr));
+				pref = ntohl(*(u_int32_t *)(ad + 16));
+				valid = ntohl(*(u_int32_t *)(ad + 20));
+			}
+		}
+	}
+	if (reply < 0 || code != DH6OPT_STCODE_SUCCESS || valid == 0) {
+		failed++;
+		c->state = ST_SOLICIT;
+		c->due = vnow + RETRY_USEC;
+		return;
+	}
+
+	if (c->state == ST_SOLICIT) {
+		c->state = ST_REQUEST;
+		c->due = vnow + 1000;
+		return;
+	}
+	if (c->state == ST_REQUEST)
+		bound++;
+	else
+		renewed++;
+	if (t1 == 0 || t1 == DHCP6_DURATITION_INFINITE)
+		t1 = pref / 2;
+	if (t1 == 0 || pref == DHCP6_DURATITION_INFINITE)
+		t1 = 3600;
+	c->state = ST_RENEW;
+	c->due = vnow + (u_int64_t)t1 * 1000000;
+}
+
+static void
+synth_run(duration)
+	u_int64_t duration;
+{
+	u_int32_t i, idx;
+	u_int64_t end;
+
+	if ((clients = malloc(nclients * sizeof(*clients))) == NULL ||
+	    (heap = malloc(nclients * sizeof(*heap))) == NULL) {
+		fprintf(stderr, "dhcp6replay: no memory for %u clients\n",
+			nclients);
+		exit(1);
+	}
+	end = vstart + duration;
+	memset(&replay_from, 0, sizeof(replay_from));
+	replay_from.sin6_family = AF_INET6;
+	replay_from.sin6_port = htons(atoi(DH6PORT_DOWNSTREAM));
+	replay_from.sin6_addr.s6_addr[0] = 0xfe;
+	replay_from.sin6_addr.s6_addr[1] = 0x80;
+	replay_from.sin6_scope_id = replay_pi.ipi6_ifindex;
+	inet_pton(AF_INET6, DH6ADDR_ALLAGENT, &replay_pi.ipi6_addr);
+	for (i = 0; i < nclients; i++) {
+		memset(&clients[i], 0, sizeof(clients[i]));
+		clients[i].duid = next_duid++;
+		clients[i].state = ST_SOLICIT;
+		clients[i].due = vstart + synth_random(arrival);
+		heap[i] = i;
+		heap_up(i);
+	}
+
+	while (clients[heap[0]].due < end) {
+		idx = heap[0];
+		replay_advance(clients[idx].due);
+		/* a link-local source address per client, fe80::<idx + 1> */
+		replay_from.sin6_addr.s6_addr32[3] = htonl(idx + 1);
+		synth_step(idx);
+		heap_down(0);
+	}
+	replay_advance(end);
+}
+
+static int
+pcap_open(p, path)
+	struct pcap *p;
+	char *path;
+{
+	u_int32_t hdr[6];
+
+	memset(p, 0, sizeof(*p));
+	if ((p->fp = fopen(path, "r")) == NULL) {
+		fprintf(stderr, "dhcp6replay: %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+	if (fread(hdr, sizeof(hdr), 1, p->fp) != 1)
+		goto bad;
+	switch (hdr[0]) {
+	case PCAP_MAGIC:
+		break;
+	case PCAP_MAGIC_NSEC:
+		p->nsec = 1;
+		break;
+	default:
+		p->swap = 1;
+		if (__builtin_bswap32(hdr[0]) == PCAP_MAGIC_NSEC)
+			p->nsec = 1;
+		else if (__builtin_bswap32(hdr[0]) != PCAP_MAGIC)
+			goto bad;
+	}
+	p->linktype = PCAP_SWAP(p, hdr[5]) & 0xffff;
+	return 0;
+
+  bad:
+	fprintf(stderr, "dhcp6replay: %s: not a pcap file\n", path);
+	fclose(p->fp);
+	return -1;
+}
+
+/* read the next record, its length or -1 at the end of the file */
+static int
+pcap_next(p, ts, buf, size)
+	struct pcap *p;
+	u_int64_t *ts;
+	char *buf;
+	size_t size;
+{
+	u_int32_t rec[4], caplen;
+
+	for (;;) {
+		if (fread(rec, sizeof(rec), 1, p->fp) != 1)
+			return -1;
+		caplen = PCAP_SWAP(p, rec[2]);
+		*ts = (u_int64_t)PCAP_SWAP(p, rec[0]) * 1000000 +
+		      (p->nsec ? PCAP_SWAP(p, rec[1]) / 1000 : PCAP_SWAP(p, rec[1]));
+		if (caplen <= size) {
+			if (fread(buf, caplen, 1, p->fp) != 1)
+				return -1;
+			return caplen;
+		}
+		if (fseek(p->fp, caplen, SEEK_CUR) < 0)
+			return -1;
+	}
+}
+
+/*
+ * Find the DHCPv6 payload of a UDP datagram to the server port and fill
+ * in replay_from and replay_pi.ipi6_addr from its headers.
+ */
+static char *
+pcap_udp(p, buf, caplen, len)
+	struct pcap *p;
+	char *buf;
+	ssize_t caplen, *len;
+{
+	u_int8_t *ip, *end = (u_int8_t *)buf + caplen;
+	u_int16_t proto, ulen;
+	int nh, off;
+
+	switch (p->linktype) {
+	case 0:		/* BSD loopback, address family in host order */
+		ip = (u_int8_t *)buf + 4;
+		break;
+	case 1:		/* Ethernet, possibly VLAN tagged */
+		off = 12;
+		do {
+			if (buf + off + 2 > (char *)end)
+				return NULL;
+			proto = ((u_int8_t)buf[off] << 8) | (u_int8_t)buf[off + 1];
+			off += 2;
+			if (proto == 0x8100 || proto == 0x88a8)
+				off += 2;
+		} while (proto == 0x8100 || proto == 0x88a8);
+		if (proto != 0x86dd)
+			return NULL;
+		ip = (u_int8_t *)buf + off;
+		break;
+	case 113:	/* Linux cooked */
+		if (caplen < 16 ||
+		    (((u_int8_t)buf[14] << 8) | (u_int8_t)buf[15]) != 0x86dd)
+			return NULL;
+		ip = (u_int8_t *)buf + 16;
+		break;
+	case 276:	/* Linux cooked v2 */
+		if (caplen < 20 ||
+		    (((u_int8_t)buf[0] << 8) | (u_int8_t)buf[1]) != 0x86dd)
+			return NULL;
+		ip = (u_int8_t *)buf + 20;
+		break;
+	case 12:
+	case 101:	/* raw IP */
+	case 229:	/* raw IPv6 */
+		ip = (u_int8_t *)buf;
+		break;
+	default:
+		return NULL;
+	}
+	if (ip + 40 > end || (ip[0] >> 4) != 6)
+		return NULL;
+
+	memset(&replay_from, 0, sizeof(replay_from));
+	replay_from.sin6_family = AF_INET6;
+	memcpy(&replay_from.sin6_addr, ip + 8, 16);
+	memcpy(&replay_pi.ipi6_addr, ip + 24, 16);
+	if (IN6_IS_ADDR_LINKLOCAL(&replay_from.sin6_addr))
+		replay_from.sin6_scope_id = replay_pi.ipi6_ifindex;
+
+	/* hop-by-hop, routing and destination options; no fragments */
+	nh = ip[6];
+	ip += 40;
+	while (nh == 0 || nh == 43 || nh == 60) {
+		if (ip + 8 > end)
+			return NULL;
+		nh = ip[0];
+		ip += (ip[1] + 1) * 8;
+	}
+	if (nh != IPPROTO_UDP || ip + 8 > end)
+		return NULL;
+	if (((ip[2] << 8) | ip[3]) != atoi(DH6PORT_UPSTREAM))
+		return NULL;
+	memcpy(&replay_from.sin6_port, ip, 2);
+	ulen = (ip[4] << 8) | ip[5];
+	if (ulen < 8)
+		return NULL;
+	ip += 8;
+	*len = ulen - 8;
+	if (ip + *len > end)
+		*len = end - ip;
+	if (*len < sizeof(struct dhcp6))
+		return NULL;
+
+	/* what the server sends to relays is to port 547 too */
+	switch (ip[0]) {
+	case DH6_ADVERTISE:
+	case DH6_REPLY:
+	case DH6_RECONFIGURE:
+	case DH6_RELAY_REPL:
+		return NULL;
+	}
+	return (char *)ip;
+}
+
+static void
+pcap_run(path)
+	char *path;
+{
+	struct pcap p;
+	char buf[65536], *msg;
+	u_int64_t ts;
+	ssize_t len;
+	int caplen;
+
+	if (pcap_open(&p, path) < 0)
+		exit(1);
+	while ((caplen = pcap_next(&p, &ts, buf, sizeof(buf))) >= 0) {
+		if ((msg = pcap_udp(&p, buf, caplen, &len)) == NULL)
+			continue;
+		replay_advance(ts > vnow ? ts : vnow);
+		replay_input(msg, len);
+	}
+	fclose(p.fp);
+}
+
+/*
+ * Start the clock at the first message of the trace and, unless given
+ * one, take the first server identifier a client asked for as the DUID
+ * of the server.
+ */
+static void
+pcap_scan(path, needid)
+	char *path;
+	int needid;
+{
+	struct pcap p;
+	char buf[65536], *msg;
+	u_int64_t ts;
+	ssize_t len;
+	int caplen, optlen;
+
+	if (pcap_open(&p, path) < 0)
+		exit(1);
+	while ((caplen = pcap_next(&p, &ts, buf, sizeof(buf))) >= 0) {
+		if ((msg = pcap_udp(&p, buf, caplen, &len)) == NULL)
+			continue;
+		if (vstart == 0)
+			vnow = vstart = ts;
+		if (!needid)
+			break;
+		while ((u_int8_t)msg[0] == DH6_RELAY_FORW &&
+		       len > sizeof(struct dhcp6_relay) &&
+		       (msg = replay_option(msg + sizeof(struct dhcp6_relay),
+					    len - sizeof(struct dhcp6_relay),
+					    DH6OPT_RELAY_MSG, &optlen)) != NULL)
+			len = optlen;
+		if (msg != NULL && replay_serverid(msg, len) == 0)
+			break;
+	}
+	fclose(p.fp);
+}
+
+/*
+ * Give the server a DUID file so get_duid() does not need a hardware
+ * address: the one the trace's clients talk to, or a fixed DUID-LL.
+ */
+static void
+write_duid(path)
+	char *path;
+{
+	static const char fixed[] = { 0, 3, 0, 1, 2, 0, 0, 0, 0, 1 };
+	u_int16_t len;
+	FILE *fp;
+
+	if (access(path, F_OK) == 0)
+		return;
+	if (srvidlen == 0) {
+		memcpy(srvid, fixed, sizeof(fixed));
+		srvidlen = sizeof(fixed);
+	}
+	len = srvidlen;
+	if ((fp = fopen(path, "w")) == NULL ||
+	    fwrite(&len, sizeof(len), 1, fp) != 1 ||
+	    fwrite(srvid, len, 1, fp) != 1) {
+		fprintf(stderr, "dhcp6replay: %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	fclose(fp);
+	/* the synthetic clients learn it from the first ADVERTISE */
+	srvidlen = 0;
+}
+
+static void
+replay_report(wall)
+	u_int64_t wall;
+{
+	double virt = (vnow - vstart) / 1e6, secs = wall / 1e9;
+	u_int64_t n = 0, cpu = 0;
+	int i;
+
+	for (i = 0; i < MSG_TYPES; i++) {
+		n += stats[i].count;
+		cpu += stats[i].cpu;
+	}
+	printf("%llu messages over %.1f virtual hours in %.3f s (%.0fx)\n",
+	       (unsigned long long)n, virt / 3600, secs,
+	       secs > 0 ? virt / secs : 0.0);
+	printf("%-12s %10s %10s %9s %9s %9s %9s %10s %10s\n", "message",
+	       "count", "replied", "avg(us)", "p50(us)", "p99(us)",
+	       "p999(us)", "allocs/msg", "frees/msg");
+	for (i = 0; i <= MSG_TYPES; i++) {
+		struct msgstats *st = i < MSG_TYPES ? &stats[i] : &timerstats;
+
+		if (st->count == 0)
+			continue;
+		printf("%-12s %10llu %10llu %9.2f %9.2f %9.2f %9.2f %10.2f %10.2f\n",
+		       i == MSG_TYPES ? "(timers)" :
+		       i == 0 ? "(other)" : dhcp6msgstr(i),
+		       (unsigned long long)st->count,
+		       (unsigned long long)st->replied,
+		       st->cpu / 1e3 / st->count,
+		       stats_hist_percentile(&st->hist, 0.5) / 1e3,
+		       stats_hist_percentile(&st->hist, 0.99) / 1e3,
+		       stats_hist_percentile(&st->hist, 0.999) / 1e3,
+		       (double)st->allocs / st->count,
+		       (double)st->frees / st->count);
+	}
+	printf("replies:");
+	for (i = 0; i < MSG_TYPES; i++) {
+		if (replies[i])
+			printf(" %s %llu", i ? dhcp6msgstr(i) : "(other)",
+			       (unsigned long long)replies[i]);
+	}
+	printf("\n");
+	printf("server cpu: %.3f s in messages, %.3f s in timers\n",
+	       cpu / 1e9, timerstats.cpu / 1e9);
+	printf("leases: %u at end, %u peak, %llu expired\n",
+	       lease_hash_table->hash_count, leases_peak,
+	       (unsigned long long)leases_expired);
+	if (clients != NULL)
+		printf("clients: %llu bound, %llu renewals, %llu released, "
+		       "%llu abandoned, %llu failed exchanges\n",
+		       (unsigned long long)bound, (unsigned long long)renewed,
+		       (unsigned long long)released,
+		       (unsigned long long)abandoned,
+		       (unsigned long long)failed);
+}
+
+int
+main(argc, argv)
+	int argc;
+	char **argv;
+{
+	char *conffile = "/etc/dhcp6s.conf", *ifname = "lo", *dir = NULL;
+	char *pcapfile = NULL, *duid = NULL, path[MAXPATHLEN];
+	char tmpdir[] = "/tmp/dhcp6replay.XXXXXX";
+	u_int64_t duration = 86400 * 1000000ULL, wall;
+	unsigned long n;
+	unsigned int seed = 1;
+	int ch, debug = 0;
+	DIR *dp;
+	struct dirent *de;
+
+	while ((ch = getopt(argc, argv, "a:c:dD:i:n:p:r:s:S:t:")) != -1) {
+		switch (ch) {
+		case 'a':
+			arrival = (u_int64_t)(atof(optarg) * 1e6);
+			break;
+		case 'c':
+			conffile = optarg;
+			break;
+		case 'd':
+			debug++;
+			break;
+		case 'D':
+			dir = optarg;
+			break;
+		case 'i':
+			ifname = optarg;
+			break;
+		case 'n':
+			n = strtoul(optarg, NULL, 10);
+			if (n == 0 || n > DH6_XIDMASK) {
+				fprintf(stderr, "dhcp6replay: clients must be "
+					"between 1 and %u\n", DH6_XIDMASK);
+				exit(1);
+			}
+			nclients = n;
+			break;
+		case 'p':
+			pcapfile = optarg;
+			break;
+		case 'r':
+			churn = atoi(optarg);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 'S':
+			duid = optarg;
+			break;
+		case 't':
+			duration = (u_int64_t)(atof(optarg) * 1e6);
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind != argc)
+		usage();
+
+	foreground = 1;
+	setloglevel(debug);
+	/* dprintf hands whatever is below the threshold to syslog */
+	setlogmask(LOG_UPTO(debug ? LOG_DEBUG : LOG_ERR));
+	srandom(seed);
+
+	if (dir == NULL && (dir = mkdtemp(tmpdir)) == NULL) {
+		fprintf(stderr, "dhcp6replay: mkdtemp: %s\n", strerror(errno));
+		exit(1);
+	}
+	if ((replay_pi.ipi6_ifindex = if_nametoindex(ifname)) == 0) {
+		fprintf(stderr, "dhcp6replay: unknown interface %s\n", ifname);
+		exit(1);
+	}
+	if (duid != NULL) {
+		char *cp;
+
+		for (cp = duid; *cp && srvidlen < sizeof(srvid); ) {
+			srvid[srvidlen++] = strtoul(cp, &cp, 16);
+			if (*cp == ':')
+				cp++;
+			else if (*cp)
+				usage();
+		}
+	}
+	/* a fixed epoch keeps synthetic runs reproducible */
+	if (pcapfile != NULL)
+		pcap_scan(pcapfile, duid == NULL);
+	if (vstart == 0)
+		vnow = vstart = 1000000000 * 1000000ULL;
+	snprintf(path, sizeof(path), "%s/dhcp6s_duid", dir);
+	write_duid(path);
+
+	dhcp6_clock = replay_clock;
+	dhcp6_timer_init();
+	server6_replay_init(conffile, ifname, dir);
+	replay_timers();
+
+	wall = walltime();
+	if (pcapfile != NULL)
+		pcap_run(pcapfile);
+	else
+		synth_run(duration);
+	wall = walltime() - wall;
+
+	replay_report(wall);
+
+	if (dir == tmpdir && (dp = opendir(dir)) != NULL) {
+		while ((de = readdir(dp)) != NULL) {
+			if (de->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+			unlink(path);
+		}
+		closedir(dp);
+		rmdir(dir);
+	}
+	exit(0);
+}
+
+static void
+usage()
+{
+	fprintf(stderr,
+		"usage: dhcp6replay [-d] [-c configfile] [-D dir] [-i interface]\n"
+		"                   [-S serverduid] [-s seed] -p pcapfile\n"
+		"       dhcp6replay [-d] [-c configfile] [-D dir] [-i interface]\n"
+		"                   [-s seed] [-a arrival] [-n clients] "
+		"[-r churn%%] [-t secs]\n");
+	exit(1);
+}
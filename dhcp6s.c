@@ -31,6 +31,7 @@
  */
 
 #include <sys/types.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/socket.h>
 #include <linux/sockios.h>
@@ -38,6 +39,8 @@
 #include <sys/file.h>
 
 #include <sys/uio.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
 #if TIME_WITH_SYS_TIME
 # include <sys/time.h>
 # include <time.h>
@@ -67,6 +70,7 @@
 #include <err.h>
 #include <netdb.h>
 #include <limits.h>
+#include <signal.h>
 
 #include "queue.h"
 #include "timer.h"
@@ -75,6 +79,15 @@
 #include "common.h"
 #include "server6_conf.h"
 #include "lease.h"
+#include "hash.h"
+#include "server6_stats.h"
+#include "server6_ctl.h"
+#include "server6_lq.h"
+#include "server6_balance.h"
+#include "server6_bulk.h"
+#include "server6_limit.h"
+#include "server6_reconf.h"
+#include "server6_repl.h"
 
 typedef enum { DHCP6_CONFINFO_PREFIX, DHCP6_CONFINFO_ADDRS } dhcp6_conftype_t;
 
@@ -89,24 +102,38 @@ struct dhcp6_binding {
 	struct dhcp6_timer *timer;
 };
 
-static char *device[100];
-static int num_device = 0;
-static int debug = 0;
 const dhcp6_mode_t dhcp6_mode = DHCP6_MODE_SERVER;
 int insock;	/* inbound udp port */
 int outsock;	/* outbound udp port */
+int nlsock = -1;	/* rtnetlink link monitor */
+#ifndef DHCP6S_REPLAY
+static char *device[100];
+static int num_device = 0;
+static int debug = 0;
+static int ctlsock = -1;	/* control socket */
+static char *ctlpath = DHCP6S_CTL;
+static int bulk = 0;		/* serve bulk leasequery */
+static int share_ports = 0;	/* let a local load generator bind 546/547 */
+static int bulksock = -1;
+static char *repl_peer = NULL;	/* replicate leases to or from */
+static int repl_standby = 0;
+static dhcp6_time_t server_start;
+static struct msghdr rmh;
+static char rdatabuf[BUFSIZ];
+static int rmsgctllen;
+static char *rmsgctlbuf;
+#endif
+static u_int64_t rx_start;	/* when the current message was read */
 extern FILE *server6_lease_file;
 char server6_lease_temp[100];
 
 static const struct sockaddr_in6 *sa6_any_downstream;
 static u_int16_t upstream_port;
-static struct msghdr rmh;
-static char rdatabuf[BUFSIZ];
-static int rmsgctllen;
-static char *rmsgctlbuf;
 static struct duid server_duid;
 static struct dns_list arg_dnslist;
 static struct dhcp6_timer *sync_lease_timer;
+static char *server6_lease_path = PATH_SERVER6_LEASE;
+static char *server6_conffile;
 
 struct link_decl *subnet = NULL;
 struct host_decl *host = NULL;
@@ -120,18 +147,55 @@ struct rootgroup *globalgroup = NULL;
 	 a == DH6_REBIND || a == DH6_CONFIRM || a == DH6_RELEASE || \
 	 a == DH6_DECLINE || a == DH6_INFORM_REQ)
 
+#ifndef DHCP6S_REPLAY
 static void usage __P((void));
 static void server6_init __P((void));
 static void server6_mainloop __P((void));
 static int server6_recv __P((int));
+static int server6_link_event __P((struct nlmsghdr *, void *));
+static int server6_transmit __P((struct sockaddr_in6 *, char *, size_t));
+static void server6_ctl_stats __P((FILE *, char *));
+static void server6_ctl_reload __P((FILE *, char *));
+static void server6_reload __P((void));
+static void server6_hup __P((int));
+
+static volatile sig_atomic_t reload_pending = 0;
+
+static const struct server6_ctl_cmd server6_ctl_cmds[] = {
+	{ "stats", server6_ctl_stats },
+	{ "reload", server6_ctl_reload },
+	{ "balance", server6_balance_ctl },
+	{ "repl", server6_repl_ctl },
+	{ "reconfigure", server6_reconf_ctl },
+	{ "limit", server6_limit_ctl },
+	{ NULL, NULL }
+};
+#else
+/* supplied by dhcp6replay in place of the sockets */
+extern int server6_transmit __P((struct sockaddr_in6 *, char *, size_t));
+#endif
+static void server6_state_init __P((char *));
+static struct rootgroup *server6_conf_load __P((char *));
+static int server6_input __P((char *, ssize_t, struct in6_pktinfo *,
+			      struct sockaddr *, int));
 static int server6_react_message __P((struct dhcp6_if *,
 				      struct in6_pktinfo *, struct dhcp6 *,
 				      struct dhcp6_optinfo *,
 				      struct sockaddr *, int));
+static int server6_react_ia __P((int, int, int, int, struct dhcp6_optinfo *,
+				 struct dhcp6_optinfo *));
+static int server6_ia_status __P((struct dhcp6_optinfo *,
+				  struct dhcp6_optinfo *, int));
+static int server6_react_ias __P((int, int, int, int, struct dhcp6_optinfo *,
+				  struct dhcp6_optinfo *, int));
+static int server6_leasequery __P((struct dhcp6_if *, struct dhcp6 *,
+				    struct dhcp6opt *,
+				    struct dhcp6_optinfo *,
+				    struct sockaddr *, int));
 static int server6_send __P((int, struct dhcp6_if *, struct dhcp6 *,
 			     struct dhcp6_optinfo *,
 			     struct sockaddr *, int,
-			     struct dhcp6_optinfo *));
+			     struct dhcp6_optinfo *, char *, int));
 static struct dhcp6_timer *check_lease_file_timo __P((void *arg));
 static struct dhcp6 *dhcp6_parse_relay __P((struct dhcp6_relay *,
                                             struct dhcp6_relay *,
@@ -150,6 +214,7 @@ extern struct host_decl *dhcp6_allocate_host __P((struct dhcp6_if *, struct root
 extern int dhcp6_get_hostconf __P((struct dhcp6_optinfo *, struct dhcp6_optinfo *,
 			struct dhcp6_iaidaddr *, struct host_decl *)); 
 
+#ifndef DHCP6S_REPLAY
 static void random_init(void) 
 {
 	int f, n;
@@ -186,8 +251,11 @@ main(argc, argv)
 	TAILQ_INIT(&arg_dnslist.addrlist);
 
 	random_init();
-	while ((ch = getopt(argc, argv, "c:dDfn:")) != -1) {
+	while ((ch = getopt(argc, argv, "bc:dDfl:L:n:Pr:R:s:")) != -1) {
 		switch (ch) {
+		case 'b':
+			bulk = 1;
+			break;
 		case 'c':
 			conffile = optarg;
 			break;
@@ -200,6 +268,18 @@ main(argc, argv)
 		case 'f':
 			foreground++;
 			break;
+		case 'l':
+			if (server6_balance_set(optarg) < 0) {
+				errx(1, "invalid bucket range %s", optarg);
+				/* NOTREACHED */
+			}
+			break;
+		case 'L':
+			if (server6_limit_set(optarg) < 0) {
+				errx(1, "invalid limit %s", optarg);
+				/* NOTREACHED */
+			}
+			break;
 		case 'n':
 			warnx("-n dnsserv option was obsoleted.  "
 			    "use configuration file.");
@@ -214,6 +294,17 @@ main(argc, argv)
 			dlv->val_addr6 = a;
 			TAILQ_INSERT_TAIL(&arg_dnslist.addrlist, dlv, link);
 			break;
+		case 'P':
+			share_ports = 1;
+			break;
+		case 'r':
+		case 'R':
+			repl_peer = optarg;
+			repl_standby = (ch == 'R');
+			break;
+		case 's':
+			ctlpath = optarg;
+			break;
 		default:
 			usage();
 			/* NOTREACHED */
@@ -232,29 +323,7 @@ main(argc, argv)
 	setloglevel(debug);
 
 	server6_init();
-	if ((server6_lease_file = init_leases(PATH_SERVER6_LEASE)) == NULL) {
-		dprintf(LOG_ERR, "%s" "failed to parse lease file",
-			FNAME);
-		exit(1);
-	}
-	strcpy(server6_lease_temp, PATH_SERVER6_LEASE);
-	strcat(server6_lease_temp, "XXXXXX");
-	server6_lease_file = 
-		sync_leases(server6_lease_file, PATH_SERVER6_LEASE, server6_lease_temp);	
-	if (server6_lease_file == NULL)
-		exit(1);
-	globalgroup = (struct rootgroup *)malloc(sizeof(struct rootgroup));
-	if (globalgroup == NULL) {
-		dprintf(LOG_ERR, "failed to allocate memory %s", strerror(errno));
-		exit(1);
-	}
-	memset(globalgroup, 0, sizeof(*globalgroup));
-	TAILQ_INIT(&globalgroup->scope.dnslist.addrlist);
-	if ((sfparse(conffile)) != 0) {
-		dprintf(LOG_ERR, "%s" "failed to parse addr configuration file",
-			FNAME);
-		exit(1);
-	}
+	server6_state_init(conffile);
 	server6_mainloop();
 	exit(0);
 }
@@ -263,7 +332,10 @@ static void
 usage()
 {
 	fprintf(stderr,
-		"usage: dhcp6s [-c configfile] [-dDf] [interface]\n");
+		"usage: dhcp6s [-c configfile] [-bdDfP] [-l first-last] "
+		"[-L key=rate[/burst]]\n"
+		"              [-r standby | -R primary] [-s ctlsocket] "
+		"[interface]\n");
 	exit(0);
 }
 
@@ -283,8 +355,6 @@ server6_init()
 	char buff[1024];
 	struct ifconf ifc;
 	struct ifreq *ifr;
-	double d;
-	struct timeval timo;
 	/* initialize inbound socket */
 	memset(&hints, 0, sizeof(hints));
 	hints.ai_family = PF_INET6;
@@ -320,6 +390,14 @@ server6_init()
 		exit(1);
 	}
 #endif
+	/* let a load generator on this host bind the ports to its own address */
+	if (share_ports && setsockopt(insock, SOL_SOCKET, SO_REUSEADDR, &on,
+		       sizeof(on)) < 0) {
+		dprintf(LOG_ERR, "%s"
+			"setsockopt(inbound, SO_REUSEADDR): %s",
+			FNAME, strerror(errno));
+		exit(1);
+	}
 	if (bind(insock, res->ai_addr, res->ai_addrlen) < 0) {
 		dprintf(LOG_ERR, "%s" "bind(insock): %s",
 			FNAME, strerror(errno));
@@ -342,6 +420,13 @@ server6_init()
 			FNAME, strerror(errno));
 		exit(1);
 	}
+	if (share_ports && setsockopt(outsock, SOL_SOCKET, SO_REUSEADDR, &on,
+		       sizeof(on)) < 0) {
+		dprintf(LOG_ERR, "%s"
+			"setsockopt(outbound, SO_REUSEADDR): %s",
+			FNAME, strerror(errno));
+		exit(1);
+	}
 	if (bind(outsock, res->ai_addr, res->ai_addrlen) < 0) {
 		dprintf(LOG_ERR, "%s" "bind(outsock): %s",
 			FNAME, strerror(errno));
@@ -466,13 +551,24 @@ server6_init()
 			exit(1);
 		}
 	}
-	/* set up sync lease file timer */
-	sync_lease_timer = dhcp6_add_timer(check_lease_file_timo, NULL);
-	d = DHCP6_SYNCFILE_TIME;
-	timo.tv_sec = (long)d;
-	timo.tv_usec = 0;
-	dprintf(LOG_DEBUG, "set timer for syncing file ...");
-	dhcp6_set_timer(&timo, sync_lease_timer);
+	/* watch for interfaces being renumbered */
+	if ((nlsock = netlink_open_monitor(RTMGRP_LINK)) < 0)
+		dprintf(LOG_WARNING, "%s" "interface changes will be missed",
+			FNAME);
+	server_start = dhcp6_now();
+	if ((ctlsock = server6_ctl_open(ctlpath)) < 0)
+		dprintf(LOG_WARNING, "%s" "no control socket", FNAME);
+	if (bulk && (bulksock = server6_bulk_open(&server_duid)) < 0)
+		exit(1);
+	if (repl_peer && server6_repl_open(repl_peer, repl_standby) < 0)
+		exit(1);
+	if (server6_reconf_init(&server_duid) < 0)
+		exit(1);
+	if (signal(SIGHUP, server6_hup) == SIG_ERR) {
+		dprintf(LOG_WARNING, "%s" "failed to set signal: %s",
+			FNAME, strerror(errno));
+		exit(1);
+	}
 	return;
 }
 
@@ -481,29 +577,159 @@ static void
 server6_mainloop()
 {
 	struct timeval *w;
-	int ret;
-	fd_set r;
+	int ret, maxfd, relink;
+	fd_set r, wr;
 
 	while (1) {
 		w = dhcp6_check_timer();
 
 		FD_ZERO(&r);
+		FD_ZERO(&wr);
 		FD_SET(insock, &r);
-		ret = select(insock + 1, &r, NULL, NULL, w);
+		maxfd = insock;
+		if (nlsock >= 0) {
+			FD_SET(nlsock, &r);
+			if (nlsock > maxfd)
+				maxfd = nlsock;
+		}
+		if (ctlsock >= 0) {
+			FD_SET(ctlsock, &r);
+			if (ctlsock > maxfd)
+				maxfd = ctlsock;
+		}
+		if (bulksock >= 0)
+			maxfd = server6_bulk_fdset(bulksock, &r, &wr, maxfd);
+		maxfd = server6_repl_fdset(&r, &wr, maxfd);
+		ret = select(maxfd + 1, &r, &wr, NULL, w);
+		dhcp6_clock_update();
 		switch (ret) {
 		case -1:
-			dprintf(LOG_ERR, "%s" "select: %s",
-				FNAME, strerror(errno));
-			exit(1);
-			/* NOTREACHED */
+			if (errno != EINTR) {
+				dprintf(LOG_ERR, "%s" "select: %s",
+					FNAME, strerror(errno));
+				exit(1);
+			}
+			FD_ZERO(&r);
+			FD_ZERO(&wr);
+			break;
 		case 0:		/* timeout */
 			break;
 		default:
 			break;
 		}
+		if (reload_pending) {
+			reload_pending = 0;
+			server6_reload();
+		}
+		if (nlsock >= 0 && FD_ISSET(nlsock, &r)) {
+			relink = 0;
+			if (netlink_recv_monitor(nlsock, server6_link_event,
+			    &relink) > 0 && relink)
+				ifindex_refresh();
+		}
 		if (FD_ISSET(insock, &r))
 			server6_recv(insock);
+		if (ctlsock >= 0 && FD_ISSET(ctlsock, &r))
+			server6_ctl_serve(ctlsock, server6_ctl_cmds);
+		if (bulksock >= 0)
+			server6_bulk_serve(bulksock, &r, &wr);
+		server6_repl_serve(&r, &wr);
+	}
+}
+
+static void
+server6_ctl_stats(fp, args)
+	FILE *fp;
+	char *args;
+{
+	fprintf(fp, "dhcp6s_uptime_seconds %llu\n",
+	    (unsigned long long)((dhcp6_now() - server_start) / DHCP6_NSEC));
+	server6_stats_dump(fp);
+	server6_pool_dump(fp);
+}
+
+static void
+server6_ctl_reload(fp, args)
+	FILE *fp;
+	char *args;
+{
+	struct rootgroup *old = globalgroup;
+
+	server6_reload();
+	fprintf(fp, "%s\n", globalgroup != old ? "reloaded" :
+	    "failed, configuration unchanged");
+}
+
+static void
+server6_hup(sig)
+	int sig;
+{
+	reload_pending = 1;
+}
+
+/* the addresses reserved to hosts, hashed by the parser */
+static void
+server6_hostaddr_free(table)
+	struct hash_table *table;
+{
+	struct hashlist_element *element, *next;
+	int i;
+
+	for (i = 0; i < table->hash_size; i++) {
+		for (element = table->hash_list[i]; element; element = next) {
+			next = element->next;
+			free(element->data);
+			free(element);
+		}
+	}
+	free(table->hash_list);
+	free(table);
+}
+
+/*
+ * Parse the configuration file again and swap it in between two
+ * messages.  The leases stay; each is counted again in the range or
+ * prefix of the new configuration it falls in, and a binding whose
+ * address no longer is on any range learns so at its next Renew or
+ * Rebind.  A configuration that fails to parse leaves the old one in
+ * place.
+ */
+static void
+server6_reload()
+{
+	struct rootgroup *old = globalgroup, *root;
+	struct hash_table *oldhosts = host_addr_hash_table;
+
+	host_addr_hash_table = hash_table_create(DEFAULT_HASH_SIZE, addr_hash,
+	    v6addr_findkey, v6addr_key_compare);
+	if (host_addr_hash_table == NULL ||
+	    (root = server6_conf_load(server6_conffile)) == NULL) {
+		if (host_addr_hash_table != NULL)
+			server6_hostaddr_free(host_addr_hash_table);
+		host_addr_hash_table = oldhosts;
+		globalgroup = old;
+		dprintf(LOG_ERR, "%s" "failed to reload %s, keeping the "
+			"running configuration", FNAME, server6_conffile);
+		return;
 	}
+	globalgroup = root;
+	server6_pool_sync(root);
+	server6_pool_inherit(old, root);
+	server6_conf_free(old);
+	server6_hostaddr_free(oldhosts);
+	dprintf(LOG_NOTICE, "%s" "reloaded %s", FNAME, server6_conffile);
+}
+
+static int
+server6_link_event(nlm, arg)
+	struct nlmsghdr *nlm;
+	void *arg;
+{
+	/* a NULL message means events were lost */
+	if (nlm == NULL || nlm->nlmsg_type == RTM_NEWLINK ||
+	    nlm->nlmsg_type == RTM_DELLINK)
+		*(int *)arg = 1;
+	return 0;
 }
 
 static int
@@ -518,10 +744,6 @@ server6_recv(s)
 	char cmsgbuf[BUFSIZ];
 	struct cmsghdr *cm;
 	struct in6_pktinfo *pi = NULL;
-	struct dhcp6_if *ifp;
-	struct dhcp6 *dh6;
-	struct dhcp6_optinfo optinfo;
-	struct in6_addr relay;  /* the address of the first relay, if any */
 	memset(&iov, 0, sizeof(iov));
 	memset(&mhdr, 0, sizeof(mhdr));
 
@@ -534,8 +756,10 @@ server6_recv(s)
 	mhdr.msg_control = (caddr_t)cmsgbuf;
 	mhdr.msg_controllen = sizeof(cmsgbuf);
 
+	rx_start = server6_stats_clock();
 	if ((len = recvmsg(insock, &mhdr, 0)) < 0) {
 		dprintf(LOG_ERR, "%s" "recvmsg: %s", FNAME, strerror(errno));
+		STATS_DROP(DROP_RECV);
 		return -1;
 	}
 	fromlen = mhdr.msg_namelen;
@@ -550,25 +774,133 @@ server6_recv(s)
 	}
 	if (pi == NULL) {
 		dprintf(LOG_NOTICE, "%s" "failed to get packet info", FNAME);
+		STATS_DROP(DROP_NOPKTINFO);
 		return -1;
 	}
+	return server6_input(rdatabuf, len, pi, (struct sockaddr *)&from,
+	    fromlen);
+}
+
+static int
+server6_transmit(dst, buf, len)
+	struct sockaddr_in6 *dst;
+	char *buf;
+	size_t len;
+{
+	return transmit_sa(outsock, dst, buf, len);
+}
+#endif /* !DHCP6S_REPLAY */
+
+/*
+ * Load the leases and the configuration and start the lease file sync
+ * timer.
+ */
+static void
+server6_state_init(conffile)
+	char *conffile;
+{
+	double d;
+	struct timeval timo;
+
+	if ((server6_lease_file = init_leases(server6_lease_path, NULL)) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to parse lease file",
+			FNAME);
+		exit(1);
+	}
+	strcpy(server6_lease_temp, server6_lease_path);
+	strcat(server6_lease_temp, "XXXXXX");
+	server6_lease_file = 
+		sync_leases(server6_lease_file, server6_lease_path,
+		    server6_lease_temp, NULL);
+	if (server6_lease_file == NULL)
+		exit(1);
+	server6_conffile = conffile;
+	if ((globalgroup = server6_conf_load(conffile)) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to parse addr configuration file",
+			FNAME);
+		exit(1);
+	}
+	server6_pool_sync(globalgroup);
+	/* set up sync lease file timer */
+	sync_lease_timer = dhcp6_add_timer(check_lease_file_timo, NULL);
+	d = DHCP6_SYNCFILE_TIME;
+	timo.tv_sec = (long)d;
+	timo.tv_usec = 0;
+	dprintf(LOG_DEBUG, "set timer for syncing file ...");
+	dhcp6_set_timer(&timo, sync_lease_timer);
+}
+
+/* parse a configuration file into a new rootgroup, NULL if it is wrong */
+static struct rootgroup *
+server6_conf_load(conffile)
+	char *conffile;
+{
+	struct rootgroup *root;
+
+	root = (struct rootgroup *)malloc(sizeof(struct rootgroup));
+	if (root == NULL) {
+		dprintf(LOG_ERR, "failed to allocate memory %s", strerror(errno));
+		return NULL;
+	}
+	memset(root, 0, sizeof(*root));
+	TAILQ_INIT(&root->scope.dnslist.addrlist);
+	/* the parser builds into globalgroup */
+	globalgroup = root;
+	if ((sfparse(conffile)) != 0) {
+		server6_conf_free(root);
+		globalgroup = NULL;
+		return NULL;
+	}
+	return root;
+}
+
+/*
+ * Everything the server does with a received message once it is off the
+ * socket.  Kept free of socket state so dhcp6replay can drive it.
+ */
+static int
+server6_input(buf, len, pi, from, fromlen)
+	char *buf;
+	ssize_t len;
+	struct in6_pktinfo *pi;
+	struct sockaddr *from;
+	int fromlen;
+{
+	struct dhcp6_if *ifp;
+	struct dhcp6 *dh6;
+	struct dhcp6_optinfo optinfo;
+	struct in6_addr relay;  /* the address of the first relay, if any */
+	u_int64_t t0, t1;
+	int reason;
+
+	/* dhcp6replay has no recvmsg() to start the clock */
+	t0 = rx_start ? rx_start : server6_stats_clock();
+	rx_start = 0;
 	dprintf(LOG_DEBUG, "received message packet info addr is %s, scope id (%d)",
 	    in6addr2str(&pi->ipi6_addr, 0), (unsigned int)pi->ipi6_ifindex);
 	if ((ifp = find_ifconfbyid((unsigned int)pi->ipi6_ifindex)) == NULL) {
 		dprintf(LOG_INFO, "%s" "unexpected interface (%d)", FNAME,
 		    (unsigned int)pi->ipi6_ifindex);
+		STATS_DROP(DROP_NOIF);
 		return -1;
 	}
 	if (len < sizeof(*dh6)) {
 		dprintf(LOG_INFO, "%s" "short packet", FNAME);
+		STATS_DROP(DROP_SHORT);
+		return -1;
+	}
+	/* a flooding client or a looping relay stops here */
+	if ((reason = server6_limit_check(buf, len, from)) >= 0) {
+		dprintf(LOG_DEBUG, "%s" "rate limited message from %s", FNAME,
+		    addr2str(from));
+		STATS_DROP(reason);
 		return -1;
 	}
 	
-	dh6 = (struct dhcp6 *)rdatabuf;
+	dh6 = (struct dhcp6 *)buf;
 
 	dprintf(LOG_DEBUG, "%s" "received %s from %s", FNAME,
-	    dhcp6msgstr(dh6->dh6_msgtype),
-	    addr2str((struct sockaddr *)&from));
+	    dhcp6msgstr(dh6->dh6_msgtype), addr2str(from));
 
 	dhcp6_init_options(&optinfo);
 
@@ -579,7 +911,7 @@ server6_recv(s)
 	 */
 	if (dh6->dh6_msgtype == DH6_RELAY_FORW) {
 		dh6 = dhcp6_parse_relay((struct dhcp6_relay *) dh6, 
-		                        (struct dhcp6_relay *) (rdatabuf + len), 
+		                        (struct dhcp6_relay *) (buf + len), 
 		                        &optinfo, &relay);
 
 		/*
@@ -589,6 +921,7 @@ server6_recv(s)
 		if (dh6 == NULL) {
 			dprintf(LOG_INFO, "%s" "failed to parse relay fields "
 			                       "or could not find client message", FNAME);
+			STATS_DROP(DROP_RELAY);
 			return -1;
 		}
 	}
@@ -597,10 +930,15 @@ server6_recv(s)
 	 * parse and validate options in the request
 	 */
 	if (dhcp6_get_options((struct dhcp6opt *)(dh6 + 1),
-	    (struct dhcp6opt *)(rdatabuf + len), &optinfo) < 0) {
+	    (struct dhcp6opt *)(buf + len), &optinfo) < 0) {
 		dprintf(LOG_INFO, "%s" "failed to parse options", FNAME);
+		STATS_DROP(DROP_OPTIONS);
 		return -1;
 	}
+	server6_stats.rx[STATS_TYPE(dh6->dh6_msgtype)]++;
+	t1 = server6_stats_clock();
+	server6_stats_add(STAGE_RECEIVE, t1 - t0);
+	server6_stats.msg_nested = 0;
 	/* check host decl first */
 	host = dhcp6_allocate_host(ifp, globalgroup, &optinfo);
 	/* ToDo: allocate subnet after relay agent done
@@ -618,16 +956,244 @@ server6_recv(s)
 	else
 		subnet = dhcp6_allocate_link(ifp, globalgroup, &relay);
 
-	if (!(DH6_VALID_MESSAGE(dh6->dh6_msgtype)))
+	if (server6_repl_standby()) {
+		/* the primary answers, we only follow its leases */
+		STATS_DROP(DROP_STANDBY);
+	} else if (dh6->dh6_msgtype == DH6_LEASEQUERY)
+		server6_leasequery(ifp, dh6, (struct dhcp6opt *)(buf + len),
+				   &optinfo, from, fromlen);
+	else if (!(DH6_VALID_MESSAGE(dh6->dh6_msgtype))) {
 		dprintf(LOG_INFO, "%s" "unknown or unsupported msgtype %s",
 		    FNAME, dhcp6msgstr(dh6->dh6_msgtype));
-	else
-		server6_react_message(ifp, pi, dh6, &optinfo,
-			(struct sockaddr *)&from, fromlen);
+		STATS_DROP(DROP_BADTYPE);
+	} else
+		server6_react_message(ifp, pi, dh6, &optinfo, from, fromlen);
 	dhcp6_clear_options(&optinfo);
+	server6_stats_add(STAGE_PROCESS,
+	    server6_stats_clock() - t1 - server6_stats.msg_nested);
 	return 0;
 }
 
+/*
+ * Answer the IA held in optinfo's own fields into those of roptinfo.
+ * Returns the status code for the message, or -1 to drop it.
+ */
+static int
+server6_react_ia(msgtype, resptype, addr_flag, sending_hint, optinfo, roptinfo)
+	int msgtype, resptype, addr_flag, sending_hint;
+	struct dhcp6_optinfo *optinfo, *roptinfo;
+{
+	struct dhcp6_iaidaddr *iaidaddr;
+	int found_binding = 0;
+	int num = DH6OPT_STCODE_SUCCESS;
+
+	if (msgtype == DH6_SOLICIT || msgtype == DH6_REQUEST) {
+		memcpy(&roptinfo->iaidinfo, &optinfo->iaidinfo, 
+				sizeof(roptinfo->iaidinfo));
+		roptinfo->type = optinfo->type;
+		/* find bindings */
+		if ((iaidaddr = dhcp6_find_iaidaddr(roptinfo)) != NULL) {
+			found_binding = 1;
+			addr_flag = ADDR_UPDATE;
+		}
+		if (host)
+			dhcp6_get_hostconf(roptinfo, optinfo, iaidaddr, host);
+		/* valid and create addresses list */
+		if (optinfo->type == IAPD)
+			dhcp6_create_prefixlist(roptinfo, optinfo, iaidaddr, subnet);
+		else
+			dhcp6_create_addrlist(msgtype, roptinfo,
+					      optinfo, iaidaddr, subnet);
+		if (TAILQ_EMPTY(&roptinfo->addr_list)) {
+			if (resptype == DH6_ADVERTISE) {
+				/* Omit IA option */
+				roptinfo->iaidinfo.iaid = 0;
+				num = DH6OPT_STCODE_NOADDRAVAIL;
+			} else if (resptype == DH6_REPLY) {
+				/* Set status code in IA */
+				roptinfo->ia_stcode = DH6OPT_STCODE_NOADDRAVAIL;
+				num = DH6OPT_STCODE_UNDEFINE;
+			}
+		} else if (sending_hint == 0) {
+		/* valid client request address list */
+			if (found_binding) {
+			       if (dhcp6_update_iaidaddr(roptinfo, addr_flag) != 0) {
+					dprintf(LOG_ERR,
+					"assigned ipv6address for client iaid %u failed",
+						roptinfo->iaidinfo.iaid);
+					num = DH6OPT_STCODE_UNSPECFAIL;
+			       } else
+					num = DH6OPT_STCODE_SUCCESS;
+			} else {
+			       	if (dhcp6_add_iaidaddr(roptinfo) != 0) {
+					dprintf(LOG_ERR, 
+					"assigned ipv6address for client iaid %u failed",
+						roptinfo->iaidinfo.iaid);
+					num = DH6OPT_STCODE_UNSPECFAIL;
+				} else
+					num = DH6OPT_STCODE_SUCCESS;
+			}
+		}
+		return (num);
+	}
+	roptinfo->type = optinfo->type;
+	if (!TAILQ_EMPTY(&optinfo->addr_list) && resptype != DH6_ADVERTISE) {
+		memcpy(&roptinfo->iaidinfo, &optinfo->iaidinfo, 
+				sizeof(roptinfo->iaidinfo));
+		roptinfo->type = optinfo->type;
+		/* find bindings */
+		if ((iaidaddr = dhcp6_find_iaidaddr(roptinfo)) == NULL) {
+			if (msgtype == DH6_REBIND) {
+				return (-1);
+			} else if (msgtype == DH6_CONFIRM) {
+				num = DH6OPT_STCODE_NOTONLINK;
+			} else { 
+				/* Set status code in IA */
+				roptinfo->ia_stcode = DH6OPT_STCODE_NOBINDING;
+				num = DH6OPT_STCODE_UNDEFINE;
+			}
+			dprintf(LOG_INFO, "%s" "Nobinding for client %s iaid %u",
+				FNAME, duidstr(&optinfo->clientID), 
+					optinfo->iaidinfo.iaid);
+			return (num);
+		}
+		if (addr_flag != ADDR_UPDATE) {
+			dhcp6_copy_list(&roptinfo->addr_list, &optinfo->addr_list);
+		} else {
+			/* get static host configuration */
+			if (host)
+				dhcp6_get_hostconf(roptinfo, optinfo, iaidaddr, host);
+			/* allow dynamic address assginment for the host too */
+			if (optinfo->type == IAPD)
+				dhcp6_create_prefixlist(roptinfo, 
+							optinfo, 
+							iaidaddr, 
+							subnet);
+			else
+				dhcp6_create_addrlist(msgtype,
+						      roptinfo, optinfo, 
+						      iaidaddr, subnet);
+			/* in case there is not bindings available */
+			if (TAILQ_EMPTY(&roptinfo->addr_list)) {
+				num = DH6OPT_STCODE_NOBINDING;
+				dprintf(LOG_INFO, "%s" 
+				    "Bindings are not on link for client %s iaid %u",
+					FNAME, duidstr(&optinfo->clientID), 
+					roptinfo->iaidinfo.iaid);
+				return (num);
+			}
+		}
+		if (addr_flag == ADDR_VALIDATE) {
+			if (dhcp6_validate_bindings(roptinfo, iaidaddr))
+				num = DH6OPT_STCODE_NOTONLINK;
+			return (num);
+		} else {
+			/* do update if this is not a confirm */
+			if (dhcp6_update_iaidaddr(roptinfo, addr_flag) 
+					!= 0) {
+				dprintf(LOG_INFO, "%s" 
+					"bindings failed for client %s iaid %u",
+					FNAME, duidstr(&optinfo->clientID), 
+						roptinfo->iaidinfo.iaid);
+				num = DH6OPT_STCODE_UNSPECFAIL;
+				return (num);
+			}
+		}
+		num = DH6OPT_STCODE_SUCCESS;
+	} else if (msgtype == DH6_CONFIRM) {
+		dprintf(LOG_DEBUG, "no addresses in confirm message");
+		return (-1);
+	} else {
+		num = DH6OPT_STCODE_NOADDRAVAIL;
+	}
+	return (num);
+}
+
+/*
+ * Fold the result of server6_react_ia() for one of several IAs: a
+ * failure goes into the IA's own status code, so the other IAs of the
+ * message are still answered.  An IA the server would drop the message
+ * for, such as a Rebind of one it has no binding of, is left out.
+ */
+static int
+server6_ia_status(optinfo, roptinfo, num)
+	struct dhcp6_optinfo *optinfo, *roptinfo;
+	int num;
+{
+	switch (num) {
+	case -1:
+		roptinfo->iaidinfo.iaid = 0;
+		dhcp6_clear_list(&roptinfo->addr_list);
+		roptinfo->ia_stcode = DH6OPT_STCODE_UNDEFINE;
+		return (num);
+	case DH6OPT_STCODE_NOTONLINK:
+	case DH6OPT_STCODE_SUCCESS:
+	case DH6OPT_STCODE_UNDEFINE:
+		return (num);
+	default:
+		/* an IA omitted from an Advertise is sent with its status */
+		if (roptinfo->iaidinfo.iaid == 0)
+			memcpy(&roptinfo->iaidinfo, &optinfo->iaidinfo,
+			       sizeof(roptinfo->iaidinfo));
+		dhcp6_clear_list(&roptinfo->addr_list);
+		roptinfo->ia_stcode = num;
+		return (DH6OPT_STCODE_UNDEFINE);
+	}
+}
+
+/*
+ * Answer the IAs of a message after the first one, which has already
+ * been answered with status num.  Each IA carries its own status; the
+ * message status is Success if any IA was served.  The message is only
+ * dropped if every IA is left out.
+ */
+static int
+server6_react_ias(msgtype, resptype, addr_flag, sending_hint, optinfo,
+		  roptinfo, num)
+	int msgtype, resptype, addr_flag, sending_hint;
+	struct dhcp6_optinfo *optinfo, *roptinfo;
+	int num;
+{
+	struct dhcp6_ia *ia, *ria;
+	int served = 0, notonlink = 0, answered = 0;
+
+	num = server6_ia_status(optinfo, roptinfo, num);
+	for (ia = TAILQ_FIRST(&optinfo->ia_list); ;
+	     ia = TAILQ_NEXT(ia, link)) {
+		if (num == DH6OPT_STCODE_SUCCESS)
+			served = 1;
+		else if (num == DH6OPT_STCODE_NOTONLINK)
+			notonlink = 1;
+		if (num >= 0)
+			answered = 1;
+		if (ia == NULL)
+			break;
+		if ((ria = dhcp6_add_ia(&roptinfo->ia_list, &ia->iaidinfo,
+		    ia->type)) == NULL)
+			return (-1);
+		dhcp6_swap_ia(optinfo, ia);
+		dhcp6_swap_ia(roptinfo, ria);
+		num = server6_react_ia(msgtype, resptype, addr_flag,
+		    sending_hint, optinfo, roptinfo);
+		num = server6_ia_status(optinfo, roptinfo, num);
+		dhcp6_swap_ia(roptinfo, ria);
+		dhcp6_swap_ia(optinfo, ia);
+	}
+	if (!answered)
+		return (-1);
+	if (notonlink)
+		return (DH6OPT_STCODE_NOTONLINK);
+	if (served)
+		return (DH6OPT_STCODE_SUCCESS);
+	if (resptype == DH6_ADVERTISE) {
+		/* nothing to offer: no IA, NoAddrsAvail for the message */
+		roptinfo->iaidinfo.iaid = 0;
+		dhcp6_clear_ia_list(&roptinfo->ia_list);
+		return (DH6OPT_STCODE_NOADDRAVAIL);
+	}
+	return (DH6OPT_STCODE_UNDEFINE);
+}
+
 static int
 server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	struct dhcp6_if *ifp;
@@ -638,18 +1204,23 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	int fromlen;
 {
 	struct dhcp6_optinfo roptinfo;
-	
+	char reconfbuf[SERVER6_RECONF_OPTLEN];
+	int reconflen = 0;
 	int addr_flag = 0;
 	int addr_request = 0;
+	int ia_request = 0;
 	int resptype = DH6_REPLY;
 	int num = DH6OPT_STCODE_SUCCESS;
 	int sending_hint = 0;
+	int balance = BALANCE_OURS;
+	u_int64_t t0;
 
 	/* message validation according to Section 18.2 of dhcpv6-28 */
 
 	/* the message must include a Client Identifier option */
 	if (optinfo->clientID.duid_len == 0) {
 		dprintf(LOG_INFO, "%s" "no server ID option", FNAME);
+		STATS_DROP(DROP_CLIENTID);
 		return -1;
 	} else {
 		dprintf(LOG_DEBUG, "%s" "client ID %s", FNAME,
@@ -663,12 +1234,14 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	case DH6_RELEASE:
 		if (optinfo->serverID.duid_len == 0) {
 			dprintf(LOG_INFO, "%s" "no server ID option", FNAME);
+			STATS_DROP(DROP_SERVERID);
 			return -1;
 		}
 		/* the contents of the Server Identifier option must match ours */
 		if (duidcmp(&optinfo->serverID, &server_duid)) {
 			dprintf(LOG_INFO, "server ID %s mismatch %s", 
 				duidstr(&optinfo->serverID), duidstr(&server_duid));
+			STATS_DROP(DROP_SERVERID);
 			return -1;
 		}
 		break;
@@ -678,11 +1251,22 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	case DH6_REBIND:
 		if (optinfo->serverID.duid_len != 0) {
 			dprintf(LOG_INFO, "%s" "found server ID option in message Solicit/Confirm/Rebind", FNAME);
+			STATS_DROP(DROP_SERVERID);
 			return -1;
 		}
 	default:
 		break;
 	}
+	/* the client came back as a Reconfigure asked */
+	if (dh6->dh6_msgtype == DH6_RENEW || dh6->dh6_msgtype == DH6_REBIND ||
+	    dh6->dh6_msgtype == DH6_INFORM_REQ)
+		server6_reconf_answered(&optinfo->clientID);
+	/* with a load balancing peer, leave it the clients of its share */
+	if (optinfo->serverID.duid_len == 0 &&
+	    (balance = server6_balance_check(optinfo)) == BALANCE_PEER) {
+		STATS_DROP(DROP_PEER);
+		return -1;
+	}
 	/*
 	 * configure necessary options based on the options in request.
 	 */
@@ -697,6 +1281,12 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		dprintf(LOG_ERR, "%s" "failed to copy client ID", FNAME);
 		goto fail;
 	}
+	/* and the relay the client is behind, for the binding */
+	if (optinfo->relayID.duid_len != 0 &&
+	    duidcpy(&roptinfo.relayID, &optinfo->relayID)) {
+		dprintf(LOG_ERR, "%s" "failed to copy relay ID", FNAME);
+		goto fail;
+	}
 	/* if the client is not on the link */
 	if (host == NULL && subnet == NULL) {
 		num = DH6OPT_STCODE_NOTONLINK; 
@@ -718,6 +1308,14 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 				host->hostscope.send_flags;
 		dnslist = host->hostscope.dnslist;
 	}
+	/*
+	 * answering for the peer: a client that hears it too should pick
+	 * it, and must not commit to both of us.
+	 */
+	if (balance == BALANCE_TAKEOVER) {
+		roptinfo.pref = 0;
+		roptinfo.flags &= ~DHCIFF_RAPID_COMMIT;
+	}
 	/* prohibit a mixture of old and new style of DNS server config */
 	if (!TAILQ_EMPTY(&arg_dnslist.addrlist)) {
 		if (!TAILQ_EMPTY(&dnslist.addrlist)) {
@@ -809,10 +1407,7 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		 * message.
 		 */
 		if (optinfo->iaidinfo.iaid != 0 && !(roptinfo.flags & DHCIFF_INFO_ONLY)) {
-			memcpy(&roptinfo.iaidinfo, &optinfo->iaidinfo, 
-					sizeof(roptinfo.iaidinfo));
-			roptinfo.type = optinfo->type;
-			dprintf(LOG_DEBUG, "option type is %d", roptinfo.type);
+			dprintf(LOG_DEBUG, "option type is %d", optinfo->type);
 			addr_request = 1;
 			if (roptinfo.flags & DHCIFF_RAPID_COMMIT) {
 				resptype = DH6_REPLY;
@@ -836,12 +1431,8 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		break;
 	case DH6_REQUEST:
 		/* get iaid for that request client for that interface */
-		if (optinfo->iaidinfo.iaid != 0 && !(roptinfo.flags & DHCIFF_INFO_ONLY)) {
-			memcpy(&roptinfo.iaidinfo, &optinfo->iaidinfo, 
-					sizeof(roptinfo.iaidinfo));
-			roptinfo.type = optinfo->type;
+		if (optinfo->iaidinfo.iaid != 0 && !(roptinfo.flags & DHCIFF_INFO_ONLY))
 			addr_request = 1;
-		} 
 		break;
 	/*
 	 * Locates the client's binding and verifies that the information
@@ -852,7 +1443,6 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	case DH6_DECLINE:
 	case DH6_RELEASE:
 	case DH6_CONFIRM:
-		roptinfo.type = optinfo->type;
 		/* XXX: how server knows the difference between rebind_confirm and rebind 
 		 * for prefix delegation ?*/
 		if (dh6->dh6_msgtype == DH6_RENEW || dh6->dh6_msgtype == DH6_REBIND)
@@ -870,79 +1460,10 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		}
 		if (dh6->dh6_msgtype == DH6_DECLINE)
 			addr_flag = ADDR_ABANDON;
-	if (optinfo->iaidinfo.iaid != 0) {
-		if (!TAILQ_EMPTY(&optinfo->addr_list) && resptype != DH6_ADVERTISE) {
-			struct dhcp6_iaidaddr *iaidaddr;
-			memcpy(&roptinfo.iaidinfo, &optinfo->iaidinfo, 
-					sizeof(roptinfo.iaidinfo));
-			roptinfo.type = optinfo->type;
-			/* find bindings */
-			if ((iaidaddr = dhcp6_find_iaidaddr(&roptinfo)) == NULL) {
-				if (dh6->dh6_msgtype == DH6_REBIND) {
-					goto fail;
-				} else if (dh6->dh6_msgtype == DH6_CONFIRM) {
-					num = DH6OPT_STCODE_NOTONLINK;
-				} else { 
-					/* Set status code in IA */
-					roptinfo.ia_stcode = DH6OPT_STCODE_NOBINDING;
-					num = DH6OPT_STCODE_UNDEFINE;
-				}
-				dprintf(LOG_INFO, "%s" "Nobinding for client %s iaid %u",
-					FNAME, duidstr(&optinfo->clientID), 
-						optinfo->iaidinfo.iaid);
-				break;
-			}
-			if (addr_flag != ADDR_UPDATE) {
-				dhcp6_copy_list(&roptinfo.addr_list, &optinfo->addr_list);
-			} else {
-				/* get static host configuration */
-				if (host)
-					dhcp6_get_hostconf(&roptinfo, optinfo, iaidaddr, host);
-				/* allow dynamic address assginment for the host too */
-				if (optinfo->type == IAPD)
-					dhcp6_create_prefixlist(&roptinfo, 
-								optinfo, 
-								iaidaddr, 
-								subnet);
-				else
-					dhcp6_create_addrlist(dh6->dh6_msgtype,
-							      &roptinfo, optinfo, 
-							      iaidaddr, subnet);
-				/* in case there is not bindings available */
-				if (TAILQ_EMPTY(&roptinfo.addr_list)) {
-					num = DH6OPT_STCODE_NOBINDING;
-					dprintf(LOG_INFO, "%s" 
-					    "Bindings are not on link for client %s iaid %u",
-						FNAME, duidstr(&optinfo->clientID), 
-						roptinfo.iaidinfo.iaid);
-					break;
-				}
-			}
-			if (addr_flag == ADDR_VALIDATE) {
-				if (dhcp6_validate_bindings(&roptinfo, iaidaddr))
-					num = DH6OPT_STCODE_NOTONLINK;
-				break;
-			} else {
-				/* do update if this is not a confirm */
-				if (dhcp6_update_iaidaddr(&roptinfo, addr_flag) 
-						!= 0) {
-					dprintf(LOG_INFO, "%s" 
-						"bindings failed for client %s iaid %u",
-						FNAME, duidstr(&optinfo->clientID), 
-							roptinfo.iaidinfo.iaid);
-					num = DH6OPT_STCODE_UNSPECFAIL;
-					break;
-				}
-			}
-			num = DH6OPT_STCODE_SUCCESS;
-		} else if (dh6->dh6_msgtype == DH6_CONFIRM) {
-			dprintf(LOG_DEBUG, "no addresses in confirm message");
-			goto fail;
-		} else {
-			num = DH6OPT_STCODE_NOADDRAVAIL;
-		}
-	} else 
-		dprintf(LOG_ERR, "invalid message type");
+		if (optinfo->iaidinfo.iaid != 0)
+			ia_request = 1;
+		else
+			dprintf(LOG_ERR, "invalid message type");
 		break;
 	default:
 		break;
@@ -961,52 +1482,16 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 	 * that we can provide.  So we do not have to check the option request
 	 * options.
 	 */
+	if (addr_request == 1 || ia_request == 1) {
+		num = server6_react_ia(dh6->dh6_msgtype, resptype, addr_flag,
+		    sending_hint, optinfo, &roptinfo);
+		if (!TAILQ_EMPTY(&optinfo->ia_list))
+			num = server6_react_ias(dh6->dh6_msgtype, resptype,
+			    addr_flag, sending_hint, optinfo, &roptinfo, num);
+		if (num < 0)
+			goto fail;
+	}
 	if (addr_request == 1) {
-		int found_binding = 0;
-		struct dhcp6_iaidaddr *iaidaddr;
-		/* find bindings */
-		if ((iaidaddr = dhcp6_find_iaidaddr(&roptinfo)) != NULL) {
-			found_binding = 1;
-			addr_flag = ADDR_UPDATE;
-		}
-		if (host)
-			dhcp6_get_hostconf(&roptinfo, optinfo, iaidaddr, host);
-		/* valid and create addresses list */
-		if (optinfo->type == IAPD)
-			dhcp6_create_prefixlist(&roptinfo, optinfo, iaidaddr, subnet);
-		else
-			dhcp6_create_addrlist(dh6->dh6_msgtype, &roptinfo,
-					      optinfo, iaidaddr, subnet);
-		if (TAILQ_EMPTY(&roptinfo.addr_list)) {
-			if (resptype == DH6_ADVERTISE) {
-				/* Omit IA option */
-				roptinfo.iaidinfo.iaid = 0;
-				num = DH6OPT_STCODE_NOADDRAVAIL;
-			} else if (resptype == DH6_REPLY) {
-				/* Set status code in IA */
-				roptinfo.ia_stcode = DH6OPT_STCODE_NOADDRAVAIL;
-				num = DH6OPT_STCODE_UNDEFINE;
-			}
-		} else if (sending_hint == 0) {
-		/* valid client request address list */
-			if (found_binding) {
-			       if (dhcp6_update_iaidaddr(&roptinfo, addr_flag) != 0) {
-					dprintf(LOG_ERR,
-					"assigned ipv6address for client iaid %u failed",
-						roptinfo.iaidinfo.iaid);
-					num = DH6OPT_STCODE_UNSPECFAIL;
-			       } else
-					num = DH6OPT_STCODE_SUCCESS;
-			} else {
-			       	if (dhcp6_add_iaidaddr(&roptinfo) != 0) {
-					dprintf(LOG_ERR, 
-					"assigned ipv6address for client iaid %u failed",
-						roptinfo.iaidinfo.iaid);
-					num = DH6OPT_STCODE_UNSPECFAIL;
-				} else
-					num = DH6OPT_STCODE_SUCCESS;
-			}
-		}
 		/* DNS server */
 		if (dhcp6_copy_list(&roptinfo.dns_list.addrlist, &dnslist.addrlist)) {
 			dprintf(LOG_ERR, "%s" "failed to copy DNS servers", FNAME);
@@ -1014,6 +1499,11 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		}
 		roptinfo.dns_list.domainlist = dnslist.domainlist;
 	}
+	/* the key a client that accepts Reconfigure will check them with */
+	if (resptype == DH6_REPLY && (roptinfo.flags & DHCIFF_RECONF_ACCEPT) &&
+	    (addr_request == 1 ||
+	     (ia_request == 1 && addr_flag == ADDR_UPDATE)))
+		reconflen = server6_reconf_reply(&optinfo->clientID, reconfbuf);
 	/* add address status code */
   send:
 	dprintf(LOG_DEBUG, " status code: %s", dhcp6_stcodestr(num));
@@ -1026,25 +1516,129 @@ server6_react_message(ifp, pi, dh6, optinfo, from, fromlen)
 		}
 	}
 	/* send a reply message. */
-	(void)server6_send(resptype, ifp, dh6, optinfo, from, fromlen,
-			   &roptinfo);
+	t0 = server6_stats_clock();
+	if (server6_send(resptype, ifp, dh6, optinfo, from, fromlen,
+			 &roptinfo, reconfbuf, reconflen) == 0)
+		server6_stats.tx[STATS_TYPE(resptype)]++;
+	else
+		STATS_DROP(DROP_SEND);
+	t0 = server6_stats_clock() - t0;
+	server6_stats_add(STAGE_SEND, t0);
+	server6_stats.msg_nested += t0;
+	if (num != DH6OPT_STCODE_UNDEFINE)
+		server6_stats.stcode[STATS_STCODE(num)]++;
+
+	dhcp6_clear_options(&roptinfo);
+	return 0;
+
+  fail:
+	STATS_DROP(DROP_DISCARD);
+	dhcp6_clear_options(&roptinfo);
+	return -1;
+}
+
+/*
+ * Answer a LEASEQUERY (RFC 5007) from a requestor on a link where
+ * "allow leasequery" is configured.
+ */
+static int
+server6_leasequery(ifp, dh6, ep, optinfo, from, fromlen)
+	struct dhcp6_if *ifp;
+	struct dhcp6 *dh6;
+	struct dhcp6opt *ep;
+	struct dhcp6_optinfo *optinfo;
+	struct sockaddr *from;
+	int fromlen;
+{
+	struct dhcp6_optinfo roptinfo;
+	struct interface *ifnetwork;
+	struct scope *scope = NULL;
+	char lqbuf[BUFSIZ];
+	int lqlen, num = DH6OPT_STCODE_UNDEFINE;
+	u_int64_t t0;
+
+	if (optinfo->clientID.duid_len == 0) {
+		dprintf(LOG_INFO, "%s" "no client ID option", FNAME);
+		STATS_DROP(DROP_CLIENTID);
+		return -1;
+	}
+	if (optinfo->serverID.duid_len != 0 &&
+	    duidcmp(&optinfo->serverID, &server_duid)) {
+		dprintf(LOG_INFO, "server ID %s mismatch %s",
+			duidstr(&optinfo->serverID), duidstr(&server_duid));
+		STATS_DROP(DROP_SERVERID);
+		return -1;
+	}
+	dprintf(LOG_DEBUG, "%s" "requestor ID %s", FNAME,
+		duidstr(&optinfo->clientID));
+
+	dhcp6_init_options(&roptinfo);
+	if (duidcpy(&roptinfo.serverID, &server_duid) ||
+	    duidcpy(&roptinfo.clientID, &optinfo->clientID)) {
+		dprintf(LOG_ERR, "%s" "failed to copy DUIDs", FNAME);
+		goto fail;
+	}
+	/* the requestor's link decides, else the interface it came in on */
+	if (subnet)
+		scope = &subnet->linkscope;
+	else {
+		for (ifnetwork = globalgroup->iflist; ifnetwork;
+		     ifnetwork = ifnetwork->next)
+			if (strcmp(ifnetwork->name, ifp->ifname) == 0) {
+				scope = &ifnetwork->ifscope;
+				break;
+			}
+	}
+	lqlen = 0;
+	if (scope == NULL || !(scope->allow_flags & DHCIFF_LEASEQUERY)) {
+		dprintf(LOG_INFO, "%s" "leasequery from %s not allowed", FNAME,
+			addr2str(from));
+		num = DH6OPT_STCODE_NOTALLOWED;
+		if (dhcp6_add_listval(&roptinfo.stcode_list,
+				      &num, DHCP6_LISTVAL_NUM) == NULL)
+			goto fail;
+	} else if ((lqlen = server6_lq_options((struct dhcp6opt *)(dh6 + 1),
+					       ep, lqbuf,
+					       lqbuf + sizeof(lqbuf))) < 0) {
+		dprintf(LOG_INFO, "%s" "leasequery reply too large", FNAME);
+		goto fail;
+	}
 
+	t0 = server6_stats_clock();
+	if (server6_send(DH6_LQ_REPLY, ifp, dh6, optinfo, from, fromlen,
+			 &roptinfo, lqbuf, lqlen) == 0)
+		server6_stats.tx[STATS_TYPE(DH6_LQ_REPLY)]++;
+	else
+		STATS_DROP(DROP_SEND);
+	t0 = server6_stats_clock() - t0;
+	server6_stats_add(STAGE_SEND, t0);
+	server6_stats.msg_nested += t0;
+	if (num != DH6OPT_STCODE_UNDEFINE)
+		server6_stats.stcode[STATS_STCODE(num)]++;
 	dhcp6_clear_options(&roptinfo);
 	return 0;
 
   fail:
+	STATS_DROP(DROP_DISCARD);
 	dhcp6_clear_options(&roptinfo);
 	return -1;
 }
 
+/*
+ * Send a message of the given type built from roptinfo, followed by
+ * xoptlen bytes of options already encoded at xopt.
+ */
 static int
-server6_send(type, ifp, origmsg, optinfo, from, fromlen, roptinfo)
+server6_send(type, ifp, origmsg, optinfo, from, fromlen, roptinfo,
+	     xopt, xoptlen)
 	int type;
 	struct dhcp6_if *ifp;
 	struct dhcp6 *origmsg;
 	struct dhcp6_optinfo *optinfo, *roptinfo;
 	struct sockaddr *from;
 	int fromlen;
+	char *xopt;
+	int xoptlen;
 {
 	char replybuf[BUFSIZ];
 	struct sockaddr_in6 dst;
@@ -1081,6 +1675,14 @@ server6_send(type, ifp, origmsg, optinfo, from, fromlen, roptinfo)
 		return (-1);
 	}
 	len += optlen;
+	if (xoptlen > 0) {
+		if ((char *)dh6 + len + xoptlen > replybuf + sizeof(replybuf)) {
+			dprintf(LOG_INFO, "%s" "reply options do not fit", FNAME);
+			return (-1);
+		}
+		memcpy((char *)dh6 + len, xopt, xoptlen);
+		len += xoptlen;
+	}
 
 	/*
 	 * If there were any Relay Message options, fill in the option-len
@@ -1099,11 +1701,14 @@ server6_send(type, ifp, origmsg, optinfo, from, fromlen, roptinfo)
 	   agent is listening on, namely DH6PORT_UPSTREAM */
 	if (relaylen > 0)
 		dst.sin6_port = upstream_port;
+	/* a leasequery requestor may send from any port */
+	else if (type == DH6_LQ_REPLY)
+		dst.sin6_port = ((struct sockaddr_in6 *)from)->sin6_port;
 
 	dst.sin6_scope_id = ((struct sockaddr_in6 *)from)->sin6_scope_id;
 	dprintf(LOG_DEBUG, "send destination address is %s, scope id is %d", 
 		addr2str((struct sockaddr *)&dst), dst.sin6_scope_id);
-	if (transmit_sa(outsock, &dst, replybuf, len) != 0) {
+	if (server6_transmit(&dst, replybuf, len) != 0) {
 		dprintf(LOG_ERR, "%s" "transmit %s to %s failed", FNAME,
 			dhcp6msgstr(type), addr2str((struct sockaddr *)&dst));
 		return (-1);
@@ -1122,11 +1727,12 @@ static struct dhcp6_timer
 	struct timeval timo;
 	struct stat buf;
 	FILE *file;
-	stat(PATH_SERVER6_LEASE, &buf);
-	strcpy(server6_lease_temp, PATH_SERVER6_LEASE);
+	stat(server6_lease_path, &buf);
+	strcpy(server6_lease_temp, server6_lease_path);
 	strcat(server6_lease_temp, "XXXXXX");	
 	if (buf.st_size > MAX_FILE_SIZE) {
-		file = sync_leases(server6_lease_file, PATH_SERVER6_LEASE, server6_lease_temp);
+		file = sync_leases(server6_lease_file, server6_lease_path,
+		    server6_lease_temp, NULL);
 		if (file != NULL)
 			server6_lease_file = file;
 	}
@@ -1185,12 +1791,16 @@ dhcp6_parse_relay(relay_msg, endptr, optinfo, relay_addr)
 		 */
 		memcpy (relay_addr, &relay_val->relay.link_addr, 
 		        sizeof (struct in6_addr));
+		/* likewise only the first relay's Relay-ID is kept */
+		if (optinfo->relayID.duid_len != 0)
+			duidfree(&optinfo->relayID);
 
 		/* now handle the options in the RELAY-FORW message */
 		/*
 		 * The only options that should appear in a RELAY-FORW message are:
 		 * - Interface identifier
 		 * - Relay message
+		 * - Relay identifier (RFC 5460)
 		 *
 		 * All other options are ignored.
 		 */
@@ -1270,6 +1880,21 @@ dhcp6_parse_relay(relay_msg, endptr, optinfo, relay_addr)
 					return NULL;
 				}
 			}
+			else if (opt == DH6OPT_RELAY_ID) {
+				/* remembered in the client's binding for bulk
+				   leasequery by relay */
+				if (optlen > 0 && optlen <= 255 &&
+				    optinfo->relayID.duid_len == 0) {
+					struct duid id;
+
+					id.duid_len = optlen;
+					id.duid_id = (char *) (option + 1);
+					if (duidcpy(&optinfo->relayID, &id)) {
+						relayfree(&optinfo->relay_list);
+						return NULL;
+					}
+				}
+			}
 			else   /* No other options besides interface identifier and relay
 			          message make sense, so ignore them with a warning */
 				dprintf(LOG_INFO, "%s" "Unsupported option %s found in "
@@ -1421,3 +2046,46 @@ dhcp6_set_relay_option_len(optinfo, reply_msg_len)
 		}
 	}
 }
+
+#ifdef DHCP6S_REPLAY
+/*
+ * Entry points for dhcp6replay: the server state without its sockets.
+ * The lease file and DUID live under dir so no root access is needed.
+ */
+void
+server6_replay_init(conffile, ifname, dir)
+	char *conffile, *ifname, *dir;
+{
+	static struct sockaddr_in6 sa6_any_downstream_storage;
+	static char leasepath[MAXPATHLEN];
+	char duidpath[MAXPATHLEN];
+
+	ifinit(ifname);
+	snprintf(duidpath, sizeof(duidpath), "%s/dhcp6s_duid", dir);
+	if (get_duid(duidpath, ifname, &server_duid)) {
+		dprintf(LOG_ERR, "%s" "failed to get a DUID", FNAME);
+		exit(1);
+	}
+	memset(&sa6_any_downstream_storage, 0,
+	    sizeof(sa6_any_downstream_storage));
+	sa6_any_downstream_storage.sin6_family = AF_INET6;
+	sa6_any_downstream_storage.sin6_port = htons(atoi(DH6PORT_DOWNSTREAM));
+	sa6_any_downstream = &sa6_any_downstream_storage;
+	upstream_port = htons(atoi(DH6PORT_UPSTREAM));
+
+	snprintf(leasepath, sizeof(leasepath), "%s/server6.leases", dir);
+	server6_lease_path = leasepath;
+	server6_state_init(conffile);
+}
+
+int
+server6_replay_input(buf, len, pi, from, fromlen)
+	char *buf;
+	ssize_t len;
+	struct in6_pktinfo *pi;
+	struct sockaddr *from;
+	int fromlen;
+{
+	return server6_input(buf, len, pi, from, fromlen);
+}
+#endif /* DHCP6S_REPLAY */
@@ -55,12 +55,10 @@
 #include "common.h"
 #include "lease.h"
 
-extern struct dhcp6_iaidaddr client6_iaidaddr;
 extern FILE *server6_lease_file;
 extern char *server6_lease_temp;
-extern FILE *client6_lease_file;
-extern char *client6_lease_temp;
 u_int32_t do_hash __P((const void *, u_int8_t ));
+static u_int32_t hash_bytes __P((const void *, int));
 static int init_lease_hashes __P((void));
 
 int 
@@ -88,6 +86,16 @@ write_lease(const struct dhcp6_lease *lease_ptr,
 		lease_ptr->iaidaddr->client6_info.iaidinfo.renewtime);
 	fprintf(file, "\t RebindTime: %u;\n",
 		lease_ptr->iaidaddr->client6_info.iaidinfo.rebindtime);
+	if (lease_ptr->iaidaddr->relayid.duid_len != 0)
+		fprintf(file, "\t RelayID: %s;\n",
+			duidstr(&lease_ptr->iaidaddr->relayid));
+	if (lease_ptr->iaidaddr->reconf_accept) {
+		struct duid key;
+
+		key.duid_len = sizeof(lease_ptr->iaidaddr->reconfkey);
+		key.duid_id = (char *)lease_ptr->iaidaddr->reconfkey;
+		fprintf(file, "\t ReconfKey: %s;\n", duidstr(&key));
+	}
 	if (!IN6_IS_ADDR_UNSPECIFIED(&lease_ptr->linklocal)) {
 		if ((inet_ntop(AF_INET6, &lease_ptr->linklocal, addr_str, 
 			sizeof(struct in6_addr))) == 0) {
@@ -126,8 +134,13 @@ write_lease(const struct dhcp6_lease *lease_ptr,
 	return 0;
 }
 
+/*
+ * The server writes out its lease hash, a client the leases of the
+ * binding given in iaidaddr.
+ */
 FILE *
-sync_leases (FILE *file, const char *original, char *template)
+sync_leases (FILE *file, const char *original, char *template,
+	     const struct dhcp6_iaidaddr *iaidaddr)
 {
 	int i, fd;
 	struct hashlist_element *element;
@@ -150,7 +163,7 @@ sync_leases (FILE *file, const char *original, char *template)
 		}
 	} else if (dhcp6_mode == DHCP6_MODE_CLIENT) {
 		struct dhcp6_lease *lv, *lv_next;
-		for (lv = TAILQ_FIRST(&client6_iaidaddr.lease_list); lv; lv = lv_next) {
+		for (lv = TAILQ_FIRST(&iaidaddr->lease_list); lv; lv = lv_next) {
 			lv_next = TAILQ_NEXT(lv, link);
 			if (write_lease(lv, sync_file) < 0)  
 				dprintf(LOG_ERR, "%s" "write lease failed", FNAME);
@@ -177,7 +190,7 @@ syncfile_timo(void *arg)
 }
 
 FILE *
-init_leases(const char *name)
+init_leases(const char *name, struct dhcp6_iaidaddr *iaidaddr)
 {
 	FILE *file;
 	file = fopen(name, "a+");
@@ -191,7 +204,7 @@ init_leases(const char *name)
 			return (NULL);
 		}
 	}
-	lease_parse(file);
+	lease_parse(file, iaidaddr);
 	return file;
 } 
 
@@ -222,6 +235,18 @@ init_lease_hashes(void)
 		dprintf(LOG_ERR, "%s" "Couldn't create hash table", FNAME);
 		return (-1);
 	}
+        client_hash_table = hash_table_create(DEFAULT_HASH_SIZE, 
+			client_hash, client_findkey, client_key_compare);
+	if (!client_hash_table) {
+		dprintf(LOG_ERR, "%s" "Couldn't create hash table", FNAME);
+		return (-1);
+	}
+        relay_hash_table = hash_table_create(DEFAULT_HASH_SIZE, 
+			client_hash, relay_findkey, relay_key_compare);
+	if (!relay_hash_table) {
+		dprintf(LOG_ERR, "%s" "Couldn't create hash table", FNAME);
+		return (-1);
+	}
 	return 0;
 
 }
@@ -242,13 +267,31 @@ do_hash(const void *key, u_int8_t len)
 	return index;
 }
 
+/*
+ * FNV-1a, for the hash tables.  do_hash() drops the last word of keys
+ * that are a multiple of 4 bytes long, which put a whole address range
+ * in one bucket; it also derives client IAIDs, so it is left as it is.
+ */
+static u_int32_t
+hash_bytes(const void *key, int len)
+{
+	const u_int8_t *p = key;
+	u_int32_t h = 2166136261U;
+
+	while (len-- > 0) {
+		h ^= *p++;
+		h *= 16777619;
+	}
+	return h;
+}
+
 unsigned int
 iaid_hash(const void *key)
 {
 	const struct client6_if *iaidkey = (const struct client6_if *)key;
 	const struct duid *duid = &iaidkey->clientid;
 	unsigned int index;
-	index = do_hash((const void *) duid->duid_id, duid->duid_len);
+	index = hash_bytes((const void *) duid->duid_id, duid->duid_len);
 	return index;
 }
 
@@ -258,10 +301,51 @@ addr_hash(const void *key)
 	const struct in6_addr *addrkey 
 		= (const struct in6_addr *)&(((const struct dhcp6_addr *)key)->addr);
 	unsigned int index;
-	index = do_hash((const void *)addrkey, sizeof(*addrkey));
+	index = hash_bytes((const void *)addrkey, sizeof(*addrkey));
 	return index;
 }
 
+unsigned int
+client_hash(const void *key)
+{
+	const struct duid *duid = (const struct duid *)key;
+	return hash_bytes((const void *)duid->duid_id, duid->duid_len);
+}
+
+void *
+client_findkey(const void *data)
+{
+	struct dhcp6_client *client = (struct dhcp6_client *)data;
+	return (void *)(&client->clientid);
+}
+
+int
+client_key_compare(const void *data, const void *key)
+{
+	const struct dhcp6_client *client = (const struct dhcp6_client *)data;
+
+	if (duidcmp((const struct duid *)key, &client->clientid) == 0)
+		return MATCH;
+	return MISCOMPARE;
+}
+
+void *
+relay_findkey(const void *data)
+{
+	struct dhcp6_relayagent *relay = (struct dhcp6_relayagent *)data;
+	return (void *)(&relay->relayid);
+}
+
+int
+relay_key_compare(const void *data, const void *key)
+{
+	const struct dhcp6_relayagent *relay = (const struct dhcp6_relayagent *)data;
+
+	if (duidcmp((const struct duid *)key, &relay->relayid) == 0)
+		return MATCH;
+	return MISCOMPARE;
+}
+
 void * 
 v6addr_findkey(const void *data)
 {
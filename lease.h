@@ -42,23 +42,24 @@
 #define PATH_SERVER6_LEASE "/var/lib/dhcpv6/server6.leases"
 #define PATH_CLIENT6_LEASE "/var/lib/dhcpv6/client6.leases"
 
-#define HASH_TABLE_COUNT 	4
+#define HASH_TABLE_COUNT 	5
 
 extern struct hash_table **hash_anchors;
 #define server6_hash_table hash_anchors[HT_IAIDADDR]
 #define lease_hash_table hash_anchors[HT_IPV6LEASE]
 #define host_addr_hash_table hash_anchors[HT_IPV6ADDR]
+#define client_hash_table hash_anchors[HT_CLIENTID]
+#define relay_hash_table hash_anchors[HT_RELAYID]
 #define PREFIX_LEN_NOTINRA 64 
 #define MAX_FILE_SIZE 512*1024
 
 
 typedef enum { IFADDRCONF_ADD, IFADDRCONF_REMOVE } ifaddrconf_cmd_t;
 
-enum hash_type{HT_IPV6ADDR = 0, HT_IPV6LEASE, HT_IAIDADDR};
+enum hash_type{HT_IPV6ADDR = 0, HT_IPV6LEASE, HT_IAIDADDR, HT_CLIENTID,
+	HT_RELAYID};
 
-struct dhcp6_iaidaddr client6_iaidaddr;
 FILE *server6_lease_file;
-FILE *client6_lease_file;
 FILE *lease_file;
 FILE *sync_file;
 struct hash_table **hash_anchors;
@@ -79,14 +80,42 @@ struct dhcp6_iaidaddr {
 	struct dhcp6_timer *timer;
 	/* list of client leases */
 	TAILQ_HEAD(,dhcp6_lease) lease_list;
+	/* server: the other bindings of the same DUID */
+	TAILQ_ENTRY(dhcp6_iaidaddr) clientlink;
+	struct dhcp6_client *client;
+	struct duid relayid;	/* server: the relay the client is behind */
+	/* server: the other bindings behind the same relay */
+	TAILQ_ENTRY(dhcp6_iaidaddr) relaylink;
+	struct dhcp6_relayagent *relay;
+	/* server: the client accepts Reconfigure, signed with this key */
+	int reconf_accept;
+	u_int8_t reconfkey[DH6_RECONFKEY_LEN];
+};
+
+/* server: all the bindings of one DUID, in client_hash_table */
+struct dhcp6_client {
+	struct duid clientid;
+	TAILQ_HEAD(, dhcp6_iaidaddr) iaidaddr_list;
+	TAILQ_ENTRY(dhcp6_client) link;		/* in server6_clients */
+};
+TAILQ_HEAD(dhcp6_client_list, dhcp6_client);
+extern struct dhcp6_client_list server6_clients;
+
+/* server: all the bindings behind one Relay-ID, in relay_hash_table */
+struct dhcp6_relayagent {
+	struct duid relayid;
+	TAILQ_HEAD(, dhcp6_iaidaddr) iaidaddr_list;
 };
 
 extern u_int32_t do_hash __P((const void *, u_int8_t ));
 int get_linklocal __P((const char *, struct in6_addr *));
-extern void dhcp6_init_iaidaddr __P((void));
+extern int client6_init_iaidaddr __P((struct dhcp6_if *));
 extern int dhcp6_remove_iaidaddr __P((struct dhcp6_iaidaddr *));
 extern int dhcp6_add_iaidaddr __P((struct dhcp6_optinfo *));
 extern int dhcp6_update_iaidaddr __P((struct dhcp6_optinfo *, int));
+extern int client6_add_iaidaddr __P((struct dhcp6_if *, struct dhcp6_optinfo *));
+extern int client6_update_iaidaddr __P((struct dhcp6_if *,
+				       struct dhcp6_optinfo *, int));
 extern struct dhcp6_timer *dhcp6_iaidaddr_timo __P((void *));
 extern struct dhcp6_timer *dhcp6_lease_timo __P((void *));
 extern u_int32_t get_min_preferlifetime __P((struct dhcp6_iaidaddr *));
@@ -95,24 +124,38 @@ extern struct dhcp6_iaidaddr *dhcp6_find_iaidaddr __P((struct dhcp6_optinfo *));
 extern struct dhcp6_lease *dhcp6_find_lease __P((struct dhcp6_iaidaddr *, 
 			struct dhcp6_addr *));
 extern int dhcp6_remove_lease __P((struct dhcp6_lease *));
+extern int server6_lease_apply __P((struct dhcp6_optinfo *, state_t));
+extern void server6_lease_sweep __P((u_int32_t));
 extern int dhcp6_validate_bindings __P((struct dhcp6_optinfo *, struct dhcp6_iaidaddr *));
 extern int get_iaid __P((const char *, const struct iaid_table *, int));
 extern int create_iaid __P((struct iaid_table *, int));
-extern FILE *init_leases __P((const char *));
-extern void lease_parse __P((FILE *));
+extern FILE *init_leases __P((const char *, struct dhcp6_iaidaddr *));
+extern void lease_parse __P((FILE *, struct dhcp6_iaidaddr *));
 extern int do_iaidaddr_hash __P((struct dhcp6_lease *, struct client6_if *));
 extern int write_lease __P((const struct dhcp6_lease *, FILE *));
-extern FILE *sync_leases __P((FILE *, const char *, char *));
+extern FILE *sync_leases __P((FILE *, const char *, char *,
+			       const struct dhcp6_iaidaddr *));
 extern struct dhcp6_timer *syncfile_timo __P((void *));
 extern unsigned int addr_hash __P((const void *));
 extern unsigned int iaid_hash __P((const void *));
+extern unsigned int client_hash __P((const void *));
+extern void * client_findkey __P((const void *));
+extern int client_key_compare __P((const void *, const void *));
+extern void * relay_findkey __P((const void *));
+extern int relay_key_compare __P((const void *, const void *));
+extern struct dhcp6_client *dhcp6_find_client __P((struct duid *));
+extern struct dhcp6_relayagent *dhcp6_find_relay __P((struct duid *));
 extern void * iaid_findkey __P((const void *));
 extern int iaid_key_compare __P((const void *, const void *));
 extern void * lease_findkey __P((const void *));
 extern int lease_key_compare __P((const void *, const void *));
 extern void * v6addr_findkey __P((const void *));
 extern int v6addr_key_compare __P((const void *, const void *));
-extern int client6_ifaddrconf __P((ifaddrconf_cmd_t , struct dhcp6_addr *));
+extern int client6_ifaddrconf __P((ifaddrconf_cmd_t, struct dhcp6_if *,
+				   struct dhcp6_addr *));
+extern int client6_prefixconf __P((ifaddrconf_cmd_t, struct dhcp6_if *,
+				   struct dhcp6_addr *));
+extern void radvd_reload __P((void));
 extern int dhcp6_get_prefixlen __P((struct in6_addr *, struct dhcp6_if *));
 extern int prefixcmp __P((struct in6_addr *, struct in6_addr *, int));
 extern int addr_on_addrlist __P((struct dhcp6_list *, struct dhcp6_addr *));
@@ -126,5 +169,5 @@ extern int dhcp6_create_addrlist __P((	int msgtype,
 					struct dhcp6_optinfo *,
 					const struct dhcp6_iaidaddr *,
 					const struct link_decl *));
-extern int dad_parse(const char *file);
+extern int dad_parse(const char *file, struct dhcp6_if *ifp);
 #endif
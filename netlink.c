@@ -352,3 +352,277 @@ get_if_rainfo(struct dhcp6_if *ifp)
 out:	close(sd);
 	return status;
 }
+
+/*
+ * open a netlink socket subscribed to the given RTMGRP_* groups, for
+ * the daemons to watch link and address changes from their select loop
+ */
+int
+netlink_open_monitor(u_int32_t groups)
+{
+	struct sockaddr_nl nl_addr;
+	int sd;
+
+	sd = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE);
+	if (sd < 0) {
+		dprintf(LOG_ERR, "%s" "netlink socket: %s", FNAME,
+			strerror(errno));
+		return -1;
+	}
+	memset(&nl_addr, 0, sizeof(nl_addr));
+	nl_addr.nl_family = AF_NETLINK;
+	nl_addr.nl_groups = groups;
+	if (bind(sd, (struct sockaddr *)&nl_addr, sizeof(nl_addr)) < 0) {
+		dprintf(LOG_ERR, "%s" "netlink bind: %s", FNAME,
+			strerror(errno));
+		close(sd);
+		return -1;
+	}
+	return sd;
+}
+
+/*
+ * read whatever is queued on a monitor socket without blocking and pass
+ * each message to func.  If the kernel dropped messages, func is called
+ * once with a NULL message so the caller can resynchronize.
+ * Returns the number of messages seen, or -1 on error.
+ */
+int
+netlink_recv_monitor(int sd, int (*func)(struct nlmsghdr *, void *),
+		     void *arg)
+{
+	char buf[8192];
+	struct nlmsghdr *nlm;
+	int msg_len, count = 0;
+
+	for (;;) {
+		msg_len = recv(sd, buf, sizeof(buf), MSG_DONTWAIT);
+		if (msg_len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			if (errno == ENOBUFS) {
+				dprintf(LOG_INFO, "%s" "netlink overrun", FNAME);
+				(void)(*func)(NULL, arg);
+				count++;
+				continue;
+			}
+			dprintf(LOG_ERR, "%s" "netlink recv: %s", FNAME,
+				strerror(errno));
+			return -1;
+		} else if (msg_len == 0)
+			break;
+
+		for (nlm = (struct nlmsghdr *)buf; NLMSG_OK(nlm, msg_len);
+		     nlm = (struct nlmsghdr *)NLMSG_NEXT(nlm, msg_len)) {
+			if (nlm->nlmsg_type == NLMSG_DONE ||
+			    nlm->nlmsg_type == NLMSG_ERROR)
+				continue;
+			(void)(*func)(nlm, arg);
+			count++;
+		}
+	}
+	return count;
+}
+
+static void
+netlink_add_rtattr(struct nlmsghdr *nlm, int type, const void *data, int len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)nlm + NLMSG_ALIGN(nlm->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	nlm->nlmsg_len = NLMSG_ALIGN(nlm->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+#define IFADDR_MSG_SIZE	(NLMSG_ALIGN(sizeof(struct nlmsghdr)) + \
+			 NLMSG_ALIGN(sizeof(struct ifaddrmsg)) + \
+			 RTA_SPACE(sizeof(struct in6_addr)) + \
+			 RTA_SPACE(sizeof(struct ifa_cacheinfo)))
+
+/*
+ * add (RTM_NEWADDR) or remove (RTM_DELADDR) a set of addresses on one
+ * interface, one request per address but all sent in a single datagram.
+ * Added addresses carry their lifetimes in IFA_CACHEINFO, so the kernel
+ * deprecates and expires them by itself, and NLM_F_REPLACE makes adding
+ * an existing address refresh its lifetimes.  err[i] is set to the
+ * kernel's answer for addrs[i], 0 or an errno value.
+ * Returns the number of failed requests, or -1 on error.
+ */
+int
+netlink_ifaddr(int request, int ifindex, struct dhcp6_addr **addrs,
+	       int naddr, int *err)
+{
+	struct sockaddr_nl nl_addr;
+	struct nlmsghdr *nlm;
+	struct ifaddrmsg *ifa;
+	struct ifa_cacheinfo ci;
+	struct nlmsgerr *nle;
+	char *buf, rbuf[8192];
+	int sd, i, len, msg_len, seq, pending, failed = 0;
+
+	if (naddr <= 0)
+		return 0;
+	if ((buf = calloc(naddr, IFADDR_MSG_SIZE)) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return -1;
+	}
+	if ((sd = open_netlink_socket()) < 0) {
+		dprintf(LOG_ERR, "%s" "netlink socket: %s", FNAME,
+			strerror(errno));
+		free(buf);
+		return -1;
+	}
+
+	seq = (int)time(NULL);
+	for (i = 0, len = 0; i < naddr; i++) {
+		err[i] = ETIMEDOUT;
+		nlm = (struct nlmsghdr *)(buf + len);
+		nlm->nlmsg_len = NLMSG_LENGTH(sizeof(*ifa));
+		nlm->nlmsg_type = request;
+		nlm->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+		if (request == RTM_NEWADDR)
+			nlm->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+		nlm->nlmsg_pid = getpid();
+		nlm->nlmsg_seq = seq + i;
+
+		ifa = (struct ifaddrmsg *)NLMSG_DATA(nlm);
+		ifa->ifa_family = AF_INET6;
+		ifa->ifa_prefixlen = addrs[i]->plen;
+		ifa->ifa_scope = RT_SCOPE_UNIVERSE;
+		ifa->ifa_index = ifindex;
+		netlink_add_rtattr(nlm, IFA_ADDRESS, &addrs[i]->addr,
+				   sizeof(struct in6_addr));
+		if (request == RTM_NEWADDR) {
+			memset(&ci, 0, sizeof(ci));
+			/* DHCP6_DURATITION_INFINITE is the kernel's infinity too */
+			ci.ifa_prefered = addrs[i]->preferlifetime;
+			ci.ifa_valid = addrs[i]->validlifetime;
+			netlink_add_rtattr(nlm, IFA_CACHEINFO, &ci, sizeof(ci));
+		}
+		len += NLMSG_ALIGN(nlm->nlmsg_len);
+	}
+
+	memset(&nl_addr, 0, sizeof(nl_addr));
+	nl_addr.nl_family = AF_NETLINK;
+	if (sendto(sd, buf, len, 0, (struct sockaddr *)&nl_addr,
+	    sizeof(nl_addr)) < 0) {
+		dprintf(LOG_ERR, "%s" "netlink send: %s", FNAME,
+			strerror(errno));
+		failed = -1;
+		goto out;
+	}
+
+	/* every request is acknowledged, in order */
+	for (pending = naddr; pending > 0; ) {
+		msg_len = recv(sd, rbuf, sizeof(rbuf), 0);
+		if (msg_len < 0) {
+			if (errno == EINTR)
+				continue;
+			dprintf(LOG_ERR, "%s" "netlink recv: %s", FNAME,
+				strerror(errno));
+			failed = -1;
+			goto out;
+		}
+		for (nlm = (struct nlmsghdr *)rbuf; NLMSG_OK(nlm, msg_len);
+		     nlm = (struct nlmsghdr *)NLMSG_NEXT(nlm, msg_len)) {
+			if (nlm->nlmsg_type != NLMSG_ERROR)
+				continue;
+			i = nlm->nlmsg_seq - seq;
+			if (i < 0 || i >= naddr || err[i] != ETIMEDOUT)
+				continue;
+			nle = (struct nlmsgerr *)NLMSG_DATA(nlm);
+			err[i] = -nle->error;
+			if (err[i] != 0)
+				failed++;
+			pending--;
+		}
+	}
+out:
+	close(sd);
+	free(buf);
+	return failed;
+}
+
+#define RTMSG_SIZE	(NLMSG_ALIGN(sizeof(struct nlmsghdr)) + \
+			 NLMSG_ALIGN(sizeof(struct rtmsg)) + \
+			 RTA_SPACE(sizeof(struct in6_addr)) + \
+			 RTA_SPACE(sizeof(int)))
+
+/*
+ * add (RTM_NEWROUTE) or remove (RTM_DELROUTE) an IPv6 route of the given
+ * type, RTN_UNICAST through ifindex or RTN_UNREACHABLE.
+ * Returns 0, the kernel's errno value, or -1 on error.
+ */
+int
+netlink_route(int request, int type, int ifindex, struct in6_addr *prefix,
+	      int plen)
+{
+	struct sockaddr_nl nl_addr;
+	struct nlmsghdr *nlm;
+	struct rtmsg *rtm;
+	struct nlmsgerr *nle;
+	char buf[RTMSG_SIZE], rbuf[4096];
+	int sd, msg_len, seq, error = -1;
+
+	if ((sd = open_netlink_socket()) < 0) {
+		dprintf(LOG_ERR, "%s" "netlink socket: %s", FNAME,
+			strerror(errno));
+		return -1;
+	}
+
+	memset(buf, 0, sizeof(buf));
+	seq = (int)time(NULL);
+	nlm = (struct nlmsghdr *)buf;
+	nlm->nlmsg_len = NLMSG_LENGTH(sizeof(*rtm));
+	nlm->nlmsg_type = request;
+	nlm->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	if (request == RTM_NEWROUTE)
+		nlm->nlmsg_flags |= NLM_F_CREATE | NLM_F_REPLACE;
+	nlm->nlmsg_pid = getpid();
+	nlm->nlmsg_seq = seq;
+
+	rtm = (struct rtmsg *)NLMSG_DATA(nlm);
+	rtm->rtm_family = AF_INET6;
+	rtm->rtm_dst_len = plen;
+	rtm->rtm_table = RT_TABLE_MAIN;
+	rtm->rtm_protocol = RTPROT_BOOT;
+	rtm->rtm_scope = RT_SCOPE_UNIVERSE;
+	rtm->rtm_type = type;
+	netlink_add_rtattr(nlm, RTA_DST, prefix, sizeof(struct in6_addr));
+	if (type == RTN_UNICAST)
+		netlink_add_rtattr(nlm, RTA_OIF, &ifindex, sizeof(ifindex));
+
+	memset(&nl_addr, 0, sizeof(nl_addr));
+	nl_addr.nl_family = AF_NETLINK;
+	if (sendto(sd, buf, nlm->nlmsg_len, 0, (struct sockaddr *)&nl_addr,
+	    sizeof(nl_addr)) < 0) {
+		dprintf(LOG_ERR, "%s" "netlink send: %s", FNAME,
+			strerror(errno));
+		goto out;
+	}
+	while (error < 0) {
+		msg_len = recv(sd, rbuf, sizeof(rbuf), 0);
+		if (msg_len < 0) {
+			if (errno == EINTR)
+				continue;
+			dprintf(LOG_ERR, "%s" "netlink recv: %s", FNAME,
+				strerror(errno));
+			goto out;
+		}
+		for (nlm = (struct nlmsghdr *)rbuf; NLMSG_OK(nlm, msg_len);
+		     nlm = (struct nlmsghdr *)NLMSG_NEXT(nlm, msg_len)) {
+			if (nlm->nlmsg_type != NLMSG_ERROR ||
+			    nlm->nlmsg_seq != seq)
+				continue;
+			nle = (struct nlmsgerr *)NLMSG_DATA(nlm);
+			error = -nle->error;
+		}
+	}
+out:
+	close(sd);
+	return error;
+}
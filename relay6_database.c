@@ -34,6 +34,8 @@
 #include <arpa/inet.h>
 
 #include "relay6_database.h"
+#include "relay6_thread.h"
+#include "relay6_trace.h"
 
 void  
 init_relay(void)
@@ -42,6 +44,9 @@ init_relay(void)
 	multicast_off = 0;
 	nr_of_devices = 0;
 	max_count = 0;
+	relay_threads = 0;
+	netlink_sock_desc = -1;
+	trace_level = TRACE_PACKET;
 
 	cifaces_list.next = &cifaces_list;
 
@@ -58,63 +63,310 @@ init_relay(void)
 
 	msg_parser_list.prev = &msg_parser_list;	
 	msg_parser_list.next = &msg_parser_list; 
+
+	relay_worker_list.next = &relay_worker_list;
+}
+
+/* Per-packet interface resolution goes through an index rebuilt whenever
+ * the interface list changes: dense arrays by ifindex and by opaq value
+ * and hashes by name and by global address.  The index is replaced as a
+ * whole so the -t workers never see it half built; the one it replaced is
+ * only freed on the next rebuild.  The RELAY-FORW header templates live in
+ * the index for the same reason.
+ */
+struct iface_hent {
+	struct iface_hent *next;
+	const char *key;
+	struct interface *iface;
+};
+
+struct iface_index {
+	uint32_t nindex;
+	struct interface **byindex;
+	uint32_t nopaq;
+	struct interface **byopaq;
+	uint32_t nbucket;          /* power of two */
+	struct iface_hent **byname;
+	struct iface_hent **byaddr;
+	struct iface_hent *hent;
+	uint8_t (*bytmpl)[RELAY_FORW_HDRLEN]; /* by ifindex */
+	struct IPv6_address *stale; /* address lists replaced by this rebuild */
+};
+
+static struct iface_index *iface_index = NULL;
+
+static uint32_t
+iface_hash(const char *s)
+{
+	uint32_t h = 2166136261U;
+
+	while (*s != '\0') {
+		h ^= (uint8_t) *s++;
+		h *= 16777619U;
+	}
+
+	return h;
+}
+
+static void
+free_iface_index(struct iface_index *idx)
+{
+	struct IPv6_address *ipv6a, *next;
+
+	if (idx == NULL)
+		return;
+
+	for (ipv6a = idx->stale; ipv6a != NULL; ipv6a = next) {
+		next = ipv6a->next;
+		free(ipv6a->gaddr);
+		free(ipv6a);
+	}
+
+	free(idx->byindex);
+	free(idx->byopaq);
+	free(idx->byname);
+	free(idx->byaddr);
+	free(idx->hent);
+	free(idx->bytmpl);
+	free(idx);
+}
+
+static void
+iface_hash_insert(idx, table, hent, key, device)
+	struct iface_index *idx;
+	struct iface_hent **table;
+	struct iface_hent *hent;
+	const char *key;
+	struct interface *device;
+{
+	uint32_t b = iface_hash(key) & (idx->nbucket - 1);
+
+	hent->key = key;
+	hent->iface = device;
+	hent->next = table[b];
+	table[b] = hent;
+}
+
+static struct interface *
+iface_hash_lookup(idx, table, key)
+	struct iface_index *idx;
+	struct iface_hent **table;
+	const char *key;
+{
+	struct iface_hent *hent;
+
+	for (hent = table[iface_hash(key) & (idx->nbucket - 1)]; hent != NULL;
+	     hent = hent->next) {
+		if (strcmp(key, hent->key) == 0)
+			return hent->iface;
+	}
+
+	return NULL;
+}
+
+/* 
+ * msg-type, link-address, interface-id option and the relay-msg option
+ * header; the hop-count, peer-address and relay-msg length are left for
+ * process_RELAY_FORW() to fill in.
+ */
+static void
+build_forw_template(tmpl, device)
+	uint8_t *tmpl;
+	struct interface *device;
+{
+	uint16_t v16;
+	uint32_t v32;
+	uint8_t *p;
+
+	memset(tmpl, 0, RELAY_FORW_HDRLEN);
+	tmpl[0] = RELAY_FORW;
+
+	if (inet_pton(AF_INET6, device->ipv6addr->gaddr, tmpl + 2) <= 0) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "index_interfaces()--> ERROR IN inet_pton\n");
+		exit(1);
+	}
+
+	p = tmpl + RELAY_HEADER_LENGTH;
+	v16 = htons(OPTION_INTERFACE_ID);
+	memcpy(p, &v16, 2);
+	v16 = htons(4); /* 4 octeti length */
+	memcpy(p + 2, &v16, 2);
+	v32 = htonl(device->opaq);
+	memcpy(p + 4, &v32, 4);
+	v16 = htons(OPTION_RELAY_MSG);
+	memcpy(p + 8, &v16, 2);
+}
+
+/* rebuild the lookup index from interface_list, 'stale' holds the address
+ * lists and link-local addresses that were just unlinked from the interfaces
+ */
+void
+index_interfaces(struct IPv6_address *stale)
+{
+	struct iface_index *idx, *old;
+	struct interface *device;
+	struct IPv6_address *ipv6a;
+	struct cifaces *ci;
+	uint32_t nent = 0, slot;
+	int n = 0;
+
+	idx = (struct iface_index *) malloc(sizeof(struct iface_index));
+	if (idx == NULL) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "index_interfaces()--> ERROR NO MORE MEMORY AVAILABLE\n");
+		exit(1);
+	}
+	memset(idx, 0, sizeof(struct iface_index));
+	idx->stale = stale;
+
+	for (device = interface_list.next; device != &interface_list;
+	     device = device->next) {
+		if (device->devindex >= idx->nindex)
+			idx->nindex = device->devindex + 1;
+		slot = (device->opaq - OPAQ) / 10;
+		if (slot >= idx->nopaq)
+			idx->nopaq = slot + 1;
+		nent++;
+		for (ipv6a = device->ipv6addr; ipv6a != NULL; ipv6a = ipv6a->next)
+			nent++;
+
+		/* a client interface is one named by -cm, or any without -cm */
+		device->ciface = (cifaces_list.next == &cifaces_list);
+		for (ci = cifaces_list.next; ci != &cifaces_list; ci = ci->next) {
+			if (strcmp(device->ifname, ci->ciface) == 0) {
+				device->ciface = 1;
+				break;
+			}
+		}
+		device->msg_mask = MSG_BIT(RELAY_REPL);
+		if (device->ciface)
+			device->msg_mask |= CLIENT_MSG_MASK | MSG_BIT(RELAY_FORW);
+	}
+
+	for (idx->nbucket = 16; idx->nbucket < nent; idx->nbucket <<= 1)
+		;
+
+	idx->byindex = (struct interface **) 
+	               calloc(idx->nindex + 1, sizeof(struct interface *));
+	idx->byopaq = (struct interface **) 
+	              calloc(idx->nopaq + 1, sizeof(struct interface *));
+	idx->byname = (struct iface_hent **) 
+	              calloc(idx->nbucket, sizeof(struct iface_hent *));
+	idx->byaddr = (struct iface_hent **) 
+	              calloc(idx->nbucket, sizeof(struct iface_hent *));
+	idx->hent = (struct iface_hent *) 
+	            calloc(nent + 1, sizeof(struct iface_hent));
+	idx->bytmpl = (uint8_t (*)[RELAY_FORW_HDRLEN])
+	              calloc(idx->nindex + 1, RELAY_FORW_HDRLEN);
+	if ((idx->byindex == NULL) || (idx->byopaq == NULL) || 
+	    (idx->byname == NULL) || (idx->byaddr == NULL) || 
+	    (idx->hent == NULL) || (idx->bytmpl == NULL)) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "index_interfaces()--> ERROR NO MORE MEMORY AVAILABLE\n");
+		exit(1);
+	}
+
+	for (device = interface_list.next; device != &interface_list;
+	     device = device->next) {
+		iface_hash_insert(idx, idx->byname, &idx->hent[n++], device->ifname,
+		                  device);
+
+		/* interfaces without a global address cannot be relayed for */
+		if (device->ipv6addr == NULL)
+			continue;
+
+		idx->byindex[device->devindex] = device;
+		idx->byopaq[(device->opaq - OPAQ) / 10] = device;
+		build_forw_template(idx->bytmpl[device->devindex], device);
+		for (ipv6a = device->ipv6addr; ipv6a != NULL; ipv6a = ipv6a->next)
+			iface_hash_insert(idx, idx->byaddr, &idx->hent[n++], 
+			                  ipv6a->gaddr, device);
+	}
+
+	/* the workers read the index without a lock: publish the new one,
+	 * then free the old one once none of them can still be using it
+	 */
+	__sync_synchronize();
+	old = iface_index;
+	iface_index = idx;
+	relay_workers_synchronize();
+	free_iface_index(old);
 }
 
+/* replies from the servers may come in on any interface, known or not */
 int 
-check_interface_semafor(int index)
+check_interface_msg(int index, int msg_type)
 {
 	struct interface *device = NULL;
-	struct cifaces *iface;
+	uint16_t mask = MSG_BIT(RELAY_REPL);
 
 	device = get_interface(index);
-	if (device == NULL) {
-		printf("FATAL ERROR IN CheckInterfaceSemafor()\n");
-		exit(1);   	
+	if (device != NULL)
+		mask = device->msg_mask;
+	if ((mask & MSG_BIT(msg_type)) == 0) {
+		RTRACE(TRACE_PACKET, EV_DROP_IFACE, index, msg_type, 0, 0, 0, NULL);
+		return 0;
 	}	
      
-	if (cifaces_list.next == &cifaces_list)
-		return 1;
-          
-	for (iface = cifaces_list.next; iface != &cifaces_list; 
-	     iface = iface->next) {
-		if (strcmp(device->ifname, iface->ciface) == 0)
-			return 1;   		
-	}	
- 
-	return 0;
+	return 1;
 }	
 
 struct interface *get_interface(int if_index)
 {
-	struct interface *deviface;
+	struct iface_index *idx = iface_index;
  
-	for (deviface = interface_list.next; deviface != &interface_list;  
-	     deviface = deviface->next) {
-		if (deviface->devindex == if_index)
-			return deviface;
-	}
+	if ((if_index < 0) || (if_index >= idx->nindex))
+		return NULL;
 
-	return NULL;
+	return idx->byindex[if_index];
+}
+
+uint8_t *get_forw_template(int if_index)
+{
+	struct iface_index *idx = iface_index;
+ 
+	if ((if_index < 0) || (if_index >= idx->nindex) || 
+	    (idx->byindex[if_index] == NULL))
+		return NULL;
+
+	return idx->bytmpl[if_index];
 }
 
 struct interface *get_interface_s(char *s)
 {
-	struct interface *deviface;
+	struct iface_index *idx = iface_index;
 
-	for (deviface = interface_list.next; deviface != &interface_list;  
-	     deviface = deviface->next) {   
-		if (strcmp(s, deviface->ifname)== 0)
-			return deviface;
-	}
+	return iface_hash_lookup(idx, idx->byname, s);
+}
 
-	return NULL;
+struct interface *get_interface_opaq(int opaq)
+{
+	struct iface_index *idx = iface_index;
+	int slot;
+
+	if ((opaq <= OPAQ) || ((opaq - OPAQ) % 10 != 0))
+		return NULL;
+
+	slot = (opaq - OPAQ) / 10;
+	if (slot >= idx->nopaq)
+		return NULL;
+
+	return idx->byopaq[slot];
+}
+
+struct interface *get_interface_addr(char *addr)
+{
+	struct iface_index *idx = iface_index;
+
+	return iface_hash_lookup(idx, idx->byaddr, addr);
 }
 
-struct msg_parser *get_send_messages_out(void)
+struct msg_parser *get_send_messages_out(struct msg_parser *list)
 {
 	struct msg_parser *msg;
 
-	for (msg = msg_parser_list.next; msg != &msg_parser_list; msg = msg->next) {
+	for (msg = list->next; msg != list; msg = msg->next) {
 		if (msg->sent == 0)
 			return msg;
 	}
@@ -123,11 +375,11 @@ struct msg_parser *get_send_messages_out(void)
 }
 
 
-void delete_messages(void)
+void delete_messages(struct msg_parser *list)
 {
 	struct msg_parser *msg;
 
-	for (msg = msg_parser_list.next; msg != &msg_parser_list; msg = msg->next) {
+	for (msg = list->next; msg != list; msg = msg->next) {
 		if (msg->sent == 1) {
 			msg->prev->next = msg->next;
 			msg->next->prev = msg->prev;
@@ -135,7 +387,7 @@ void delete_messages(void)
 			msg->prev = NULL;
 			free(msg->buffer);            	 
 			free(msg);
-			msg = msg_parser_list.next;
+			msg = list->next;
 		}        	
 	}
 }
@@ -144,139 +396,65 @@ void delete_messages(void)
 int
 process_RELAY_FORW(struct msg_parser *msg)
 {
-	uint8_t *head = (uint8_t *) malloc(HEAD_SIZE*sizeof(uint8_t));
-	uint8_t *newbuff = (uint8_t *) malloc(MAX_DHCP_MSG_LENGTH*sizeof(uint8_t));
-	uint8_t *pointer;
-	struct interface *device = NULL;
-	struct sockaddr_in6 sap;
-	int check = 0;
-	uint16_t *p16, *optl;
-	uint32_t *p32;
-	int len, hop;
-
-	if ((head == NULL) || (newbuff == NULL)) {
-		printf("ProcessRELAYFORW--> ERROR, NO MORE MEMRY AVAILABLE  \n");	
-		exit(1);	
-	}	
- 
-	memset(head, 0, HEAD_SIZE);
-
-	pointer = head;
-
-
-	if (msg->isRF == 1) { /* got message from a relay agent to be relayed */
-		(*pointer) = RELAY_FORW;
-		pointer += 1;
-		(*pointer) = msg->hop_count + 1; /* increased hop-count */
-		msg->hc_pointer = pointer;
-
-		if (max_count == 1) {
-			(*pointer) = MAXHOPCOUNT;
-			hop = (int) (*pointer);            
-			TRACE(dump, "%s - %s%d\n", dhcp6r_clock(), "HOPCOUNT: ", hop);
-		}
-
-		pointer += 1;
-
-	}
-	else {            /*got message from a client to be relayed */
-		(*pointer) = RELAY_FORW;
-		pointer += 1;
-		(*pointer) = 0; /* hop-count */
-		msg->hc_pointer = pointer;
-
-		if (max_count == 1) {
-			(*pointer) = MAXHOPCOUNT;
-			hop = (int) (*pointer);	            
-			TRACE(dump, "%s - %s%d\n", dhcp6r_clock(), "HOPCOUNT: ", hop);
-		}
-		pointer += 1;
+	uint8_t *newbuff, *tmpl;
+	uint16_t optl;
+	int hop;
+
+	/* an interface without a global address has no template, nor has one
+	 * that came up after the index was last rebuilt
+	 */
+	tmpl = get_forw_template(msg->interface_in);
+	if (tmpl == NULL) {
+		RTRACE(TRACE_PACKET, EV_DROP_NOADDR, msg->interface_in, 0, 0, 
+		       msg->datalength, 0, NULL);
+		return 0;
 	}
 
-	msg->msg_type = RELAY_FORW;
-
-	device = get_interface(msg->interface_in);
-	if (device == NULL) {
-		printf("ProcessRELAYFORW--->ERROR NO INTERFACE FOUND!\n");
-		exit(1);
+	RTRACE(TRACE_DETAIL, EV_FORW_BUILT, msg->interface_in, 0, 0, 
+	       RELAY_FORW_HDRLEN, msg->datalength, NULL);
+	
+	if ((RELAY_FORW_HDRLEN + msg->datalength) > MAX_DHCP_MSG_LENGTH) {
+		RTRACE(TRACE_PACKET, EV_DROP_TOOBIG, msg->interface_in, 0, 0, 
+		       RELAY_FORW_HDRLEN + msg->datalength, 0, NULL);
+		return 0;
 	}
 
-	/* fill in link-address */
+	newbuff = (uint8_t *) malloc(MAX_DHCP_MSG_LENGTH*sizeof(uint8_t));
+	if (newbuff == NULL) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "process_RELAY_FORW--> ERROR NO MORE MEMORY AVAILABLE\n");
+		exit(1);	
+	}	
 
-	if (inet_pton(AF_INET6, msg->src_addr , &sap.sin6_addr) <= 0) {
-		printf("ProcessRELAYFORW1--->ERROR IN  inet_pton !\n");
-		exit(1);
-	}
+	memcpy(newbuff, tmpl, RELAY_FORW_HDRLEN);
 
-	if ((!IN6_IS_ADDR_LINKLOCAL(&sap.sin6_addr)) && (nr_of_devices == 1 )) {
-		memset(&sap.sin6_addr, 0, sizeof(sap.sin6_addr));
-		memcpy(pointer, &sap.sin6_addr, INET6_LEN);
-		pointer += INET6_LEN;
-	}
-	else {
-		check = 0;
-          
-		memset(&sap.sin6_addr, 0, sizeof(sap.sin6_addr));
-
-		if (inet_pton(AF_INET6, device->ipv6addr->gaddr, &sap.sin6_addr) <= 0) {
-			printf("ProcessRELAYFORW1--->ERROR IN  inet_pton !\n");
-			exit(1);
-		}
+	/* hop-count, increased when the message came from a relay agent */
+	msg->hc_pointer = newbuff + 1;
+	if (msg->isRF == 1)
+		*msg->hc_pointer = msg->hop_count + 1;
 
-		memcpy(pointer, &sap.sin6_addr, INET6_LEN);
-		pointer += INET6_LEN;
+	if (max_count == 1) {
+		*msg->hc_pointer = MAXHOPCOUNT;
+		hop = (int) *msg->hc_pointer;
+		RTRACE(TRACE_DETAIL, EV_HOPCOUNT, msg->interface_in, 0, 0, hop, 0, 
+		       NULL);
 	}
 
+	msg->msg_type = RELAY_FORW;
 
-	/* fill in peer-addrees */
-	memset(&sap.sin6_addr, 0, sizeof(sap.sin6_addr));
-
-	if (inet_pton(AF_INET6, msg->src_addr , &sap.sin6_addr) <= 0) {
-		printf("ProcessRELAYFORW--->ERROR2 IN  inet_pton !\n");
-		exit(1);
-	}
-
-	memcpy(pointer, &sap.sin6_addr, INET6_LEN);
-	pointer += INET6_LEN;
+	/* link-address stays unspecified for a global source on a single link */
+	if ((!IN6_IS_ADDR_LINKLOCAL(&msg->src_in6)) && (nr_of_devices == 1))
+		memset(newbuff + 2, 0, INET6_LEN);
 
-	/* Insert Interface_ID option to identify the interface */
-	p16 = (uint16_t *) pointer;
-	*p16 = htons(OPTION_INTERFACE_ID);
-	pointer += 2;
-	p16 = (uint16_t *) pointer;
-	*p16 = htons(4); /* 4 octeti length */
-	pointer += 2;
-	p32 = (uint32_t *) pointer;
-	*p32 = htonl(device->opaq);
-	pointer += 4;
+	/* peer-address */
+	memcpy(newbuff + 2 + INET6_LEN, &msg->src_in6, INET6_LEN);
 
-	p16 = (uint16_t *) pointer;
-	*p16 = htons(OPTION_RELAY_MSG);
-	pointer += 2;
-	optl = (uint16_t *) pointer;
-	pointer += 2;
-	*optl = htons(msg->datalength);
-
-	len = (pointer - head);
-	TRACE(dump, "%s - %s%d\n", dhcp6r_clock(), "RELAY_FORW HEADERLENGTH: ", 
-	      len);
-	TRACE(dump, "%s - %s%d\n", dhcp6r_clock(), "ORIGINAL MESSAGE LENGTH: ",
-	      msg->datalength );
-	
-	if ((len+ msg->datalength) > MAX_DHCP_MSG_LENGTH) {
-		printf(" ERROR FRAGMENTATION WILL OCCUR IF SENT, DROP THE PACKET"
-		       "......\n");
-		return 0;
-	}
+	optl = htons(msg->datalength);
+	memcpy(newbuff + RELAY_FORW_HDRLEN - 2, &optl, 2);
 
-	pointer = newbuff;
-	memset(pointer, 0, MAX_DHCP_MSG_LENGTH);
-	memcpy(pointer, head, len);
-	pointer += len;
-	memcpy(pointer, msg->buffer, msg->datalength);
-	msg->datalength += len; /* final length for sending */
+	memcpy(newbuff + RELAY_FORW_HDRLEN, msg->buffer, msg->datalength);
+	msg->datalength += RELAY_FORW_HDRLEN; /* final length for sending */
 	free(msg->buffer);
-	free(head);
 	msg->buffer = newbuff;
 
 	return 1;
@@ -289,12 +467,9 @@ process_RELAY_REPL(struct msg_parser *msg)
 	uint8_t *pointer, *pstart, *psp;
 	struct interface *device = NULL;
 	struct sockaddr_in6 sap;
-	int check = 0;
 	uint16_t *p16, option, opaqlen, msglen;
 	uint32_t *p32;
 	int len, opaq;
-	struct IPv6_address *ipv6a;
-	char *s; 
  
 	if (newbuff == NULL) {
 		printf("ProcessRELAYREPL--> ERROR, NO MORE MEMRY AVAILABLE  \n");	
@@ -401,13 +576,9 @@ process_RELAY_REPL(struct msg_parser *msg)
 				*pointer = RELAY_REPL; /* is the job of the server to set to 
 				                         RELAY_REPL? */
 			/*--------------------------*/
-			for (device = interface_list.next; device != &interface_list;  
-			     device = device->next) {
-				if (device->opaq == opaq)
-					break;
-			}
+			device = get_interface_opaq(opaq);
 
-			if (device != &interface_list ) {
+			if (device != NULL) {
 				msg->if_index = device->devindex;
 				memset(newbuff, 0, MAX_DHCP_MSG_LENGTH);
 				len = (pointer - msg->buffer);
@@ -420,30 +591,14 @@ process_RELAY_REPL(struct msg_parser *msg)
 				
 			}
 			else {
-				s = msg->link_addr;
-                    
-				for (device = interface_list.next; device != &interface_list;  
-				     device = device->next) {
-					ipv6a = device->ipv6addr;
-
-					while(ipv6a!= NULL) { 
-						if (strcmp(s, ipv6a->gaddr) == 0) {
-							msg->if_index = device->devindex;
-							check = 1;
-							break;
-						}
-						ipv6a = ipv6a->next;
-					}
-
-					if (check == 1) 
-						break;
-				}
+				device = get_interface_addr(msg->link_addr);
 
-				if (check == 0) {
+				if (device == NULL) {
 					printf("ProcessRELAYREPL--->ERROR NO INTERFACE FOUND!\n");
 					return 0;
 				}
 
+				msg->if_index = device->devindex;
 				memset(newbuff, 0, MAX_DHCP_MSG_LENGTH);
 				len = (pointer - msg->buffer);
 				len = (msg->datalength - len);
@@ -503,13 +658,9 @@ process_RELAY_REPL(struct msg_parser *msg)
 			*pointer = RELAY_REPL; /* is the job of the server to set to 
 		                          RELAY_REPL? */
 		/*--------------------------*/
-		for (device = interface_list.next; device != &interface_list;
-		     device = device->next) {             
-			if (device->opaq == opaq)
-				break;
-		}
+		device = get_interface_opaq(opaq);
 
-		if (device != &interface_list) {
+		if (device != NULL) {
 			msg->if_index = device->devindex;
 			memset(newbuff, 0, MAX_DHCP_MSG_LENGTH);
 			len = (pointer - msg->buffer);
@@ -521,30 +672,15 @@ process_RELAY_REPL(struct msg_parser *msg)
 			return 1;
 		}
 		else {
-			s = msg->link_addr;
-	
-			for (device = interface_list.next; device != &interface_list;
-		     	device = device->next) {
-				ipv6a = device->ipv6addr;
-                   	  	
-				while(ipv6a != NULL) { 
-					if (strcmp(s, ipv6a->gaddr) == 0) {
-						msg->if_index = device->devindex;
-						check = 1;
-						break;
-					}
-					ipv6a = ipv6a->next;
-				}
-
-				if (check == 1) 
-					break;
-			}
+			device = get_interface_addr(msg->link_addr);
   
-			if (check == 0) {
+			if (device == NULL) {
 				printf("ProcessRELAYREPL--->ERROR NO INTERFACE FOUND!\n");
 				return 0;
 			}
 
+			msg->if_index = device->devindex;
+
 			memset(newbuff, 0, MAX_DHCP_MSG_LENGTH);
 			len = (pointer - msg->buffer);
 			len = (msg->datalength - len);
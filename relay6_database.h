@@ -70,8 +70,17 @@ struct interface {
 	uint32_t devindex;
 	char *link_local;
 	int opaq;  
+	int ciface;                   /* receives client messages */
+	struct IPv6_address *pending; /* addresses read by the last update */
+	uint16_t msg_mask;            /* message types accepted, see MSG_BIT */
 };
 
+#define MSG_BIT(type)           (1 << (type))
+#define CLIENT_MSG_MASK         0x0FFE  /* SOLICIT .. INFORMATION_REQUEST */
+
+/* relay header, interface-id option and the relay-msg option header */
+#define RELAY_FORW_HDRLEN       (RELAY_HEADER_LENGTH + 8 + 4)
+
 struct cifaces cifaces_list;
 struct sifaces sifaces_list;
 struct server  server_list;
@@ -81,11 +90,15 @@ struct interface    interface_list ;
 
 int process_RELAY_FORW __P((struct msg_parser *msg));
 int process_RELAY_REPL __P((struct msg_parser *msg));
-struct msg_parser *get_send_messages_out __P((void));
-void delete_messages __P((void));
-int check_interface_semafor __P((int index));
+struct msg_parser *get_send_messages_out __P((struct msg_parser *));
+void delete_messages __P((struct msg_parser *));
+int check_interface_msg __P((int index, int msg_type));
 struct interface *get_interface __P((int if_index));
 struct interface *get_interface_s __P((char *s));
+uint8_t *get_forw_template __P((int if_index));
+struct interface *get_interface_opaq __P((int opaq));
+struct interface *get_interface_addr __P((char *addr));
+void index_interfaces __P((struct IPv6_address *stale));
  
 int nr_of_devices;
 int nr_of_uni_addr;
@@ -32,8 +32,11 @@
 
 #include "relay6_parser.h"
 #include "relay6_database.h"
+#include "relay6_trace.h"
 
-struct msg_parser *create_parser_obj() 
+struct msg_parser *create_parser_obj(rs, list) 
+	struct receive *rs;
+	struct msg_parser *list;
 {
 	struct msg_parser *msg;
   
@@ -49,24 +52,25 @@ struct msg_parser *create_parser_obj()
 		exit(1);
 	}
 
-	memcpy(msg->buffer, recvsock->databuf, MAX_DHCP_MSG_LENGTH);
+	memcpy(msg->buffer, rs->databuf, MAX_DHCP_MSG_LENGTH);
 
 	msg->sent = 0;
 	msg->if_index = 0;
 
-	msg->interface_in = recvsock->pkt_interface;
-	memcpy(msg->src_addr, recvsock->src_addr, sizeof(recvsock->src_addr));
-	msg->datalength = recvsock->buflength;
+	msg->interface_in = rs->pkt_interface;
+	memcpy(msg->src_addr, rs->src_addr, sizeof(rs->src_addr));
+	msg->src_in6 = rs->from.sin6_addr;
+	msg->datalength = rs->buflength;
 	msg->pointer_start = msg->buffer;
-	msg->dst_addr_type = recvsock->dst_addr_type;
+	msg->dst_addr_type = rs->dst_addr_type;
   
-	msg->prev = &msg_parser_list;
-	msg->next =  msg_parser_list.next;
+	msg->prev = list;
+	msg->next =  list->next;
 	msg->prev->next = msg;
 	msg->next->prev = msg;
    
-	TRACE(dump, "\n%s - RECEIVED NEW MESSAGE ON INTERFACE: %d,  SOURCE: %s\n",
-	      dhcp6r_clock(), msg->interface_in, msg->src_addr);
+	RTRACE(TRACE_PACKET, EV_RECV, msg->interface_in, 0, 0, msg->datalength, 0,
+	       &rs->from.sin6_addr);
  
 	return msg;
 }
@@ -85,194 +89,137 @@ check_buffer(ref, mesg)
 		return 0;
 }
 
-int
-put_msg_in_store(mesg) 
+/* 
+ * Client messages are relayed as they are, whatever their type; only the
+ * relay messages need handling of their own.  Slots without a handler are
+ * dropped as unknown.
+ */
+static int relay_client_msg __P((struct msg_parser *, uint8_t, uint32_t));
+static int relay_forw_msg __P((struct msg_parser *, uint8_t, uint32_t));
+static int relay_repl_msg __P((struct msg_parser *, uint8_t, uint32_t));
+
+static const struct msg_dispatch {
+	const char *name;
+	int (*handler) __P((struct msg_parser *, uint8_t, uint32_t));
+} msg_dispatch[MSG_TYPE_MAX + 1] = {
+	{ "UNKNOWN",             NULL },
+	{ "SOLICIT",             relay_client_msg },
+	{ "ADVERTISE",           relay_client_msg },
+	{ "REQUEST",             relay_client_msg },
+	{ "CONFIRM",             relay_client_msg },
+	{ "RENEW",               relay_client_msg },
+	{ "REBIND",              relay_client_msg },
+	{ "REPLY",               relay_client_msg },
+	{ "RELEASE",             relay_client_msg },
+	{ "DECLINE",             relay_client_msg },
+	{ "RECONFIGURE",         relay_client_msg },
+	{ "INFORMATION_REQUEST", relay_client_msg },
+	{ "RELAY_FORW",          relay_forw_msg },
+	{ "RELAY_REPL",          relay_repl_msg },
+};
+
+static int
+relay_client_msg(mesg, msg_type, xid)
 	struct msg_parser *mesg;
+	uint8_t msg_type;
+	uint32_t xid;
 {
-	uint32_t msg_type;
-	uint8_t *hop, msg;
-
-	/* --------------------------- */
-	mesg->pstart = mesg->buffer;
-    
-	if (check_buffer(MESSAGE_HEADER_LENGTH, mesg) == 0) {
-		printf("put_msg_in_store()--> opt_length has 0 value for "
-		       "MESSAGE_HEADER_LENGTH, DROPING... \n");
-		return 0;
-	}
-	msg_type = *((uint32_t *) mesg->pstart);
-	msg_type =  (ntohl(msg_type) & 0xFF000000)>>24;
-
-	if (msg_type == SOLICIT) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'SOLICIT' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
-
-		return 1;
-	}
-	else if (msg_type == REBIND) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;  
-                
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'REBIND' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
-
-		return 1;
-	}
-	else if (msg_type == INFORMATION_REQUEST) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'INFORMATION_REQUEST' FROM CLIENT---> "
-		      "IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+	RTRACE(TRACE_PACKET, EV_CLIENT_MSG, mesg->interface_in, msg_type, xid,
+	       mesg->datalength, 0, NULL);
+	mesg->isRF = 0;
 
-		return 1;
-	}
-	else if (msg_type == REQUEST) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(), 
-		      "GOT MESSAGE 'REQUEST' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+	return process_RELAY_FORW(mesg);
+}
 
-		return 1;
+static int
+relay_forw_msg(mesg, msg_type, xid)
+	struct msg_parser *mesg;
+	uint8_t msg_type;
+	uint32_t xid;
+{
+	uint8_t *hop;
+
+	hop = (mesg->pstart + 1);
+	RTRACE(TRACE_PACKET, EV_RELAY_FORW_IN, mesg->interface_in, msg_type, 0, 
+	       *hop, 0, NULL);
+	if (*hop >= HOP_COUNT_LIMIT) {
+		RTRACE(TRACE_PACKET, EV_DROP_HOPLIMIT, mesg->interface_in, msg_type, 
+		       0, *hop, 0, NULL);
+		return 0;
 	}
-	else if (msg_type == REPLY) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'REPLY' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
 
-		return 1;
-	}
-	else if (msg_type == RENEW) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'RENEW' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+	mesg->hop_count = *hop;
+	mesg->isRF = 1;
 
-		return 1;
-	}
-	else if (msg_type == RECONFIGURE) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'RECONFIGURE' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+	return process_RELAY_FORW(mesg);
+}
 
-		return 1;
-	} 
-	else if (msg_type == CONFIRM) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'CONFIRM' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+static int
+relay_repl_msg(mesg, msg_type, xid)
+	struct msg_parser *mesg;
+	uint8_t msg_type;
+	uint32_t xid;
+{
+	RTRACE(TRACE_PACKET, EV_RELAY_REPL_IN, mesg->interface_in, msg_type, 0,
+	       mesg->datalength, 0, NULL);
 
-		return 1;
-	}
-	else if (msg_type == ADVERTISE) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'ADVERTISE' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+	return process_RELAY_REPL(mesg);
+}
 
-		return 1;
-	} 
-	else if (msg_type == DECLINE) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'DECLINE' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
+int
+put_msg_in_store(mesg) 
+	struct msg_parser *mesg;
+{
+	const struct msg_dispatch *md;
+	uint32_t xid;
+	uint8_t msg_type;
 
-		return 1;
+	/* --------------------------- */
+	mesg->pstart = mesg->buffer;
+    
+	if (check_buffer(MESSAGE_HEADER_LENGTH, mesg) == 0) {
+		__sync_fetch_and_add(&msg_counters[0].dropped, 1);
+		RTRACE(TRACE_PACKET, EV_DROP_SHORT, mesg->interface_in, 0, 0, 
+		       mesg->datalength, 0, NULL);
+		return 0;
 	}
-	else if (msg_type == RELEASE) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'RELEASE' FROM CLIENT---> IS TO BE RELAYED\n");
-		mesg->isRF = 0;
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
-
-		return 1;
+	xid = ntohl(*((uint32_t *) mesg->pstart));
+	msg_type = (xid & 0xFF000000) >> 24;
+	xid &= 0x00FFFFFF;
+
+	if (msg_type > MSG_TYPE_MAX)
+		msg_type = 0;
+	md = &msg_dispatch[msg_type];
+	__sync_fetch_and_add(&msg_counters[msg_type].received, 1);
+
+	if (md->handler == NULL) {
+		RTRACE(TRACE_PACKET, EV_DROP_UNKNOWN, mesg->interface_in, 
+		       *mesg->pstart, 0, mesg->datalength, 0, NULL);
+		__sync_fetch_and_add(&msg_counters[msg_type].dropped, 1);
+		return 0;
 	}
-	msg = *mesg->pstart;
- 
-	if (msg == RELAY_FORW) {
-		if (check_interface_semafor(mesg->interface_in) == 0)
-			return 0;
-         
-		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "GOT MESSAGE 'RELAY_FORW' FROM RELAY AGENT---> "
-		      "IS TO BE FURTHER RELAYED\n");
-		hop = (mesg->pstart + 1);
-		if (*hop >= HOP_COUNT_LIMIT) {
-			TRACE(dump, "%s - %s", dhcp6r_clock(),
-			      "HOP COUNT EXCEEDED, PACKET WILL BE DROPED...\n");
-			return 0;
-		}
-
-		mesg->hop_count = *hop;
-		mesg->isRF = 1;
-
-		if (process_RELAY_FORW(mesg) == 0)
-			return 0;
 
-		return 1;
+	if ((check_interface_msg(mesg->interface_in, msg_type) == 0) ||
+	    ((*md->handler)(mesg, msg_type, xid) == 0)) {
+		__sync_fetch_and_add(&msg_counters[msg_type].dropped, 1);
+		return 0;
 	}
 
-	if (msg == RELAY_REPL) {
-		TRACE(dump, "%s - %s", dhcp6r_clock(), 
-		      "GOT MESSAGE 'RELAY_REPL' FROM RELAY AGENT OR SERVER---> "
-		      "IS TO BE FURTHER RELAYED\n");
+	__sync_fetch_and_add(&msg_counters[msg_type].relayed, 1);
+	return 1;
+}
 
-		if (process_RELAY_REPL(mesg) == 0)
-			return 0;
-       
-		return 1;
+void
+print_msg_counters(fp)
+	FILE *fp;
+{
+	int i;
+
+	for (i = 0; i <= MSG_TYPE_MAX; i++) {
+		if (msg_counters[i].received == 0)
+			continue;
+		TRACE(fp, "%s - %-19s received %u, relayed %u, dropped %u\n",
+		      dhcp6r_clock(), msg_dispatch[i].name, msg_counters[i].received,
+		      msg_counters[i].relayed, msg_counters[i].dropped);
 	}
-
-	TRACE(dump, "%s - %s", dhcp6r_clock(),
-	      "put_msg_in_store()--> ERROR GOT UNKNOWN MESSAGE DROPING IT......\n");
-
-	return 0;
 }
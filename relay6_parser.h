@@ -46,6 +46,7 @@ struct msg_parser {
 	uint32_t datalength;  /* the length of the DHCPv6 message */
 	int dst_addr_type;
 	char src_addr[INET6_ADDRSTRLEN];  /* source address from the UDP packet */
+	struct in6_addr src_in6;          /* the same, in binary */
 	char peer_addr[INET6_ADDRSTRLEN];
 	char link_addr[INET6_ADDRSTRLEN];
 	int interface_in, hop_count;
@@ -54,9 +55,20 @@ struct msg_parser {
 };
 
 struct msg_parser msg_parser_list;
+
+/* per message type, slot 0 counts the malformed and unknown ones */
+struct msg_counter {
+	uint32_t received;
+	uint32_t relayed;
+	uint32_t dropped;
+};
+
+struct msg_counter msg_counters[MSG_TYPE_MAX + 1];
  
-struct msg_parser *create_parser_obj __P((void));
+struct msg_parser *create_parser_obj __P((struct receive *, 
+                                         struct msg_parser *));
 int put_msg_in_store __P((struct msg_parser *mesg));
 int check_buffer __P((int ref, struct msg_parser *mesg));
+void print_msg_counters __P((FILE *));
 
 #endif /* __RELAY6_PARSER_H_DEFINED */
@@ -32,95 +32,133 @@
 #include <arpa/inet.h>
 #include <net/if.h>
 #include <errno.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/filter.h>
 
 #include "relay6_socket.h"
 #include "relay6_database.h"
+#include "relay6_thread.h"
+#include "relay6_trace.h"
 
 #ifndef IPV6_2292PKTINFO
 #define IPV6_2292PKTINFO IPV6_PKTINFO
 #endif
 
-void 
-init_socket()
+struct receive *
+create_recvsock()
 {
-	recvsock = (struct receive *) malloc(sizeof(struct receive));
-	sendsock = (struct send *) malloc(sizeof(struct send)); 
-   
-	if ((recvsock == NULL) || (sendsock == NULL)) {
+	struct receive *rs;
+
+	rs = (struct receive *) malloc(sizeof(struct receive));
+	if (rs == NULL) {
 		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "init_socket--> ERROR NO MORE MEMORY AVAILABLE\n");
+		      "create_recvsock--> ERROR NO MORE MEMORY AVAILABLE\n");
 		exit(1);
 	}	
 
-	memset(recvsock, 0, sizeof(struct receive));
-	memset(sendsock, 0, sizeof(struct send));
+	memset(rs, 0, sizeof(struct receive));
    
-	recvsock->databuf = (char *) malloc(MAX_DHCP_MSG_LENGTH*sizeof(char));
-	if (recvsock->databuf == NULL) {
+	rs->databuf = (char *) malloc(MAX_DHCP_MSG_LENGTH*sizeof(char));
+	if (rs->databuf == NULL) {
 		TRACE(dump, "%s - %s", dhcp6r_clock(),
-		      "init_socket--> ERROR NO MORE MEMORY AVAILABLE\n");
+		      "create_recvsock--> ERROR NO MORE MEMORY AVAILABLE\n");
 		exit(1);
 	}	  
 
-	if ((recvsock->recv_sock_desc = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
+	if ((rs->recv_sock_desc = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
 		printf("Failed to get new socket with socket()\n");
 		exit(0);
 	}
 
-	if ((sendsock->send_sock_desc = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
+	return rs;
+}
+
+struct send *
+create_sendsock()
+{
+	struct send *ss;
+
+	ss = (struct send *) malloc(sizeof(struct send)); 
+	if (ss == NULL) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "create_sendsock--> ERROR NO MORE MEMORY AVAILABLE\n");
+		exit(1);
+	}	
+
+	memset(ss, 0, sizeof(struct send));
+
+	if ((ss->send_sock_desc = socket(AF_INET6, SOCK_DGRAM, 0)) < 0) {
 		printf("Failed to get new socket with socket()\n");
 		exit(0);
 	}
+
+	return ss;
+}
+
+void 
+init_socket()
+{
+	recvsock = create_recvsock();
+	sendsock = create_sendsock();
 }
 
 int
-get_recv_data() 
+get_recv_data(rs) 
+	struct receive *rs;
 {
 	struct cmsghdr *cm;
 	struct in6_pktinfo *pi;
 	struct sockaddr_in6 dst;
 
-	memset(recvsock->src_addr, 0, sizeof(recvsock->src_addr));
+	memset(rs->src_addr, 0, sizeof(rs->src_addr));
 
-	for(cm = (struct cmsghdr *) CMSG_FIRSTHDR(&recvsock->msg); cm; 
-	    cm = (struct cmsghdr *) CMSG_NXTHDR(&recvsock->msg, cm)) {
+	for(cm = (struct cmsghdr *) CMSG_FIRSTHDR(&rs->msg); cm; 
+	    cm = (struct cmsghdr *) CMSG_NXTHDR(&rs->msg, cm)) {
 		if ((cm->cmsg_level == IPPROTO_IPV6) && (cm->cmsg_type == IPV6_2292PKTINFO)
 		    && (cm->cmsg_len == CMSG_LEN(sizeof(struct in6_pktinfo)))) {
 			pi = (struct in6_pktinfo *)(CMSG_DATA(cm));
 			dst.sin6_addr = pi->ipi6_addr;
-			recvsock->pkt_interface = pi->ipi6_ifindex; /* the interface index 
-			                                               the packet got in */
+			rs->pkt_interface = pi->ipi6_ifindex; /* the interface index 
+			                                         the packet got in */
+
+			/* multicast for a worker's interface is delivered to recvsock
+			 * as well, leave it to the worker
+			 */
+			if ((rs->bound_ifindex == 0) && relay_threads &&
+			    (get_relay_worker(rs->pkt_interface) != NULL))
+				return 0;
 
-			if (IN6_IS_ADDR_LOOPBACK(&recvsock->from.sin6_addr)) {
-				TRACE(dump, "%s - %s", dhcp6r_clock(), 
-				      "get_recv_data()-->SOURCE ADDRESS IS LOOPBACK!\n");
+			if (IN6_IS_ADDR_LOOPBACK(&rs->from.sin6_addr)) {
+				RTRACE(TRACE_PACKET, EV_DROP_LOOPBACK, rs->pkt_interface, 0, 0, 
+				       rs->buflength, 0, &rs->from.sin6_addr);
 				return 0;
 			}
 
-			if (inet_ntop(AF_INET6, &recvsock->from.sin6_addr, 
-			              recvsock->src_addr, INET6_ADDRSTRLEN) <= 0) {
+			if (inet_ntop(AF_INET6, &rs->from.sin6_addr, 
+			              rs->src_addr, INET6_ADDRSTRLEN) <= 0) {
 				TRACE(dump, "%s - %s", dhcp6r_clock(),
 				      "inet_ntop failed in get_recv_data()\n");
 				return 0;
        		}
 
 			if (IN6_IS_ADDR_LOOPBACK(&dst.sin6_addr)) {
-				recvsock->dst_addr_type = 1;
+				rs->dst_addr_type = 1;
 			}
 			else if (IN6_IS_ADDR_MULTICAST(&dst.sin6_addr)) {
-				recvsock->dst_addr_type = 2;
+				rs->dst_addr_type = 2;
 				if (multicast_off == 1) {
-					TRACE(dump, "%s - %s", dhcp6r_clock(), 
-					      "RECEIVED MULTICAST PACKET IS DROPPED, ONLY UNICAST "
-					      "IS ALLOWED!\n");
+					RTRACE(TRACE_PACKET, EV_DROP_MCAST, rs->pkt_interface, 0, 0, 
+					       rs->buflength, 0, &rs->from.sin6_addr);
 					return 0;
 				}
 			}
 			else if (IN6_IS_ADDR_LINKLOCAL(&dst.sin6_addr)) {
-				recvsock->dst_addr_type = 3;
+				rs->dst_addr_type = 3;
 			}
 			else if (IN6_IS_ADDR_SITELOCAL(&dst.sin6_addr))
-          		recvsock->dst_addr_type = 4;
+          		rs->dst_addr_type = 4;
 
 			return 1;
 		}
@@ -130,7 +168,8 @@ get_recv_data()
 }
 
 int
-check_select(void) 
+check_select(rs) 
+	struct receive *rs;
 {
 	int i = 0;
 	int flag = 0;
@@ -140,7 +179,7 @@ check_select(void)
 	tv.tv_usec = 0;
 
 	FD_ZERO(&readfd);
-	fdmax = recvsock->recv_sock_desc; /* check the max of them if many 
+	fdmax = rs->recv_sock_desc; /* check the max of them if many 
 	                                     desc used */
 	FD_SET(fdmax, &readfd);
 
@@ -159,15 +198,11 @@ check_select(void)
 	return flag;
 }
 
-int 
-set_sock_opt() 
+static int
+set_send_sock_opt(ss)
+	struct send *ss;
 {
-    int on = 1;
-    int hop_limit;
-    struct interface *device;
-	int flag; 
-	struct cifaces *iface;
-	struct ipv6_mreq  sock_opt;    
+	int hop_limit;
 
 	/* If the relay agent relays messages to the All_DHCP_Servers
 	 * multicast address or other multicast addresses, it sets the
@@ -175,7 +210,7 @@ set_sock_opt()
 	 * [RFC3315 Section 20]
 	 */
 	hop_limit = 32;
-	if (setsockopt(sendsock->send_sock_desc, IPPROTO_IPV6,
+	if (setsockopt(ss->send_sock_desc, IPPROTO_IPV6,
 		IPV6_MULTICAST_HOPS, &hop_limit, sizeof(hop_limit)) < 0) {
 		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
 				"Failed to set socket for IPV6_MULTICAST_HOPS",
@@ -183,7 +218,38 @@ set_sock_opt()
 		return 0;
 	}
 
-	if (setsockopt(recvsock->recv_sock_desc, IPPROTO_IPV6, IPV6_2292PKTINFO,
+	return 1;
+}
+
+/* 
+ * The kernel runs a UDP socket filter with the UDP header at offset 0, the
+ * DHCPv6 message type is the first payload byte.  Anything shorter than a
+ * message header, of type 0 or above RELAY_REPL, or a relay message shorter
+ * than a relay header, never gets queued on the socket.
+ */
+#define UDP_HDRLEN	8
+
+static struct sock_filter dhcp6_filter[] = {
+	BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+	BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, UDP_HDRLEN + MESSAGE_HEADER_LENGTH, 0, 7),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, UDP_HDRLEN),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0, 5, 0),
+	BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, MSG_TYPE_MAX, 4, 0),
+	BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, RELAY_FORW, 0, 2),
+	BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+	BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, UDP_HDRLEN + RELAY_HEADER_LENGTH, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+static int
+set_recv_sock_opt(rs)
+	struct receive *rs;
+{
+	struct sock_fprog prog;
+	int on = 1;
+
+	if (setsockopt(rs->recv_sock_desc, IPPROTO_IPV6, IPV6_2292PKTINFO,
 	               &on, sizeof(on) ) < 0) {
 		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
 		      "Failed to set socket for IPV6_2292PKTINFO",
@@ -191,8 +257,71 @@ set_sock_opt()
 		return 0;
 	}
 
-	for (device = interface_list.next; device != &interface_list;
-	     device = device->next) {   
+	/* the per-interface worker sockets share port 547 with recvsock */
+	if (relay_threads && setsockopt(rs->recv_sock_desc, SOL_SOCKET, 
+	    SO_REUSEADDR, &on, sizeof(on)) < 0) {
+		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
+		      "Failed to set socket for SO_REUSEADDR",
+		      strerror(errno));
+		return 0;
+	}
+
+	prog.len = sizeof(dhcp6_filter) / sizeof(dhcp6_filter[0]);
+	prog.filter = dhcp6_filter;
+	if (setsockopt(rs->recv_sock_desc, SOL_SOCKET, SO_ATTACH_FILTER,
+	               &prog, sizeof(prog)) < 0) {
+		/* not fatal, put_msg_in_store() checks all of it again */
+		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
+		      "Failed to attach socket filter", strerror(errno));
+	}
+
+	return 1;
+}
+
+static int
+join_relay_group(rs, device)
+	struct receive *rs;
+	struct interface *device;
+{
+	struct ipv6_mreq  sock_opt;    
+
+	sock_opt.ipv6mr_interface = device->devindex;
+    
+	if (inet_pton(AF_INET6, ALL_DHCP_RELAY_AND_SERVERS, 
+	              &sock_opt.ipv6mr_multiaddr) <= 0) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(),
+		      "Failed to set struct for MULTICAST receive\n");
+		return 0;
+	}
+
+	if (setsockopt(rs->recv_sock_desc, IPPROTO_IPV6, IPV6_JOIN_GROUP, 
+	               (char *) &sock_opt, sizeof(sock_opt)) < 0) {
+		TRACE(dump, "%s - %s", dhcp6r_clock(), 
+		      "Failed to set socket option for IPV6_JOIN_GROUP \n");
+		return 0;
+	}
+
+	return 1;
+}
+
+int 
+set_sock_opt() 
+{
+    struct interface *device;
+	int flag; 
+	struct cifaces *iface;
+
+	if (set_send_sock_opt(sendsock) == 0)
+		return 0;
+
+	if (set_recv_sock_opt(recvsock) == 0)
+		return 0;
+
+	/* with -t every client interface joins the group on its own socket,
+	 * recvsock then only picks up the unicast replies from the servers 
+	 */
+	for (device = interface_list.next; device != &interface_list && 
+	     relay_threads == 0; device = device->next) {   
 		if (cifaces_list.next != &cifaces_list) {
 			flag = 0;
 			for (iface = cifaces_list.next; iface != &cifaces_list; 
@@ -206,21 +335,8 @@ set_sock_opt()
 				continue;	      	
 		}
        	
-		sock_opt.ipv6mr_interface = device->devindex;
-    
-		if (inet_pton(AF_INET6, ALL_DHCP_RELAY_AND_SERVERS, 
-		              &sock_opt.ipv6mr_multiaddr) <= 0) {
-			TRACE(dump, "%s - %s", dhcp6r_clock(),
-			      "Failed to set struct for MULTICAST receive\n");
+		if (join_relay_group(recvsock, device) == 0)
 			return 0;
-		}
-
-		if (setsockopt(recvsock->recv_sock_desc, IPPROTO_IPV6, IPV6_JOIN_GROUP, 
-		               (char *) &sock_opt, sizeof(sock_opt)) < 0) {
-			TRACE(dump, "%s - %s", dhcp6r_clock(), 
-			      "Failed to set socket option for IPV6_JOIN_GROUP \n");
-			return 0;
-		}
 	}
 
 	TRACE(dump, "%s - %s", dhcp6r_clock(),
@@ -229,29 +345,58 @@ set_sock_opt()
 	return 1;
 }
 
+int
+set_worker_sock_opt(rs, ss, device)
+	struct receive *rs;
+	struct send *ss;
+	struct interface *device;
+{
+	if (set_send_sock_opt(ss) == 0)
+		return 0;
+
+	if (set_recv_sock_opt(rs) == 0)
+		return 0;
+
+	if (setsockopt(rs->recv_sock_desc, SOL_SOCKET, SO_BINDTODEVICE, 
+	               device->ifname, strlen(device->ifname) + 1) < 0) {
+		TRACE(dump, "%s - %s %s, %s\n", dhcp6r_clock(), 
+		      "Failed to set socket for SO_BINDTODEVICE", device->ifname,
+		      strerror(errno));
+		return 0;
+	}
+
+	if (join_relay_group(rs, device) == 0)
+		return 0;
+
+	rs->bound_ifindex = device->devindex;
+
+	return 1;
+}
+
 
 int 
-fill_addr_struct() 
+fill_addr_struct(rs) 
+	struct receive *rs;
 {
-	bzero((char *)&recvsock->from, sizeof(struct sockaddr_in6));
-	recvsock->from.sin6_family = AF_INET6;
-	recvsock->from.sin6_addr = in6addr_any;
-	recvsock->from.sin6_port = htons(547);
-
-	recvsock->iov[0].iov_base = recvsock->databuf;
-	recvsock->iov[0].iov_len = MAX_DHCP_MSG_LENGTH;
-	recvsock->msg.msg_name = (void *) &recvsock->from;
-	recvsock->msg.msg_namelen = sizeof(recvsock->from);
-	recvsock->msg.msg_iov = &recvsock->iov[0];
-	recvsock->msg.msg_iovlen = 1;
-
-	recvsock->recvmsglen = CMSG_SPACE(sizeof(struct in6_pktinfo));
-	recvsock->recvp = (char *) malloc(recvsock->recvmsglen*sizeof(char));
-	recvsock->msg.msg_control = (void *) recvsock->recvp;
-	recvsock->msg.msg_controllen = recvsock->recvmsglen;
-
-    if (bind(recvsock->recv_sock_desc, (struct sockaddr *)&recvsock->from, 
-	         sizeof(recvsock->from)) < 0) {
+	bzero((char *)&rs->from, sizeof(struct sockaddr_in6));
+	rs->from.sin6_family = AF_INET6;
+	rs->from.sin6_addr = in6addr_any;
+	rs->from.sin6_port = htons(547);
+
+	rs->iov[0].iov_base = rs->databuf;
+	rs->iov[0].iov_len = MAX_DHCP_MSG_LENGTH;
+	rs->msg.msg_name = (void *) &rs->from;
+	rs->msg.msg_namelen = sizeof(rs->from);
+	rs->msg.msg_iov = &rs->iov[0];
+	rs->msg.msg_iovlen = 1;
+
+	rs->recvmsglen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+	rs->recvp = (char *) malloc(rs->recvmsglen*sizeof(char));
+	rs->msg.msg_control = (void *) rs->recvp;
+	rs->msg.msg_controllen = rs->recvmsglen;
+
+    if (bind(rs->recv_sock_desc, (struct sockaddr *)&rs->from, 
+	         sizeof(rs->from)) < 0) {
 		perror("bind");
 		return 0;
 	}
@@ -260,25 +405,29 @@ fill_addr_struct()
 }
 
 int 
-recv_data() 
+recv_data(rs) 
+	struct receive *rs;
 {
 	int count = -1;
 
-	memset(recvsock->databuf, 0, (MAX_DHCP_MSG_LENGTH*sizeof(char)));
+	memset(rs->databuf, 0, (MAX_DHCP_MSG_LENGTH*sizeof(char)));
 
-	if ((count = recvmsg(recvsock->recv_sock_desc, &recvsock->msg, 0)) < 0) {
+	if ((count = recvmsg(rs->recv_sock_desc, &rs->msg, 0)) < 0) {
 		TRACE(dump, "%s - %s", dhcp6r_clock(), 
 		      "Failed to receive data with recvmsg()-->Receive::recv_data()\n");
 		return -1;
 	}
 
-	recvsock->buflength = count;
+	rs->buflength = count;
 
 	return 1;
 }
 
-int
-get_interface_info() 
+static int next_opaq = OPAQ;   /* opaq values stay unique across updates */
+
+static int
+read_interface_info(update)
+	int update;
 {
 	FILE *f;
 	char addr6[40], devname[20];
@@ -287,15 +436,18 @@ get_interface_info()
 	char addr6p[8][5];
 	char src_addr[INET6_ADDRSTRLEN];
 	struct interface *device = NULL;
-	int opaq = OPAQ;
 	int sw = 0;
-	struct IPv6_address *ipv6addr;
+	struct IPv6_address *ipv6addr, *stale = NULL;
     
 	if ((f = fopen(INTERFACEINFO, "r")) == NULL) {
 		printf("FATAL ERROR-->COULD NOT OPEN FILE: %s\n", INTERFACEINFO);
 		return 0;
 	}         
 
+	for (device = interface_list.next; device != &interface_list;
+	     device = device->next)
+		device->pending = NULL;
+
 	while (fscanf(f, "%4s%4s%4s%4s%4s%4s%4s%4s %02x %02x %02x %02x %20s\n",
 	              addr6p[0], addr6p[1], addr6p[2], addr6p[3],addr6p[4], 
 	              addr6p[5], addr6p[6], addr6p[7], &if_idx, &plen, &scope, 
@@ -327,7 +479,7 @@ get_interface_info()
 		}	
 
 		if (sw == 0) {      	
-			opaq += 10;
+			next_opaq += 10;
 			device = (struct interface *) malloc(sizeof(struct interface));
 			if (device ==NULL) {
 				TRACE(dump, "%s - %s", dhcp6r_clock(), 
@@ -335,19 +487,42 @@ get_interface_info()
 				      "ERROR NO MORE MEMORY AVAILABLE\n");
 				exit(1);
 			}
-			device->opaq = opaq;	
+			memset(device, 0, sizeof(struct interface));
+			device->opaq = next_opaq;	
 			device->ifname = strdup(devname);
 			device->devindex = if_idx;
 			device->ipv6addr = NULL;
+			device->pending = NULL;
 			device->prev = &interface_list;
 			device->next =  interface_list.next;
+			__sync_synchronize();
 			device->prev->next = device;
 			device->next->prev = device;        
 			nr_of_devices += 1;
 		}
 
 		if (IN6_IS_ADDR_LINKLOCAL(&sap.sin6_addr)) {            
-			device->link_local = strdup(src_addr);
+			if ((device->link_local == NULL) || 
+			    (strcmp(device->link_local, src_addr) != 0)) {
+				/* a worker may still read the old one: the
+				 * index frees it along with the stale lists
+				 */
+				if (device->link_local != NULL) {
+					ipv6addr = (struct IPv6_address *)
+					           malloc(sizeof(struct IPv6_address));
+					if (ipv6addr == NULL) {
+						TRACE(dump, "%s - %s", dhcp6r_clock(), 
+						      "get_interface_info()--> "
+						      "ERROR NO MORE MEMORY AVAILABLE\n");
+						exit(1);
+					}
+					ipv6addr->gaddr = device->link_local;
+					ipv6addr->next = stale;
+					stale = ipv6addr;
+				}
+				__sync_synchronize();
+				device->link_local = strdup(src_addr);
+			}
 			TRACE(dump,"%s %s %s %d %s %s\n",\
 			      "RELAY INTERFACE INFO-> DEVNAME:", devname, "INDEX:", if_idx,
 			      "LINK_LOCAL_ADDRR:", src_addr);       
@@ -362,31 +537,119 @@ get_interface_info()
 				exit(1);
 			}
 			ipv6addr->gaddr = strdup(src_addr);
-			ipv6addr->next = NULL;
-			if (device->ipv6addr!= NULL)     	  
-				ipv6addr->next = device->ipv6addr;
-                          
-			device->ipv6addr = ipv6addr;
+			ipv6addr->next = device->pending;
+			device->pending = ipv6addr;
 		}
 	} /* while */
+	fclose(f);
     
 	fflush(dump); 
 	for (device = interface_list.next; device != &interface_list;
 	     device = device->next) {	
-		if ( device->ipv6addr == NULL) {
+		if ((device->pending == NULL) && (update == 0)) {
 			TRACE(dump,"%s - ERROR--> ONE MUST ASSIGN SITE SCOPED IPv6 "
 			      "ADDRESS FOR INTERFACE: %s\n", dhcp6r_clock(), 
 			      device->ifname);
 			exit(1);	      	     
 		}
+
+		/* the old list may still be in use, the index frees it later */
+		if (device->ipv6addr != NULL) {
+			for (ipv6addr = device->ipv6addr; ipv6addr->next != NULL;
+			     ipv6addr = ipv6addr->next)
+				;
+			ipv6addr->next = stale;
+			stale = device->ipv6addr;
+		}
+		__sync_synchronize();
+		device->ipv6addr = device->pending;
+		device->pending = NULL;
 	}	
-        
-	fclose(f);
+
+	index_interfaces(stale);
+	return 1;
+}
+
+int
+get_interface_info() 
+{
+	return read_interface_info(0);
+}
+
+int
+update_interface_info() 
+{
+	TRACE(dump, "%s - %s", dhcp6r_clock(),
+	      "INTERFACE CHANGE REPORTED, RELOADING INTERFACE INFO\n");
+	return read_interface_info(1);
+}
+
+int
+init_netlink_socket() 
+{
+	struct sockaddr_nl nl_addr;
+
+	if ((netlink_sock_desc = socket(PF_NETLINK, SOCK_RAW, NETLINK_ROUTE)) 
+	    < 0) {
+		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
+		      "Failed to open netlink socket", strerror(errno));
+		return 0;
+	}
+
+	memset(&nl_addr, 0, sizeof(nl_addr));
+	nl_addr.nl_family = AF_NETLINK;
+	nl_addr.nl_groups = RTMGRP_LINK | RTMGRP_IPV6_IFADDR;
+	if (bind(netlink_sock_desc, (struct sockaddr *) &nl_addr, 
+	         sizeof(nl_addr)) < 0) {
+		TRACE(dump, "%s - %s, %s\n", dhcp6r_clock(), 
+		      "Failed to bind netlink socket", strerror(errno));
+		close(netlink_sock_desc);
+		netlink_sock_desc = -1;
+		return 0;
+	}
+
 	return 1;
 }
 
+/* drain pending link and address events, returns 1 if there were any */
 int
-send_message() 
+check_netlink() 
+{
+	char buf[8192];
+	struct nlmsghdr *nlm;
+	int len, changed = 0;
+
+	if (netlink_sock_desc < 0)
+		return 0;
+
+	while ((len = recv(netlink_sock_desc, buf, sizeof(buf), MSG_DONTWAIT)) 
+	       > 0) {
+		for (nlm = (struct nlmsghdr *) buf; NLMSG_OK(nlm, len);
+		     nlm = NLMSG_NEXT(nlm, len)) {
+			switch (nlm->nlmsg_type) {
+			case RTM_NEWLINK:
+			case RTM_DELLINK:
+			case RTM_NEWADDR:
+			case RTM_DELADDR:
+				changed = 1;
+				break;
+			default:
+				break;
+			}
+		}
+	}
+
+	/* events were lost, reread everything anyway */
+	if ((len < 0) && (errno == ENOBUFS))
+		changed = 1;
+
+	return changed;
+}
+
+int
+send_message(ss, list) 
+	struct send *ss;
+	struct msg_parser *list;
 {
 	struct sockaddr_in6 sin6;    /* my address information */
 	struct msghdr msg;
@@ -404,7 +667,7 @@ send_message()
 	struct server *uservers;
 	struct sifaces *si;
       
-	if ((mesg = get_send_messages_out()) == NULL)
+	if ((mesg = get_send_messages_out(list)) == NULL)
 		return 0;
 
 	if (mesg->sent == 1)
@@ -463,8 +726,8 @@ send_message()
 				      "inet_pton failed in send_message()\n");
 				exit(1);
 			}
-			TRACE(dump, "%s - SOURCE ADDRESS: %s\n", dhcp6r_clock(), 
-			      src_addr);
+			RTRACE(TRACE_DETAIL, EV_SRC_ADDR, mesg->if_index, 0, 0, 0, 0,
+			       &in6_pkt->ipi6_addr);
         }
 		else {
 			/* the kernel will choose the source address */
@@ -473,10 +736,6 @@ send_message()
 
 		/* OUTGOING DEVICE FOR RELAY_REPLY MSG */
 		in6_pkt->ipi6_ifindex = mesg->if_index;        
-		TRACE(dump, "%s - OUTGOING DEVICE INDEX: %d\n", dhcp6r_clock(), 
-		      in6_pkt->ipi6_ifindex);
-		TRACE(dump, "%s - DESTINATION PORT: %d\n", dhcp6r_clock(), 
-		      ntohs(sin6.sin6_port));
 
 		iov[0].iov_base = mesg->buffer;
 		iov[0].iov_len = mesg->datalength;
@@ -485,7 +744,7 @@ send_message()
 		msg.msg_iov = &iov[0];
 		msg.msg_iovlen = 1;
 
-		if ((count = sendmsg(sendsock->send_sock_desc, &msg, 0)) < 0) { 
+		if ((count = sendmsg(ss->send_sock_desc, &msg, 0)) < 0) { 
 			perror("sendmsg");
 			return 0;
 		}
@@ -493,8 +752,8 @@ send_message()
 		if (count > MAX_DHCP_MSG_LENGTH)
 			perror("bytes in sendmsg");
              
-		TRACE(dump, "%s - *********> RELAY_REPL, SENT TO: %s SENT_BYTES: %d\n", 
-		      dhcp6r_clock(), dest_addr, count);
+		RTRACE(TRACE_PACKET, EV_SENT_REPL, in6_pkt->ipi6_ifindex, 
+		       mesg->buffer[0], 0, count, 0, &sin6.sin6_addr);
                        
 		free(recvp);
       
@@ -556,7 +815,7 @@ send_message()
 			msg.msg_iov = &iov[0];
 			msg.msg_iovlen = 1;
 
-			if ((count = sendmsg(sendsock->send_sock_desc, &msg, 0)) < 0) {     
+			if ((count = sendmsg(ss->send_sock_desc, &msg, 0)) < 0) {     
 				perror("sendmsg");	
 				return 0;
 			}
@@ -564,15 +823,16 @@ send_message()
 			if (count > MAX_DHCP_MSG_LENGTH)
 				perror("bytes sendmsg");
              
-			TRACE(dump,
-			      "%s - ========> RELAY_FORW, SENT TO: %s SENT_BYTES: %d\n", 
-			      dhcp6r_clock(), dest_addr, count);     
+			RTRACE(TRACE_PACKET, EV_SENT_FORW, in6_pkt->ipi6_ifindex, 
+			       RELAY_FORW, 0, count, 0, &sin6.sin6_addr);
 			free(recvp);
 			hit = 1;
 		} /* for */
    
 		for (iface = interface_list.next;  iface!= &interface_list;  
 	     	 iface = iface->next) {        	
+			if (iface->ipv6addr == NULL)
+				continue;
 			uservers = iface->sname;
 			while (uservers != NULL) { 	
 				bzero((char *)&sin6, sizeof(struct sockaddr_in6));
@@ -615,16 +875,14 @@ send_message()
 				in6_pkt->ipi6_ifindex = iface->devindex;  
 				sin6.sin6_scope_id = in6_pkt->ipi6_ifindex;
      
-				TRACE(dump, "%s - OUTGOING DEVICE INDEX: %d\n", dhcp6r_clock(), 
-				      in6_pkt->ipi6_ifindex);
 				if (inet_pton(AF_INET6, iface->ipv6addr->gaddr, 
 				              &in6_pkt->ipi6_addr) <= 0) {  /* source address */
 					TRACE(dump,"%s - %s",dhcp6r_clock(),
 					      "inet_pton failed in send_message()\n");
 					exit(1);
 				}
-				TRACE(dump, "%s - SOURCE ADDRESS: %s\n", dhcp6r_clock(), 
-				      iface->ipv6addr->gaddr);
+				RTRACE(TRACE_DETAIL, EV_SRC_ADDR, in6_pkt->ipi6_ifindex, 0, 0, 0, 0,
+				       &in6_pkt->ipi6_addr);
                
 				sin6.sin6_port = htons(SERVER_PORT);
     
@@ -635,7 +893,7 @@ send_message()
 				msg.msg_iov = &iov[0];
 				msg.msg_iovlen = 1;
 
-				if ((count = sendmsg(sendsock->send_sock_desc, &msg, 0)) < 0) {
+				if ((count = sendmsg(ss->send_sock_desc, &msg, 0)) < 0) {
 					perror("sendmsg");	
 					return 0;
 				}
@@ -643,9 +901,8 @@ send_message()
 				if (count > MAX_DHCP_MSG_LENGTH)
 					perror("bytes sendmsg");
              
-				TRACE(dump, 
-				      "%s - ========> RELAY_FORW, SENT TO: %s SENT_BYTES: %d\n",
-				      dhcp6r_clock(), dest_addr, count);
+				RTRACE(TRACE_PACKET, EV_SENT_FORW, in6_pkt->ipi6_ifindex, 
+				       RELAY_FORW, 0, count, 0, &sin6.sin6_addr);
 				free(recvp);
 				uservers = uservers->next;
 				hit = 1;  
@@ -691,25 +948,23 @@ send_message()
 				return 0;
 			} 
      
-			in6_pkt->ipi6_ifindex = if_nametoindex(si->siface);  
-			sin6.sin6_scope_id = in6_pkt->ipi6_ifindex;
-   
-			TRACE(dump, "%s - OUTGOING DEVICE INDEX: %d\n", dhcp6r_clock(), 
-			      in6_pkt->ipi6_ifindex);
-			iface = get_interface(in6_pkt->ipi6_ifindex);
-			if (iface == NULL) {
+			iface = get_interface_s(si->siface);
+			if ((iface == NULL) || (iface->ipv6addr == NULL)) {
 				TRACE(dump, "%s - %s", dhcp6r_clock(),
 				      "ERROR--> send_message(), NO INTERFACE INFO FOUND\n");
 				exit(0);
 			} 
+			in6_pkt->ipi6_ifindex = iface->devindex;  
+			sin6.sin6_scope_id = in6_pkt->ipi6_ifindex;
+   
 			if (inet_pton(AF_INET6, iface->ipv6addr->gaddr, 
 			              &in6_pkt->ipi6_addr)<=0) {  /* source address */
              	TRACE(dump, "%s - %s", dhcp6r_clock(),
 				      "inet_pton failed in send_message()\n");
              	exit(1);
 			}
-			TRACE(dump,"%s - SOURCE ADDRESS: %s\n",dhcp6r_clock(), 
-			      iface->ipv6addr->gaddr);
+			RTRACE(TRACE_DETAIL, EV_SRC_ADDR, in6_pkt->ipi6_ifindex, 0, 0, 0, 0,
+			       &in6_pkt->ipi6_addr);
      	           
 			sin6.sin6_port = htons(SERVER_PORT);
     
@@ -720,7 +975,7 @@ send_message()
 			msg.msg_iov = &iov[0];
 			msg.msg_iovlen = 1;
 
-			if ((count = sendmsg(sendsock->send_sock_desc, &msg, 0)) < 0) {
+			if ((count = sendmsg(ss->send_sock_desc, &msg, 0)) < 0) {
 				perror("sendmsg");	    
 				return 0;
 			}
@@ -728,9 +983,8 @@ send_message()
 			if (count > MAX_DHCP_MSG_LENGTH)
 				perror("bytes sendmsg");
              
-			TRACE(dump, 
-			      "%s - ========> RELAY_FORW, SENT TO: %s SENT_BYTES: %d\n", 
-			     dhcp6r_clock(), dest_addr, count);
+			RTRACE(TRACE_PACKET, EV_SENT_FORW, in6_pkt->ipi6_ifindex, 
+			       RELAY_FORW, 0, count, 0, &sin6.sin6_addr);
       
 			free(recvp);
 			hit = 1;
@@ -739,7 +993,8 @@ send_message()
 		if (hit == 0) {
 			for (iface = interface_list.next;  iface != &interface_list;
 		     	iface = iface->next) {
-				if (mesg->interface_in == iface->devindex)   
+				if ((mesg->interface_in == iface->devindex) ||
+				    (iface->ipv6addr == NULL))
 					continue;
 
 				*(mesg->hc_pointer)= MAXHOPCOUNT;
@@ -784,8 +1039,6 @@ send_message()
 				in6_pkt->ipi6_ifindex = iface->devindex;
 				sin6.sin6_scope_id = in6_pkt->ipi6_ifindex;
    
-				TRACE(dump, "%s - OUTGOING DEVICE INDEX: %d\n", dhcp6r_clock(), 
-				      in6_pkt->ipi6_ifindex);
 				if (inet_pton(AF_INET6, iface->ipv6addr->gaddr, 
 				              &in6_pkt->ipi6_addr)<=0) {  /* source address */
 					TRACE(dump, "%s - %s", dhcp6r_clock(),
@@ -793,8 +1046,8 @@ send_message()
 					exit(1);
 				}
      
-				TRACE(dump, "%s - SOURCE ADDRESS: %s\n", dhcp6r_clock(), 
-				      iface->ipv6addr->gaddr);
+				RTRACE(TRACE_DETAIL, EV_SRC_ADDR, in6_pkt->ipi6_ifindex, 0, 0, 0, 0,
+				       &in6_pkt->ipi6_addr);
      
 				iov[0].iov_base = mesg->buffer;
 				iov[0].iov_len = mesg->datalength;
@@ -803,7 +1056,7 @@ send_message()
 				msg.msg_iov = &iov[0];
 				msg.msg_iovlen = 1;
 
-				if ((count = sendmsg(sendsock->send_sock_desc, &msg, 0))< 0) {
+				if ((count = sendmsg(ss->send_sock_desc, &msg, 0))< 0) {
 					perror("sendmsg");            
 					return 0;
 				}
@@ -811,9 +1064,8 @@ send_message()
 				if (count > MAX_DHCP_MSG_LENGTH)
 					perror("sendmsg");
 
-				TRACE(dump, 
-				      "%s - ========> RELAY_FORW, SENT TO: %s SENT_BYTES: %d\n",
-				      dhcp6r_clock(), dest_addr, count);
+				RTRACE(TRACE_PACKET, EV_SENT_FORW, in6_pkt->ipi6_ifindex, 
+				       RELAY_FORW, 0, count, 0, &sin6.sin6_addr);
 				free(recvp);
 			} /* for */
 		}
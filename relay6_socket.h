@@ -53,6 +53,7 @@ struct receive {
 	int dst_addr_type ;
 	char *databuf;
 	int recv_sock_desc;
+	int bound_ifindex;   /* SO_BINDTODEVICE interface of a worker, or 0 */
 };
 
 struct send {
@@ -61,14 +62,25 @@ struct send {
 
 struct send  *sendsock;
 struct receive *recvsock;
+int netlink_sock_desc;
 
-int send_message __P((void));
-int fill_addr_struct __P((void));
+struct interface;
+struct msg_parser;
+
+int send_message __P((struct send *, struct msg_parser *));
+int fill_addr_struct __P((struct receive *));
 int set_sock_opt __P((void));
-int recv_data __P((void));
-int check_select __P((void));
-int get_recv_data __P((void));
+int set_worker_sock_opt __P((struct receive *, struct send *, 
+                             struct interface *));
+int recv_data __P((struct receive *));
+int check_select __P((struct receive *));
+int get_recv_data __P((struct receive *));
 int get_interface_info __P((void));
+int update_interface_info __P((void));
+int init_netlink_socket __P((void));
+int check_netlink __P((void));
 void init_socket __P((void));
+struct receive *create_recvsock __P((void));
+struct send *create_sendsock __P((void));
 
 #endif /* __RELAY6_SOCKET_H_DEFINED */
@@ -0,0 +1,184 @@
+/*
+ * Copyright (C) NEC Europe Ltd., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <pthread.h>
+
+#include "relay6_thread.h"
+#include "relay6_database.h"
+
+static void *
+relay_worker_loop(arg)
+	void *arg;
+{
+	struct relay_worker *worker = (struct relay_worker *) arg;
+	struct msg_parser *mesg;
+
+	while (1) {
+		/* the socket is bound to one interface, so just block on it */
+		if (recv_data(worker->recvsock) != 1)
+			continue;
+
+		/* from here until the epoch is even again, index_interfaces()
+		 * keeps the interface index it replaces
+		 */
+		__sync_fetch_and_add(&worker->epoch, 1);
+		if (get_recv_data(worker->recvsock) == 1) {
+			mesg = create_parser_obj(worker->recvsock, 
+			                         &worker->msg_parser_list);
+			if (put_msg_in_store(mesg) == 0)
+				mesg->sent = 1; /* mark it for deletion */
+		}
+
+		while (send_message(worker->sendsock, 
+		                    &worker->msg_parser_list) == 1)
+			;
+		delete_messages(&worker->msg_parser_list);
+		__sync_fetch_and_add(&worker->epoch, 1);
+	}
+
+	return NULL;
+}
+
+struct relay_worker *
+get_relay_worker(ifindex)
+	int ifindex;
+{
+	struct relay_worker *worker;
+
+	for (worker = relay_worker_list.next; worker != &relay_worker_list;
+	     worker = worker->next) {
+		if (worker->iface->devindex == ifindex)
+			return worker;
+	}
+
+	return NULL;
+}
+
+/* wait until no worker still handles a message it started before the call */
+void
+relay_workers_synchronize()
+{
+	struct relay_worker *worker;
+	unsigned long epoch;
+
+	__sync_synchronize();
+	for (worker = relay_worker_list.next; worker != &relay_worker_list;
+	     worker = worker->next) {
+		epoch = worker->epoch;
+		if ((epoch & 1) == 0)
+			continue;
+		while (worker->epoch == epoch)
+			sched_yield();
+	}
+}
+
+int
+start_relay_workers()
+{
+	struct relay_worker *worker;
+	struct interface *device;
+	struct cifaces *ci;
+	sigset_t set, oset;
+	cpu_set_t cpus;
+	long ncpu;
+	int n = 0;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu < 1)
+		ncpu = 1;
+
+	for (ci = cifaces_list.next; ci != &cifaces_list; ci = ci->next) {
+		if ((device = get_interface_s(ci->ciface)) == NULL) {
+			TRACE(dump, "%s - ERROR--> NO INTERFACE INFO FOUND FOR %s\n",
+			      dhcp6r_clock(), ci->ciface);
+			return 0;
+		}
+
+		worker = (struct relay_worker *) malloc(sizeof(struct relay_worker));
+		if (worker == NULL) {
+			TRACE(dump, "%s - %s", dhcp6r_clock(),
+			      "start_relay_workers--> ERROR NO MORE MEMORY AVAILABLE\n");
+			exit(1);
+		}
+		memset(worker, 0, sizeof(struct relay_worker));
+
+		worker->iface = device;
+		worker->cpu = n++ % ncpu;
+		worker->recvsock = create_recvsock();
+		worker->sendsock = create_sendsock();
+		worker->msg_parser_list.prev = &worker->msg_parser_list;
+		worker->msg_parser_list.next = &worker->msg_parser_list;
+
+		if (set_worker_sock_opt(worker->recvsock, worker->sendsock, 
+		                        device) == 0)
+			return 0;
+
+		if (fill_addr_struct(worker->recvsock) == 0)
+			return 0;
+
+		worker->next = relay_worker_list.next;
+		relay_worker_list.next = worker;
+	}
+
+	/* signals are left to the main thread */
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+
+	for (worker = relay_worker_list.next; worker != &relay_worker_list;
+	     worker = worker->next) {
+		if (pthread_create(&worker->tid, NULL, relay_worker_loop, 
+		                   worker) != 0) {
+			TRACE(dump, "%s - ERROR--> FAILED TO START WORKER FOR %s\n",
+			      dhcp6r_clock(), worker->iface->ifname);
+			pthread_sigmask(SIG_SETMASK, &oset, NULL);
+			return 0;
+		}
+
+		CPU_ZERO(&cpus);
+		CPU_SET(worker->cpu, &cpus);
+		if (pthread_setaffinity_np(worker->tid, sizeof(cpus), &cpus) != 0)
+			TRACE(dump, "%s - COULD NOT PIN WORKER FOR %s TO CPU %d\n",
+			      dhcp6r_clock(), worker->iface->ifname, worker->cpu);
+
+		TRACE(dump, "%s - STARTED WORKER FOR INTERFACE: %s ON CPU %d\n",
+		      dhcp6r_clock(), worker->iface->ifname, worker->cpu);
+	}
+
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+	fflush(dump);
+	return 1;
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) NEC Europe Ltd., 2003
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __RELAY6_THREAD_H_DEFINED
+#define __RELAY6_THREAD_H_DEFINED
+
+#include <pthread.h>
+
+#include "dhcp6r.h"
+#include "relay6_socket.h"
+#include "relay6_parser.h"
+
+/* one receive worker per client interface (-t), each with its own
+ * sockets and message store; the interface database is shared read-only
+ */
+struct relay_worker {
+	struct relay_worker *next;
+
+	pthread_t tid;
+	int cpu;
+	struct interface *iface;
+	struct receive *recvsock;
+	struct send *sendsock;
+	struct msg_parser msg_parser_list;
+	/* odd while the worker may hold pointers into the interface index */
+	volatile unsigned long epoch;
+};
+
+struct relay_worker relay_worker_list;
+int relay_threads;
+
+int start_relay_workers __P((void));
+struct relay_worker *get_relay_worker __P((int ifindex));
+void relay_workers_synchronize __P((void));
+
+#endif /* __RELAY6_THREAD_H_DEFINED */
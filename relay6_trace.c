@@ -0,0 +1,298 @@
+/*
+ * Copyright (C) NEC Europe Ltd., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "relay6_trace.h"
+
+struct trace_ring {
+	struct trace_ring *next;
+	uint32_t id;
+	volatile uint32_t head;    /* written by the owning thread only */
+	volatile uint32_t tail;    /* written by the drain thread only */
+	volatile uint32_t lost;
+	struct trace_rec rec[TRACE_RING_SIZE];
+};
+
+static struct trace_ring *trace_rings = NULL;
+static pthread_mutex_t trace_rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t trace_ring_count = 0;
+static __thread struct trace_ring *my_ring = NULL;
+static FILE *trace_file = NULL;
+
+static const char *trace_event_name[EV_MAX] = {
+	"NONE",
+	"RECEIVED NEW MESSAGE",
+	"GOT CLIENT MESSAGE TO BE RELAYED",
+	"GOT RELAY_FORW FROM RELAY AGENT",
+	"GOT RELAY_REPL FROM RELAY AGENT OR SERVER",
+	"HOPCOUNT",
+	"RELAY_FORW BUILT",
+	"========> RELAY_FORW SENT",
+	"*********> RELAY_REPL SENT",
+	"SOURCE ADDRESS",
+	"DROPPED, SOURCE ADDRESS IS LOOPBACK",
+	"DROPPED MULTICAST, ONLY UNICAST IS ALLOWED",
+	"DROPPED, NOT A CLIENT INTERFACE",
+	"DROPPED, HOP COUNT EXCEEDED",
+	"DROPPED, UNKNOWN MESSAGE",
+	"DROPPED, MESSAGE TOO SHORT",
+	"DROPPED, FRAGMENTATION WOULD OCCUR",
+	"TRACE RECORDS LOST",
+	"DROPPED, NO GLOBAL ADDRESS ON THE INTERFACE",
+};
+
+static struct trace_ring *
+new_trace_ring()
+{
+	struct trace_ring *ring;
+
+	ring = (struct trace_ring *) malloc(sizeof(struct trace_ring));
+	if (ring == NULL)
+		return NULL;
+	memset(ring, 0, sizeof(struct trace_ring));
+
+	pthread_mutex_lock(&trace_rings_lock);
+	ring->id = trace_ring_count++;
+	ring->next = trace_rings;
+	__sync_synchronize();
+	trace_rings = ring;
+	pthread_mutex_unlock(&trace_rings_lock);
+
+	return ring;
+}
+
+void
+relay_trace(event, ifindex, msg_type, xid, len, len2, addr)
+	int event;
+	int ifindex;
+	int msg_type;
+	uint32_t xid;
+	uint32_t len;
+	uint32_t len2;
+	const struct in6_addr *addr;
+{
+	struct trace_ring *ring = my_ring;
+	struct trace_rec *rec;
+	struct timespec ts;
+	uint32_t head;
+
+	if (ring == NULL) {
+		if ((ring = new_trace_ring()) == NULL)
+			return;
+		my_ring = ring;
+	}
+
+	head = ring->head;
+	if (head - ring->tail >= TRACE_RING_SIZE) {
+		__sync_fetch_and_add(&ring->lost, 1);
+		return;
+	}
+
+	rec = &ring->rec[head & (TRACE_RING_SIZE - 1)];
+	clock_gettime(CLOCK_REALTIME, &ts);
+	rec->ts = (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	rec->event = event;
+	rec->msg_type = msg_type;
+	rec->pad = 0;
+	rec->ifindex = ifindex;
+	rec->xid = xid;
+	rec->len = len;
+	rec->len2 = len2;
+	rec->thread = ring->id;
+	if (addr != NULL)
+		rec->addr = *addr;
+	else
+		memset(&rec->addr, 0, sizeof(rec->addr));
+
+	__sync_synchronize();   /* publish the record before the index */
+	ring->head = head + 1;
+}
+
+void
+format_trace_rec(fp, rec)
+	FILE *fp;
+	const struct trace_rec *rec;
+{
+	char when[32], addr[INET6_ADDRSTRLEN];
+	const char *name = "UNKNOWN EVENT";
+	time_t sec = rec->ts / 1000000000ULL;
+	struct tm tm;
+
+	localtime_r(&sec, &tm);
+	strftime(when, sizeof(when), "%a/%b/%d/%H:%M:%S/%Y", &tm);
+	if (rec->event < EV_MAX)
+		name = trace_event_name[rec->event];
+
+	fprintf(fp, "%s.%06u [%u] - %s", when, 
+	        (unsigned int) ((rec->ts % 1000000000ULL) / 1000), rec->thread, 
+	        name);
+	if (rec->ifindex != 0)
+		fprintf(fp, ", INTERFACE: %u", rec->ifindex);
+	if (rec->msg_type != 0)
+		fprintf(fp, ", TYPE: %u", rec->msg_type);
+	if (rec->xid != 0)
+		fprintf(fp, ", XID: %06x", rec->xid);
+
+	switch (rec->event) {
+	case EV_RELAY_FORW_IN:
+	case EV_HOPCOUNT:
+		fprintf(fp, ", HOPCOUNT: %u", rec->len);
+		break;
+	case EV_FORW_BUILT:
+		fprintf(fp, ", HEADERLENGTH: %u, ORIGINAL MESSAGE LENGTH: %u",
+		        rec->len, rec->len2);
+		break;
+	case EV_RECV:
+	case EV_SENT_FORW:
+	case EV_SENT_REPL:
+	case EV_DROP_TOOBIG:
+	case EV_LOST:
+		fprintf(fp, ", BYTES: %u", rec->len);
+		break;
+	default:
+		break;
+	}
+
+	if (!IN6_IS_ADDR_UNSPECIFIED(&rec->addr) &&
+	    (inet_ntop(AF_INET6, &rec->addr, addr, sizeof(addr)) != NULL))
+		fprintf(fp, ", ADDRESS: %s", addr);
+	fprintf(fp, "\n");
+}
+
+static void
+emit_trace_rec(rec)
+	const struct trace_rec *rec;
+{
+	if (trace_file != NULL)
+		fwrite(rec, sizeof(struct trace_rec), 1, trace_file);
+	if (dump == stderr)
+		format_trace_rec(dump, rec);
+}
+
+static void *
+trace_drain_loop(arg)
+	void *arg;
+{
+	struct trace_ring *ring;
+	struct trace_rec lost;
+	struct timespec delay, now;
+	uint32_t head, tail, n;
+
+	delay.tv_sec = 0;
+	delay.tv_nsec = 50 * 1000 * 1000;
+
+	while (1) {
+		n = 0;
+		for (ring = trace_rings; ring != NULL; ring = ring->next) {
+			head = ring->head;
+			__sync_synchronize();
+			for (tail = ring->tail; tail != head; tail++, n++)
+				emit_trace_rec(&ring->rec[tail & (TRACE_RING_SIZE - 1)]);
+			__sync_synchronize();
+			ring->tail = tail;
+
+			if (ring->lost != 0) {
+				memset(&lost, 0, sizeof(lost));
+				clock_gettime(CLOCK_REALTIME, &now);
+				lost.ts = (uint64_t) now.tv_sec * 1000000000ULL + now.tv_nsec;
+				lost.event = EV_LOST;
+				lost.thread = ring->id;
+				lost.len = __sync_fetch_and_and(&ring->lost, 0);
+				emit_trace_rec(&lost);
+			}
+		}
+
+		if (n != 0) {
+			if (trace_file != NULL)
+				fflush(trace_file);
+			fflush(dump);
+		}
+		else
+			nanosleep(&delay, NULL);
+	}
+
+	return NULL;
+}
+
+int
+start_trace_thread(path)
+	const char *path;
+{
+	struct trace_file_hdr hdr;
+	pthread_t tid;
+	sigset_t set, oset;
+
+	trace_file = fopen(path, "w");
+	if (trace_file == NULL) {
+		printf("COULD NOT WRITE TRACE FILE: %s\n", path);
+		return 0;
+	}
+
+	hdr.magic = TRACE_MAGIC;
+	hdr.version = TRACE_VERSION;
+	hdr.rec_size = sizeof(struct trace_rec);
+	fwrite(&hdr, sizeof(hdr), 1, trace_file);
+	fflush(trace_file);
+
+	sigfillset(&set);
+	pthread_sigmask(SIG_BLOCK, &set, &oset);
+	if (pthread_create(&tid, NULL, trace_drain_loop, NULL) != 0) {
+		pthread_sigmask(SIG_SETMASK, &oset, NULL);
+		printf("COULD NOT START TRACE THREAD\n");
+		return 0;
+	}
+	pthread_detach(tid);
+	pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+	return 1;
+}
+
+/* SIGUSR1/SIGUSR2 step the verbosity of a running relay */
+void
+trace_level_up(signo)
+	int signo;
+{
+	if (trace_level < TRACE_DETAIL)
+		trace_level++;
+}
+
+void
+trace_level_down(signo)
+	int signo;
+{
+	if (trace_level > TRACE_OFF)
+		trace_level--;
+}
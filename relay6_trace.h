@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) NEC Europe Ltd., 2003
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __RELAY6_TRACE_H_DEFINED
+#define __RELAY6_TRACE_H_DEFINED
+
+#include <stdio.h>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "dhcp6r.h"
+
+/* The forwarding path records fixed-size binary events into a ring owned
+ * by the calling thread; a background thread drains the rings, appends
+ * the records to TRACEFILE and, with -d, formats them to stderr.
+ * dhcp6rdump decodes TRACEFILE.
+ */
+
+#define TRACE_OFF             0
+#define TRACE_PACKET          1  /* one event per received/sent/dropped packet */
+#define TRACE_DETAIL          2  /* every step of building a message */
+
+#define TRACE_RING_SIZE       4096  /* records per thread, power of two */
+#define TRACE_MAGIC           0x64367274  /* "d6rt" */
+#define TRACE_VERSION         1
+
+enum trace_event {
+	EV_NONE = 0,
+	EV_RECV,             /* len: datagram length, addr: source */
+	EV_CLIENT_MSG,       /* client message to be relayed */
+	EV_RELAY_FORW_IN,    /* len: hop-count */
+	EV_RELAY_REPL_IN,
+	EV_HOPCOUNT,         /* len: hop-count put in the RELAY-FORW */
+	EV_FORW_BUILT,       /* len: header length, len2: original length */
+	EV_SENT_FORW,        /* len: bytes sent, addr: destination */
+	EV_SENT_REPL,        /* len: bytes sent, addr: destination */
+	EV_SRC_ADDR,         /* addr: source address chosen */
+	EV_DROP_LOOPBACK,
+	EV_DROP_MCAST,       /* multicast while -cu is in effect */
+	EV_DROP_IFACE,       /* not a client interface */
+	EV_DROP_HOPLIMIT,
+	EV_DROP_UNKNOWN,     /* unknown message type */
+	EV_DROP_SHORT,       /* shorter than a message header */
+	EV_DROP_TOOBIG,      /* RELAY-FORW would exceed MAX_DHCP_MSG_LENGTH */
+	EV_LOST,             /* len: records lost by a full ring */
+	EV_DROP_NOADDR,      /* interface has no global address to relay from */
+	EV_MAX
+};
+
+struct trace_rec {
+	uint64_t ts;         /* CLOCK_REALTIME, ns */
+	uint16_t event;
+	uint8_t msg_type;
+	uint8_t pad;
+	uint32_t ifindex;
+	uint32_t xid;
+	uint32_t len;
+	uint32_t len2;
+	uint32_t thread;     /* ring number of the recording thread */
+	struct in6_addr addr;
+};
+
+struct trace_file_hdr {
+	uint32_t magic;
+	uint16_t version;
+	uint16_t rec_size;
+};
+
+volatile int trace_level;
+
+#define RTRACE(lvl, ev, ifx, type, xid, len, len2, addr)                   \
+	do {                                                                   \
+		if ((lvl) <= trace_level)                                          \
+			relay_trace((ev), (ifx), (type), (xid), (len), (len2), (addr)); \
+	} while (0)
+
+void relay_trace __P((int, int, int, uint32_t, uint32_t, uint32_t, 
+                      const struct in6_addr *));
+int start_trace_thread __P((const char *));
+void trace_level_up __P((int));
+void trace_level_down __P((int));
+void format_trace_rec __P((FILE *, const struct trace_rec *));
+
+#endif /* __RELAY6_TRACE_H_DEFINED */
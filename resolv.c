@@ -0,0 +1,362 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * resolv.conf handling for the client.
+ *
+ * The resolv.conf found at the first update is read once and kept in
+ * memory: its lines verbatim, except for the search and domain lines,
+ * plus the IPv6 name servers and the search domains it names.  Every
+ * interface keeps the DNS configuration it last received in ifp->dnslist,
+ * and when one of those changes the merged file is written to a temporary
+ * file and renamed over resolv.conf.  A reply that carries the same
+ * configuration as the last one does not touch the file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <syslog.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+
+static int base_loaded = 0;
+static char *base_text = NULL;	/* resolv.conf without search/domain lines */
+static size_t base_len = 0;
+static mode_t base_mode = 0644;
+static struct dns_list base_dns;
+
+static int resolv_load __P((void));
+static int resolv_write __P((void));
+static int dnslist_equal __P((const struct dns_list *,
+			      const struct dns_list *));
+static int dnslist_copy __P((struct dns_list *, const struct dns_list *));
+static void dnslist_clear __P((struct dns_list *));
+static int domain_add __P((struct domain_list **, const char *));
+
+/*
+ * record the DNS configuration received on ifp and bring resolv.conf
+ * up to date with it.
+ */
+int
+resolv_update(struct dhcp6_if *ifp, const struct dns_list *dns_list)
+{
+	if (dnslist_equal(&ifp->dnslist, dns_list)) {
+		dprintf(LOG_DEBUG, "%s" "DNS configuration on %s unchanged",
+			FNAME, ifp->ifname);
+		return (0);
+	}
+	if (!base_loaded && resolv_load() != 0)
+		return (-1);
+	dnslist_clear(&ifp->dnslist);
+	if (dnslist_copy(&ifp->dnslist, dns_list) != 0) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		dnslist_clear(&ifp->dnslist);
+		return (-1);
+	}
+	if (resolv_write() != 0) {
+		/* try again with the next reply */
+		dnslist_clear(&ifp->dnslist);
+		return (-1);
+	}
+	return (0);
+}
+
+/* forget the DNS configuration of an interface */
+void
+resolv_clear(struct dhcp6_if *ifp)
+{
+	dnslist_clear(&ifp->dnslist);
+}
+
+/* put back the resolv.conf dhcp6c found */
+void
+resolv_restore()
+{
+	struct stat buf;
+
+	if (!lstat(RESOLV_CONF_BAK_FILE, &buf)) {
+		if (rename(RESOLV_CONF_BAK_FILE, RESOLV_CONF_FILE))
+			dprintf(LOG_ERR, "%s" " failed to restore resolv.conf",
+				FNAME);
+	}
+	free(base_text);
+	base_text = NULL;
+	base_len = 0;
+	dnslist_clear(&base_dns);
+	base_loaded = 0;
+}
+
+/*
+ * read the original resolv.conf, which is the backup if a previous
+ * dhcp6c did not get to restore it.
+ */
+static int
+resolv_load()
+{
+	FILE *fp;
+	struct stat buf;
+	struct in6_addr addr;
+	char line[1024], word[MAXDNAME + 1], *p, *text;
+	int n, keep;
+
+	TAILQ_INIT(&base_dns.addrlist);
+	base_dns.domainlist = NULL;
+	if ((fp = fopen(RESOLV_CONF_BAK_FILE, "r")) == NULL &&
+	    (fp = fopen(RESOLV_CONF_FILE, "r")) == NULL) {
+		if (errno != ENOENT) {
+			dprintf(LOG_ERR, "%s" "fopen(%s): %s", FNAME,
+				RESOLV_CONF_FILE, strerror(errno));
+			return (-1);
+		}
+		base_loaded = 1;
+		return (0);
+	}
+	if (fstat(fileno(fp), &buf) == 0)
+		base_mode = buf.st_mode & 07777;
+
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		keep = 1;
+		p = line;
+		if (strncmp(p, "nameserver", 10) == 0 && isspace(p[10])) {
+			if (sscanf(p + 10, "%255s", word) == 1 &&
+			    inet_pton(AF_INET6, word, &addr) == 1 &&
+			    dhcp6_find_listval(&base_dns.addrlist, &addr,
+			    DHCP6_LISTVAL_ADDR6) == NULL &&
+			    dhcp6_add_listval(&base_dns.addrlist, &addr,
+			    DHCP6_LISTVAL_ADDR6) == NULL)
+				goto nomem;
+		} else if ((strncmp(p, "search", 6) == 0 && isspace(p[6])) ||
+			   (strncmp(p, "domain", 6) == 0 && isspace(p[6]))) {
+			/* merged with the received domains when written */
+			keep = 0;
+			for (p += 6; sscanf(p, "%255s%n", word, &n) == 1;
+			     p += n) {
+				if (domain_add(&base_dns.domainlist, word) != 0)
+					goto nomem;
+			}
+		}
+		if (!keep)
+			continue;
+		n = strlen(line);
+		if ((text = realloc(base_text, base_len + n + 1)) == NULL)
+			goto nomem;
+		base_text = text;
+		memcpy(base_text + base_len, line, n + 1);
+		base_len += n;
+	}
+	fclose(fp);
+	base_loaded = 1;
+	return (0);
+
+  nomem:
+	dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+	fclose(fp);
+	free(base_text);
+	base_text = NULL;
+	base_len = 0;
+	dnslist_clear(&base_dns);
+	return (-1);
+}
+
+static int
+resolv_write()
+{
+	char template[sizeof(RESOLV_CONF_DHCPV6_FILE) + 6];
+	struct dhcp6_list servers;
+	struct dhcp6_listval *lv;
+	struct domain_list *domains = NULL, *dl;
+	struct dhcp6_if *ifp;
+	struct stat buf;
+	FILE *fp;
+	int fd, error = -1;
+
+	snprintf(template, sizeof(template), "%sXXXXXX",
+		 RESOLV_CONF_DHCPV6_FILE);
+	if ((fd = mkstemp(template)) < 0) {
+		dprintf(LOG_ERR, "%s" "failed to create %s: %s", FNAME,
+			template, strerror(errno));
+		return (-1);
+	}
+	(void)fchmod(fd, base_mode);
+	if ((fp = fdopen(fd, "w")) == NULL) {
+		dprintf(LOG_ERR, "%s" "fdopen(%s): %s", FNAME, template,
+			strerror(errno));
+		close(fd);
+		unlink(template);
+		return (-1);
+	}
+
+	TAILQ_INIT(&servers);
+	for (dl = base_dns.domainlist; dl; dl = dl->next) {
+		if (domain_add(&domains, dl->name) != 0)
+			goto fail;
+	}
+	for (ifp = dhcp6_if; ifp; ifp = ifp->next) {
+		for (lv = TAILQ_FIRST(&ifp->dnslist.addrlist); lv;
+		     lv = TAILQ_NEXT(lv, link)) {
+			if (dhcp6_find_listval(&base_dns.addrlist,
+			    &lv->val_addr6, DHCP6_LISTVAL_ADDR6) ||
+			    dhcp6_find_listval(&servers, &lv->val_addr6,
+			    DHCP6_LISTVAL_ADDR6))
+				continue;
+			if (dhcp6_add_listval(&servers, &lv->val_addr6,
+			    DHCP6_LISTVAL_ADDR6) == NULL)
+				goto fail;
+		}
+		for (dl = ifp->dnslist.domainlist; dl; dl = dl->next) {
+			if (domain_add(&domains, dl->name) != 0)
+				goto fail;
+		}
+	}
+
+	if (base_len > 0)
+		fwrite(base_text, 1, base_len, fp);
+	for (lv = TAILQ_FIRST(&servers); lv; lv = TAILQ_NEXT(lv, link))
+		fprintf(fp, "nameserver %s\n", in6addr2str(&lv->val_addr6, 0));
+	if (domains != NULL) {
+		fputs("search", fp);
+		for (dl = domains; dl; dl = dl->next)
+			fprintf(fp, " %s", dl->name);
+		fputs("\n", fp);
+	}
+	if (fflush(fp) == EOF || fsync(fd) < 0) {
+		dprintf(LOG_ERR, "%s" "write %s failed: %s", FNAME, template,
+			strerror(errno));
+		goto fail;
+	}
+	/* keep the original for resolv_restore() */
+	if (!lstat(RESOLV_CONF_FILE, &buf) &&
+	    lstat(RESOLV_CONF_BAK_FILE, &buf) < 0 && errno == ENOENT &&
+	    link(RESOLV_CONF_FILE, RESOLV_CONF_BAK_FILE)) {
+		dprintf(LOG_ERR, "%s" " backup failed for resolv.conf file",
+			FNAME);
+		goto fail;
+	}
+	if (rename(template, RESOLV_CONF_FILE)) {
+		dprintf(LOG_ERR, "%s" " rename failed for resolv.conf file",
+			FNAME);
+		goto fail;
+	}
+	dprintf(LOG_DEBUG, "%s" "resolv.conf updated", FNAME);
+	error = 0;
+
+  fail:
+	if (error)
+		unlink(template);
+	fclose(fp);
+	dhcp6_clear_list(&servers);
+	while ((dl = domains) != NULL) {
+		domains = dl->next;
+		free(dl);
+	}
+	return (error);
+}
+
+static int
+dnslist_equal(a, b)
+	const struct dns_list *a, *b;
+{
+	const struct dhcp6_listval *la, *lb;
+	const struct domain_list *da, *db;
+
+	for (la = TAILQ_FIRST(&a->addrlist), lb = TAILQ_FIRST(&b->addrlist);
+	     la && lb; la = TAILQ_NEXT(la, link), lb = TAILQ_NEXT(lb, link)) {
+		if (!IN6_ARE_ADDR_EQUAL(&la->val_addr6, &lb->val_addr6))
+			return (0);
+	}
+	if (la || lb)
+		return (0);
+	for (da = a->domainlist, db = b->domainlist; da && db;
+	     da = da->next, db = db->next) {
+		if (strcmp(da->name, db->name))
+			return (0);
+	}
+	return (da == NULL && db == NULL);
+}
+
+static int
+dnslist_copy(dst, src)
+	struct dns_list *dst;
+	const struct dns_list *src;
+{
+	const struct domain_list *dl;
+
+	if (dhcp6_copy_list(&dst->addrlist, &src->addrlist))
+		return (-1);
+	for (dl = src->domainlist; dl; dl = dl->next) {
+		if (domain_add(&dst->domainlist, dl->name))
+			return (-1);
+	}
+	return (0);
+}
+
+static void
+dnslist_clear(dns_list)
+	struct dns_list *dns_list;
+{
+	struct domain_list *dl;
+
+	dhcp6_clear_list(&dns_list->addrlist);
+	TAILQ_INIT(&dns_list->addrlist);
+	while ((dl = dns_list->domainlist) != NULL) {
+		dns_list->domainlist = dl->next;
+		free(dl);
+	}
+}
+
+/* append a domain name to a list unless it is already there */
+static int
+domain_add(head, name)
+	struct domain_list **head;
+	const char *name;
+{
+	struct domain_list *dl, **dlp;
+
+	for (dlp = head; (dl = *dlp) != NULL; dlp = &dl->next) {
+		if (strcmp(dl->name, name) == 0)
+			return (0);
+	}
+	if ((dl = malloc(sizeof(*dl))) == NULL)
+		return (-1);
+	memset(dl, 0, sizeof(*dl));
+	strncpy(dl->name, name, sizeof(dl->name) - 1);
+	*dlp = dl;
+	return (0);
+}
@@ -34,7 +34,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
-//#include <openssl/md5.h>
+#include <openssl/rand.h>
 
 #include <sys/types.h>
 #include <sys/time.h>
@@ -58,17 +58,38 @@
 #include "lease.h"
 #include "timer.h"
 #include "hash.h"
+#include "server6_stats.h"
+#include "server6_repl.h"
+#include "server6_lq.h"
 
 extern FILE *server6_lease_file;
 
+/* every dhcp6_client, in the order they were first bound */
+struct dhcp6_client_list server6_clients =
+	TAILQ_HEAD_INITIALIZER(server6_clients);
+
 struct dhcp6_lease *
 dhcp6_find_lease __P((struct dhcp6_iaidaddr *, struct dhcp6_addr *));
 static int dhcp6_add_lease __P((struct dhcp6_iaidaddr *, struct dhcp6_addr *));
 static int dhcp6_update_lease __P((struct dhcp6_addr *, struct dhcp6_lease *));
 static int addr_on_segment __P((struct v6addrseg *, struct dhcp6_addr *));
-static void  server6_get_newaddr __P((iatype_t, struct dhcp6_addr *, struct v6addrseg *));
+static int lease_unchanged __P((struct dhcp6_lease *, struct dhcp6_addr *,
+				 struct dhcp6_optinfo *));
 static void  server6_get_addrpara __P((struct dhcp6_addr *, struct v6addrseg *));
 static void  server6_get_prefixpara __P((struct dhcp6_addr *, struct v6prefix *));
+static int server6_write_lease __P((struct dhcp6_lease *));
+static void server6_pool_attach __P((struct dhcp6_lease *));
+static void server6_pool_detach __P((struct dhcp6_lease *, int));
+static u_int64_t seg_size __P((struct v6addrseg *));
+static int seg_reuse_addr __P((struct v6addrseg *, struct dhcp6_addr *));
+static void server6_client_attach __P((struct dhcp6_iaidaddr *));
+static void server6_client_detach __P((struct dhcp6_iaidaddr *));
+static void server6_relay_attach __P((struct dhcp6_iaidaddr *));
+static void server6_relay_detach __P((struct dhcp6_iaidaddr *));
+static void server6_set_relayid __P((struct dhcp6_iaidaddr *,
+				     struct dhcp6_optinfo *));
+static void server6_set_reconf __P((struct dhcp6_iaidaddr *,
+				    struct dhcp6_optinfo *));
 
 struct link_decl *dhcp6_allocate_link __P((struct dhcp6_if *, struct rootgroup *, 
 			struct in6_addr *));
@@ -110,6 +131,11 @@ dhcp6_add_iaidaddr(optinfo)
 	}
 	memset(iaidaddr, 0, sizeof(*iaidaddr));
 	duidcpy(&iaidaddr->client6_info.clientid, &optinfo->clientID);
+	/* before the leases, which are written with it */
+	if (optinfo->relayID.duid_len != 0 &&
+	    duidcpy(&iaidaddr->relayid, &optinfo->relayID))
+		iaidaddr->relayid.duid_len = 0;
+	server6_set_reconf(iaidaddr, optinfo);
 	iaidaddr->client6_info.iaidinfo.iaid = optinfo->iaidinfo.iaid;
 	iaidaddr->client6_info.type = optinfo->type;
 	TAILQ_INIT(&iaidaddr->lease_list);
@@ -139,6 +165,8 @@ dhcp6_add_iaidaddr(optinfo)
 		dhcp6_remove_iaidaddr(iaidaddr);
 		return (-1);
 	}
+	server6_client_attach(iaidaddr);
+	server6_relay_attach(iaidaddr);
 	dprintf(LOG_DEBUG, "%s" "hash_add an iaidaddr %u for client duid %s", 
 		FNAME, iaidaddr->client6_info.iaidinfo.iaid,
 			duidstr(&iaidaddr->client6_info.clientid));
@@ -182,6 +210,10 @@ dhcp6_remove_iaidaddr(iaidaddr)
 			FNAME, iaidaddr->client6_info.iaidinfo.iaid);
 		return (-1);
 	}
+	server6_client_detach(iaidaddr);
+	server6_relay_detach(iaidaddr);
+	if (iaidaddr->relayid.duid_len != 0)
+		duidfree(&iaidaddr->relayid);
 	if (iaidaddr->timer)
 		dhcp6_remove_timer(iaidaddr->timer);
 	dprintf(LOG_DEBUG, "%s" "removed iaidaddr %u", FNAME,
@@ -190,6 +222,189 @@ dhcp6_remove_iaidaddr(iaidaddr)
 	return (0);
 }
 
+/* index a binding by its DUID */
+static void
+server6_client_attach(iaidaddr)
+	struct dhcp6_iaidaddr *iaidaddr;
+{
+	struct dhcp6_client *client;
+	struct duid *duid = &iaidaddr->client6_info.clientid;
+
+	if (iaidaddr->client != NULL)
+		return;
+	if ((client = hash_search(client_hash_table, duid)) == NULL) {
+		if ((client = malloc(sizeof(*client))) == NULL) {
+			dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+			return;
+		}
+		memset(client, 0, sizeof(*client));
+		TAILQ_INIT(&client->iaidaddr_list);
+		if (duidcpy(&client->clientid, duid) ||
+		    hash_add(client_hash_table, &client->clientid, client)) {
+			dprintf(LOG_ERR, "%s" "failed to index client duid %s",
+				FNAME, duidstr(duid));
+			duidfree(&client->clientid);
+			free(client);
+			return;
+		}
+	}
+	TAILQ_INSERT_TAIL(&client->iaidaddr_list, iaidaddr, clientlink);
+	if (TAILQ_FIRST(&client->iaidaddr_list) == iaidaddr)
+		TAILQ_INSERT_TAIL(&server6_clients, client, link);
+	iaidaddr->client = client;
+}
+
+static void
+server6_client_detach(iaidaddr)
+	struct dhcp6_iaidaddr *iaidaddr;
+{
+	struct dhcp6_client *client;
+
+	if ((client = iaidaddr->client) == NULL)
+		return;
+	TAILQ_REMOVE(&client->iaidaddr_list, iaidaddr, clientlink);
+	iaidaddr->client = NULL;
+	if (TAILQ_EMPTY(&client->iaidaddr_list)) {
+		server6_lq_forget_client(client);
+		server6_repl_forget_client(client);
+		TAILQ_REMOVE(&server6_clients, client, link);
+		hash_delete(client_hash_table, &client->clientid);
+		duidfree(&client->clientid);
+		free(client);
+	}
+}
+
+/* index a binding by the Relay-ID it is behind, if any */
+static void
+server6_relay_attach(iaidaddr)
+	struct dhcp6_iaidaddr *iaidaddr;
+{
+	struct dhcp6_relayagent *relay;
+	struct duid *duid = &iaidaddr->relayid;
+
+	if (iaidaddr->relay != NULL || duid->duid_len == 0)
+		return;
+	if ((relay = hash_search(relay_hash_table, duid)) == NULL) {
+		if ((relay = malloc(sizeof(*relay))) == NULL) {
+			dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+			return;
+		}
+		memset(relay, 0, sizeof(*relay));
+		TAILQ_INIT(&relay->iaidaddr_list);
+		if (duidcpy(&relay->relayid, duid) ||
+		    hash_add(relay_hash_table, &relay->relayid, relay)) {
+			dprintf(LOG_ERR, "%s" "failed to index relay duid %s",
+				FNAME, duidstr(duid));
+			duidfree(&relay->relayid);
+			free(relay);
+			return;
+		}
+	}
+	TAILQ_INSERT_TAIL(&relay->iaidaddr_list, iaidaddr, relaylink);
+	iaidaddr->relay = relay;
+}
+
+static void
+server6_relay_detach(iaidaddr)
+	struct dhcp6_iaidaddr *iaidaddr;
+{
+	struct dhcp6_relayagent *relay;
+
+	if ((relay = iaidaddr->relay) == NULL)
+		return;
+	server6_lq_forget_binding(iaidaddr);
+	TAILQ_REMOVE(&relay->iaidaddr_list, iaidaddr, relaylink);
+	iaidaddr->relay = NULL;
+	if (TAILQ_EMPTY(&relay->iaidaddr_list)) {
+		hash_delete(relay_hash_table, &relay->relayid);
+		duidfree(&relay->relayid);
+		free(relay);
+	}
+}
+
+/* remember the Relay-ID the client's last message came through */
+static void
+server6_set_relayid(iaidaddr, optinfo)
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_optinfo *optinfo;
+{
+	if (iaidaddr->relayid.duid_len == optinfo->relayID.duid_len &&
+	    (optinfo->relayID.duid_len == 0 ||
+	     !duidcmp(&iaidaddr->relayid, &optinfo->relayID)))
+		return;
+	server6_relay_detach(iaidaddr);
+	if (iaidaddr->relayid.duid_len != 0)
+		duidfree(&iaidaddr->relayid);
+	if (optinfo->relayID.duid_len != 0 &&
+	    duidcpy(&iaidaddr->relayid, &optinfo->relayID))
+		iaidaddr->relayid.duid_len = 0;
+	server6_relay_attach(iaidaddr);
+}
+
+/*
+ * remember whether the client's last message offered to accept
+ * Reconfigure, and the key for it (RFC 3315 21.5): one key for all the
+ * bindings of the client, made up the first time, or the one the
+ * primary made when it comes from the replication stream.
+ */
+static void
+server6_set_reconf(iaidaddr, optinfo)
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_optinfo *optinfo;
+{
+	struct dhcp6_client *client;
+	struct dhcp6_iaidaddr *other;
+
+	if (!(optinfo->flags & DHCIFF_RECONF_ACCEPT)) {
+		iaidaddr->reconf_accept = 0;
+		return;
+	}
+	if (optinfo->reconfkey.duid_len == sizeof(iaidaddr->reconfkey)) {
+		memcpy(iaidaddr->reconfkey, optinfo->reconfkey.duid_id,
+		       sizeof(iaidaddr->reconfkey));
+		iaidaddr->reconf_accept = 1;
+		return;
+	}
+	if (iaidaddr->reconf_accept)
+		return;
+	if ((client = dhcp6_find_client(&optinfo->clientID)) != NULL) {
+		TAILQ_FOREACH(other, &client->iaidaddr_list, clientlink) {
+			if (other->reconf_accept) {
+				memcpy(iaidaddr->reconfkey, other->reconfkey,
+				       sizeof(iaidaddr->reconfkey));
+				iaidaddr->reconf_accept = 1;
+				return;
+			}
+		}
+	}
+	if (RAND_bytes(iaidaddr->reconfkey, sizeof(iaidaddr->reconfkey)) != 1) {
+		dprintf(LOG_ERR, "%s" "failed to make a reconfigure key for %s",
+			FNAME, duidstr(&optinfo->clientID));
+		return;
+	}
+	iaidaddr->reconf_accept = 1;
+}
+
+/* the bindings of a DUID, NULL if it has none */
+struct dhcp6_client *
+dhcp6_find_client(duid)
+	struct duid *duid;
+{
+	if (client_hash_table == NULL)
+		return (NULL);
+	return hash_search(client_hash_table, duid);
+}
+
+/* the bindings behind a Relay-ID, NULL if there are none */
+struct dhcp6_relayagent *
+dhcp6_find_relay(duid)
+	struct duid *duid;
+{
+	if (relay_hash_table == NULL)
+		return (NULL);
+	return hash_search(relay_hash_table, duid);
+}
+
 struct dhcp6_iaidaddr
 *dhcp6_find_iaidaddr(optinfo)
 	struct dhcp6_optinfo *optinfo;
@@ -208,12 +423,32 @@ struct dhcp6_iaidaddr
 	return iaidaddr;
 }
 
+/*
+ * write_lease() to the server lease file, timed as the persist stage,
+ * and pass the change on to a standby
+ */
+static int
+server6_write_lease(lease)
+	struct dhcp6_lease *lease;
+{
+	u_int64_t t0;
+	int ret;
+
+	t0 = server6_stats_clock();
+	server6_repl_lease(lease);
+	ret = write_lease(lease, server6_lease_file);
+	t0 = server6_stats_clock() - t0;
+	server6_stats_add(STAGE_PERSIST, t0);
+	server6_stats.msg_nested += t0;
+	return ret;
+}
+
 int
 dhcp6_remove_lease(lease)
 	struct dhcp6_lease *lease;
 {
 	lease->state = INVALID;
-	if (write_lease(lease, server6_lease_file) != 0) {
+	if (server6_write_lease(lease) != 0) {
 		dprintf(LOG_ERR, "%s" "failed to write an invalid lease %s to lease file", 
 			FNAME, in6addr2str(&lease->lease_addr.addr, 0));
 		return (-1);
@@ -225,6 +460,7 @@ dhcp6_remove_lease(lease)
 	}
 	if (lease->timer)
 		dhcp6_remove_timer(lease->timer);
+	server6_pool_detach(lease, 0);
 	TAILQ_REMOVE(&lease->iaidaddr->lease_list, lease, link);
 	dprintf(LOG_DEBUG, "%s" "removed lease %s", FNAME,
 		in6addr2str(&lease->lease_addr.addr, 0));
@@ -249,6 +485,8 @@ dhcp6_update_iaidaddr(optinfo, flag)
 	}
 	
 	if (flag == ADDR_UPDATE) {		
+		server6_set_relayid(iaidaddr, optinfo);
+		server6_set_reconf(iaidaddr, optinfo);
 		/* add or update new lease */
 		for (lv = TAILQ_FIRST(&optinfo->addr_list); lv; lv = lv_next) {
 			lv_next = TAILQ_NEXT(lv, link);
@@ -283,6 +521,8 @@ dhcp6_update_iaidaddr(optinfo, flag)
 					 * for maintain abandoned list with
 					 * preferlifetime xxx, validlifetime xxx
 					 */
+					/* at least keep it off the reuse list */
+					server6_pool_detach(lease, 1);
 				}
 				dhcp6_remove_lease(lease);
 			} else {
@@ -372,7 +612,7 @@ dhcp6_add_lease(iaidaddr, addr)
 	time(&sp->start_date);
 	dprintf(LOG_DEBUG, "%s" "start date is %ld", FNAME, sp->start_date);
 	sp->state = ACTIVE;
-	if (write_lease(sp, server6_lease_file) != 0) {
+	if (server6_write_lease(sp) != 0) {
 		dprintf(LOG_ERR, "%s" "failed to write a new lease address %s to lease file", 
 			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 		free(sp->timer);
@@ -388,6 +628,7 @@ dhcp6_add_lease(iaidaddr, addr)
 			return (-1);
 	}
 	TAILQ_INSERT_TAIL(&iaidaddr->lease_list, sp, link);
+	server6_pool_attach(sp);
 	if (sp->lease_addr.validlifetime == DHCP6_DURATITION_INFINITE || 
 	    sp->lease_addr.preferlifetime == DHCP6_DURATITION_INFINITE) {
 		dprintf(LOG_INFO, "%s" "infinity address life time for %s",
@@ -437,7 +678,7 @@ dhcp6_update_lease(addr, sp)
 	memcpy(&sp->lease_addr, addr, sizeof(sp->lease_addr));
 	time(&sp->start_date);
 	sp->state = ACTIVE;
-	if (write_lease(sp, server6_lease_file) != 0) {
+	if (server6_write_lease(sp) != 0) {
 		dprintf(LOG_ERR, "%s" "failed to write an updated lease %s to lease file", 
 			FNAME, in6addr2str(&sp->lease_addr.addr, 0));
 		return (-1);
@@ -462,6 +703,166 @@ dhcp6_update_lease(addr, sp)
 	return (0);
 }
 
+/*
+ * Take in a lease change from the replication stream: optinfo holds the
+ * binding with its one address, state what became of the lease.
+ */
+int
+server6_lease_apply(optinfo, state)
+	struct dhcp6_optinfo *optinfo;
+	state_t state;
+{
+	struct dhcp6_listval *lv;
+	struct dhcp6_iaidaddr *iaidaddr, *old;
+	struct dhcp6_lease *lease;
+	struct timeval timo;
+	int ret = 0;
+
+	if ((lv = TAILQ_FIRST(&optinfo->addr_list)) == NULL)
+		return (-1);
+	iaidaddr = dhcp6_find_iaidaddr(optinfo);
+	/* the address may have gone to another binding meanwhile */
+	lease = hash_search(lease_hash_table, (void *)&lv->val_dhcp6addr);
+	if (lease != NULL && lease->iaidaddr != iaidaddr) {
+		old = lease->iaidaddr;
+		dhcp6_remove_lease(lease);
+		if (TAILQ_EMPTY(&old->lease_list))
+			dhcp6_remove_iaidaddr(old);
+		lease = NULL;
+	}
+	switch (state) {
+	case INVALID:
+		if (lease == NULL)
+			return (0);
+		dhcp6_remove_lease(lease);
+		if (TAILQ_EMPTY(&iaidaddr->lease_list))
+			dhcp6_remove_iaidaddr(iaidaddr);
+		return (0);
+	case EXPIRED:
+		if (lease == NULL || lease->state != ACTIVE)
+			return (0);
+		lease->state = EXPIRED;
+		if (lease->timer != NULL) {
+			timo.tv_sec = lease->lease_addr.validlifetime -
+			    lease->lease_addr.preferlifetime;
+			timo.tv_usec = 0;
+			dhcp6_set_timer(&timo, lease->timer);
+		}
+		return (0);
+	default:
+		break;
+	}
+	if (iaidaddr == NULL)
+		return dhcp6_add_iaidaddr(optinfo);
+	/* a resync resends what the standby has, which stays as it is */
+	if (lease != NULL &&
+	    lease_unchanged(lease, &lv->val_dhcp6addr, optinfo))
+		return (0);
+	server6_set_relayid(iaidaddr, optinfo);
+	server6_set_reconf(iaidaddr, optinfo);
+	if (lease != NULL)
+		ret = dhcp6_update_lease(&lv->val_dhcp6addr, lease);
+	else
+		ret = dhcp6_add_lease(iaidaddr, &lv->val_dhcp6addr);
+	if (TAILQ_EMPTY(&iaidaddr->lease_list)) {
+		dhcp6_remove_iaidaddr(iaidaddr);
+		return (ret);
+	}
+	time(&iaidaddr->start_date);
+	iaidaddr->state = ACTIVE;
+	timo.tv_sec = get_max_validlifetime(iaidaddr);
+	timo.tv_usec = 0;
+	dhcp6_set_timer(&timo, iaidaddr->timer);
+	return (ret);
+}
+
+/*
+ * The same lease as the one the replication stream sends, which then
+ * need not be written again: the lifetimes in addr count from now, and
+ * end within a second of those the lease holds.
+ */
+static int
+lease_unchanged(lease, addr, optinfo)
+	struct dhcp6_lease *lease;
+	struct dhcp6_addr *addr;
+	struct dhcp6_optinfo *optinfo;
+{
+	struct dhcp6_iaid_info *iaidinfo;
+	u_int32_t had[2], has[2];
+	time_t now = time(NULL), d;
+	int i;
+
+	iaidinfo = &lease->iaidaddr->client6_info.iaidinfo;
+	if (lease->state != ACTIVE || lease->lease_addr.plen != addr->plen ||
+	    iaidinfo->renewtime != optinfo->iaidinfo.renewtime ||
+	    iaidinfo->rebindtime != optinfo->iaidinfo.rebindtime)
+		return (0);
+	if (lease->iaidaddr->relayid.duid_len != optinfo->relayID.duid_len ||
+	    (optinfo->relayID.duid_len != 0 &&
+	     duidcmp(&lease->iaidaddr->relayid, &optinfo->relayID)))
+		return (0);
+	if (lease->iaidaddr->reconf_accept !=
+	    (optinfo->reconfkey.duid_len != 0) ||
+	    (lease->iaidaddr->reconf_accept &&
+	     memcmp(lease->iaidaddr->reconfkey, optinfo->reconfkey.duid_id,
+		    sizeof(lease->iaidaddr->reconfkey))))
+		return (0);
+	had[0] = lease->lease_addr.preferlifetime;
+	had[1] = lease->lease_addr.validlifetime;
+	has[0] = addr->preferlifetime;
+	has[1] = addr->validlifetime;
+	for (i = 0; i < 2; i++) {
+		if (had[i] == DHCP6_DURATITION_INFINITE ||
+		    has[i] == DHCP6_DURATITION_INFINITE) {
+			if (had[i] != has[i])
+				return (0);
+			continue;
+		}
+		d = (lease->start_date + had[i]) - (now + has[i]);
+		if (d < -1 || d > 1)
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * After the replication stream resent every binding, remove the leases
+ * it did not mention, those whose replgen is not gen.
+ */
+void
+server6_lease_sweep(gen)
+	u_int32_t gen;
+{
+	struct hashlist_element *element;
+	struct dhcp6_lease **stale, *lease;
+	struct dhcp6_iaidaddr *iaidaddr;
+	unsigned int i, n = 0;
+
+	stale = malloc((lease_hash_table->hash_count + 1) * sizeof(*stale));
+	if (stale == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return;
+	}
+	for (i = 0; i < lease_hash_table->hash_size; i++) {
+		for (element = lease_hash_table->hash_list[i]; element;
+		     element = element->next) {
+			lease = element->data;
+			if (lease->replgen != gen)
+				stale[n++] = lease;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		iaidaddr = stale[i]->iaidaddr;
+		dhcp6_remove_lease(stale[i]);
+		if (TAILQ_EMPTY(&iaidaddr->lease_list))
+			dhcp6_remove_iaidaddr(iaidaddr);
+	}
+	if (n > 0)
+		dprintf(LOG_INFO, "%s" "removed %u leases the primary no "
+			"longer holds", FNAME, n);
+	free(stale);
+}
+
 struct dhcp6_lease *
 dhcp6_find_lease(iaidaddr, ifaddr)
 	struct dhcp6_iaidaddr *iaidaddr;
@@ -520,6 +921,7 @@ dhcp6_lease_timo(arg)
 	switch(sp->state) {
 	case ACTIVE:
 		sp->state = EXPIRED;
+		server6_repl_lease(sp);
 		d = sp->lease_addr.validlifetime - sp->lease_addr.preferlifetime;
 		timeo.tv_sec = (long)d;
 		timeo.tv_usec = 0;
@@ -757,7 +1159,7 @@ addr_on_segment(seg, addr)
 	
 }
 
-static void 
+void 
 server6_get_newaddr(type, v6addr, seg)
 	iatype_t type;
 	struct dhcp6_addr *v6addr;
@@ -765,6 +1167,20 @@ server6_get_newaddr(type, v6addr, seg)
 {
 	struct in6_addr current;
 	int round = 0;
+
+	if (type == IANA) {
+		/* a full segment would otherwise be probed address by address */
+		if (seg->size != 0 && seg->nactive >= seg->size) {
+			memset(&v6addr->addr, 0, sizeof(v6addr->addr));
+			return;
+		}
+		if (seg_reuse_addr(seg, v6addr) == 0) {
+			dprintf(LOG_DEBUG, "reused address %s",
+				in6addr2str(&v6addr->addr, 0));
+			server6_get_addrpara(v6addr, seg);
+			return;
+		}
+	}
 	memcpy(&current, &seg->free, sizeof(current));
 	do {
 		v6addr->type = type;
@@ -800,6 +1216,509 @@ server6_get_newaddr(type, v6addr, seg)
 	return;
 }
 
+/*
+ * Take the oldest address of the segment's recently expired ring that is
+ * still free.  Returns -1 when there is none.
+ */
+static int
+seg_reuse_addr(seg, v6addr)
+	struct v6addrseg *seg;
+	struct dhcp6_addr *v6addr;
+{
+	while (seg->nexpired > 0) {
+		v6addr->type = IANA;
+		memcpy(&v6addr->addr, &seg->expired[seg->expired_head],
+		       sizeof(v6addr->addr));
+		seg->expired_head = (seg->expired_head + 1) % SEG_EXPIRED_MAX;
+		seg->nexpired--;
+		if (hash_search(lease_hash_table, (void *)v6addr) == NULL &&
+		    hash_search(host_addr_hash_table,
+				(void *)&v6addr->addr) == NULL)
+			return 0;
+	}
+	return -1;
+}
+
+/*
+ * The ranges and prefixes of the configuration sorted by their first
+ * address, so that a lease finds its own in O(log n) instead of walking
+ * every interface and link.  Each entry remembers its place in the
+ * configuration, since the first declared range that holds an address
+ * still wins where ranges overlap.
+ */
+struct pool_ent {
+	struct in6_addr min;
+	struct in6_addr max;
+	u_int8_t plen;
+	int order;
+	void *decl;
+};
+struct pool_index {
+	struct pool_ent *ent;
+	struct in6_addr *reach;		/* highest max of ent[0] .. ent[i] */
+	int n;
+};
+static struct pool_index pool_byrange;		/* IANA, seg->min .. seg->max */
+static struct pool_index pool_byprefix;		/* IATA, seg->prefix */
+static struct pool_index pool_bypd;		/* IAPD, link->prefixlist */
+
+static int
+pool_ent_cmp(a, b)
+	const void *a, *b;
+{
+	const struct pool_ent *ea = a, *eb = b;
+	int r;
+
+	if ((r = memcmp(&ea->min, &eb->min, sizeof(ea->min))) != 0)
+		return r;
+	if (ea->plen != eb->plen)
+		return ea->plen < eb->plen ? -1 : 1;
+	return ea->order - eb->order;
+}
+
+static int
+pool_index_alloc(idx, n)
+	struct pool_index *idx;
+	int n;
+{
+	free(idx->ent);
+	free(idx->reach);
+	idx->ent = NULL;
+	idx->reach = NULL;
+	idx->n = 0;
+	if (n == 0)
+		return 0;
+	idx->ent = malloc(n * sizeof(*idx->ent));
+	idx->reach = malloc(n * sizeof(*idx->reach));
+	if (idx->ent == NULL || idx->reach == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		free(idx->ent);
+		free(idx->reach);
+		idx->ent = NULL;
+		idx->reach = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+static void
+pool_index_sort(idx)
+	struct pool_index *idx;
+{
+	int i;
+
+	if (idx->n == 0)
+		return;
+	qsort(idx->ent, idx->n, sizeof(*idx->ent), pool_ent_cmp);
+	memcpy(&idx->reach[0], &idx->ent[0].max, sizeof(idx->reach[0]));
+	for (i = 1; i < idx->n; i++) {
+		if (memcmp(&idx->ent[i].max, &idx->reach[i - 1],
+			   sizeof(idx->reach[i])) > 0)
+			memcpy(&idx->reach[i], &idx->ent[i].max,
+			       sizeof(idx->reach[i]));
+		else
+			memcpy(&idx->reach[i], &idx->reach[i - 1],
+			       sizeof(idx->reach[i]));
+	}
+}
+
+/* index the ranges and prefixes of root */
+static void
+server6_pool_index(root)
+	struct rootgroup *root;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+	struct pool_ent *ent;
+	int nseg = 0, nprefix = 0, order = 0, i;
+
+	for (ifnetwork = root->iflist; ifnetwork; ifnetwork = ifnetwork->next) {
+		for (link = ifnetwork->linklist; link; link = link->next) {
+			for (seg = link->seglist; seg; seg = seg->next)
+				nseg++;
+			for (prefix6 = link->prefixlist; prefix6;
+			     prefix6 = prefix6->next)
+				nprefix++;
+		}
+	}
+	if (pool_index_alloc(&pool_byrange, nseg) ||
+	    pool_index_alloc(&pool_byprefix, nseg) ||
+	    pool_index_alloc(&pool_bypd, nprefix))
+		return;
+	for (ifnetwork = root->iflist; ifnetwork; ifnetwork = ifnetwork->next) {
+		for (link = ifnetwork->linklist; link; link = link->next) {
+			for (seg = link->seglist; seg; seg = seg->next) {
+				order++;
+				ent = &pool_byrange.ent[pool_byrange.n++];
+				ent->min = seg->min;
+				ent->max = seg->max;
+				ent->plen = 0;
+				ent->order = order;
+				ent->decl = seg;
+				/* a temporary address only has to share the prefix */
+				ent = &pool_byprefix.ent[pool_byprefix.n++];
+				ent->min = seg->prefix.addr;
+				ent->max = seg->prefix.addr;
+				for (i = 0; i < 128; i++) {
+					if (i < seg->prefix.plen)
+						continue;
+					ent->min.s6_addr[i / 8] &= ~(0x80 >> (i % 8));
+					ent->max.s6_addr[i / 8] |= 0x80 >> (i % 8);
+				}
+				ent->plen = 0;
+				ent->order = order;
+				ent->decl = seg;
+			}
+			for (prefix6 = link->prefixlist; prefix6;
+			     prefix6 = prefix6->next) {
+				order++;
+				ent = &pool_bypd.ent[pool_bypd.n++];
+				ent->min = prefix6->prefix.addr;
+				ent->max = prefix6->prefix.addr;
+				ent->plen = prefix6->prefix.plen;
+				ent->order = order;
+				ent->decl = prefix6;
+			}
+		}
+	}
+	pool_index_sort(&pool_byrange);
+	pool_index_sort(&pool_byprefix);
+	pool_index_sort(&pool_bypd);
+}
+
+/* the first declared range of idx that holds addr */
+static void *
+pool_index_lookup(idx, addr)
+	struct pool_index *idx;
+	struct in6_addr *addr;
+{
+	struct pool_ent *best = NULL;
+	int lo = 0, hi = idx->n, mid, i;
+
+	/* the last entry starting at or below addr */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (memcmp(&idx->ent[mid].min, addr, sizeof(*addr)) <= 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (i = lo - 1; i >= 0; i--) {
+		if (memcmp(&idx->reach[i], addr, sizeof(*addr)) < 0)
+			break;
+		if (memcmp(&idx->ent[i].max, addr, sizeof(*addr)) < 0)
+			continue;
+		if (best == NULL || idx->ent[i].order < best->order)
+			best = &idx->ent[i];
+	}
+	return best ? best->decl : NULL;
+}
+
+/* the first declared prefix equal to addr/plen */
+static struct v6prefix *
+pool_index_prefix(addr, plen)
+	struct in6_addr *addr;
+	u_int8_t plen;
+{
+	struct pool_ent key;
+	int lo = 0, hi = pool_bypd.n, mid;
+
+	key.min = *addr;
+	key.plen = plen;
+	key.order = 0;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (pool_ent_cmp(&pool_bypd.ent[mid], &key) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	if (lo == pool_bypd.n || pool_bypd.ent[lo].plen != plen ||
+	    !IN6_ARE_ADDR_EQUAL(&pool_bypd.ent[lo].min, addr))
+		return NULL;
+	return pool_bypd.ent[lo].decl;
+}
+
+/* count a lease in the range or prefix it belongs to */
+static void
+server6_pool_attach(lease)
+	struct dhcp6_lease *lease;
+{
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+
+	if (globalgroup == NULL || lease->seg != NULL || lease->prefix != NULL)
+		return;
+	switch (lease->lease_addr.type) {
+	case IAPD:
+		prefix6 = pool_index_prefix(&lease->lease_addr.addr,
+					    lease->lease_addr.plen);
+		if (prefix6 == NULL)
+			return;
+		lease->prefix = prefix6;
+		TAILQ_INSERT_TAIL(&prefix6->active, lease, seglink);
+		prefix6->nactive++;
+		if (prefix6->pool)
+			prefix6->pool->nprefix++;
+		return;
+	case IATA:
+		seg = pool_index_lookup(&pool_byprefix,
+					&lease->lease_addr.addr);
+		break;
+	case IANA:
+		seg = pool_index_lookup(&pool_byrange,
+					&lease->lease_addr.addr);
+		break;
+	default:
+		return;
+	}
+	if (seg == NULL)
+		return;
+	lease->seg = seg;
+	TAILQ_INSERT_TAIL(&seg->active, lease, seglink);
+	/* a temporary address takes nothing from the range */
+	if (lease->lease_addr.type == IATA) {
+		seg->ntemp++;
+		if (seg->pool)
+			seg->pool->ntemp++;
+		return;
+	}
+	seg->nactive++;
+	if (seg->pool)
+		seg->pool->nactive++;
+}
+
+/*
+ * Uncount a lease that goes away.  The address is remembered for reuse
+ * unless the client declined it.
+ */
+static void
+server6_pool_detach(lease, abandoned)
+	struct dhcp6_lease *lease;
+	int abandoned;
+{
+	struct v6addrseg *seg;
+	int i;
+
+	if (lease->seg != NULL || lease->prefix != NULL)
+		server6_lq_forget_lease(lease);
+	if (lease->prefix != NULL) {
+		TAILQ_REMOVE(&lease->prefix->active, lease, seglink);
+		lease->prefix->nactive--;
+		if (lease->prefix->pool)
+			lease->prefix->pool->nprefix--;
+		lease->prefix = NULL;
+	}
+	if ((seg = lease->seg) == NULL)
+		return;
+	TAILQ_REMOVE(&seg->active, lease, seglink);
+	if (lease->lease_addr.type == IATA) {
+		seg->ntemp--;
+		if (seg->pool)
+			seg->pool->ntemp--;
+	} else {
+		seg->nactive--;
+		if (seg->pool)
+			seg->pool->nactive--;
+	}
+	lease->seg = NULL;
+	if (abandoned) {
+		seg->nabandoned++;
+		return;
+	}
+	if (lease->lease_addr.type != IANA)
+		return;
+	/* a full ring forgets its oldest address */
+	if (seg->nexpired == SEG_EXPIRED_MAX) {
+		seg->expired_head = (seg->expired_head + 1) % SEG_EXPIRED_MAX;
+		seg->nexpired--;
+	}
+	i = (seg->expired_head + seg->nexpired) % SEG_EXPIRED_MAX;
+	memcpy(&seg->expired[i], &lease->lease_addr.addr,
+	       sizeof(seg->expired[i]));
+	seg->nexpired++;
+}
+
+/* addresses from seg->min to seg->max, saturated at 2^64 - 1 */
+static u_int64_t
+seg_size(seg)
+	struct v6addrseg *seg;
+{
+	u_int64_t min = 0, max = 0;
+	int i;
+
+	if (memcmp(&seg->min, &seg->max, 8) != 0)
+		return ~(u_int64_t)0;
+	for (i = 8; i < 16; i++) {
+		min = (min << 8) | seg->min.s6_addr[i];
+		max = (max << 8) | seg->max.s6_addr[i];
+	}
+	if (max - min == ~(u_int64_t)0)
+		return max - min;
+	return max - min + 1;
+}
+
+/*
+ * Recount every range and prefix of the configuration from the lease
+ * table, and index the bindings by DUID, once the configuration and the
+ * lease file are both loaded.  After that the counts and the index
+ * follow each lease and binding added or removed.
+ */
+void
+server6_pool_sync(root)
+	struct rootgroup *root;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+	struct pool_decl *pool;
+	struct hashlist_element *element;
+	int i;
+
+	/* the bindings loaded from the lease file are not indexed yet */
+	if (server6_hash_table != NULL) {
+		for (i = 0; i < server6_hash_table->hash_size; i++) {
+			for (element = server6_hash_table->hash_list[i]; element;
+			     element = element->next) {
+				server6_client_attach(element->data);
+				server6_relay_attach(element->data);
+			}
+		}
+	}
+	for (ifnetwork = root->iflist; ifnetwork; ifnetwork = ifnetwork->next) {
+		for (link = ifnetwork->linklist; link; link = link->next) {
+			for (pool = link->poollist; pool; pool = pool->next)
+				pool->size = pool->nactive = pool->ntemp =
+				    pool->nprefix = 0;
+			for (seg = link->seglist; seg; seg = seg->next) {
+				TAILQ_INIT(&seg->active);
+				seg->size = seg_size(seg);
+				seg->nactive = seg->ntemp = seg->nabandoned = 0;
+				seg->nexpired = seg->expired_head = 0;
+				if (seg->pool)
+					seg->pool->size += seg->size;
+			}
+			for (prefix6 = link->prefixlist; prefix6;
+			     prefix6 = prefix6->next) {
+				TAILQ_INIT(&prefix6->active);
+				prefix6->nactive = 0;
+			}
+		}
+	}
+	server6_pool_index(root);
+	server6_lq_reload();
+	if (lease_hash_table == NULL)
+		return;
+	for (i = 0; i < lease_hash_table->hash_size; i++) {
+		for (element = lease_hash_table->hash_list[i]; element;
+		     element = element->next) {
+			struct dhcp6_lease *lease = element->data;
+
+			lease->seg = NULL;
+			lease->prefix = NULL;
+			server6_pool_attach(lease);
+		}
+	}
+}
+
+/*
+ * After a reload, carry over to the new ranges where allocation stood
+ * in the old ones they match, and what was abandoned or freed there.
+ */
+void
+server6_pool_inherit(old, root)
+	struct rootgroup *old, *root;
+{
+	struct interface *ifnetwork, *oifnetwork;
+	struct link_decl *link, *olink;
+	struct v6addrseg *seg, *oseg;
+
+	for (ifnetwork = root->iflist; ifnetwork; ifnetwork = ifnetwork->next)
+	for (link = ifnetwork->linklist; link; link = link->next)
+	for (seg = link->seglist; seg; seg = seg->next) {
+		for (oifnetwork = old->iflist; oifnetwork;
+		     oifnetwork = oifnetwork->next)
+		for (olink = oifnetwork->linklist; olink; olink = olink->next) {
+			if (strcmp(olink->name, link->name) != 0)
+				continue;
+			for (oseg = olink->seglist; oseg; oseg = oseg->next) {
+				if (!IN6_ARE_ADDR_EQUAL(&oseg->min, &seg->min) ||
+				    !IN6_ARE_ADDR_EQUAL(&oseg->max, &seg->max))
+					continue;
+				seg->free = oseg->free;
+				seg->nabandoned = oseg->nabandoned;
+				memcpy(seg->expired, oseg->expired,
+				       sizeof(seg->expired));
+				seg->expired_head = oseg->expired_head;
+				seg->nexpired = oseg->nexpired;
+			}
+		}
+	}
+}
+
+/* utilization of every range, prefix and pool for the control socket */
+void
+server6_pool_dump(fp)
+	FILE *fp;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+	struct pool_decl *pool;
+	char min[INET6_ADDRSTRLEN];
+	int n;
+
+	if (globalgroup == NULL)
+		return;
+	for (ifnetwork = globalgroup->iflist; ifnetwork;
+	     ifnetwork = ifnetwork->next) {
+		for (link = ifnetwork->linklist; link; link = link->next) {
+			for (seg = link->seglist; seg; seg = seg->next) {
+				strcpy(min, in6addr2str(&seg->min, 0));
+#define SEG_LINE(what, val) \
+				fprintf(fp, "dhcp6s_range_" what "{link=\"%s\"," \
+					"range=\"%s-%s\"} %llu\n", link->name, min, \
+					in6addr2str(&seg->max, 0), \
+					(unsigned long long)(val))
+				SEG_LINE("size", seg->size);
+				SEG_LINE("active", seg->nactive);
+				SEG_LINE("free", seg->nactive < seg->size ?
+					 seg->size - seg->nactive : 0);
+				SEG_LINE("temporary", seg->ntemp);
+				SEG_LINE("abandoned", seg->nabandoned);
+				SEG_LINE("reusable", seg->nexpired);
+#undef SEG_LINE
+			}
+			for (prefix6 = link->prefixlist; prefix6;
+			     prefix6 = prefix6->next)
+				fprintf(fp, "dhcp6s_prefix_delegated{link=\"%s\","
+					"prefix=\"%s/%d\"} %llu\n", link->name,
+					in6addr2str(&prefix6->prefix.addr, 0),
+					prefix6->prefix.plen,
+					(unsigned long long)prefix6->nactive);
+			for (pool = link->poollist, n = 0; pool;
+			     pool = pool->next, n++) {
+				fprintf(fp, "dhcp6s_pool_size{link=\"%s\","
+					"pool=\"%d\"} %llu\n", link->name, n,
+					(unsigned long long)pool->size);
+				fprintf(fp, "dhcp6s_pool_active{link=\"%s\","
+					"pool=\"%d\"} %llu\n", link->name, n,
+					(unsigned long long)pool->nactive);
+				fprintf(fp, "dhcp6s_pool_temporary{link=\"%s\","
+					"pool=\"%d\"} %llu\n", link->name, n,
+					(unsigned long long)pool->ntemp);
+				fprintf(fp, "dhcp6s_pool_delegated{link=\"%s\","
+					"pool=\"%d\"} %llu\n", link->name, n,
+					(unsigned long long)pool->nprefix);
+			}
+		}
+	}
+}
+
 static void
 server6_get_prefixpara(v6addr, seg)
 	struct dhcp6_addr *v6addr;
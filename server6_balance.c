@@ -0,0 +1,203 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Load balancing between two servers on the same links, in the manner
+ * of RFC 3074: the client DUID is hashed into one of 256 buckets, and
+ * each server answers only the clients whose bucket lies in its share
+ * (dhcp6s -l first-last).  Only messages that carry no Server Identifier
+ * are split; the others already name the server that should answer.
+ *
+ * A client of the peer is still answered, with the lowest preference,
+ * once it has waited BALANCE_DELAY for the peer, or at once while the
+ * server is told to take over with "balance takeover".
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "server6_balance.h"
+
+#define BALANCE_BUCKETS	256
+#define BALANCE_DELAY	300	/* Elapsed Time, in 1/100 s, to wait for the peer */
+
+/* the permutation of the Pearson hash of RFC 3074 */
+static const u_int8_t balance_perm[BALANCE_BUCKETS] = {
+	251, 175, 119, 215,  81,  14,  79, 191, 103,  49, 181, 143, 186, 157,   0, 232,
+	 31,  32,  55,  60, 152,  58,  17, 237, 174,  70, 160, 144, 220,  90,  57, 223,
+	 59,   3,  18, 140, 111, 166, 203, 196, 134, 243, 124,  95, 222, 179, 197,  65,
+	180,  48,  36,  15, 107,  46, 233, 130, 165,  30, 123, 161, 209,  23,  97,  16,
+	 40,  91, 219,  61, 100,  10, 210, 109, 250, 127,  22, 138,  29, 108, 244,  67,
+	207,   9, 178, 204,  74,  98, 126, 249, 167, 116,  34,  77, 193, 200, 121,   5,
+	 20, 113,  71,  35, 128,  13, 182,  94,  25, 226, 227, 199,  75,  27,  41, 245,
+	230, 224,  43, 225, 177,  26, 155, 150, 212, 142, 218, 115, 241,  73,  88, 105,
+	 39, 114,  62, 255, 192, 201, 145, 214, 168, 158, 221, 148, 154, 122,  12,  84,
+	 82, 163,  44, 139, 228, 236, 205, 242, 217,  11, 187, 146, 159,  64,  86, 239,
+	195,  42, 106, 198, 118, 112, 184, 172,  87,   2, 173, 117, 176, 229, 247, 253,
+	137, 185,  99, 164, 102, 147,  45,  66, 231,  52, 141, 211, 194, 206, 246, 238,
+	 56, 110,  78, 248,  63, 240, 189,  93,  92,  51,  53, 183,  19, 171,  72,  50,
+	 33, 104, 101,  69,   8, 252,  83, 120,  76, 135,  85,  54, 202, 125, 188, 213,
+	 96, 235, 136, 208, 162, 129, 190, 132, 156,  38,  47,   1,   7, 254,  24,   4,
+	216, 131,  89,  21,  28, 133,  37, 153, 149,  80, 170,  68,   6, 169, 234, 151,
+};
+
+static int balance_on = 0;
+static int balance_takeover = 0;
+static int balance_first, balance_last;	/* our share of the buckets */
+static u_int64_t balance_count[3];	/* by BALANCE_* verdict */
+
+static int balance_parse __P((const char *, int *, int *));
+static int balance_bucket __P((struct duid *));
+
+static int
+balance_parse(spec, first, last)
+	const char *spec;
+	int *first, *last;
+{
+	char *ep;
+	long f, l;
+
+	f = strtol(spec, &ep, 10);
+	if (ep == spec || *ep != '-')
+		return (-1);
+	spec = ep + 1;
+	l = strtol(spec, &ep, 10);
+	if (ep == spec || *ep != '\0')
+		return (-1);
+	if (f < 0 || l >= BALANCE_BUCKETS || f > l)
+		return (-1);
+	*first = f;
+	*last = l;
+	return (0);
+}
+
+/* take the share of the buckets from "first-last" */
+int
+server6_balance_set(spec)
+	const char *spec;
+{
+	if (balance_parse(spec, &balance_first, &balance_last) < 0)
+		return (-1);
+	balance_on = 1;
+	return (0);
+}
+
+static int
+balance_bucket(duid)
+	struct duid *duid;
+{
+	u_int8_t h = duid->duid_len;
+	int i;
+
+	for (i = 0; i < duid->duid_len; i++)
+		h = balance_perm[h ^ (u_int8_t)duid->duid_id[i]];
+	return (h);
+}
+
+/*
+ * Decide whether to answer a message that names no server.  The caller
+ * lowers the preference of an answer given with BALANCE_TAKEOVER, so a
+ * client that hears both servers still goes to the peer.
+ */
+int
+server6_balance_check(optinfo)
+	struct dhcp6_optinfo *optinfo;
+{
+	int bucket, verdict;
+
+	if (!balance_on)
+		return (BALANCE_OURS);
+	bucket = balance_bucket(&optinfo->clientID);
+	if (bucket >= balance_first && bucket <= balance_last)
+		verdict = BALANCE_OURS;
+	else if (balance_takeover ||
+		 ntohs(optinfo->elapsed_time) >= BALANCE_DELAY)
+		verdict = BALANCE_TAKEOVER;
+	else
+		verdict = BALANCE_PEER;
+	balance_count[verdict]++;
+	dprintf(LOG_DEBUG, "%s" "client %s bucket %d: %s", FNAME,
+		duidstr(&optinfo->clientID), bucket,
+		verdict == BALANCE_OURS ? "ours" :
+		verdict == BALANCE_PEER ? "peer" : "takeover");
+	return (verdict);
+}
+
+/*
+ * The "balance" control command: "takeover" answers every client until
+ * "normal", and "first-last" moves our share.  Then report the state.
+ */
+void
+server6_balance_ctl(fp, args)
+	FILE *fp;
+	char *args;
+{
+	int first, last;
+
+	if (*args == '\0')
+		;
+	else if (strcmp(args, "takeover") == 0)
+		balance_takeover = 1;
+	else if (strcmp(args, "normal") == 0)
+		balance_takeover = 0;
+	else if (balance_parse(args, &first, &last) == 0) {
+		balance_first = first;
+		balance_last = last;
+		balance_on = 1;
+	} else {
+		fprintf(fp, "error bad argument \"%s\"\n", args);
+		return;
+	}
+	if (*args != '\0')
+		dprintf(LOG_NOTICE, "%s" "balance %s", FNAME, args);
+	if (!balance_on) {
+		fprintf(fp, "dhcp6s_balance_enabled 0\n");
+		return;
+	}
+	fprintf(fp, "dhcp6s_balance_enabled 1\n");
+	fprintf(fp, "dhcp6s_balance_share{first=\"%d\",last=\"%d\"} %d\n",
+	    balance_first, balance_last, balance_last - balance_first + 1);
+	fprintf(fp, "dhcp6s_balance_takeover %d\n", balance_takeover);
+	fprintf(fp, "dhcp6s_balance_total{verdict=\"ours\"} %llu\n",
+	    (unsigned long long)balance_count[BALANCE_OURS]);
+	fprintf(fp, "dhcp6s_balance_total{verdict=\"peer\"} %llu\n",
+	    (unsigned long long)balance_count[BALANCE_PEER]);
+	fprintf(fp, "dhcp6s_balance_total{verdict=\"takeover\"} %llu\n",
+	    (unsigned long long)balance_count[BALANCE_TAKEOVER]);
+}
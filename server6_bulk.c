@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Bulk leasequery, RFC 5460: requestors connect to TCP port 547 and send
+ * LEASEQUERY messages, each framed by a two-byte length, and get back a
+ * LEASEQUERY-REPLY, then a LEASEQUERY-DATA per further client and a
+ * LEASEQUERY-DONE.
+ *
+ * The records of a query by relay or link are made a few at a time as
+ * the requestor takes them, never blocking, and no more than
+ * BULK_MAXQUEUE bytes wait for any one requestor, so a large answer
+ * neither stalls the server nor holds a copy of the bindings.  A client
+ * bound or released while the answer is written may or may not be in
+ * it.  A connection sends its next query only once the previous answer
+ * has gone.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "timer.h"
+#include "server6_stats.h"
+#include "server6_lq.h"
+#include "server6_bulk.h"
+
+#define BULK_MAXCONN	8	/* requestors served at once */
+#define BULK_IDLE_SEC	120	/* close a requestor silent this long */
+#define BULK_MAXMSG	65535	/* the framing allows no more */
+#define BULK_MAXQUEUE	65536	/* stop making records with this much unsent */
+#define BULK_BATCH	256	/* clients looked at per turn of the loop */
+
+struct bulk_conn {
+	TAILQ_ENTRY(bulk_conn) link;
+	int fd;
+	struct sockaddr_in6 peer;
+	dhcp6_time_t idle;	/* when it last moved */
+	/* while a query is answered */
+	u_int32_t xid;
+	struct duid requestor;
+	int nrec;		/* client records so far */
+	struct lq_cursor cur;	/* where the records stand */
+	/* the query being read, with its length */
+	char in[2 + BULK_MAXMSG];
+	size_t inlen;
+	/* the answer not yet written */
+	char *out;
+	size_t outoff, outlen, outsize;
+};
+
+static TAILQ_HEAD(, bulk_conn) bulk_conns =
+	TAILQ_HEAD_INITIALIZER(bulk_conns);
+static int bulk_nconns;
+static struct duid *bulk_serverid;
+
+static void bulk_accept __P((int));
+static void bulk_close __P((struct bulk_conn *));
+static int bulk_read __P((struct bulk_conn *));
+static int bulk_write __P((struct bulk_conn *));
+static int bulk_query __P((struct bulk_conn *, struct dhcp6 *, size_t));
+static int bulk_fill __P((struct bulk_conn *));
+static int bulk_end __P((struct bulk_conn *, char *, int));
+static int bulk_reserve __P((struct bulk_conn *, size_t));
+static int bulk_msg __P((struct bulk_conn *, int, struct duid *,
+			 char *, int, char *, int));
+static int bulk_emit __P((void *, char *, int));
+
+int
+server6_bulk_open(serverid)
+	struct duid *serverid;
+{
+	struct sockaddr_in6 sin6;
+	int s, on = 1;
+
+	if ((s = socket(AF_INET6, SOCK_STREAM, 0)) < 0) {
+		dprintf(LOG_ERR, "%s" "socket: %s", FNAME, strerror(errno));
+		return -1;
+	}
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin6, 0, sizeof(sin6));
+	sin6.sin6_family = AF_INET6;
+	sin6.sin6_port = htons(atoi(DH6PORT_UPSTREAM));
+	if (bind(s, (struct sockaddr *)&sin6, sizeof(sin6)) < 0 ||
+	    listen(s, BULK_MAXCONN) < 0 ||
+	    fcntl(s, F_SETFL, O_NONBLOCK) < 0) {
+		dprintf(LOG_ERR, "%s" "bulk leasequery socket: %s", FNAME,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	bulk_serverid = serverid;
+	return s;
+}
+
+/* what the listening socket s and the requestors wait for */
+int
+server6_bulk_fdset(s, r, w, maxfd)
+	int s;
+	fd_set *r, *w;
+	int maxfd;
+{
+	struct bulk_conn *c;
+
+	FD_SET(s, r);
+	if (s > maxfd)
+		maxfd = s;
+	TAILQ_FOREACH(c, &bulk_conns, link) {
+		if (c->outlen > c->outoff || c->cur.walk != LQC_IDLE)
+			FD_SET(c->fd, w);
+		else
+			FD_SET(c->fd, r);
+		if (c->fd > maxfd)
+			maxfd = c->fd;
+	}
+	return maxfd;
+}
+
+void
+server6_bulk_serve(s, r, w)
+	int s;
+	fd_set *r, *w;
+{
+	struct bulk_conn *c, *next;
+	dhcp6_time_t now = dhcp6_now();
+
+	for (c = TAILQ_FIRST(&bulk_conns); c; c = next) {
+		next = TAILQ_NEXT(c, link);
+		if (FD_ISSET(c->fd, w) && bulk_write(c) < 0)
+			bulk_close(c);
+		else if (FD_ISSET(c->fd, r) && bulk_read(c) < 0)
+			bulk_close(c);
+		else if (now - c->idle > BULK_IDLE_SEC * DHCP6_NSEC) {
+			dprintf(LOG_INFO, "%s" "requestor %s idle", FNAME,
+				addr2str((struct sockaddr *)&c->peer));
+			bulk_close(c);
+		}
+	}
+	if (FD_ISSET(s, r))
+		bulk_accept(s);
+}
+
+static void
+bulk_accept(s)
+	int s;
+{
+	struct bulk_conn *c;
+	struct sockaddr_in6 peer;
+	socklen_t len = sizeof(peer);
+	int fd;
+
+	if ((fd = accept(s, (struct sockaddr *)&peer, &len)) < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			dprintf(LOG_NOTICE, "%s" "accept: %s", FNAME,
+				strerror(errno));
+		return;
+	}
+	if (!server6_lq_allowed(&peer.sin6_addr)) {
+		dprintf(LOG_INFO, "%s" "bulk leasequery from %s not allowed",
+			FNAME, addr2str((struct sockaddr *)&peer));
+		close(fd);
+		return;
+	}
+	if (bulk_nconns >= BULK_MAXCONN) {
+		dprintf(LOG_INFO, "%s" "too many requestors, refused %s",
+			FNAME, addr2str((struct sockaddr *)&peer));
+		close(fd);
+		return;
+	}
+	if (fcntl(fd, F_SETFL, O_NONBLOCK) < 0 ||
+	    (c = malloc(sizeof(*c))) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to set up requestor %s", FNAME,
+			addr2str((struct sockaddr *)&peer));
+		close(fd);
+		return;
+	}
+	memset(c, 0, sizeof(*c));
+	c->fd = fd;
+	c->peer = peer;
+	c->idle = dhcp6_now();
+	TAILQ_INSERT_TAIL(&bulk_conns, c, link);
+	bulk_nconns++;
+	dprintf(LOG_DEBUG, "%s" "bulk leasequery from %s", FNAME,
+		addr2str((struct sockaddr *)&peer));
+}
+
+static void
+bulk_close(c)
+	struct bulk_conn *c;
+{
+	dprintf(LOG_DEBUG, "%s" "closing requestor %s", FNAME,
+		addr2str((struct sockaddr *)&c->peer));
+	TAILQ_REMOVE(&bulk_conns, c, link);
+	bulk_nconns--;
+	server6_lq_bulk_stop(&c->cur);
+	if (c->requestor.duid_len != 0)
+		duidfree(&c->requestor);
+	close(c->fd);
+	free(c->out);
+	free(c);
+}
+
+/* take what the requestor sent, up to a whole query; -1 to close */
+static int
+bulk_read(c)
+	struct bulk_conn *c;
+{
+	size_t want, len;
+	ssize_t n;
+
+	for (;;) {
+		len = ((u_int8_t)c->in[0] << 8) | (u_int8_t)c->in[1];
+		if (c->inlen >= 2 && len < sizeof(struct dhcp6)) {
+			dprintf(LOG_INFO, "%s" "short message from %s", FNAME,
+				addr2str((struct sockaddr *)&c->peer));
+			STATS_DROP(DROP_SHORT);
+			return -1;
+		}
+		want = c->inlen < 2 ? 2 : 2 + len;
+		if (c->inlen == want)
+			break;
+		if ((n = read(c->fd, c->in + c->inlen, want - c->inlen)) < 0)
+			return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+		if (n == 0)
+			return -1;
+		c->idle = dhcp6_now();
+		c->inlen += n;
+	}
+	c->inlen = 0;
+	if (bulk_query(c, (struct dhcp6 *)(c->in + 2), len) < 0)
+		return -1;
+	return bulk_write(c);
+}
+
+/* send what the requestor will take, and make more records; -1 to close */
+static int
+bulk_write(c)
+	struct bulk_conn *c;
+{
+	ssize_t n;
+
+	for (;;) {
+		while (c->outoff < c->outlen) {
+			n = write(c->fd, c->out + c->outoff,
+				  c->outlen - c->outoff);
+			if (n < 0)
+				return (errno == EAGAIN || errno == EINTR) ?
+				    0 : -1;
+			c->outoff += n;
+			c->idle = dhcp6_now();
+		}
+		c->outoff = c->outlen = 0;
+		if (c->cur.walk == LQC_IDLE)
+			break;
+		/* the next few records, or come back when writable again */
+		if (bulk_fill(c) < 0)
+			return -1;
+		if (c->outlen == 0)
+			return 0;
+	}
+	/* all gone, give the memory of a large answer back */
+	if (c->outsize > BUFSIZ) {
+		free(c->out);
+		c->out = NULL;
+		c->outsize = 0;
+	}
+	return 0;
+}
+
+/*
+ * Make the records of the query under way, up to BULK_MAXQUEUE bytes
+ * unsent or BULK_BATCH clients, and the end of the answer once the walk
+ * is over.
+ */
+static int
+bulk_fill(c)
+	struct bulk_conn *c;
+{
+	char lqbuf[BUFSIZ];
+	int i, lqlen, ret;
+
+	for (i = 0; i < BULK_BATCH && c->outlen - c->outoff < BULK_MAXQUEUE;
+	     i++) {
+		if ((ret = server6_lq_bulk_next(&c->cur, bulk_emit, c)) < 0)
+			return -1;
+		if (ret > 0)
+			continue;
+		if ((lqlen = server6_lq_bulk_done(&c->cur, lqbuf,
+						  lqbuf + sizeof(lqbuf))) < 0)
+			return -1;
+		return bulk_end(c, lqbuf, lqlen);
+	}
+	return 0;
+}
+
+/*
+ * Every answer ends with a done; the status goes in the reply, or after
+ * the records in the done.
+ */
+static int
+bulk_end(c, lqbuf, lqlen)
+	struct bulk_conn *c;
+	char *lqbuf;
+	int lqlen;
+{
+	int ret;
+
+	if (c->nrec == 0)
+		ret = bulk_msg(c, DH6_LQ_REPLY, &c->requestor, NULL, 0,
+			       lqbuf, lqlen) ||
+		    bulk_msg(c, DH6_LQ_DONE, NULL, NULL, 0, NULL, 0) ? -1 : 0;
+	else
+		ret = bulk_msg(c, DH6_LQ_DONE, NULL, NULL, 0, lqbuf, lqlen);
+	dprintf(LOG_DEBUG, "%s" "%d clients for %s", FNAME, c->nrec,
+		addr2str((struct sockaddr *)&c->peer));
+	duidfree(&c->requestor);
+	return ret;
+}
+
+/* answer a query of len bytes; -1 to close */
+static int
+bulk_query(c, dh6, len)
+	struct bulk_conn *c;
+	struct dhcp6 *dh6;
+	size_t len;
+{
+	struct dhcp6_optinfo optinfo;
+	struct dhcp6opt *p = (struct dhcp6opt *)(dh6 + 1);
+	struct dhcp6opt *ep = (struct dhcp6opt *)((char *)dh6 + len);
+	char lqbuf[BUFSIZ];
+	int lqlen, ret = -1;
+
+	server6_stats.rx[STATS_TYPE(dh6->dh6_msgtype)]++;
+	if (dh6->dh6_msgtype != DH6_LEASEQUERY) {
+		dprintf(LOG_INFO, "%s" "unexpected %s from %s", FNAME,
+			dhcp6msgstr(dh6->dh6_msgtype),
+			addr2str((struct sockaddr *)&c->peer));
+		STATS_DROP(DROP_BADTYPE);
+		return -1;
+	}
+	dhcp6_init_options(&optinfo);
+	if (dhcp6_get_options(p, ep, &optinfo) < 0) {
+		dprintf(LOG_INFO, "%s" "failed to parse options", FNAME);
+		STATS_DROP(DROP_OPTIONS);
+		goto done;
+	}
+	if (optinfo.clientID.duid_len == 0) {
+		dprintf(LOG_INFO, "%s" "no client ID option", FNAME);
+		STATS_DROP(DROP_CLIENTID);
+		goto done;
+	}
+	if (optinfo.serverID.duid_len != 0 &&
+	    duidcmp(&optinfo.serverID, bulk_serverid)) {
+		dprintf(LOG_INFO, "%s" "server ID %s mismatch", FNAME,
+			duidstr(&optinfo.serverID));
+		STATS_DROP(DROP_SERVERID);
+		goto done;
+	}
+
+	c->xid = ntohl(dh6->dh6_xid) & DH6_XIDMASK;
+	c->nrec = 0;
+	if (duidcpy(&c->requestor, &optinfo.clientID))
+		goto done;
+	lqlen = server6_lq_bulk(p, ep, lqbuf, lqbuf + sizeof(lqbuf), &c->cur);
+	if (lqlen < 0) {
+		dprintf(LOG_ERR, "%s" "failed to answer %s", FNAME,
+			addr2str((struct sockaddr *)&c->peer));
+		duidfree(&c->requestor);
+		goto done;
+	}
+	/* the records follow as the requestor takes them */
+	ret = c->cur.walk != LQC_IDLE ? 0 : bulk_end(c, lqbuf, lqlen);
+
+  done:
+	dhcp6_clear_options(&optinfo);
+	return ret;
+}
+
+static int
+bulk_reserve(c, len)
+	struct bulk_conn *c;
+	size_t len;
+{
+	size_t size;
+	char *out;
+
+	if (c->outlen + len <= c->outsize)
+		return 0;
+	for (size = c->outsize ? c->outsize : BUFSIZ;
+	     size < c->outlen + len; size *= 2)
+		;
+	if ((out = realloc(c->out, size)) == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to allocate memory", FNAME);
+		return -1;
+	}
+	c->out = out;
+	c->outsize = size;
+	return 0;
+}
+
+/*
+ * Queue a message: the client and server identifiers if clientid is
+ * given, then the options at a and b.
+ */
+static int
+bulk_msg(c, type, clientid, a, alen, b, blen)
+	struct bulk_conn *c;
+	int type;
+	struct duid *clientid;
+	char *a, *b;
+	int alen, blen;
+{
+	struct dhcp6opt opth;
+	u_int32_t x;
+	size_t len;
+	char *cp;
+
+	len = sizeof(struct dhcp6) + alen + blen;
+	if (clientid != NULL)
+		len += 2 * sizeof(opth) + clientid->duid_len +
+		    bulk_serverid->duid_len;
+	if (len > BULK_MAXMSG || bulk_reserve(c, 2 + len) < 0)
+		return -1;
+	cp = c->out + c->outlen;
+	*cp++ = len >> 8;
+	*cp++ = len & 0xff;
+	x = htonl((type << 24) | c->xid);
+	memcpy(cp, &x, sizeof(x));
+	cp += sizeof(x);
+	if (clientid != NULL) {
+		opth.dh6opt_type = htons(DH6OPT_CLIENTID);
+		opth.dh6opt_len = htons(clientid->duid_len);
+		memcpy(cp, &opth, sizeof(opth));
+		memcpy(cp + sizeof(opth), clientid->duid_id,
+		       clientid->duid_len);
+		cp += sizeof(opth) + clientid->duid_len;
+		opth.dh6opt_type = htons(DH6OPT_SERVERID);
+		opth.dh6opt_len = htons(bulk_serverid->duid_len);
+		memcpy(cp, &opth, sizeof(opth));
+		memcpy(cp + sizeof(opth), bulk_serverid->duid_id,
+		       bulk_serverid->duid_len);
+		cp += sizeof(opth) + bulk_serverid->duid_len;
+	}
+	if (alen > 0)
+		memcpy(cp, a, alen);
+	if (blen > 0)
+		memcpy(cp + alen, b, blen);
+	c->outlen += 2 + len;
+	server6_stats.tx[STATS_TYPE(type)]++;
+	return 0;
+}
+
+/* a client record from server6_lq_bulk(): the reply, then data */
+static int
+bulk_emit(arg, rec, len)
+	void *arg;
+	char *rec;
+	int len;
+{
+	struct bulk_conn *c = arg;
+
+	if (c->nrec++ == 0)
+		return bulk_msg(c, DH6_LQ_REPLY, &c->requestor, rec, len,
+				NULL, 0);
+	return bulk_msg(c, DH6_LQ_DATA, NULL, rec, len, NULL, 0);
+}
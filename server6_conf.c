@@ -50,6 +50,10 @@
 #define NMASK(n) htonl((1<<(n))-1)
 
 static void download_scope __P((struct scope *, struct scope *));
+static void free_scope __P((struct scope *));
+static struct domain_list *domain_list_copy __P((struct domain_list *));
+
+static int conf_error;	/* post_config() found the configuration wrong */
 
 int 
 ipv6addrcmp(addr1, addr2)
@@ -169,7 +173,7 @@ struct scopelist
 	return current;
 }
 
-void
+int
 post_config(root)
 	struct rootgroup *root;
 {
@@ -181,6 +185,7 @@ post_config(root)
 	struct scope *current;
 	struct scope *up;
 	
+	conf_error = 0;
 	if (root->group)
 		download_scope(root->group, &root->scope);
 	up = &root->scope;
@@ -226,7 +231,7 @@ post_config(root)
 							dprintf(LOG_ERR, "%s" 
 					"preferlife time is greater than validlife time",
 							    FNAME);
-							exit (1);
+							conf_error = 1;
 						}
 						memcpy(&seg->parainfo, current, 
 								sizeof(seg->parainfo));
@@ -250,7 +255,7 @@ post_config(root)
 							dprintf(LOG_ERR, "%s" 
 					"preferlife time is greater than validlife time",
 							    FNAME);
-							exit (1);
+							conf_error = 1;
 						}
 						memcpy(&prefix6->parainfo, current, 
 								sizeof(prefix6->parainfo));
@@ -261,7 +266,7 @@ post_config(root)
 				}
 			}
 	}
-	return;				
+	return (conf_error ? -1 : 0);
 }
 
 static void
@@ -279,7 +284,7 @@ download_scope(up, current)
 		current->rebind_time = up->rebind_time;
 	if (current->renew_time > current->rebind_time) {
 		dprintf(LOG_ERR, "dhcpv6 server defines T1 > T2");
-		exit(1);
+		conf_error = 1;
 	}
 	if (current->server_pref == 0 || current->server_pref == DH6OPT_PREF_UNDEF) {
 		if (up->server_pref != 0)
@@ -292,10 +297,31 @@ download_scope(up, current)
 	if (TAILQ_EMPTY(&current->dnslist.addrlist))
 		dhcp6_copy_list(&current->dnslist.addrlist, &up->dnslist.addrlist);
 	if (current->dnslist.domainlist == NULL)
-		current->dnslist.domainlist = up->dnslist.domainlist;
+		current->dnslist.domainlist =
+		    domain_list_copy(up->dnslist.domainlist);
 	return;
 }
 
+static struct domain_list *
+domain_list_copy(src)
+	struct domain_list *src;
+{
+	struct domain_list *head = NULL, **tail = &head, *dl;
+
+	for (; src; src = src->next) {
+		if ((dl = malloc(sizeof(*dl))) == NULL) {
+			dprintf(LOG_ERR, "%s" "memory allocation failed", FNAME);
+			conf_error = 1;
+			break;
+		}
+		strcpy(dl->name, src->name);
+		dl->next = NULL;
+		*tail = dl;
+		tail = &dl->next;
+	}
+	return (head);
+}
+
 int 
 is_anycast(struct in6_addr *in, int plen)
 {
@@ -323,3 +349,80 @@ is_anycast(struct in6_addr *in, int plen)
 	return (in->s6_addr32[3] | htonl(0x7f)) == (u_int32_t)~0;
 }
 
+
+/*
+ * Free a configuration replaced by server6_reload(), or one that failed
+ * to parse.  The group scopes are kept on the root, the declarations
+ * only point to them.
+ */
+void
+server6_conf_free(root)
+	struct rootgroup *root;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+	struct v6addrlist *relay;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+	struct pool_decl *pool;
+	struct host_decl *host;
+	struct scopelist *group;
+
+	while ((ifnetwork = root->iflist) != NULL) {
+		root->iflist = ifnetwork->next;
+		while ((link = ifnetwork->linklist) != NULL) {
+			ifnetwork->linklist = link->next;
+			while ((relay = link->relaylist) != NULL) {
+				link->relaylist = relay->next;
+				free(relay);
+			}
+			while ((seg = link->seglist) != NULL) {
+				link->seglist = seg->next;
+				free(seg);
+			}
+			while ((prefix6 = link->prefixlist) != NULL) {
+				link->prefixlist = prefix6->next;
+				free(prefix6);
+			}
+			while ((pool = link->poollist) != NULL) {
+				link->poollist = pool->next;
+				free_scope(&pool->poolscope);
+				free(pool);
+			}
+			free_scope(&link->linkscope);
+			free(link);
+		}
+		while ((host = ifnetwork->hostlist) != NULL) {
+			ifnetwork->hostlist = host->next;
+			duidfree(&host->cid);
+			dhcp6_clear_list(&host->addrlist);
+			dhcp6_clear_list(&host->prefixlist);
+			free_scope(&host->hostscope);
+			free(host);
+		}
+		free_scope(&ifnetwork->ifscope);
+		free(ifnetwork);
+	}
+	while ((group = root->grouplist) != NULL) {
+		root->grouplist = group->next;
+		free_scope(group->scope);
+		free(group->scope);
+		free(group);
+	}
+	free_scope(&root->scope);
+	free(root);
+}
+
+/* each scope has its own DNS servers and domains, see download_scope() */
+static void
+free_scope(scope)
+	struct scope *scope;
+{
+	struct domain_list *dl;
+
+	dhcp6_clear_list(&scope->dnslist.addrlist);
+	while ((dl = scope->dnslist.domainlist) != NULL) {
+		scope->dnslist.domainlist = dl->next;
+		free(dl);
+	}
+}
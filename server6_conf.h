@@ -62,6 +62,7 @@ struct rootgroup {
 	struct scope scope;
 	struct scope *group;
 	struct interface *iflist;
+	struct scopelist *grouplist;	/* every group scope, to free them */
 };
 
 struct v6addr {
@@ -100,6 +101,9 @@ struct link_decl {
 };
 
 
+/* addresses freed by expiry or release that a segment remembers for reuse */
+#define SEG_EXPIRED_MAX	64
+
 struct v6addrseg {
 	struct v6addrseg *next;
 	struct v6addrseg *prev;
@@ -109,9 +113,16 @@ struct v6addrseg {
 	struct in6_addr max;
 	struct in6_addr free;
 	struct v6addr prefix;
-	struct lease *active;
-	struct lease *expired;
-	struct lease *abandoned;
+	/* kept up to date as leases come and go, see server6_pool_sync() */
+	TAILQ_HEAD(, dhcp6_lease) active;
+	u_int64_t size;		/* addresses from min to max, saturated */
+	u_int64_t nactive;	/* leases of the range */
+	u_int64_t ntemp;	/* temporary addresses, from the whole prefix */
+	u_int64_t nabandoned;	/* addresses declined by clients */
+	/* ring of recently expired or released addresses, oldest first */
+	struct in6_addr expired[SEG_EXPIRED_MAX];
+	int expired_head;
+	int nexpired;
 	struct scope parainfo;
 };
 
@@ -121,6 +132,9 @@ struct v6prefix {
 	struct link_decl *link;
 	struct pool_decl *pool;
 	struct v6addr prefix;
+	/* kept up to date as leases come and go, see server6_pool_sync() */
+	TAILQ_HEAD(, dhcp6_lease) active;
+	u_int64_t nactive;	/* delegations of the prefix */
 	struct scope parainfo;
 };
 
@@ -131,6 +145,11 @@ struct pool_decl {
 	struct pool_decl *next;
 	struct interface *network;
 	struct link_decl *link;
+	/* sums over the ranges and prefixes of the pool */
+	u_int64_t size;
+	u_int64_t nactive;
+	u_int64_t ntemp;
+	u_int64_t nprefix;
 	struct scope poolscope;
 	struct scope *group;
 };
@@ -156,11 +175,16 @@ struct host_decl {
 
 int is_anycast __P((struct in6_addr *, int));	
 extern void printf_in6addr __P((struct in6_addr *));
-void post_config(struct rootgroup *);
+int post_config(struct rootgroup *);
+void server6_conf_free __P((struct rootgroup *));
 int sfparse __P((char *));
 int ipv6addrcmp __P((struct in6_addr *, struct in6_addr *));
 struct v6addr *getprefix __P((struct in6_addr *, int));
 struct in6_addr *inc_ipv6addr __P((struct in6_addr *));
+void server6_get_newaddr __P((iatype_t, struct dhcp6_addr *, struct v6addrseg *));
+void server6_pool_sync __P((struct rootgroup *));
+void server6_pool_inherit __P((struct rootgroup *, struct rootgroup *));
+void server6_pool_dump __P((FILE *));
 struct scopelist *push_double_list __P((struct scopelist *, struct scope *));
 struct scopelist *pop_double_list __P((struct scopelist *));
 int get_primary_ipv6addr __P((const char *device));
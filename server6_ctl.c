@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * The dhcp6s control socket: a UNIX stream socket that takes one command
+ * line per connection, writes the answer and closes it, e.g.
+ *
+ *	echo stats | socat - UNIX-CONNECT:/var/run/dhcp6s.ctl
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "server6_ctl.h"
+
+/* bounds how long a stalled peer can hold up the server */
+#define CTL_TIMEOUT_MSEC	200
+
+int
+server6_ctl_open(path)
+	const char *path;
+{
+	struct sockaddr_un sun;
+	int s;
+	mode_t mask;
+
+	if (strlen(path) >= sizeof(sun.sun_path)) {
+		dprintf(LOG_ERR, "%s" "control socket path too long: %s",
+			FNAME, path);
+		return -1;
+	}
+	if ((s = socket(PF_UNIX, SOCK_STREAM, 0)) < 0) {
+		dprintf(LOG_ERR, "%s" "socket: %s", FNAME, strerror(errno));
+		return -1;
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+	unlink(path);
+	/* the commands can change server state, keep it to root */
+	mask = umask(077);
+	if (bind(s, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+		umask(mask);
+		dprintf(LOG_ERR, "%s" "bind(%s): %s", FNAME, path,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	umask(mask);
+	if (listen(s, 8) < 0 || fcntl(s, F_SETFL, O_NONBLOCK) < 0) {
+		dprintf(LOG_ERR, "%s" "listen(%s): %s", FNAME, path,
+			strerror(errno));
+		close(s);
+		return -1;
+	}
+	return s;
+}
+
+/* answer one connection waiting on the listening socket */
+void
+server6_ctl_serve(s, cmds)
+	int s;
+	const struct server6_ctl_cmd *cmds;
+{
+	const struct server6_ctl_cmd *cmd;
+	struct timeval tv;
+	char line[256], *args;
+	FILE *fp;
+	size_t n;
+	int c;
+
+	if ((c = accept(s, NULL, NULL)) < 0) {
+		if (errno != EAGAIN && errno != EINTR)
+			dprintf(LOG_NOTICE, "%s" "accept: %s", FNAME,
+				strerror(errno));
+		return;
+	}
+	tv.tv_sec = 0;
+	tv.tv_usec = CTL_TIMEOUT_MSEC * 1000;
+	setsockopt(c, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(c, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	if ((fp = fdopen(c, "r+")) == NULL) {
+		close(c);
+		return;
+	}
+	if (fgets(line, sizeof(line), fp) == NULL) {
+		fclose(fp);
+		return;
+	}
+	n = strcspn(line, "\r\n");
+	line[n] = '\0';
+	n = strcspn(line, " \t");
+	args = line + n;
+	if (*args != '\0')
+		*args++ = '\0';
+	args += strspn(args, " \t");
+
+	/* an empty line asks for the first command */
+	for (cmd = cmds; cmd->name != NULL; cmd++) {
+		if (line[0] == '\0' || strcmp(line, cmd->name) == 0)
+			break;
+	}
+	/* a read and a write on the same stream need a positioning call */
+	fseek(fp, 0, SEEK_CUR);
+	if (cmd->name == NULL)
+		fprintf(fp, "error unknown command \"%s\"\n", line);
+	else {
+		dprintf(LOG_DEBUG, "%s" "control command %s", FNAME, cmd->name);
+		(*cmd->func)(fp, args);
+	}
+	fclose(fp);
+}
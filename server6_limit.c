@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Admission control: a token bucket for each client DUID, for each
+ * source of unrelayed messages and for each link-address relays
+ * forward from, each kind with its own rate and burst (dhcp6s -L or the
+ * "limit" control command; a rate of 0 leaves it unlimited).  A message
+ * that finds one of its buckets empty is dropped, before anything is
+ * allocated or parsed beyond the relay headers and the Client Identifier.
+ *
+ * The buckets of each kind live in a table of LIMIT_SLOTS, so a flood of
+ * made-up DUIDs costs no memory.  A key may sit in either of two slots;
+ * a new key takes whichever of them is idler, and if both are still in
+ * use it shares the idler with its holder, who then get limited
+ * together, as in a count-min sketch.  The hash is seeded from the
+ * system's random source at start up, so that colliding keys cannot be
+ * made up in advance.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <openssl/rand.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "timer.h"
+#include "server6_stats.h"
+#include "server6_limit.h"
+
+#define LIMIT_SLOTS	16384	/* a power of two */
+#define LIMIT_MAXHOPS	32	/* HOP_COUNT_LIMIT of RFC 3315 */
+#define LIMIT_TOKEN	1000	/* tokens are kept in thousandths */
+
+struct limit_bucket {
+	u_int32_t tag;		/* of the key, 0 if unused */
+	u_int32_t tokens;
+	dhcp6_time_t last;	/* when tokens was brought up to date */
+};
+
+struct limit_conf {
+	u_int32_t rate;		/* tokens a second */
+	u_int32_t burst;	/* tokens a bucket holds */
+};
+
+static const char *limit_kindstr[LIMIT_KINDS] = {
+	"client", "source", "link"
+};
+static const int limit_drop[LIMIT_KINDS] = {
+	DROP_LIMIT_CLIENT, DROP_LIMIT_SOURCE, DROP_LIMIT_LINK
+};
+
+static struct limit_conf limit_conf[LIMIT_KINDS];
+static int limit_on = 0;
+static struct limit_bucket *limit_table[LIMIT_KINDS];
+static u_int64_t limit_seed;
+static u_int64_t limit_shared;	/* keys that had to share a bucket */
+
+static u_int64_t limit_hash __P((const void *, int));
+static u_int32_t limit_refill __P((struct limit_bucket *,
+				   struct limit_conf *, dhcp6_time_t));
+static int limit_take __P((int, const void *, int));
+static int limit_parse __P((const char *, int *, struct limit_conf *));
+
+/* "kind=rate[/burst]", kind one of limit_kindstr */
+static int
+limit_parse(spec, kind, conf)
+	const char *spec;
+	int *kind;
+	struct limit_conf *conf;
+{
+	const char *eq;
+	char *ep;
+	unsigned long rate, burst;
+
+	if ((eq = strchr(spec, '=')) == NULL)
+		return (-1);
+	for (*kind = 0; *kind < LIMIT_KINDS; (*kind)++)
+		if (strlen(limit_kindstr[*kind]) == eq - spec &&
+		    strncmp(spec, limit_kindstr[*kind], eq - spec) == 0)
+			break;
+	if (*kind == LIMIT_KINDS)
+		return (-1);
+	if (strcmp(eq + 1, "off") == 0) {
+		conf->rate = conf->burst = 0;
+		return (0);
+	}
+	rate = strtoul(eq + 1, &ep, 10);
+	burst = rate;
+	if (*ep == '/')
+		burst = strtoul(ep + 1, &ep, 10);
+	if (*ep != '\0' || rate > 1000000 || burst > 1000000 ||
+	    (rate > 0 && burst == 0))
+		return (-1);
+	conf->rate = rate;
+	conf->burst = burst;
+	return (0);
+}
+
+int
+server6_limit_set(spec)
+	const char *spec;
+{
+	struct limit_conf conf;
+	int kind;
+
+	if (limit_parse(spec, &kind, &conf) < 0)
+		return (-1);
+	if (limit_table[kind] == NULL) {
+		limit_table[kind] = calloc(LIMIT_SLOTS, sizeof(**limit_table));
+		if (limit_table[kind] == NULL) {
+			dprintf(LOG_ERR, "%s" "memory allocation failed",
+				FNAME);
+			return (-1);
+		}
+	}
+	if (limit_seed == 0 &&
+	    RAND_bytes((u_char *)&limit_seed, sizeof(limit_seed)) != 1) {
+		dprintf(LOG_ERR, "%s" "failed to seed the limit hash", FNAME);
+		return (-1);
+	}
+	limit_conf[kind] = conf;
+	for (limit_on = 0, kind = 0; kind < LIMIT_KINDS; kind++)
+		if (limit_conf[kind].rate > 0)
+			limit_on = 1;
+	return (0);
+}
+
+/* FNV-1a over the seed and the key */
+static u_int64_t
+limit_hash(key, len)
+	const void *key;
+	int len;
+{
+	const u_char *p = key;
+	u_int64_t h = 14695981039346656037ULL ^ limit_seed;
+
+	while (len-- > 0)
+		h = (h ^ *p++) * 1099511628211ULL;
+	return (h);
+}
+
+static u_int32_t
+limit_refill(b, conf, now)
+	struct limit_bucket *b;
+	struct limit_conf *conf;
+	dhcp6_time_t now;
+{
+	u_int64_t add, max = (u_int64_t)conf->burst * LIMIT_TOKEN;
+
+	if (now > b->last) {
+		/* long idle buckets are full, whatever the rate */
+		if (now - b->last >= 1000 * DHCP6_NSEC)
+			add = max;
+		else
+			add = (now - b->last) * conf->rate /
+			    (DHCP6_NSEC / LIMIT_TOKEN);
+		b->tokens = b->tokens + add > max ? max : b->tokens + add;
+		b->last = now;
+	}
+	return (b->tokens);
+}
+
+/* take a token from the bucket of a key; -1 if it has none */
+static int
+limit_take(kind, key, len)
+	int kind;
+	const void *key;
+	int len;
+{
+	struct limit_conf *conf = &limit_conf[kind];
+	struct limit_bucket *b, *b2;
+	dhcp6_time_t now = dhcp6_now();
+	u_int64_t h;
+	u_int32_t tag;
+
+	if (conf->rate == 0)
+		return (0);
+	h = limit_hash(key, len);
+	tag = (u_int32_t)(h >> 32) | 1;
+	b = &limit_table[kind][h & (LIMIT_SLOTS - 1)];
+	b2 = &limit_table[kind][(h >> 16) & (LIMIT_SLOTS - 1)];
+	if (b->tag != tag && b2->tag == tag)
+		b = b2;
+	else if (b->tag != tag) {
+		/* a new key: the idler slot, or share it if busy */
+		if (b->tag != 0 && (b2->tag == 0 ||
+		    limit_refill(b2, conf, now) > limit_refill(b, conf, now)))
+			b = b2;
+		if (b->tag == 0 ||
+		    limit_refill(b, conf, now) == conf->burst * LIMIT_TOKEN) {
+			b->tag = tag;
+			b->tokens = conf->burst * LIMIT_TOKEN;
+			b->last = now;
+		} else
+			limit_shared++;
+	}
+	if (limit_refill(b, conf, now) < LIMIT_TOKEN)
+		return (-1);
+	b->tokens -= LIMIT_TOKEN;
+	return (0);
+}
+
+/*
+ * Whether a message gets in: -1 if it does, otherwise the reason to
+ * count it dropped for.  Malformed messages get in, to be dropped as such.
+ */
+int
+server6_limit_check(buf, len, from)
+	char *buf;
+	ssize_t len;
+	struct sockaddr *from;
+{
+	struct dhcp6_relay *relay = NULL;
+	struct dhcp6opt opth;
+	char *cp = buf, *ep = buf + len, *msg;
+	u_int16_t type, optlen;
+	int hops;
+
+	if (!limit_on)
+		return (-1);
+	/* down to the client message, and the first relay */
+	for (hops = 0; ep - cp >= sizeof(*relay) &&
+	     *cp == DH6_RELAY_FORW && hops <= LIMIT_MAXHOPS; hops++) {
+		relay = (struct dhcp6_relay *)cp;
+		for (msg = NULL, cp += sizeof(*relay);
+		     ep - cp >= sizeof(opth); cp += sizeof(opth) + optlen) {
+			memcpy(&opth, cp, sizeof(opth));
+			type = ntohs(opth.dh6opt_type);
+			optlen = ntohs(opth.dh6opt_len);
+			if (optlen > ep - cp - sizeof(opth))
+				return (-1);
+			if (type == DH6OPT_RELAY_MSG) {
+				msg = cp + sizeof(opth);
+				ep = msg + optlen;
+				break;
+			}
+		}
+		if ((cp = msg) == NULL)
+			return (-1);
+	}
+	/* the client first, so that one flooding it spares its link */
+	if (limit_conf[LIMIT_CLIENT].rate > 0 &&
+	    ep - cp >= sizeof(struct dhcp6)) {
+		for (msg = cp + sizeof(struct dhcp6); ep - msg >= sizeof(opth);
+		     msg += sizeof(opth) + optlen) {
+			memcpy(&opth, msg, sizeof(opth));
+			type = ntohs(opth.dh6opt_type);
+			optlen = ntohs(opth.dh6opt_len);
+			if (optlen > ep - msg - sizeof(opth))
+				break;
+			if (type != DH6OPT_CLIENTID)
+				continue;
+			if (limit_take(LIMIT_CLIENT, msg + sizeof(opth),
+				       optlen) < 0)
+				return (limit_drop[LIMIT_CLIENT]);
+			break;
+		}
+	}
+	if (relay != NULL) {
+		if (limit_take(LIMIT_LINK, &relay->link_addr,
+			       sizeof(relay->link_addr)) < 0)
+			return (limit_drop[LIMIT_LINK]);
+	} else if (limit_take(LIMIT_SOURCE,
+		   &((struct sockaddr_in6 *)from)->sin6_addr,
+		   sizeof(struct in6_addr)) < 0)
+		return (limit_drop[LIMIT_SOURCE]);
+	return (-1);
+}
+
+/*
+ * The "limit" control command reports the limits, or with
+ * "kind=rate[/burst]" or "kind=off" first changes one.
+ */
+void
+server6_limit_ctl(fp, args)
+	FILE *fp;
+	char *args;
+{
+	int kind;
+
+	if (*args != '\0') {
+		if (server6_limit_set(args) < 0) {
+			fprintf(fp, "error bad argument \"%s\"\n", args);
+			return;
+		}
+		dprintf(LOG_NOTICE, "%s" "limit %s", FNAME, args);
+	}
+	for (kind = 0; kind < LIMIT_KINDS; kind++) {
+		fprintf(fp, "dhcp6s_limit_rate{key=\"%s\"} %u\n",
+		    limit_kindstr[kind], limit_conf[kind].rate);
+		fprintf(fp, "dhcp6s_limit_burst{key=\"%s\"} %u\n",
+		    limit_kindstr[kind], limit_conf[kind].burst);
+		fprintf(fp, "dhcp6s_limit_drop_total{key=\"%s\"} %llu\n",
+		    limit_kindstr[kind], (unsigned long long)
+		    server6_stats.drop[limit_drop[kind]]);
+	}
+	fprintf(fp, "dhcp6s_limit_shared_total %llu\n",
+	    (unsigned long long)limit_shared);
+}
@@ -0,0 +1,791 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Leasequery, RFC 5007: who holds an address, and what does a DUID hold.
+ * Queries are answered from the lease table, the DUID index, the
+ * Relay-ID index and the lease lists each range and prefix of a link
+ * keeps; only a bulk query for every binding walks them all.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "server6_conf.h"
+#include "lease.h"
+#include "hash.h"
+#include "server6_lq.h"
+
+/* links a DUID can be reported on in an OPTION_LQ_CLIENT_LINK */
+#define LQ_MAXLINKS	16
+
+static char *lq_put_option __P((char *, char *, int, const void *, int));
+static char *lq_status __P((char *, char *, int, const char *));
+static struct link_decl *lq_find_link __P((struct in6_addr *));
+static int lq_link_addr __P((struct link_decl *, struct in6_addr *));
+static struct link_decl *lq_lease_link __P((struct dhcp6_lease *));
+static struct dhcp6_lease *lq_find_lease __P((struct in6_addr *,
+					      struct link_decl *));
+static char *lq_lease __P((char *, char *, struct dhcp6_lease *));
+static char *lq_client_data __P((char *, char *, struct duid *,
+				 struct dhcp6_client *, struct dhcp6_iaidaddr *,
+				 struct link_decl *, struct duid *));
+static char *lq_client_links __P((char *, char *, struct dhcp6_client *,
+				  int *));
+static struct dhcp6_lease *lq_first_lease __P((struct dhcp6_client *,
+					       struct link_decl *,
+					       struct duid *));
+static int lq_bulk_client __P((struct dhcp6_client *, struct link_decl *,
+			       struct duid *,
+			       int (*) __P((void *, char *, int)), void *));
+static void lq_cursor_seek __P((struct lq_cursor *));
+
+/* the bulk queries still walking, see server6_lq_forget_lease() */
+static TAILQ_HEAD(, lq_cursor) lq_cursors = TAILQ_HEAD_INITIALIZER(lq_cursors);
+
+/* append one option; NULL when it does not fit */
+static char *
+lq_put_option(bp, ep, type, data, len)
+	char *bp, *ep;
+	int type;
+	const void *data;
+	int len;
+{
+	struct dhcp6opt opth;
+
+	if (bp == NULL || ep - bp < (int)sizeof(opth) + len)
+		return (NULL);
+	opth.dh6opt_type = htons(type);
+	opth.dh6opt_len = htons(len);
+	memcpy(bp, &opth, sizeof(opth));
+	if (len > 0)
+		memcpy(bp + sizeof(opth), data, len);
+	return (bp + sizeof(opth) + len);
+}
+
+static char *
+lq_status(bp, ep, code, msg)
+	char *bp, *ep;
+	int code;
+	const char *msg;
+{
+	char buf[2 + 128];
+	u_int16_t val16 = htons(code);
+	int len = strlen(msg);
+
+	if (len > sizeof(buf) - 2)
+		len = sizeof(buf) - 2;
+	memcpy(buf, &val16, 2);
+	memcpy(buf + 2, msg, len);
+	dprintf(LOG_DEBUG, "%s" "leasequery status %d: %s", FNAME, code, msg);
+	return lq_put_option(bp, ep, DH6OPT_STATUS_CODE, buf, 2 + len);
+}
+
+/* the configured link an address (usually a relay's link-address) is on */
+static struct link_decl *
+lq_find_link(addr)
+	struct in6_addr *addr;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+	struct v6addrlist *relay;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix6;
+
+	if (globalgroup == NULL)
+		return (NULL);
+	for (ifnetwork = globalgroup->iflist; ifnetwork;
+	     ifnetwork = ifnetwork->next) {
+		for (link = ifnetwork->linklist; link; link = link->next) {
+			for (relay = link->relaylist; relay; relay = relay->next)
+				if (!prefixcmp(addr, &relay->v6addr.addr,
+					       relay->v6addr.plen))
+					return (link);
+			for (seg = link->seglist; seg; seg = seg->next)
+				if (!prefixcmp(addr, &seg->prefix.addr,
+					       seg->prefix.plen))
+					return (link);
+			for (prefix6 = link->prefixlist; prefix6;
+			     prefix6 = prefix6->next)
+				if (!prefixcmp(addr, &prefix6->prefix.addr,
+					       prefix6->prefix.plen))
+					return (link);
+		}
+	}
+	return (NULL);
+}
+
+/* an address that names the link, for OPTION_LQ_CLIENT_LINK */
+static int
+lq_link_addr(link, addr)
+	struct link_decl *link;
+	struct in6_addr *addr;
+{
+	if (link->relaylist != NULL)
+		*addr = link->relaylist->v6addr.addr;
+	else if (link->seglist != NULL)
+		*addr = link->seglist->prefix.addr;
+	else if (link->prefixlist != NULL)
+		*addr = link->prefixlist->prefix.addr;
+	else
+		return (-1);
+	return (0);
+}
+
+static struct link_decl *
+lq_lease_link(lease)
+	struct dhcp6_lease *lease;
+{
+	if (lease->seg != NULL)
+		return (lease->seg->link);
+	if (lease->prefix != NULL)
+		return (lease->prefix->link);
+	return (NULL);
+}
+
+/*
+ * The lease of an address: the address itself, or else a delegated
+ * prefix that contains it.
+ */
+static struct dhcp6_lease *
+lq_find_lease(addr, link)
+	struct in6_addr *addr;
+	struct link_decl *link;
+{
+	struct interface *ifnetwork;
+	struct link_decl *l;
+	struct v6prefix *prefix6;
+	struct dhcp6_addr key;
+	struct dhcp6_lease *lease;
+
+	memset(&key, 0, sizeof(key));
+	key.addr = *addr;
+	key.type = IANA;
+	if ((lease = hash_search(lease_hash_table, &key)) != NULL)
+		return (lease);
+	key.type = IAPD;
+	for (ifnetwork = globalgroup ? globalgroup->iflist : NULL; ifnetwork;
+	     ifnetwork = ifnetwork->next) {
+		for (l = ifnetwork->linklist; l; l = l->next) {
+			if (link != NULL && l != link)
+				continue;
+			for (prefix6 = l->prefixlist; prefix6;
+			     prefix6 = prefix6->next) {
+				if (prefixcmp(addr, &prefix6->prefix.addr,
+					      prefix6->prefix.plen))
+					continue;
+				key.addr = prefix6->prefix.addr;
+				key.plen = prefix6->prefix.plen;
+				if ((lease = hash_search(lease_hash_table,
+							 &key)) != NULL)
+					return (lease);
+			}
+		}
+	}
+	return (NULL);
+}
+
+/* an OPTION_IAADDR or OPTION_IAPREFIX with the lifetimes last granted */
+static char *
+lq_lease(bp, ep, lease)
+	char *bp, *ep;
+	struct dhcp6_lease *lease;
+{
+	struct dhcp6_addr *a = &lease->lease_addr;
+	char buf[25];
+	u_int32_t val32;
+
+	if (a->type == IAPD) {
+		val32 = htonl(a->preferlifetime);
+		memcpy(buf, &val32, 4);
+		val32 = htonl(a->validlifetime);
+		memcpy(buf + 4, &val32, 4);
+		buf[8] = a->plen;
+		memcpy(buf + 9, &a->addr, 16);
+		return lq_put_option(bp, ep, DH6OPT_IAPREFIX, buf, 25);
+	}
+	memcpy(buf, &a->addr, 16);
+	val32 = htonl(a->preferlifetime);
+	memcpy(buf + 16, &val32, 4);
+	val32 = htonl(a->validlifetime);
+	memcpy(buf + 20, &val32, 4);
+	return lq_put_option(bp, ep, DH6OPT_IADDR, buf, 24);
+}
+
+/*
+ * OPTION_CLIENT_DATA with the leases a client holds on a link (on any
+ * link if link is NULL), taken from all its bindings or just one, and
+ * only from those behind the relay relayid if that is given.  Writes
+ * nothing when there are none.
+ */
+static char *
+lq_client_data(bp, ep, duid, client, iaidaddr, link, relayid)
+	char *bp, *ep;
+	struct duid *duid;
+	struct dhcp6_client *client;
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct link_decl *link;
+	struct duid *relayid;
+{
+	struct dhcp6_lease *lease;
+	struct dhcp6opt opth;
+	char *cp, *start = bp;
+	time_t last = 0;
+	u_int32_t val32;
+	int n = 0;
+
+	if (client != NULL)
+		iaidaddr = TAILQ_FIRST(&client->iaidaddr_list);
+	if (ep - bp < (int)sizeof(opth))
+		return (NULL);
+	cp = lq_put_option(bp + sizeof(opth), ep, DH6OPT_CLIENTID,
+			   duid->duid_id, duid->duid_len);
+	for (; iaidaddr; iaidaddr = client ?
+	     TAILQ_NEXT(iaidaddr, clientlink) : NULL) {
+		if (relayid != NULL && duidcmp(&iaidaddr->relayid, relayid))
+			continue;
+		for (lease = TAILQ_FIRST(&iaidaddr->lease_list); lease;
+		     lease = TAILQ_NEXT(lease, link)) {
+			if (link != NULL && lq_lease_link(lease) != link)
+				continue;
+			cp = lq_lease(cp, ep, lease);
+			if (lease->start_date > last)
+				last = lease->start_date;
+			n++;
+		}
+	}
+	if (n == 0)
+		return (start);
+	/* seconds since the client last talked to us */
+	val32 = htonl(time(NULL) > last ? time(NULL) - last : 0);
+	cp = lq_put_option(cp, ep, DH6OPT_CLT_TIME, &val32, 4);
+	if (cp == NULL)
+		return (NULL);
+	opth.dh6opt_type = htons(DH6OPT_CLIENT_DATA);
+	opth.dh6opt_len = htons(cp - start - sizeof(opth));
+	memcpy(start, &opth, sizeof(opth));
+	return (cp);
+}
+
+/*
+ * OPTION_LQ_CLIENT_LINK when the client holds leases on more than one
+ * link; *nlinks tells how many links it holds leases on.
+ */
+static char *
+lq_client_links(bp, ep, client, nlinks)
+	char *bp, *ep;
+	struct dhcp6_client *client;
+	int *nlinks;
+{
+	struct link_decl *links[LQ_MAXLINKS], *link;
+	struct in6_addr addrs[LQ_MAXLINKS];
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_lease *lease;
+	int i, n = 0;
+
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink) {
+		TAILQ_FOREACH(lease, &iaidaddr->lease_list, link) {
+			if ((link = lq_lease_link(lease)) == NULL)
+				continue;
+			for (i = 0; i < n; i++)
+				if (links[i] == link)
+					break;
+			if (i == n && n < LQ_MAXLINKS)
+				links[n++] = link;
+		}
+	}
+	*nlinks = n;
+	if (n < 2)
+		return (bp);
+	for (i = 0; i < n; i++)
+		lq_link_addr(links[i], &addrs[i]);
+	return lq_put_option(bp, ep, DH6OPT_LQ_CLIENT_LINK, addrs,
+			     n * sizeof(addrs[0]));
+}
+
+/*
+ * Answer the OPTION_LQ_QUERY among the options p..ep of a LEASEQUERY:
+ * write the options of the LEASEQUERY-REPLY, other than the client and
+ * server identifiers, to bp..ebp.  Returns their length, -1 if they do
+ * not fit.
+ */
+int
+server6_lq_options(p, ep, bp, ebp)
+	struct dhcp6opt *p, *ep;
+	char *bp, *ebp;
+{
+	struct dhcp6opt opth, *np, *qp = NULL, *qep;
+	struct in6_addr linkaddr, addr;
+	struct link_decl *link = NULL;
+	struct dhcp6_lease *lease;
+	struct dhcp6_client *client;
+	struct duid duid;
+	char *cp, *qcp;
+	int qtype, optlen, nlinks, have = 0;
+
+	/* find the query */
+	for (; p + 1 <= ep; p = np) {
+		memcpy(&opth, p, sizeof(opth));
+		np = (struct dhcp6opt *)((char *)(p + 1) +
+					 ntohs(opth.dh6opt_len));
+		if (np > ep)
+			break;
+		if (ntohs(opth.dh6opt_type) == DH6OPT_LQ_QUERY) {
+			qp = p;
+			break;
+		}
+	}
+	optlen = qp ? ntohs(opth.dh6opt_len) : 0;
+	if (qp == NULL || optlen < 1 + sizeof(linkaddr)) {
+		cp = lq_status(bp, ebp, DH6OPT_STCODE_MALFORMEDQUERY,
+			       "no query");
+		return (cp ? cp - bp : -1);
+	}
+	qcp = (char *)(qp + 1);
+	qtype = *(u_int8_t *)qcp;
+	memcpy(&linkaddr, qcp + 1, sizeof(linkaddr));
+	qep = (struct dhcp6opt *)(qcp + optlen);
+	if (!IN6_IS_ADDR_UNSPECIFIED(&linkaddr) &&
+	    (link = lq_find_link(&linkaddr)) == NULL) {
+		cp = lq_status(bp, ebp, DH6OPT_STCODE_NOTCONFIGURED,
+			       "link not configured");
+		return (cp ? cp - bp : -1);
+	}
+
+	/* the query options carry what is looked for */
+	for (p = (struct dhcp6opt *)(qcp + 1 + sizeof(linkaddr));
+	     p + 1 <= qep && !have; p = np) {
+		memcpy(&opth, p, sizeof(opth));
+		optlen = ntohs(opth.dh6opt_len);
+		np = (struct dhcp6opt *)((char *)(p + 1) + optlen);
+		if (np > qep)
+			break;
+		switch (ntohs(opth.dh6opt_type)) {
+		case DH6OPT_IADDR:
+			if (qtype != LQ_QUERY_BY_ADDRESS ||
+			    optlen < sizeof(addr) + 8)
+				break;
+			memcpy(&addr, p + 1, sizeof(addr));
+			have = 1;
+			break;
+		case DH6OPT_CLIENTID:
+			if (qtype != LQ_QUERY_BY_CLIENTID || optlen == 0 ||
+			    optlen > 255)
+				break;
+			duid.duid_len = optlen;
+			duid.duid_id = (char *)(p + 1);
+			have = 1;
+			break;
+		}
+	}
+
+	cp = bp;
+	switch (qtype) {
+	case LQ_QUERY_BY_ADDRESS:
+		if (!have) {
+			cp = lq_status(cp, ebp, DH6OPT_STCODE_MALFORMEDQUERY,
+				       "no address");
+			break;
+		}
+		dprintf(LOG_DEBUG, "%s" "leasequery for address %s", FNAME,
+			in6addr2str(&addr, 0));
+		lease = lq_find_lease(&addr, link);
+		if (lease == NULL ||
+		    (link != NULL && lq_lease_link(lease) != link))
+			break;
+		client = lease->iaidaddr->client;
+		cp = lq_client_data(cp, ebp,
+				    &lease->iaidaddr->client6_info.clientid,
+				    client, lease->iaidaddr, lq_lease_link(lease),
+				    NULL);
+		break;
+	case LQ_QUERY_BY_CLIENTID:
+		if (!have) {
+			cp = lq_status(cp, ebp, DH6OPT_STCODE_MALFORMEDQUERY,
+				       "no client identifier");
+			break;
+		}
+		dprintf(LOG_DEBUG, "%s" "leasequery for client %s", FNAME,
+			duidstr(&duid));
+		if ((client = dhcp6_find_client(&duid)) == NULL)
+			break;
+		if (link == NULL) {
+			cp = lq_client_links(cp, ebp, client, &nlinks);
+			if (nlinks > 1)
+				break;
+		}
+		cp = lq_client_data(cp, ebp, &duid, client, NULL, link, NULL);
+		break;
+	default:
+		cp = lq_status(cp, ebp, DH6OPT_STCODE_UNKNOWNQUERYTYPE,
+			       "unknown query type");
+		break;
+	}
+	return (cp ? cp - bp : -1);
+}
+
+/* whether "allow leasequery" covers a requestor at addr */
+int
+server6_lq_allowed(addr)
+	struct in6_addr *addr;
+{
+	struct link_decl *link;
+	struct scope *scope;
+
+	if (globalgroup == NULL)
+		return (0);
+	if ((link = lq_find_link(addr)) != NULL)
+		scope = &link->linkscope;
+	else
+		scope = &globalgroup->scope;
+	return ((scope->allow_flags & DHCIFF_LEASEQUERY) != 0);
+}
+
+/*
+ * The first lease, in the order of its bindings, that client holds on
+ * link behind relay rid, either of which may be NULL for any.  A bulk
+ * query reaches a client once per binding or lease, and sends it only
+ * from this one.
+ */
+static struct dhcp6_lease *
+lq_first_lease(client, link, rid)
+	struct dhcp6_client *client;
+	struct link_decl *link;
+	struct duid *rid;
+{
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_lease *lease;
+
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink) {
+		if (rid != NULL && duidcmp(&iaidaddr->relayid, rid))
+			continue;
+		TAILQ_FOREACH(lease, &iaidaddr->lease_list, link) {
+			if (link == NULL || lq_lease_link(lease) == link)
+				return (lease);
+		}
+	}
+	return (NULL);
+}
+
+/* hand the OPTION_CLIENT_DATA of one client of a bulk query to emit() */
+static int
+lq_bulk_client(client, link, rid, emit, arg)
+	struct dhcp6_client *client;
+	struct link_decl *link;
+	struct duid *rid;
+	int (*emit) __P((void *, char *, int));
+	void *arg;
+{
+	char rec[BUFSIZ], *cp;
+
+	cp = lq_client_data(rec, rec + sizeof(rec), &client->clientid,
+			    client, NULL, link, rid);
+	if (cp == NULL) {
+		dprintf(LOG_INFO, "%s" "client %s has more leases than fit "
+			"a message", FNAME, duidstr(&client->clientid));
+		return (0);
+	}
+	if (cp > rec && (*emit)(arg, rec, cp - rec) < 0)
+		return (-1);
+	return (0);
+}
+
+/*
+ * Answer the OPTION_LQ_QUERY of a bulk leasequery (RFC 5460).  Queries
+ * by address or client are answered as over UDP, in the options written
+ * to bp..ebp.  A query by relay or link only sets up cur, leaving cur->walk
+ * other than LQC_IDLE; server6_lq_bulk_next() then takes the clients one
+ * at a time, through the Relay-ID index or the leases of the link, and
+ * server6_lq_bulk_done() says how the query ended.  Link-address ::
+ * asks for every client.  Returns the length of the options at bp..ebp,
+ * -1 if they do not fit.
+ */
+int
+server6_lq_bulk(p, ep, bp, ebp, cur)
+	struct dhcp6opt *p, *ep;
+	char *bp, *ebp;
+	struct lq_cursor *cur;
+{
+	struct dhcp6opt opth, *np, *qp = NULL, *qep;
+	struct in6_addr linkaddr;
+	struct link_decl *link = NULL;
+	struct dhcp6_relayagent *relay;
+	struct duid relayid, *rid = NULL;
+	char *cp;
+	int qtype, optlen;
+
+	for (np = p; np + 1 <= ep; np = (struct dhcp6opt *)((char *)(np + 1) +
+	     ntohs(opth.dh6opt_len))) {
+		memcpy(&opth, np, sizeof(opth));
+		if (ntohs(opth.dh6opt_type) == DH6OPT_LQ_QUERY) {
+			qp = np;
+			break;
+		}
+	}
+	if (qp == NULL || ntohs(opth.dh6opt_len) < 1 + sizeof(linkaddr) ||
+	    (char *)(qp + 1) + ntohs(opth.dh6opt_len) > (char *)ep)
+		return server6_lq_options(p, ep, bp, ebp);
+	qtype = *(u_int8_t *)(qp + 1);
+	if (qtype != LQ_QUERY_BY_RELAYID && qtype != LQ_QUERY_BY_LINK_ADDRESS)
+		return server6_lq_options(p, ep, bp, ebp);
+
+	memcpy(&linkaddr, (char *)(qp + 1) + 1, sizeof(linkaddr));
+	qep = (struct dhcp6opt *)((char *)(qp + 1) + ntohs(opth.dh6opt_len));
+	if (!IN6_IS_ADDR_UNSPECIFIED(&linkaddr) &&
+	    (link = lq_find_link(&linkaddr)) == NULL) {
+		cp = lq_status(bp, ebp, DH6OPT_STCODE_NOTCONFIGURED,
+			       "link not configured");
+		return (cp ? cp - bp : -1);
+	}
+	if (qtype == LQ_QUERY_BY_RELAYID) {
+		for (p = (struct dhcp6opt *)((char *)(qp + 1) + 1 +
+		     sizeof(linkaddr)); p + 1 <= qep; p = np) {
+			memcpy(&opth, p, sizeof(opth));
+			optlen = ntohs(opth.dh6opt_len);
+			np = (struct dhcp6opt *)((char *)(p + 1) + optlen);
+			if (np > qep)
+				break;
+			if (ntohs(opth.dh6opt_type) == DH6OPT_RELAY_ID &&
+			    optlen > 0 && optlen <= 255) {
+				relayid.duid_len = optlen;
+				relayid.duid_id = (char *)(p + 1);
+				rid = &relayid;
+				break;
+			}
+		}
+		if (rid == NULL) {
+			cp = lq_status(bp, ebp, DH6OPT_STCODE_MALFORMEDQUERY,
+				       "no relay identifier");
+			return (cp ? cp - bp : -1);
+		}
+		dprintf(LOG_DEBUG, "%s" "bulk leasequery for relay %s", FNAME,
+			duidstr(rid));
+	} else
+		dprintf(LOG_DEBUG, "%s" "bulk leasequery for link %s", FNAME,
+			in6addr2str(&linkaddr, 0));
+
+	memset(cur, 0, sizeof(*cur));
+	cur->link = link;
+	if (rid != NULL) {
+		if (duidcpy(&cur->relayid, rid))
+			return (-1);
+		if ((relay = dhcp6_find_relay(rid)) != NULL)
+			cur->iaidaddr = TAILQ_FIRST(&relay->iaidaddr_list);
+		cur->walk = LQC_RELAY;
+	} else if (link != NULL) {
+		if ((cur->seg = link->seglist) != NULL)
+			cur->lease = TAILQ_FIRST(&cur->seg->active);
+		else if ((cur->prefix = link->prefixlist) != NULL)
+			cur->lease = TAILQ_FIRST(&cur->prefix->active);
+		cur->walk = LQC_LINK;
+	} else {
+		cur->client = TAILQ_FIRST(&server6_clients);
+		cur->walk = LQC_ALL;
+	}
+	TAILQ_INSERT_TAIL(&lq_cursors, cur, chain);
+	return (0);
+}
+
+/* move a cursor by link on to the next range or prefix with a lease */
+static void
+lq_cursor_seek(cur)
+	struct lq_cursor *cur;
+{
+	while (cur->lease == NULL) {
+		if (cur->seg != NULL) {
+			if ((cur->seg = cur->seg->next) == NULL)
+				cur->prefix = cur->link->prefixlist;
+		} else if (cur->prefix != NULL)
+			cur->prefix = cur->prefix->next;
+		else
+			return;
+		if (cur->seg != NULL)
+			cur->lease = TAILQ_FIRST(&cur->seg->active);
+		else if (cur->prefix != NULL)
+			cur->lease = TAILQ_FIRST(&cur->prefix->active);
+	}
+}
+
+/*
+ * Take the next client of a bulk query and hand its OPTION_CLIENT_DATA
+ * to emit(), if it has one; a client is taken at the first of its
+ * bindings behind the relay, or of its leases on the link, that the
+ * walk comes to.  Returns 1 while there are more to look at, 0 at the
+ * end, -1 if emit() failed.
+ */
+int
+server6_lq_bulk_next(cur, emit, arg)
+	struct lq_cursor *cur;
+	int (*emit) __P((void *, char *, int));
+	void *arg;
+{
+	struct dhcp6_client *client = NULL;
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_lease *lease;
+	struct duid *rid;
+
+	rid = cur->relayid.duid_len != 0 ? &cur->relayid : NULL;
+	switch (cur->walk) {
+	case LQC_RELAY:
+		if ((iaidaddr = cur->iaidaddr) == NULL)
+			break;
+		cur->iaidaddr = TAILQ_NEXT(iaidaddr, relaylink);
+		if (iaidaddr->client != NULL &&
+		    (lease = lq_first_lease(iaidaddr->client, cur->link,
+					    rid)) != NULL &&
+		    lease->iaidaddr == iaidaddr)
+			client = iaidaddr->client;
+		return (client == NULL ||
+			lq_bulk_client(client, cur->link, rid, emit, arg) == 0 ?
+			1 : -1);
+	case LQC_LINK:
+		lq_cursor_seek(cur);
+		if ((lease = cur->lease) == NULL)
+			break;
+		cur->lease = TAILQ_NEXT(lease, seglink);
+		if (lease->iaidaddr->client != NULL &&
+		    lq_first_lease(lease->iaidaddr->client, cur->link,
+				   NULL) == lease)
+			client = lease->iaidaddr->client;
+		return (client == NULL ||
+			lq_bulk_client(client, cur->link, NULL, emit, arg) == 0 ?
+			1 : -1);
+	case LQC_ALL:
+		if ((client = cur->client) == NULL)
+			break;
+		cur->client = TAILQ_NEXT(client, link);
+		return (lq_bulk_client(client, NULL, NULL, emit, arg) == 0 ?
+			1 : -1);
+	default:
+		return (0);
+	}
+	cur->walk = LQC_DONE;
+	return (0);
+}
+
+/*
+ * Finish a bulk query: write the options that end it to bp..ebp.
+ * Returns their length, -1 if they do not fit.
+ */
+int
+server6_lq_bulk_done(cur, bp, ebp)
+	struct lq_cursor *cur;
+	char *bp, *ebp;
+{
+	char *cp;
+
+	if (cur->walk == LQC_TERMINATED)
+		cp = lq_status(bp, ebp, DH6OPT_STCODE_QUERYTERMINATED,
+			       "configuration reloaded");
+	else
+		cp = lq_status(bp, ebp, DH6OPT_STCODE_SUCCESS, "");
+	server6_lq_bulk_stop(cur);
+	return (cp ? cp - bp : -1);
+}
+
+/* drop a bulk query wherever it stands */
+void
+server6_lq_bulk_stop(cur)
+	struct lq_cursor *cur;
+{
+	if (cur->walk == LQC_IDLE)
+		return;
+	TAILQ_REMOVE(&lq_cursors, cur, chain);
+	if (cur->relayid.duid_len != 0)
+		duidfree(&cur->relayid);
+	cur->walk = LQC_IDLE;
+}
+
+/* a lease leaves the range or prefix it was counted in */
+void
+server6_lq_forget_lease(lease)
+	struct dhcp6_lease *lease;
+{
+	struct lq_cursor *cur;
+
+	TAILQ_FOREACH(cur, &lq_cursors, chain) {
+		if (cur->walk == LQC_LINK && cur->lease == lease)
+			cur->lease = TAILQ_NEXT(lease, seglink);
+	}
+}
+
+/* a binding leaves its relay */
+void
+server6_lq_forget_binding(iaidaddr)
+	struct dhcp6_iaidaddr *iaidaddr;
+{
+	struct lq_cursor *cur;
+
+	TAILQ_FOREACH(cur, &lq_cursors, chain) {
+		if (cur->walk == LQC_RELAY && cur->iaidaddr == iaidaddr)
+			cur->iaidaddr = TAILQ_NEXT(iaidaddr, relaylink);
+	}
+}
+
+/* a client loses its last binding */
+void
+server6_lq_forget_client(client)
+	struct dhcp6_client *client;
+{
+	struct lq_cursor *cur;
+
+	TAILQ_FOREACH(cur, &lq_cursors, chain) {
+		if (cur->walk == LQC_ALL && cur->client == client)
+			cur->client = TAILQ_NEXT(client, link);
+	}
+}
+
+/*
+ * The links, ranges and prefixes of the old configuration go away with
+ * it, so the queries that were walking or filtering by link end here.
+ */
+void
+server6_lq_reload()
+{
+	struct lq_cursor *cur;
+
+	TAILQ_FOREACH(cur, &lq_cursors, chain) {
+		if (cur->link != NULL && cur->walk != LQC_DONE) {
+			cur->walk = LQC_TERMINATED;
+			cur->link = NULL;
+		}
+	}
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __SERVER6_LQ_H_DEFINED
+#define __SERVER6_LQ_H_DEFINED
+
+/*
+ * Where a bulk leasequery stands between two client records.  The
+ * bindings, leases and clients it points to may go away meanwhile; the
+ * server6_lq_forget_*() hooks move it on before they do.
+ */
+struct lq_cursor {
+	TAILQ_ENTRY(lq_cursor) chain;	/* in the cursors still walking */
+	int walk;
+#define LQC_IDLE	0
+#define LQC_RELAY	1	/* the bindings behind relayid */
+#define LQC_LINK	2	/* the leases of the ranges and prefixes of link */
+#define LQC_ALL		3	/* every client */
+#define LQC_DONE	4
+#define LQC_TERMINATED	5	/* the configuration was reloaded */
+	struct link_decl *link;		/* NULL for any */
+	struct duid relayid;		/* duid_len 0 for any */
+	/* what to look at next */
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct v6addrseg *seg;
+	struct v6prefix *prefix;
+	struct dhcp6_lease *lease;
+	struct dhcp6_client *client;
+};
+
+int server6_lq_options __P((struct dhcp6opt *, struct dhcp6opt *,
+			    char *, char *));
+int server6_lq_allowed __P((struct in6_addr *));
+int server6_lq_bulk __P((struct dhcp6opt *, struct dhcp6opt *,
+			 char *, char *, struct lq_cursor *));
+int server6_lq_bulk_next __P((struct lq_cursor *,
+			      int (*) __P((void *, char *, int)), void *));
+int server6_lq_bulk_done __P((struct lq_cursor *, char *, char *));
+void server6_lq_bulk_stop __P((struct lq_cursor *));
+void server6_lq_forget_lease __P((struct dhcp6_lease *));
+void server6_lq_forget_binding __P((struct dhcp6_iaidaddr *));
+void server6_lq_forget_client __P((struct dhcp6_client *));
+void server6_lq_reload __P((void));
+
+#endif
@@ -67,6 +67,7 @@ static int allow = 0;
 
 static void cleanup(void);
 void sfyyerror(char *msg);
+void sfyyreset(void);
 
 #define ABORT	do { cleanup(); YYABORT; } while (0)
 
@@ -99,6 +100,8 @@ extern int sfyylex __P((void));
 %token	<str>	VALIDLIFETIME
 %token	<str>	PREFERLIFETIME
 %token	<str>	UNICAST
+%token	<str>	LEASEQUERY
+%token	<str>	RECONFIGURE
 %token	<str>	TEMPIPV6ADDR
 %token	<str>	DNS_SERVERS
 %token	<str>	DUID DUID_ID
@@ -192,6 +195,8 @@ ifhead
 		if (if_nametoindex(ifnetwork->name) == 0) {
 			dprintf(LOG_ERR, "this device %s doesn't exist.", $2);
 		}
+		/* the lexer made a copy of the name */
+		free($2);
 		/* set up hw_addr, link local, primary ipv6addr */
 		/* enter interface scope */
 		currentscope = push_double_list(currentscope, &ifnetwork->ifscope);
@@ -525,6 +530,7 @@ grouphead
 	: GROUP
 	{
 		struct scope *groupscope;
+		struct scopelist *group;
 		groupscope = (struct scope *)malloc(sizeof(*groupscope));
 		if (groupscope == NULL) {
 			dprintf(LOG_ERR, "group memory allocation failed");
@@ -532,6 +538,17 @@ grouphead
 		}
 		memset(groupscope, 0, sizeof(*groupscope));
 		TAILQ_INIT(&groupscope->dnslist.addrlist);
+		/* the declarations only point to it: keep it on the root */
+		group = (struct scopelist *)malloc(sizeof(*group));
+		if (group == NULL) {
+			dprintf(LOG_ERR, "group memory allocation failed");
+			free(groupscope);
+			ABORT;
+		}
+		group->prev = NULL;
+		group->scope = groupscope;
+		group->next = globalgroup->grouplist;
+		globalgroup->grouplist = group;
 		/* set up current group */
 		currentgroup = push_double_list(currentgroup, groupscope);
 		if (currentgroup == NULL)
@@ -611,6 +628,7 @@ hostdecl
 			ABORT;
 		}
 		configure_duid($2, &host->cid);
+		free($2);
 	}
 	| iaiddef
 	| hostparas
@@ -781,6 +799,19 @@ optionpara
 		else 
 			currentscope->scope->send_flags |= DHCIFF_UNICAST;
 	}
+	| LEASEQUERY ';'
+	{
+		if (allow)
+			currentscope->scope->allow_flags |= DHCIFF_LEASEQUERY;
+		else
+			currentscope->scope->send_flags |= DHCIFF_LEASEQUERY;
+	}
+	| RECONFIGURE ';'
+	{
+		/* only a client can offer to accept Reconfigure */
+		if (allow)
+			currentscope->scope->allow_flags |= DHCIFF_RECONF_ACCEPT;
+	}
 	| INFO_ONLY ';'
 	{
 		if (allow) 
@@ -932,6 +963,26 @@ void cleanup(void)
 	 */
 }
 
+/* forget what an earlier parse left behind, before parsing again */
+void
+sfyyreset(void)
+{
+	ifnetworklist = NULL;
+	linklist = NULL;
+	hostlist = NULL;
+	poollist = NULL;
+	ifnetwork = NULL;
+	link = NULL;
+	host = NULL;
+	pool = NULL;
+	/* the global scope stays pushed by the options outside any block */
+	while (currentscope != NULL)
+		currentscope = pop_double_list(currentscope);
+	while (currentgroup != NULL)
+		currentgroup = pop_double_list(currentgroup);
+	allow = 0;
+}
+
 void
 sfyyerror(char *msg)
 {
@@ -0,0 +1,634 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Server-initiated Reconfigure (RFC 3315 section 19), on demand from the
+ * control socket: "reconfigure" with all, link <name>, pool <link> <n>
+ * or client <duid>... picks the clients, which are each sent a
+ * Reconfigure to the first address they lease, asking them to Renew (or
+ * with "info" first, to send an Information-request).
+ *
+ * Only the clients that sent a Reconfigure Accept on a link that allows
+ * it are picked.  Their Reply carried a reconfigure key in an
+ * Authentication option (section 21.5), and each Reconfigure is signed
+ * with it, HMAC-MD5 over the message.
+ *
+ * Each client waits in one queue for its turn to be sent, then in a
+ * timer wheel of REC_SLOTS ticks for its retransmission, so that a
+ * hundred thousand clients cost one timer and no search.  Every tick
+ * moves the clients whose timeout came up back to the queue and sends
+ * from its head, REC_BATCH messages to a sendmmsg(), no more than the
+ * rate and the socket buffer allow.  A client leaves when it sends a Renew, Rebind or
+ * Information-request, or after REC_MAX_RC unanswered Reconfigures.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE	/* sendmmsg() */
+#endif
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "timer.h"
+#include "hash.h"
+#include "lease.h"
+#include "server6_conf.h"
+#include "server6_stats.h"
+#include "server6_reconf.h"
+
+#define REC_TICK	100		/* ms */
+#define REC_TICK_NS	(REC_TICK * 1000000ULL)
+#define REC_SLOTS	8192		/* ticks the wheel spans */
+#define REC_BATCH	64		/* messages to a sendmmsg() */
+#define REC_RATE	1000		/* messages a second, by default */
+#define REC_AUTHLEN	(3 + 8 + 1 + DH6_RECONFKEY_LEN)
+#define REC_MSGLEN	(sizeof(struct dhcp6) + \
+			 4 * sizeof(struct dhcp6opt) + 2 * 256 + 1 + \
+			 REC_AUTHLEN)
+
+struct reconf_client {
+	TAILQ_ENTRY(reconf_client) link;	/* in rec_queue or a slot */
+	struct duid clientid;
+	struct in6_addr addr;
+	u_int8_t key[DH6_RECONFKEY_LEN];
+	int msgtype;		/* DH6_RENEW or DH6_INFORM_REQ */
+	int count;		/* Reconfigures sent */
+	int rt;			/* the last timeout, in ticks */
+	int slot;		/* the wheel slot, -1 in rec_queue */
+};
+
+TAILQ_HEAD(reconf_list, reconf_client);
+
+static int rec_sock = -1;
+static struct duid *rec_duid;
+static u_int16_t rec_port;
+static struct hash_table *rec_hash;	/* the reconf_clients by DUID */
+static struct reconf_list rec_queue;	/* waiting to be sent */
+static struct reconf_list rec_wheel[REC_SLOTS];
+static unsigned int rec_cursor;		/* the slot of the last tick */
+static dhcp6_time_t rec_tick_time;	/* when that tick was */
+static struct dhcp6_timer *rec_timer;
+static unsigned int rec_rate = REC_RATE;
+static u_int64_t rec_credit;		/* messages we may send, x 1000 */
+static u_int64_t rec_pending;
+static u_int64_t rec_count_sent, rec_count_answered, rec_count_failed;
+static u_int64_t rec_count_noaddr, rec_count_noaccept;
+static u_int64_t rec_replay;		/* the last replay detection value */
+
+static void *rec_findkey __P((const void *));
+static int rec_key_compare __P((const void *, const void *));
+static struct dhcp6_timer *rec_timo __P((void *));
+static void rec_free __P((struct reconf_client *));
+static int rec_add __P((struct dhcp6_client *, int));
+static int rec_match __P((struct dhcp6_client *, struct link_decl *,
+			  struct pool_decl *));
+static struct link_decl *rec_find_link __P((const char *));
+static void rec_send __P((void));
+static void rec_schedule __P((struct reconf_client *));
+static char *rec_put_option __P((char *, int, const void *, int));
+static char *rec_put_auth __P((char *, int, const void *));
+static int rec_build __P((struct reconf_client *, char *));
+
+int
+server6_reconf_init(duid)
+	struct duid *duid;
+{
+	int i;
+
+	/*
+	 * A socket of its own, so that Reconfigures stuck on an unresolved
+	 * next hop cannot fill the buffer the replies go through.
+	 */
+	if ((rec_sock = socket(AF_INET6, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		dprintf(LOG_ERR, "%s" "socket: %s", FNAME, strerror(errno));
+		return (-1);
+	}
+	rec_duid = duid;
+	rec_port = htons(atoi(DH6PORT_DOWNSTREAM));
+	TAILQ_INIT(&rec_queue);
+	for (i = 0; i < REC_SLOTS; i++)
+		TAILQ_INIT(&rec_wheel[i]);
+	rec_hash = hash_table_create(DEFAULT_HASH_SIZE, client_hash,
+				     rec_findkey, rec_key_compare);
+	if (rec_hash == NULL) {
+		dprintf(LOG_ERR, "%s" "failed to create the Reconfigure table",
+			FNAME);
+		return (-1);
+	}
+	return (0);
+}
+
+static void *
+rec_findkey(data)
+	const void *data;
+{
+	return ((void *)&((struct reconf_client *)data)->clientid);
+}
+
+static int
+rec_key_compare(data, key)
+	const void *data, *key;
+{
+	const struct reconf_client *rc = (const struct reconf_client *)data;
+
+	if (duidcmp((const struct duid *)key, &rc->clientid) == 0)
+		return MATCH;
+	return MISCOMPARE;
+}
+
+static void
+rec_free(rc)
+	struct reconf_client *rc;
+{
+	if (rc->slot < 0)
+		TAILQ_REMOVE(&rec_queue, rc, link);
+	else
+		TAILQ_REMOVE(&rec_wheel[rc->slot], rc, link);
+	hash_delete(rec_hash, &rc->clientid);
+	duidfree(&rc->clientid);
+	free(rc);
+	rec_pending--;
+}
+
+/* a client answered: no more Reconfigures for it */
+void
+server6_reconf_answered(clientid)
+	struct duid *clientid;
+{
+	struct reconf_client *rc;
+
+	if (rec_hash == NULL || rec_pending == 0 ||
+	    (rc = hash_search(rec_hash, clientid)) == NULL)
+		return;
+	dprintf(LOG_DEBUG, "%s" "client %s answered the Reconfigure", FNAME,
+		duidstr(clientid));
+	rec_free(rc);
+	rec_count_answered++;
+}
+
+/* queue a Reconfigure for a client, to the first address it leases */
+static int
+rec_add(client, msgtype)
+	struct dhcp6_client *client;
+	int msgtype;
+{
+	struct dhcp6_iaidaddr *iaidaddr, *accept = NULL;
+	struct dhcp6_lease *lease = NULL;
+	struct reconf_client *rc;
+
+	if (hash_search(rec_hash, &client->clientid) != NULL)
+		return (0);
+	/* a client that did not offer to accept it would drop it */
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink)
+		if (iaidaddr->reconf_accept && accept == NULL)
+			accept = iaidaddr;
+	if (accept == NULL) {
+		rec_count_noaccept++;
+		return (0);
+	}
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink) {
+		if (iaidaddr->client6_info.type == IAPD)
+			continue;
+		TAILQ_FOREACH(lease, &iaidaddr->lease_list, link)
+			if (lease->state != EXPIRED && lease->state != INVALID)
+				break;
+		if (lease != NULL)
+			break;
+	}
+	if (lease == NULL) {
+		/* only prefixes: we know no address to reach it at */
+		rec_count_noaddr++;
+		return (0);
+	}
+	if ((rc = malloc(sizeof(*rc))) == NULL) {
+		dprintf(LOG_ERR, "%s" "memory allocation failed", FNAME);
+		return (-1);
+	}
+	memset(rc, 0, sizeof(*rc));
+	if (duidcpy(&rc->clientid, &client->clientid)) {
+		free(rc);
+		return (-1);
+	}
+	rc->addr = lease->lease_addr.addr;
+	memcpy(rc->key, accept->reconfkey, sizeof(rc->key));
+	rc->msgtype = msgtype;
+	rc->slot = -1;
+	if (hash_add(rec_hash, &rc->clientid, rc) != 0) {
+		duidfree(&rc->clientid);
+		free(rc);
+		return (-1);
+	}
+	TAILQ_INSERT_TAIL(&rec_queue, rc, link);
+	rec_pending++;
+	return (1);
+}
+
+/* whether a client leases anything from the link or pool */
+static int
+rec_match(client, link, pool)
+	struct dhcp6_client *client;
+	struct link_decl *link;
+	struct pool_decl *pool;
+{
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_lease *lease;
+
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink) {
+		TAILQ_FOREACH(lease, &iaidaddr->lease_list, link) {
+			if (lease->seg != NULL && (pool ?
+			    lease->seg->pool == pool : lease->seg->link == link))
+				return (1);
+			if (lease->prefix != NULL && (pool ?
+			    lease->prefix->pool == pool :
+			    lease->prefix->link == link))
+				return (1);
+		}
+	}
+	return (0);
+}
+
+static struct link_decl *
+rec_find_link(name)
+	const char *name;
+{
+	struct interface *ifnetwork;
+	struct link_decl *link;
+
+	if (globalgroup == NULL)
+		return (NULL);
+	for (ifnetwork = globalgroup->iflist; ifnetwork;
+	     ifnetwork = ifnetwork->next)
+		for (link = ifnetwork->linklist; link; link = link->next)
+			if (strcmp(link->name, name) == 0)
+				return (link);
+	return (NULL);
+}
+
+static char *
+rec_put_option(bp, type, data, len)
+	char *bp;
+	int type;
+	const void *data;
+	int len;
+{
+	struct dhcp6opt opth;
+
+	opth.dh6opt_type = htons(type);
+	opth.dh6opt_len = htons(len);
+	memcpy(bp, &opth, sizeof(opth));
+	if (len > 0)
+		memcpy(bp + sizeof(opth), data, len);
+	return (bp + sizeof(opth) + len);
+}
+
+/*
+ * an Authentication option of the reconfigure key protocol, with a
+ * replay detection value above any sent before, this run or the last
+ */
+static char *
+rec_put_auth(bp, type, value)
+	char *bp;
+	int type;
+	const void *value;
+{
+	u_char auth[REC_AUTHLEN];
+	u_int64_t now = (u_int64_t)time(NULL) << 32;
+	int i;
+
+	rec_replay = rec_replay < now ? now : rec_replay + 1;
+	auth[0] = DH6_AUTHPROTO_RECONFIG;
+	auth[1] = DH6_AUTHALG_HMACMD5;
+	auth[2] = DH6_AUTHRDM_MONOCOUNTER;
+	for (i = 0; i < 8; i++)
+		auth[3 + i] = (u_char)(rec_replay >> (56 - 8 * i));
+	auth[11] = type;
+	if (value != NULL)
+		memcpy(auth + 12, value, DH6_RECONFKEY_LEN);
+	else
+		memset(auth + 12, 0, DH6_RECONFKEY_LEN);
+	return (rec_put_option(bp, DH6OPT_AUTH, auth, sizeof(auth)));
+}
+
+/*
+ * the options a Reply carries for a client that accepts Reconfigure:
+ * Reconfigure Accept and its key.  Returns their length, 0 if the
+ * client has no key.
+ */
+int
+server6_reconf_reply(clientid, buf)
+	struct duid *clientid;
+	char *buf;
+{
+	struct dhcp6_client *client;
+	struct dhcp6_iaidaddr *iaidaddr;
+
+	if ((client = dhcp6_find_client(clientid)) == NULL)
+		return (0);
+	TAILQ_FOREACH(iaidaddr, &client->iaidaddr_list, clientlink) {
+		if (iaidaddr->reconf_accept)
+			return (rec_put_auth(rec_put_option(buf,
+			    DH6OPT_RECONF_ACCEPT, NULL, 0),
+			    DH6_AUTHINFO_RECONFKEY, iaidaddr->reconfkey) - buf);
+	}
+	return (0);
+}
+
+static int
+rec_build(rc, buf)
+	struct reconf_client *rc;
+	char *buf;
+{
+	struct dhcp6 *dh6 = (struct dhcp6 *)buf;
+	u_int8_t msgtype = rc->msgtype;
+	unsigned int maclen;
+	char *bp;
+
+	/* the transaction ID of a Reconfigure is zero */
+	dh6->dh6_xid = 0;
+	dh6->dh6_msgtype = DH6_RECONFIGURE;
+	bp = buf + sizeof(*dh6);
+	bp = rec_put_option(bp, DH6OPT_SERVERID, rec_duid->duid_id,
+			    rec_duid->duid_len);
+	bp = rec_put_option(bp, DH6OPT_CLIENTID, rc->clientid.duid_id,
+			    rc->clientid.duid_len);
+	bp = rec_put_option(bp, DH6OPT_RECONF_MSG, &msgtype, 1);
+	/* the MAC over the whole message, its own field zero */
+	bp = rec_put_auth(bp, DH6_AUTHINFO_HMACMD5, NULL);
+	HMAC(EVP_md5(), rc->key, sizeof(rc->key), (u_char *)buf, bp - buf,
+	     (u_char *)bp - DH6_RECONFKEY_LEN, &maclen);
+	return (bp - buf);
+}
+
+/* sent: wait for the answer, RT = 2 RTprev + RAND RTprev */
+static void
+rec_schedule(rc)
+	struct reconf_client *rc;
+{
+	rc->rt = rc->count == 0 ? REC_TIMEOUT / REC_TICK : 2 * rc->rt;
+	rc->rt += rc->rt * (int)(random() % 21 - 10) / 100;
+	if (rc->rt < 1)
+		rc->rt = 1;
+	if (rc->rt >= REC_SLOTS)
+		rc->rt = REC_SLOTS - 1;
+	rc->count++;
+	rc->slot = (rec_cursor + rc->rt) % REC_SLOTS;
+	TAILQ_INSERT_TAIL(&rec_wheel[rc->slot], rc, link);
+}
+
+/* send from the head of the queue, as much as the rate allows */
+static void
+rec_send()
+{
+	static char buf[REC_BATCH][REC_MSGLEN];
+	static struct sockaddr_in6 dst[REC_BATCH];
+	static struct iovec iov[REC_BATCH];
+	static struct mmsghdr msg[REC_BATCH];
+	struct reconf_client *rc[REC_BATCH];
+	int i, n, sent, ret;
+
+	while (rec_credit >= 1000 && !TAILQ_EMPTY(&rec_queue)) {
+		for (n = 0; n < REC_BATCH && rec_credit >= 1000 &&
+		     (rc[n] = TAILQ_FIRST(&rec_queue)) != NULL; n++) {
+			TAILQ_REMOVE(&rec_queue, rc[n], link);
+			memset(&dst[n], 0, sizeof(dst[n]));
+			dst[n].sin6_family = AF_INET6;
+			dst[n].sin6_port = rec_port;
+			dst[n].sin6_addr = rc[n]->addr;
+			iov[n].iov_base = buf[n];
+			iov[n].iov_len = rec_build(rc[n], buf[n]);
+			memset(&msg[n], 0, sizeof(msg[n]));
+			msg[n].msg_hdr.msg_name = &dst[n];
+			msg[n].msg_hdr.msg_namelen = sizeof(dst[n]);
+			msg[n].msg_hdr.msg_iov = &iov[n];
+			msg[n].msg_hdr.msg_iovlen = 1;
+			rec_credit -= 1000;
+		}
+		for (sent = 0; sent < n; sent += ret) {
+			ret = sendmmsg(rec_sock, msg + sent, n - sent,
+				       MSG_DONTWAIT);
+			if (ret > 0)
+				continue;
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			/* lost like any other: the retransmission covers it */
+			dprintf(LOG_INFO, "%s" "transmit Reconfigure to %s: %s",
+				FNAME, in6addr2str(&rc[sent]->addr, 0),
+				strerror(errno));
+			ret = 1;
+		}
+		for (i = 0; i < sent; i++)
+			rec_schedule(rc[i]);
+		rec_count_sent += sent;
+		server6_stats.tx[STATS_TYPE(DH6_RECONFIGURE)] += sent;
+		if (sent < n) {
+			/* the socket is full: the rest wait for the next tick */
+			for (i = n - 1; i >= sent; i--) {
+				TAILQ_INSERT_HEAD(&rec_queue, rc[i], link);
+				rec_credit += 1000;
+			}
+			break;
+		}
+	}
+}
+
+static struct dhcp6_timer *
+rec_timo(arg)
+	void *arg;
+{
+	struct reconf_client *rc;
+	struct timeval timo;
+	u_int64_t ticks, max;
+
+	ticks = (dhcp6_now() - rec_tick_time) / REC_TICK_NS;
+	rec_tick_time += ticks * REC_TICK_NS;
+	/* one turn of the wheel sees every client in it */
+	if (ticks > REC_SLOTS)
+		ticks = REC_SLOTS;
+	max = (u_int64_t)rec_rate * REC_TICK;
+	rec_credit += ticks * max;
+	/* a tick late or more: no burst to make up for it */
+	if (max < 1000)
+		max = 1000;
+	if (rec_credit > 2 * max)
+		rec_credit = 2 * max;
+	for (; ticks > 0; ticks--) {
+		rec_cursor = (rec_cursor + 1) % REC_SLOTS;
+		while ((rc = TAILQ_FIRST(&rec_wheel[rec_cursor])) != NULL) {
+			if (rc->count >= REC_MAX_RC) {
+				dprintf(LOG_INFO, "%s" "client %s did not "
+					"answer the Reconfigure", FNAME,
+					duidstr(&rc->clientid));
+				rec_free(rc);
+				rec_count_failed++;
+				continue;
+			}
+			TAILQ_REMOVE(&rec_wheel[rec_cursor], rc, link);
+			rc->slot = -1;
+			TAILQ_INSERT_TAIL(&rec_queue, rc, link);
+		}
+	}
+	rec_send();
+	if (rec_pending == 0) {
+		dhcp6_remove_timer(rec_timer);
+		rec_timer = NULL;
+		return (NULL);
+	}
+	timo.tv_sec = 0;
+	timo.tv_usec = REC_TICK * 1000;
+	dhcp6_set_timer(&timo, rec_timer);
+	return (rec_timer);
+}
+
+/*
+ * "reconfigure [info] all | link <name> | pool <link> <n> |
+ * client <duid>...", "reconfigure rate <n>" and "reconfigure stop";
+ * each answers with the counters.
+ */
+void
+server6_reconf_ctl(fp, args)
+	FILE *fp;
+	char *args;
+{
+	struct hashlist_element *element;
+	struct dhcp6_client *client;
+	struct link_decl *link = NULL;
+	struct pool_decl *pool = NULL;
+	struct reconf_client *rc;
+	struct timeval timo;
+	struct duid duid;
+	char *what, *arg, *last;
+	int msgtype = DH6_RENEW, added = 0, i, n;
+
+	if (rec_hash == NULL) {
+		fprintf(fp, "error Reconfigure unavailable\n");
+		return;
+	}
+	what = strtok_r(args, " \t", &last);
+	if (what != NULL && strcmp(what, "info") == 0) {
+		msgtype = DH6_INFORM_REQ;
+		what = strtok_r(NULL, " \t", &last);
+	}
+	arg = what ? strtok_r(NULL, " \t", &last) : NULL;
+	if (what == NULL)
+		;
+	else if (strcmp(what, "rate") == 0 && arg != NULL && atoi(arg) > 0)
+		rec_rate = atoi(arg);
+	else if (strcmp(what, "stop") == 0) {
+		while ((rc = TAILQ_FIRST(&rec_queue)) != NULL)
+			rec_free(rc);
+		for (i = 0; i < REC_SLOTS; i++)
+			while ((rc = TAILQ_FIRST(&rec_wheel[i])) != NULL)
+				rec_free(rc);
+	} else if (strcmp(what, "client") == 0 && arg != NULL) {
+		for (; arg != NULL; arg = strtok_r(NULL, " \t", &last)) {
+			if (configure_duid(arg, &duid) != 0) {
+				fprintf(fp, "error bad DUID \"%s\"\n", arg);
+				break;
+			}
+			if ((client = dhcp6_find_client(&duid)) != NULL &&
+			    rec_add(client, msgtype) > 0)
+				added++;
+			duidfree(&duid);
+		}
+	} else if ((strcmp(what, "all") == 0 && arg == NULL) ||
+		   (strcmp(what, "link") == 0 && arg != NULL &&
+		    (link = rec_find_link(arg)) != NULL) ||
+		   (strcmp(what, "pool") == 0 && arg != NULL &&
+		    (link = rec_find_link(arg)) != NULL &&
+		    (arg = strtok_r(NULL, " \t", &last)) != NULL)) {
+		if (strcmp(what, "pool") == 0) {
+			n = atoi(arg);
+			for (pool = link->poollist; pool && n > 0; n--)
+				pool = pool->next;
+			if (pool == NULL) {
+				fprintf(fp, "error no pool %s\n", arg);
+				return;
+			}
+		}
+		for (i = 0; i < client_hash_table->hash_size; i++) {
+			for (element = client_hash_table->hash_list[i];
+			     element; element = element->next) {
+				client = element->data;
+				if ((link == NULL ||
+				     rec_match(client, link, pool)) &&
+				    rec_add(client, msgtype) > 0)
+					added++;
+			}
+		}
+	} else {
+		fprintf(fp, "error bad argument \"%s\"\n", what);
+		return;
+	}
+	if (added > 0) {
+		dprintf(LOG_NOTICE, "%s" "reconfiguring %d clients", FNAME,
+			added);
+		if (rec_timer == NULL) {
+			if ((rec_timer = dhcp6_add_timer(rec_timo, NULL))
+			    == NULL) {
+				fprintf(fp, "error no timer\n");
+				return;
+			}
+			rec_tick_time = dhcp6_now();
+			rec_credit = (u_int64_t)rec_rate * REC_TICK;
+			timo.tv_sec = 0;
+			timo.tv_usec = 0;
+			dhcp6_set_timer(&timo, rec_timer);
+		}
+	}
+	fprintf(fp, "dhcp6s_reconf_rate %u\n", rec_rate);
+	fprintf(fp, "dhcp6s_reconf_added %d\n", added);
+	fprintf(fp, "dhcp6s_reconf_pending %llu\n",
+	    (unsigned long long)rec_pending);
+	fprintf(fp, "dhcp6s_reconf_sent_total %llu\n",
+	    (unsigned long long)rec_count_sent);
+	fprintf(fp, "dhcp6s_reconf_clients_total{result=\"answered\"} %llu\n",
+	    (unsigned long long)rec_count_answered);
+	fprintf(fp, "dhcp6s_reconf_clients_total{result=\"unanswered\"} %llu\n",
+	    (unsigned long long)rec_count_failed);
+	fprintf(fp, "dhcp6s_reconf_clients_total{result=\"no-address\"} %llu\n",
+	    (unsigned long long)rec_count_noaddr);
+	fprintf(fp, "dhcp6s_reconf_clients_total{result=\"not-accepted\"} %llu\n",
+	    (unsigned long long)rec_count_noaccept);
+}
@@ -0,0 +1,770 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+/*
+ * Lease replication to a hot standby.  The server started with -r peer
+ * connects to the standby on TCP port REPL_PORT, sends it every binding
+ * it holds, and every lease change as it is written to the lease file:
+ * added, renewed, expired and removed.  The bindings are sent a few
+ * clients at a time as the stream takes them, between the changes, so
+ * no number of leases makes the snapshot too large to queue.  The standby (-R peer) accepts the
+ * stream only from that peer, applies each change to its own tables and
+ * lease file, and answers no client until "repl promote" on its control
+ * socket, which is then all a takeover takes.
+ *
+ * Changes are written out without waiting for the standby, which
+ * acknowledges what it has applied once per batch it reads; the primary
+ * stays at most REPL_WINDOW changes ahead of the last acknowledgement.
+ * A standby that falls too far behind, or a lost connection, costs a
+ * full resend when the primary reconnects.  The standby keeps its
+ * bindings through a resend, rewrites only the leases that differ, and
+ * once the last binding is in removes those the primary did not send.
+ *
+ * The relay ID is sent when there is one, and with a length of 0 when
+ * there is none but the client accepts Reconfigure, whose key follows.
+ *
+ * Every frame is a two-byte length of what follows, a type byte and:
+ *   REPL_SYNC	seq(4), the bindings that follow replace all others
+ *   REPL_SYNC_END	seq(4), all of them were sent
+ *   REPL_LEASE	seq(4) state(1) type(1) plen(1) duidlen(1) iaid(4)
+ *		renewtime(4) rebindtime(4) preferlifetime(4)
+ *		validlifetime(4) start_date(4) address(16) duid(duidlen)
+ *		[relayidlen(1) relayid(relayidlen) [reconfkey(16)]]
+ *   REPL_ACK	seq(4) of the last frame applied, from the standby
+ * in network byte order.
+ */
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "timer.h"
+#include "hash.h"
+#include "lease.h"
+#include "server6_repl.h"
+
+#define REPL_SYNC	1
+#define REPL_LEASE	2
+#define REPL_ACK	3
+#define REPL_SYNC_END	4
+
+#define REPL_HDRLEN	3	/* length and type */
+#define REPL_LEASELEN	48	/* a REPL_LEASE body without the DUID */
+#define REPL_MAXFRAME	(REPL_HDRLEN + REPL_LEASELEN + 255 + 1 + 255 + \
+			 DH6_RECONFKEY_LEN)
+#define REPL_WINDOW	4096	/* frames sent ahead of the acknowledgement */
+#define REPL_MAXBUF	(32 << 20)	/* queued bytes before we resync */
+#define REPL_SNAPBUF	(64 * 1024)	/* queued bytes the snapshot tops up */
+#define REPL_RETRY_SEC	5	/* between connection attempts */
+
+#define REPL_OFF	0
+#define REPL_PRIMARY	1
+#define REPL_STANDBY	2
+
+static int repl_role = REPL_OFF;
+static struct in6_addr repl_peer;
+static int repl_fd = -1;	/* the stream */
+static int repl_lfd = -1;	/* standby: where the primary connects */
+static int repl_up = 0;		/* primary: connected and streaming */
+static struct dhcp6_timer *repl_timer;
+static u_int32_t repl_seq;	/* primary: last queued, standby: applied */
+static u_int32_t repl_acked;	/* last acknowledged */
+/* primary: frames not yet written, the first maybe in part */
+static char *repl_out;
+static size_t repl_outoff, repl_outlen, repl_outsize, repl_partial;
+static int repl_blocked;	/* the window is full */
+/* primary: the next client of the snapshot being sent */
+static struct dhcp6_client *repl_snap;
+static int repl_snapping;
+/* standby: the resync being taken, see server6_lease_sweep() */
+static u_int32_t repl_gen;
+static int repl_syncing;
+/* frames read and not yet complete */
+static char repl_in[64 * 1024];
+static size_t repl_inlen;
+static u_int64_t repl_frames, repl_syncs;
+
+static int repl_connect __P((void));
+static struct dhcp6_timer *repl_retry_timo __P((void *));
+static void repl_close __P((const char *));
+static void repl_start __P((void));
+static void repl_snapshot __P((void));
+static int repl_control __P((int));
+static int repl_queue __P((char *, size_t));
+static int repl_lease_frame __P((struct dhcp6_lease *, char *));
+static int repl_flush __P((void));
+static int repl_read __P((void));
+static int repl_frame __P((char *, size_t));
+static void repl_apply __P((char *, size_t));
+static void repl_accept __P((void));
+static void repl_ack __P((void));
+
+/*
+ * Replicate to the standby at peer, or with standby set, be the
+ * standby of the primary at peer.
+ */
+int
+server6_repl_open(peer, standby)
+	const char *peer;
+	int standby;
+{
+	struct sockaddr_in6 sin6;
+	struct timeval timo;
+	int on = 1;
+
+	if (inet_pton(AF_INET6, peer, &repl_peer) != 1) {
+		dprintf(LOG_ERR, "%s" "bad replication peer %s", FNAME, peer);
+		return (-1);
+	}
+	if (!standby) {
+		repl_role = REPL_PRIMARY;
+		if ((repl_timer = dhcp6_add_timer(repl_retry_timo, NULL)) == NULL)
+			return (-1);
+		timo.tv_sec = 0;
+		timo.tv_usec = 0;
+		dhcp6_set_timer(&timo, repl_timer);
+		return (0);
+	}
+	repl_role = REPL_STANDBY;
+	if ((repl_lfd = socket(AF_INET6, SOCK_STREAM, 0)) < 0) {
+		dprintf(LOG_ERR, "%s" "socket: %s", FNAME, strerror(errno));
+		return (-1);
+	}
+	setsockopt(repl_lfd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+	memset(&sin6, 0, sizeof(sin6));
+	sin6.sin6_family = AF_INET6;
+	sin6.sin6_port = htons(REPL_PORT);
+	if (bind(repl_lfd, (struct sockaddr *)&sin6, sizeof(sin6)) < 0 ||
+	    listen(repl_lfd, 1) < 0 ||
+	    fcntl(repl_lfd, F_SETFL, O_NONBLOCK) < 0) {
+		dprintf(LOG_ERR, "%s" "replication socket: %s", FNAME,
+			strerror(errno));
+		close(repl_lfd);
+		repl_lfd = -1;
+		return (-1);
+	}
+	return (0);
+}
+
+int
+server6_repl_standby()
+{
+	return (repl_role == REPL_STANDBY);
+}
+
+static int
+repl_connect()
+{
+	struct sockaddr_in6 sin6;
+
+	if ((repl_fd = socket(AF_INET6, SOCK_STREAM, 0)) < 0) {
+		dprintf(LOG_ERR, "%s" "socket: %s", FNAME, strerror(errno));
+		return (-1);
+	}
+	memset(&sin6, 0, sizeof(sin6));
+	sin6.sin6_family = AF_INET6;
+	sin6.sin6_port = htons(REPL_PORT);
+	sin6.sin6_addr = repl_peer;
+	if (fcntl(repl_fd, F_SETFL, O_NONBLOCK) < 0 ||
+	    (connect(repl_fd, (struct sockaddr *)&sin6, sizeof(sin6)) < 0 &&
+	     errno != EINPROGRESS)) {
+		dprintf(LOG_INFO, "%s" "connect to %s: %s", FNAME,
+			in6addr2str(&repl_peer, 0), strerror(errno));
+		close(repl_fd);
+		repl_fd = -1;
+		return (-1);
+	}
+	/* writable once connected, see server6_repl_serve() */
+	return (0);
+}
+
+static struct dhcp6_timer *
+repl_retry_timo(arg)
+	void *arg;
+{
+	struct timeval timo;
+
+	if (repl_fd < 0)
+		repl_connect();
+	timo.tv_sec = REPL_RETRY_SEC;
+	timo.tv_usec = 0;
+	dhcp6_set_timer(&timo, repl_timer);
+	return (repl_timer);
+}
+
+static void
+repl_close(why)
+	const char *why;
+{
+	dprintf(LOG_NOTICE, "%s" "replication with %s closed: %s", FNAME,
+		in6addr2str(&repl_peer, 0), why);
+	close(repl_fd);
+	repl_fd = -1;
+	repl_up = 0;
+	repl_outoff = repl_outlen = repl_partial = 0;
+	repl_blocked = 0;
+	repl_snap = NULL;
+	repl_snapping = repl_syncing = 0;
+	repl_inlen = 0;
+}
+
+/* connected: send the standby every binding, and follow the changes */
+static void
+repl_start()
+{
+	dprintf(LOG_NOTICE, "%s" "replicating to %s", FNAME,
+		in6addr2str(&repl_peer, 0));
+	repl_up = 1;
+	repl_acked = repl_seq;
+	repl_syncs++;
+	if (repl_control(REPL_SYNC) < 0)
+		return;
+	repl_snap = TAILQ_FIRST(&server6_clients);
+	repl_snapping = 1;
+}
+
+/*
+ * Queue the next clients of the snapshot while less than REPL_SNAPBUF
+ * bytes wait, and REPL_SYNC_END after the last.
+ */
+static void
+repl_snapshot()
+{
+	struct dhcp6_iaidaddr *iaidaddr;
+	struct dhcp6_lease *lease;
+	char frame[REPL_MAXFRAME];
+	int len;
+
+	while (repl_snapping && repl_outlen - repl_outoff < REPL_SNAPBUF) {
+		if (repl_snap == NULL) {
+			repl_snapping = 0;
+			repl_control(REPL_SYNC_END);
+			return;
+		}
+		TAILQ_FOREACH(iaidaddr, &repl_snap->iaidaddr_list, clientlink) {
+			TAILQ_FOREACH(lease, &iaidaddr->lease_list, link) {
+				if ((len = repl_lease_frame(lease, frame)) >= 0 &&
+				    repl_queue(frame, len) < 0)
+					return;
+			}
+		}
+		repl_snap = TAILQ_NEXT(repl_snap, link);
+	}
+}
+
+/* a client the snapshot has yet to send goes away */
+void
+server6_repl_forget_client(client)
+	struct dhcp6_client *client;
+{
+	if (repl_snap == client)
+		repl_snap = TAILQ_NEXT(client, link);
+}
+
+/* queue a frame of type with nothing but its seq */
+static int
+repl_control(type)
+	int type;
+{
+	char frame[REPL_HDRLEN + 4];
+	u_int32_t seq;
+
+	frame[0] = 0;
+	frame[1] = 5;
+	frame[2] = type;
+	seq = htonl(++repl_seq);
+	memcpy(frame + REPL_HDRLEN, &seq, sizeof(seq));
+	return repl_queue(frame, sizeof(frame));
+}
+
+/* add a frame to those to write, or give up on a standby too far behind */
+static int
+repl_queue(frame, len)
+	char *frame;
+	size_t len;
+{
+	char *p;
+	size_t n;
+
+	if (repl_outlen - repl_outoff + len > REPL_MAXBUF) {
+		repl_close("standby too far behind");
+		return (-1);
+	}
+	if (repl_outlen + len > repl_outsize) {
+		if (repl_outoff > 0) {
+			memmove(repl_out, repl_out + repl_outoff,
+				repl_outlen - repl_outoff);
+			repl_outlen -= repl_outoff;
+			repl_outoff = 0;
+		}
+		for (n = repl_outsize ? repl_outsize : 64 * 1024;
+		     n < repl_outlen + len; n *= 2)
+			;
+		if (n != repl_outsize) {
+			if ((p = realloc(repl_out, n)) == NULL) {
+				repl_close("out of memory");
+				return (-1);
+			}
+			repl_out = p;
+			repl_outsize = n;
+		}
+	}
+	memcpy(repl_out + repl_outlen, frame, len);
+	repl_outlen += len;
+	return (0);
+}
+
+static int
+repl_lease_frame(lease, frame)
+	struct dhcp6_lease *lease;
+	char *frame;
+{
+	struct client6_if *ci = &lease->iaidaddr->client6_info;
+	struct duid *relayid = &lease->iaidaddr->relayid;
+	int reconf = lease->iaidaddr->reconf_accept;
+	char *p = frame + REPL_HDRLEN;
+	u_int32_t v[7];
+	int len, i;
+
+	len = REPL_LEASELEN + ci->clientid.duid_len;
+	if (relayid->duid_len != 0 || reconf)
+		len += 1 + relayid->duid_len;
+	if (reconf)
+		len += DH6_RECONFKEY_LEN;
+	frame[0] = (len + 1) >> 8;
+	frame[1] = (len + 1) & 0xff;
+	frame[2] = REPL_LEASE;
+	v[0] = htonl(++repl_seq);
+	memcpy(p, &v[0], 4);
+	p += 4;
+	*p++ = lease->state;
+	*p++ = ci->type;
+	*p++ = lease->lease_addr.plen;
+	*p++ = ci->clientid.duid_len;
+	v[0] = ci->iaidinfo.iaid;
+	v[1] = ci->iaidinfo.renewtime;
+	v[2] = ci->iaidinfo.rebindtime;
+	v[3] = lease->lease_addr.preferlifetime;
+	v[4] = lease->lease_addr.validlifetime;
+	v[5] = (u_int32_t)lease->start_date;
+	for (i = 0; i < 6; i++) {
+		v[i] = htonl(v[i]);
+		memcpy(p, &v[i], 4);
+		p += 4;
+	}
+	memcpy(p, &lease->lease_addr.addr, sizeof(struct in6_addr));
+	p += sizeof(struct in6_addr);
+	memcpy(p, ci->clientid.duid_id, ci->clientid.duid_len);
+	p += ci->clientid.duid_len;
+	if (relayid->duid_len != 0 || reconf) {
+		*p++ = relayid->duid_len;
+		memcpy(p, relayid->duid_id, relayid->duid_len);
+		p += relayid->duid_len;
+	}
+	if (reconf)
+		memcpy(p, lease->iaidaddr->reconfkey, DH6_RECONFKEY_LEN);
+	return (REPL_HDRLEN + len);
+}
+
+/* a lease changed: tell the standby */
+void
+server6_repl_lease(lease)
+	struct dhcp6_lease *lease;
+{
+	char frame[REPL_MAXFRAME];
+	int len;
+
+	if (repl_role != REPL_PRIMARY || !repl_up || lease->iaidaddr == NULL)
+		return;
+	if ((len = repl_lease_frame(lease, frame)) >= 0)
+		repl_queue(frame, len);
+}
+
+/* write what the window allows; -1 if the connection is gone */
+static int
+repl_flush()
+{
+	u_int32_t seq;
+	size_t len;
+	ssize_t n;
+
+	repl_snapshot();
+	while (repl_outoff < repl_outlen) {
+		len = REPL_HDRLEN - 1 +
+		    (((u_char)repl_out[repl_outoff] << 8) |
+		     (u_char)repl_out[repl_outoff + 1]);
+		memcpy(&seq, repl_out + repl_outoff + REPL_HDRLEN, sizeof(seq));
+		repl_blocked = repl_partial == 0 &&
+		    ntohl(seq) - repl_acked > REPL_WINDOW;
+		if (repl_blocked)
+			break;
+		n = write(repl_fd, repl_out + repl_outoff + repl_partial,
+			  len - repl_partial);
+		if (n < 0) {
+			if (errno == EAGAIN || errno == EINTR)
+				break;
+			repl_close(strerror(errno));
+			return (-1);
+		}
+		repl_partial += n;
+		if (repl_partial < len)
+			break;
+		repl_outoff += len;
+		repl_partial = 0;
+		repl_frames++;
+	}
+	if (repl_outoff == repl_outlen)
+		repl_outoff = repl_outlen = 0;
+	return (0);
+}
+
+/* take in what the peer sent; -1 if the connection is gone */
+static int
+repl_read()
+{
+	size_t off, len;
+	ssize_t n;
+
+	n = read(repl_fd, repl_in + repl_inlen, sizeof(repl_in) - repl_inlen);
+	if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+		repl_close(n == 0 ? "closed by peer" : strerror(errno));
+		return (-1);
+	}
+	if (n < 0)
+		return (0);
+	repl_inlen += n;
+	for (off = 0; repl_inlen - off >= 2; off += len) {
+		len = 2 + (((u_char)repl_in[off] << 8) |
+			   (u_char)repl_in[off + 1]);
+		if (len < REPL_HDRLEN + 4 || len > REPL_MAXFRAME) {
+			repl_close("bad frame");
+			return (-1);
+		}
+		if (repl_inlen - off < len)
+			break;
+		if (repl_frame(repl_in + off, len) < 0) {
+			repl_close("unexpected frame");
+			return (-1);
+		}
+	}
+	memmove(repl_in, repl_in + off, repl_inlen - off);
+	repl_inlen -= off;
+	return (0);
+}
+
+static int
+repl_frame(frame, len)
+	char *frame;
+	size_t len;
+{
+	u_int32_t seq;
+
+	memcpy(&seq, frame + REPL_HDRLEN, sizeof(seq));
+	seq = ntohl(seq);
+	switch (frame[2]) {
+	case REPL_ACK:
+		if (repl_role != REPL_PRIMARY)
+			return (-1);
+		repl_acked = seq;
+		return (0);
+	case REPL_SYNC:
+		if (repl_role != REPL_STANDBY)
+			return (-1);
+		dprintf(LOG_NOTICE, "%s" "resync from %s", FNAME,
+			in6addr2str(&repl_peer, 0));
+		repl_gen++;
+		repl_syncing = 1;
+		repl_syncs++;
+		break;
+	case REPL_SYNC_END:
+		if (repl_role != REPL_STANDBY)
+			return (-1);
+		if (repl_syncing)
+			server6_lease_sweep(repl_gen);
+		repl_syncing = 0;
+		break;
+	case REPL_LEASE:
+		if (repl_role != REPL_STANDBY ||
+		    len < REPL_HDRLEN + REPL_LEASELEN + (u_char)frame[10])
+			return (-1);
+		repl_apply(frame + REPL_HDRLEN, len - REPL_HDRLEN);
+		break;
+	default:
+		return (-1);
+	}
+	repl_seq = seq;
+	repl_frames++;
+	return (0);
+}
+
+/* a REPL_LEASE body into the standby's tables */
+static void
+repl_apply(p, len)
+	char *p;
+	size_t len;
+{
+	struct dhcp6_optinfo optinfo;
+	struct dhcp6_addr addr;
+	struct dhcp6_lease *lease;
+	struct duid duid, relayid, key;
+	u_int32_t v[6];
+	time_t now;
+	size_t off;
+	int state, i;
+
+	state = (u_char)p[4];
+	dhcp6_init_options(&optinfo);
+	optinfo.type = (u_char)p[5];
+	memset(&addr, 0, sizeof(addr));
+	addr.plen = (u_char)p[6];
+	addr.type = optinfo.type;
+	addr.status_code = DH6OPT_STCODE_UNDEFINE;
+	duid.duid_len = (u_char)p[7];
+	for (i = 0; i < 6; i++) {
+		memcpy(&v[i], p + 8 + 4 * i, 4);
+		v[i] = ntohl(v[i]);
+	}
+	optinfo.iaidinfo.iaid = v[0];
+	optinfo.iaidinfo.renewtime = v[1];
+	optinfo.iaidinfo.rebindtime = v[2];
+	/* the lifetimes count from now here */
+	now = time(NULL);
+	now = now > (time_t)v[5] ? now - (time_t)v[5] : 0;
+	for (i = 3; i <= 4; i++) {
+		if (v[i] != DHCP6_DURATITION_INFINITE)
+			v[i] = v[i] > now ? v[i] - now : 1;
+	}
+	addr.preferlifetime = v[3];
+	addr.validlifetime = v[4];
+	memcpy(&addr.addr, p + 32, sizeof(addr.addr));
+	duid.duid_id = p + REPL_LEASELEN;
+	/* what follows the DUID, in older frames nothing */
+	off = REPL_LEASELEN + duid.duid_len;
+	if (off < len) {
+		relayid.duid_len = (u_char)p[off];
+		relayid.duid_id = p + off + 1;
+		off += 1 + relayid.duid_len;
+		if (off > len || (off < len && off + DH6_RECONFKEY_LEN != len) ||
+		    (off == len && relayid.duid_len == 0)) {
+			dprintf(LOG_INFO, "%s" "bad Relay-ID or key for %s",
+				FNAME, in6addr2str(&addr.addr, 0));
+			return;
+		}
+		if (relayid.duid_len != 0 &&
+		    duidcpy(&optinfo.relayID, &relayid)) {
+			dhcp6_clear_options(&optinfo);
+			return;
+		}
+		if (off < len) {
+			key.duid_len = DH6_RECONFKEY_LEN;
+			key.duid_id = p + off;
+			if (duidcpy(&optinfo.reconfkey, &key)) {
+				dhcp6_clear_options(&optinfo);
+				return;
+			}
+			optinfo.flags |= DHCIFF_RECONF_ACCEPT;
+		}
+	}
+	if (duidcpy(&optinfo.clientID, &duid) == 0 &&
+	    dhcp6_add_listval(&optinfo.addr_list, &addr,
+			      DHCP6_LISTVAL_DHCP6ADDR) != NULL &&
+	    server6_lease_apply(&optinfo, state) != 0)
+		dprintf(LOG_INFO, "%s" "failed to apply the lease of %s",
+			FNAME, in6addr2str(&addr.addr, 0));
+	/* sent since the resync began, so the sweep keeps it */
+	if (repl_syncing &&
+	    (lease = hash_search(lease_hash_table, &addr)) != NULL)
+		lease->replgen = repl_gen;
+	dhcp6_clear_options(&optinfo);
+}
+
+/* tell the primary how far we are, once per batch read */
+static void
+repl_ack()
+{
+	char frame[REPL_HDRLEN + 4];
+	u_int32_t seq;
+
+	if (repl_seq == repl_acked)
+		return;
+	frame[0] = 0;
+	frame[1] = 5;
+	frame[2] = REPL_ACK;
+	seq = htonl(repl_seq);
+	memcpy(frame + REPL_HDRLEN, &seq, sizeof(seq));
+	/* so small it only fails when the primary stopped reading */
+	if (write(repl_fd, frame, sizeof(frame)) != sizeof(frame)) {
+		repl_close("cannot acknowledge");
+		return;
+	}
+	repl_acked = repl_seq;
+}
+
+static void
+repl_accept()
+{
+	struct sockaddr_in6 from;
+	socklen_t fromlen = sizeof(from);
+	int fd;
+
+	if ((fd = accept(repl_lfd, (struct sockaddr *)&from, &fromlen)) < 0)
+		return;
+	if (!IN6_ARE_ADDR_EQUAL(&from.sin6_addr, &repl_peer)) {
+		dprintf(LOG_INFO, "%s" "refused replication from %s", FNAME,
+			in6addr2str(&from.sin6_addr, 0));
+		close(fd);
+		return;
+	}
+	/* the primary came back: its new stream replaces the old */
+	if (repl_fd >= 0)
+		repl_close("replaced");
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	repl_fd = fd;
+	repl_seq = repl_acked = 0;
+	dprintf(LOG_NOTICE, "%s" "standby of %s", FNAME,
+		in6addr2str(&repl_peer, 0));
+}
+
+/* what the replication sockets wait for */
+int
+server6_repl_fdset(r, w, maxfd)
+	fd_set *r, *w;
+	int maxfd;
+{
+	if (repl_lfd >= 0) {
+		FD_SET(repl_lfd, r);
+		if (repl_lfd > maxfd)
+			maxfd = repl_lfd;
+	}
+	if (repl_fd < 0)
+		return (maxfd);
+	FD_SET(repl_fd, r);
+	/* connecting, or frames the window lets out */
+	if (repl_role == REPL_PRIMARY && (!repl_up ||
+	    ((repl_outoff < repl_outlen || repl_snapping) && !repl_blocked)))
+		FD_SET(repl_fd, w);
+	if (repl_fd > maxfd)
+		maxfd = repl_fd;
+	return (maxfd);
+}
+
+void
+server6_repl_serve(r, w)
+	fd_set *r, *w;
+{
+	socklen_t len;
+	int err;
+
+	if (repl_lfd >= 0 && FD_ISSET(repl_lfd, r))
+		repl_accept();
+	if (repl_fd < 0)
+		return;
+	if (repl_role == REPL_STANDBY) {
+		if (FD_ISSET(repl_fd, r) && repl_read() == 0)
+			repl_ack();
+		return;
+	}
+	if (!repl_up) {
+		if (!FD_ISSET(repl_fd, w))
+			return;
+		len = sizeof(err);
+		if (getsockopt(repl_fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0)
+			err = errno;
+		if (err != 0) {
+			dprintf(LOG_INFO, "%s" "connect to %s: %s", FNAME,
+				in6addr2str(&repl_peer, 0), strerror(err));
+			close(repl_fd);
+			repl_fd = -1;
+			return;
+		}
+		repl_start();
+	}
+	if (FD_ISSET(repl_fd, r) && repl_read() < 0)
+		return;
+	if (repl_up)
+		repl_flush();
+}
+
+/*
+ * The "repl" control command reports the stream; on a standby, "repl
+ * promote" stops taking it and starts answering clients.
+ */
+void
+server6_repl_ctl(fp, args)
+	FILE *fp;
+	char *args;
+{
+	if (strcmp(args, "promote") == 0) {
+		if (repl_role != REPL_STANDBY) {
+			fprintf(fp, "error not a standby\n");
+			return;
+		}
+		if (repl_fd >= 0)
+			repl_close("promoted");
+		close(repl_lfd);
+		repl_lfd = -1;
+		repl_role = REPL_OFF;
+		dprintf(LOG_NOTICE, "%s" "promoted, answering clients", FNAME);
+	} else if (*args != '\0') {
+		fprintf(fp, "error bad argument \"%s\"\n", args);
+		return;
+	}
+	fprintf(fp, "dhcp6s_repl_role{role=\"%s\"} 1\n",
+	    repl_role == REPL_PRIMARY ? "primary" :
+	    repl_role == REPL_STANDBY ? "standby" : "none");
+	if (repl_role == REPL_OFF)
+		return;
+	fprintf(fp, "dhcp6s_repl_connected %d\n",
+	    repl_role == REPL_PRIMARY ? repl_up : repl_fd >= 0);
+	fprintf(fp, "dhcp6s_repl_frames_total %llu\n",
+	    (unsigned long long)repl_frames);
+	fprintf(fp, "dhcp6s_repl_syncs_total %llu\n",
+	    (unsigned long long)repl_syncs);
+	fprintf(fp, "dhcp6s_repl_seq %u\n", repl_seq);
+	if (repl_role == REPL_PRIMARY) {
+		fprintf(fp, "dhcp6s_repl_acked %u\n", repl_acked);
+		fprintf(fp, "dhcp6s_repl_queued_bytes %llu\n",
+		    (unsigned long long)(repl_outlen - repl_outoff));
+	}
+}
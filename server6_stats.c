@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "queue.h"
+#include "dhcp6.h"
+#include "config.h"
+#include "common.h"
+#include "timer.h"
+#include "hash.h"
+#include "lease.h"
+#include "server6_stats.h"
+
+struct server6_stats server6_stats;
+
+static const char *stats_typestr[STATS_TYPES] = {
+	"other", "solicit", "advertise", "request", "confirm", "renew",
+	"rebind", "reply", "release", "decline", "reconfigure",
+	"information-request", "relay-forw", "relay-repl", "leasequery",
+	"leasequery-reply", "leasequery-data", "leasequery-done"
+};
+
+static const char *stats_dropstr[DROP_MAX] = {
+	"recv", "no-pktinfo", "no-interface", "short", "relay", "options",
+	"bad-type", "client-id", "server-id", "discard", "send",
+	"peer-share", "standby", "limit-client", "limit-source", "limit-link"
+};
+
+static const char *stats_stcodestr[STATS_STCODES] = {
+	"success", "unspec-fail", "no-addrs-avail", "no-binding",
+	"not-on-link", "use-multicast", "auth-failed", "addr-unavail",
+	"conf-no-match", "code9", "no-prefix-avail", "code11", "code12",
+	"code13", "code14", "other"
+};
+
+static const char *stats_stagestr[STAGE_MAX] = {
+	"receive", "process", "persist", "send"
+};
+
+static const double stats_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+static u_int64_t stats_hist_value __P((int));
+
+/* a precise clock for latencies, dhcp6_now() is too coarse for them */
+u_int64_t
+server6_stats_clock()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (u_int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* record ns spent in a stage */
+void
+server6_stats_add(stage, ns)
+	int stage;
+	u_int64_t ns;
+{
+	stats_hist_add(&server6_stats.stage[stage], ns);
+}
+
+void
+stats_hist_add(h, v)
+	struct stats_hist *h;
+	u_int64_t v;
+{
+	int e;
+
+	h->count++;
+	h->sum += v;
+	if (v > h->max)
+		h->max = v;
+	if (v >= (1ULL << 36))
+		v = (1ULL << 36) - 1;
+	if (v < STATS_HIST_SUB) {
+		h->bucket[v]++;
+		return;
+	}
+	e = 63 - __builtin_clzll(v);
+	h->bucket[(e - 3) * STATS_HIST_SUB +
+		  ((v >> (e - 4)) & (STATS_HIST_SUB - 1))]++;
+}
+
+static u_int64_t
+stats_hist_value(i)
+	int i;
+{
+	if (i < STATS_HIST_SUB)
+		return i;
+	return (u_int64_t)(STATS_HIST_SUB + i % STATS_HIST_SUB) <<
+	    (i / STATS_HIST_SUB - 1);
+}
+
+u_int64_t
+stats_hist_percentile(h, p)
+	struct stats_hist *h;
+	double p;
+{
+	u_int64_t rank, seen = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	rank = (u_int64_t)(h->count * p);
+	if (rank >= h->count)
+		rank = h->count - 1;
+	for (i = 0; i < STATS_HIST_BUCKETS; i++) {
+		seen += h->bucket[i];
+		if (seen > rank)
+			return stats_hist_value(i);
+	}
+	return h->max;
+}
+
+/*
+ * One "name{labels} value" per line, every counter even when zero so
+ * that a scraper sees a stable set of series.
+ */
+void
+server6_stats_dump(fp)
+	FILE *fp;
+{
+	struct server6_stats *st = &server6_stats;
+	struct stats_hist *h;
+	int i, q;
+
+	for (i = 1; i < STATS_TYPES; i++)
+		fprintf(fp, "dhcp6s_rx_total{type=\"%s\"} %llu\n",
+			stats_typestr[i], (unsigned long long)st->rx[i]);
+	fprintf(fp, "dhcp6s_rx_total{type=\"%s\"} %llu\n",
+		stats_typestr[0], (unsigned long long)st->rx[0]);
+	for (i = 1; i < STATS_TYPES; i++)
+		fprintf(fp, "dhcp6s_tx_total{type=\"%s\"} %llu\n",
+			stats_typestr[i], (unsigned long long)st->tx[i]);
+	for (i = 0; i < DROP_MAX; i++)
+		fprintf(fp, "dhcp6s_drop_total{reason=\"%s\"} %llu\n",
+			stats_dropstr[i], (unsigned long long)st->drop[i]);
+	for (i = 0; i < STATS_STCODES; i++)
+		fprintf(fp, "dhcp6s_status_total{code=\"%s\"} %llu\n",
+			stats_stcodestr[i], (unsigned long long)st->stcode[i]);
+	for (i = 0; i < STAGE_MAX; i++) {
+		h = &st->stage[i];
+		fprintf(fp, "dhcp6s_latency_ns_count{stage=\"%s\"} %llu\n",
+			stats_stagestr[i], (unsigned long long)h->count);
+		fprintf(fp, "dhcp6s_latency_ns_sum{stage=\"%s\"} %llu\n",
+			stats_stagestr[i], (unsigned long long)h->sum);
+		for (q = 0; q < sizeof(stats_quantiles) /
+		     sizeof(stats_quantiles[0]); q++)
+			fprintf(fp, "dhcp6s_latency_ns{stage=\"%s\","
+				"quantile=\"%g\"} %llu\n", stats_stagestr[i],
+				stats_quantiles[q],
+				(unsigned long long)stats_hist_percentile(h,
+				    stats_quantiles[q]));
+		fprintf(fp, "dhcp6s_latency_ns{stage=\"%s\",quantile=\"1\"} "
+			"%llu\n", stats_stagestr[i],
+			(unsigned long long)h->max);
+	}
+	if (hash_anchors != NULL) {
+		fprintf(fp, "dhcp6s_bindings %u\n",
+			server6_hash_table->hash_count);
+		fprintf(fp, "dhcp6s_leases %u\n",
+			lease_hash_table->hash_count);
+	}
+}
@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) International Business Machines  Corp., 2003
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the project nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE PROJECT AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE PROJECT OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#ifndef __SERVER6_STATS_H_DEFINED
+#define __SERVER6_STATS_H_DEFINED
+
+/*
+ * Counters and latency histograms of dhcp6s, read through the control
+ * socket.  The server is single threaded, so they are plain integers
+ * updated without locks or atomics.
+ */
+
+#define STATS_TYPES	18	/* message types; larger ones count as 0 */
+#define STATS_TYPE(t)	((t) < STATS_TYPES ? (t) : 0)
+#define STATS_STCODES	16	/* status codes; the last is for larger ones */
+#define STATS_STCODE(c)	((c) < STATS_STCODES - 1 ? (c) : STATS_STCODES - 1)
+
+/* why a received message got no answer */
+#define DROP_RECV	0	/* recvmsg() failed */
+#define DROP_NOPKTINFO	1	/* no IPV6_PKTINFO */
+#define DROP_NOIF	2	/* arrived on an interface we do not serve */
+#define DROP_SHORT	3	/* shorter than a DHCPv6 header */
+#define DROP_RELAY	4	/* malformed RELAY-FORW */
+#define DROP_OPTIONS	5	/* option parse failure */
+#define DROP_BADTYPE	6	/* unknown or unsupported message type */
+#define DROP_CLIENTID	7	/* no Client Identifier */
+#define DROP_SERVERID	8	/* Server Identifier missing, unexpected or not ours */
+#define DROP_DISCARD	9	/* discarded by protocol rule or on error */
+#define DROP_SEND	10	/* reply could not be built or sent */
+#define DROP_PEER	11	/* client in the load balancing peer's share */
+#define DROP_STANDBY	12	/* standing by for the replication primary */
+#define DROP_LIMIT_CLIENT 13	/* over the rate of its client DUID */
+#define DROP_LIMIT_SOURCE 14	/* over the rate of its source address */
+#define DROP_LIMIT_LINK	15	/* over the rate of its relay link-address */
+#define DROP_MAX	16
+
+/* where the time goes */
+#define STAGE_RECEIVE	0	/* recvmsg(), relay and option decoding */
+#define STAGE_PROCESS	1	/* server6_react_message() less the two below */
+#define STAGE_PERSIST	2	/* writing leases to the lease file */
+#define STAGE_SEND	3	/* building and transmitting the reply */
+#define STAGE_MAX	4
+
+/*
+ * Log-linear histogram: values below STATS_HIST_SUB get a bucket each,
+ * every power of two above is split in STATS_HIST_SUB linear buckets, so
+ * a percentile is off by at most 1/STATS_HIST_SUB.  Also used by
+ * dhcp6perf and dhcp6replay.
+ */
+#define STATS_HIST_SUB		16
+#define STATS_HIST_BUCKETS	(33 * STATS_HIST_SUB)
+
+struct stats_hist {
+	u_int64_t count;
+	u_int64_t sum;
+	u_int64_t max;
+	u_int64_t bucket[STATS_HIST_BUCKETS];
+};
+
+struct server6_stats {
+	u_int64_t rx[STATS_TYPES];
+	u_int64_t tx[STATS_TYPES];
+	u_int64_t drop[DROP_MAX];
+	u_int64_t stcode[STATS_STCODES];
+	struct stats_hist stage[STAGE_MAX];
+
+	/* time spent in the stages nested in the message being processed */
+	u_int64_t msg_nested;
+};
+
+extern struct server6_stats server6_stats;
+
+#define STATS_DROP(reason)	(server6_stats.drop[(reason)]++)
+
+u_int64_t server6_stats_clock __P((void));
+void server6_stats_add __P((int, u_int64_t));
+void server6_stats_dump __P((FILE *));
+void stats_hist_add __P((struct stats_hist *, u_int64_t));
+u_int64_t stats_hist_percentile __P((struct stats_hist *, double));
+
+#endif
@@ -39,6 +39,7 @@
 #include <syslog.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #if defined(__NetBSD__) || defined(__OpenBSD__)
 #include <search.h>
 #endif
@@ -49,52 +50,60 @@
 #include "common.h"
 #include "timer.h"
 
-#define MILLION 1000000
-
 LIST_HEAD(, dhcp6_timer) timer_head;
-static struct timeval tm_sentinel;
-static struct timeval tm_max = {0x7fffffff, 0x7fffffff};
+static dhcp6_time_t tm_sentinel;
+#define TM_MAX	(~(dhcp6_time_t)0)
+
+static dhcp6_time_t timer_monotonic __P((void));
 
-/* result = a + b */
-static void
-timeval_add(struct timeval *a, struct timeval *b, struct timeval *result)
+/*
+ * The clock the timers run on.  dhcp6replay points this at a virtual
+ * clock so lease lifetimes elapse at trace speed.
+ */
+dhcp6_time_t (*dhcp6_clock) __P((void)) = timer_monotonic;
+
+static dhcp6_time_t now_cache;
+static dhcp6_time_t clock_res;	/* timers this close to due are run */
+
+static dhcp6_time_t
+timer_monotonic(void)
 {
-	long l;
+	struct timespec ts;
 
-	if ((l = a->tv_usec + b->tv_usec) < MILLION) {
-		result->tv_usec = l;
-		result->tv_sec = a->tv_sec + b->tv_sec;
-	}
-	else {
-		result->tv_usec = l - MILLION;
-		result->tv_sec = a->tv_sec + b->tv_sec + 1;
-	}
+#ifdef CLOCK_MONOTONIC_COARSE
+	/* a tick is plenty for DHCP timeouts and lifetimes, and cheaper */
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+	return (dhcp6_time_t)ts.tv_sec * DHCP6_NSEC + ts.tv_nsec;
 }
 
 /*
- * result = a - b
- * XXX: this function assumes that a >= b.
+ * The time as of the last dhcp6_clock_update().  The main loops update it
+ * once per wakeup, so all that is done for one packet sees one time and
+ * costs one clock read.
  */
-void
-timeval_sub(struct timeval *a, struct timeval *b, struct timeval *result)
+dhcp6_time_t
+dhcp6_now(void)
 {
-	long l;
+	if (now_cache == 0)
+		dhcp6_clock_update();
+	return now_cache;
+}
 
-	if ((l = a->tv_usec - b->tv_usec) >= 0) {
-		result->tv_usec = l;
-		result->tv_sec = a->tv_sec - b->tv_sec;
-	}
-	else {
-		result->tv_usec = MILLION + l;
-		result->tv_sec = a->tv_sec - b->tv_sec - 1;
-	}
+dhcp6_time_t
+dhcp6_clock_update(void)
+{
+	return (now_cache = (*dhcp6_clock)());
 }
 
 void
 dhcp6_timer_init(void)
 {
 	LIST_INIT(&timer_head);
-	tm_sentinel = tm_max;
+	tm_sentinel = TM_MAX;
+	now_cache = 0;
 }
 
 struct dhcp6_timer *
@@ -115,7 +124,7 @@ dhcp6_add_timer(struct dhcp6_timer *(*timeout)(void *),
 	}
 	newtimer->expire = timeout;
 	newtimer->expire_data = timeodata;
-	newtimer->tm = tm_max;
+	newtimer->tm = TM_MAX;
 
 	LIST_INSERT_HEAD(&timer_head, newtimer, link);
 
@@ -132,15 +141,14 @@ void
 dhcp6_set_timer(struct timeval *tm, 
 		struct dhcp6_timer *timer)
 {
-	struct timeval now;
-	timer->flag |= MARK_CLEAR;
-	/* reset the timer */
-	gettimeofday(&now, NULL);
+	dhcp6_time_t now = dhcp6_now(), d = TIMEVAL_TO_NS(tm);
 
-	timeval_add(&now, tm, &timer->tm);
+	timer->flag |= MARK_CLEAR;
+	/* reset the timer, an interval too long to represent is forever */
+	timer->tm = d < TM_MAX - now ? now + d : TM_MAX;
 
 	/* update the next expiration time */
-	if (TIMEVAL_LT(timer->tm, tm_sentinel))
+	if (timer->tm < tm_sentinel)
 		tm_sentinel = timer->tm;
 	return;
 }
@@ -154,12 +162,24 @@ struct timeval *
 dhcp6_check_timer(void)
 {
 	static struct timeval returnval;
-	struct timeval now;
+	dhcp6_time_t now;
 	struct dhcp6_timer *tm, *tm_next;
 
-	gettimeofday(&now, NULL);
+	if (clock_res == 0) {
+		struct timespec ts;
+
+		clock_res = 1;
+#ifdef CLOCK_MONOTONIC_COARSE
+		/* or we would wake up early and spin until the next tick */
+		if (dhcp6_clock == timer_monotonic &&
+		    clock_getres(CLOCK_MONOTONIC_COARSE, &ts) == 0)
+			clock_res = (dhcp6_time_t)ts.tv_sec * DHCP6_NSEC +
+			    ts.tv_nsec;
+#endif
+	}
+	now = dhcp6_clock_update();
 
-	tm_sentinel = tm_max;
+	tm_sentinel = TM_MAX;
 
 	for (tm = LIST_FIRST(&timer_head); tm; tm = tm_next) {
 		tm_next = LIST_NEXT(tm, link);
@@ -169,41 +189,36 @@ dhcp6_check_timer(void)
 			tm = NULL;
 			continue;
 		}
-		if (TIMEVAL_LEQ(tm->tm, now)) {
+		if (tm->tm < now + clock_res) {
 			if ((*tm->expire)(tm->expire_data) == NULL)
 				continue; /* timer has been freed */
 		}
 
-		if (TIMEVAL_LT(tm->tm, tm_sentinel))
+		if (tm->tm < tm_sentinel)
 			tm_sentinel = tm->tm;
 	}
 
-	if (TIMEVAL_EQUAL(tm_max, tm_sentinel)) {
+	if (tm_sentinel == TM_MAX) {
 		/* no need to timeout */
 		return (NULL);
-	} else if (TIMEVAL_LT(tm_sentinel, now)) {
+	} else if (tm_sentinel < now) {
 		/* this may occur when the interval is too small */
 		returnval.tv_sec = returnval.tv_usec = 0;
 	} else
-		timeval_sub(&tm_sentinel, &now, &returnval);
+		NS_TO_TIMEVAL(tm_sentinel - now, &returnval);
 	return (&returnval);
 }
 
-struct timeval *
+/* time left until the timer expires */
+dhcp6_time_t
 dhcp6_timer_rest(struct dhcp6_timer *timer)
 {
-	struct timeval now;
-	static struct timeval returnval; /* XXX */
-
-	gettimeofday(&now, NULL);
-	if (TIMEVAL_LEQ(timer->tm, now)) {
-		syslog(LOG_DEBUG,
-		       "<%s> a timer must be expired, but not yet",
-		       __FUNCTION__);
-		returnval.tv_sec = returnval.tv_usec = 0;
-	} else
-		timeval_sub(&timer->tm, &now, &returnval);
+	dhcp6_time_t now = dhcp6_now();
 
-	return (&returnval);
+	if (timer->tm <= now) {
+		dprintf(LOG_DEBUG, "%s" "a timer must be expired, but not yet",
+			FNAME);
+		return 0;
+	}
+	return timer->tm - now;
 }
-
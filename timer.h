@@ -30,17 +30,21 @@
  * SUCH DAMAGE.
  */
 
-/* a < b */
-#define TIMEVAL_LT(a, b) (((a).tv_sec < (b).tv_sec) ||\
-			  (((a).tv_sec == (b).tv_sec) && \
-			    ((a).tv_usec < (b).tv_usec)))
-/* a <= b */
-#define TIMEVAL_LEQ(a, b) (((a).tv_sec < (b).tv_sec) ||\
-			   (((a).tv_sec == (b).tv_sec) &&\
- 			    ((a).tv_usec <= (b).tv_usec)))
-/* a == b */
-#define TIMEVAL_EQUAL(a, b) ((a).tv_sec == (b).tv_sec &&\
-			     (a).tv_usec == (b).tv_usec)
+/*
+ * Timers run on nanoseconds of a monotonic clock, so stepping the wall
+ * clock does not move them.  Wall time is only for what is persisted,
+ * such as the start_date of a lease.
+ */
+typedef u_int64_t dhcp6_time_t;
+
+#define DHCP6_NSEC	1000000000ULL
+#define TIMEVAL_TO_NS(tv) \
+	((dhcp6_time_t)(tv)->tv_sec * DHCP6_NSEC + \
+	 (dhcp6_time_t)(tv)->tv_usec * 1000)
+#define NS_TO_TIMEVAL(ns, tv) do { \
+	(tv)->tv_sec = (ns) / DHCP6_NSEC; \
+	(tv)->tv_usec = ((ns) % DHCP6_NSEC) / 1000; \
+} while (0)
 
 #define MARK_CLEAR 0x00
 #define MARK_REMOVE 0x01
@@ -48,20 +52,21 @@
 struct dhcp6_timer {
 	LIST_ENTRY(dhcp6_timer) link;
 
-	struct timeval tm;
+	dhcp6_time_t tm;	/* when it expires */
 	int flag;
 
 	struct dhcp6_timer *(*expire) __P((void *));
 	void *expire_data;
 };
 
+extern dhcp6_time_t (*dhcp6_clock) __P((void));
+
+dhcp6_time_t dhcp6_now __P((void));
+dhcp6_time_t dhcp6_clock_update __P((void));
 void dhcp6_timer_init __P((void));
 struct dhcp6_timer *dhcp6_add_timer __P((struct dhcp6_timer *(*) __P((void *)),
 					 void *));
 void dhcp6_set_timer __P((struct timeval *, struct dhcp6_timer *));
 void dhcp6_remove_timer __P((struct dhcp6_timer *));
 struct timeval * dhcp6_check_timer __P((void));
-struct timeval * dhcp6_timer_rest __P((struct dhcp6_timer *));
-
-void timeval_sub __P((struct timeval *, struct timeval *,
-			     struct timeval *));
+dhcp6_time_t dhcp6_timer_rest __P((struct dhcp6_timer *));